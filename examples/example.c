@@ -350,6 +350,16 @@ log_thread_func(void *arg)
     }
     return NULL;
 }
+
+void *
+idle_thread_func(void *arg)
+{
+    (void)arg;
+    while (true) {
+        sleep_s(1);
+    }
+    return NULL;
+}
 #endif
 
 int
@@ -466,6 +476,10 @@ main(int argc, char **argv)
         sentry_options_set_crashpad_wait_for_upload(options, true);
     }
 
+    if (has_arg(argc, argv, "capture-all-threads")) {
+        sentry_options_set_capture_all_threads(options, true);
+    }
+
     if (has_arg(argc, argv, "attach-view-hierarchy")) {
         // assuming the example / test is run directly from the cmake build
         // directory
@@ -702,6 +716,16 @@ main(int argc, char **argv)
         fflush(stdout);
     }
 
+#ifndef SENTRY_PLATFORM_WINDOWS
+    if (has_arg(argc, argv, "idle-threads")) {
+        // give the crash handler some other threads to capture
+        for (int t = 0; t < NUM_THREADS; t++) {
+            pthread_t thread;
+            pthread_create(&thread, NULL, idle_thread_func, NULL);
+        }
+    }
+#endif
+
     if (has_arg(argc, argv, "crash")) {
         trigger_crash();
     }
@@ -665,6 +665,30 @@ SENTRY_EXPERIMENTAL_API size_t sentry_unwind_stack(
 SENTRY_EXPERIMENTAL_API size_t sentry_unwind_stack_from_ucontext(
     const sentry_ucontext_t *uctx, void **stacktrace_out, size_t max_len);
 
+/**
+ * Unwinds the stack by walking the chain of frame pointers.
+ *
+ * This is much faster than `sentry_unwind_stack`, as it does not need to parse
+ * any unwind info, but it only yields complete stack traces if all the code on
+ * the stack was compiled with frame pointers, for example using
+ * `-fno-omit-frame-pointer`. Every frame is checked against the stack bounds
+ * of the current thread, and unwinding stops at the first frame that does not
+ * have a valid frame pointer.
+ *
+ * If a frame pointer is given in `fp`, the stack is unwound from that frame.
+ * Otherwise (NULL is passed), the stack is unwound from the caller.
+ *
+ * This is currently only supported on Linux and macOS on x86, x86-64 and
+ * arm64. Building with `SENTRY_FRAME_POINTER_UNWINDER` makes
+ * `sentry_unwind_stack` and `sentry_value_new_stacktrace` try this first.
+ *
+ * The stack trace in the form of instruction-addresses is written to the
+ * caller allocated `stacktrace_out`, with up to `max_len` frames being written.
+ * The actual number of unwound stack frames is returned.
+ */
+SENTRY_EXPERIMENTAL_API size_t sentry_unwind_stack_frame_pointers(
+    void *fp, void **stacktrace_out, size_t max_len);
+
 /**
  * A UUID
  */
@@ -1416,6 +1440,19 @@ SENTRY_API void sentry_options_add_view_hierarchy_n(
 SENTRY_EXPERIMENTAL_API void sentry_options_set_attach_screenshot(
     sentry_options_t *opts, int val);
 
+/**
+ * Enables or disables capturing the stacks of all threads in fatal error
+ * events. Disabled by default.
+ *
+ * This is currently only supported by the `inproc` backend on Linux. When the
+ * process crashes, every other thread is interrupted with a real-time signal
+ * to unwind its own stack. This is bounded to 512 threads with 64 frames each,
+ * and waits at most 500ms in total. Threads that block the signal, or do not
+ * respond in time, are reported without a stacktrace.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_options_set_capture_all_threads(
+    sentry_options_t *opts, int val);
+
 /**
  * Sets the path to the crashpad handler if the crashpad backend is used.
  *
@@ -1501,6 +1538,48 @@ SENTRY_API void sentry_options_set_database_path(
 SENTRY_API void sentry_options_set_database_path_n(
     sentry_options_t *opts, const char *path, size_t path_len);
 
+/**
+ * Limits the total size in bytes of the envelopes, sessions and crash reports
+ * that are kept in the database directory.
+ *
+ * The limit is checked whenever the SDK writes to the database. Once it is
+ * exceeded, files of previous runs are deleted, starting with the least
+ * important ones: envelopes that were still queued when a previous run ended,
+ * then all other files of previous runs, and finally crash reports of the
+ * external crash reporter. Within each of these, the oldest files are deleted
+ * first. Files of the current run, and of runs of other processes that are
+ * still running, are never deleted.
+ *
+ * The reports in the database of the `crashpad` backend are deliberately not
+ * counted towards this limit. They are owned by crashpad, which the SDK asks
+ * on every start to prune them to 8 MiB and reports of the last two days.
+ *
+ * Defaults to 0, which means no limit.
+ */
+SENTRY_API void sentry_options_set_database_max_size(
+    sentry_options_t *opts, size_t max_size);
+
+/**
+ * Gets the size limit of the database directory.
+ */
+SENTRY_API size_t sentry_options_get_database_max_size(
+    const sentry_options_t *opts);
+
+/**
+ * Limits the number of files that are kept in the database directory, like
+ * `sentry_options_set_database_max_size` does for their size.
+ *
+ * Defaults to 0, which means no limit.
+ */
+SENTRY_API void sentry_options_set_database_max_files(
+    sentry_options_t *opts, size_t max_files);
+
+/**
+ * Gets the file limit of the database directory.
+ */
+SENTRY_API size_t sentry_options_get_database_max_files(
+    const sentry_options_t *opts);
+
 #ifdef SENTRY_PLATFORM_WINDOWS
 /**
  * Wide char version of `sentry_options_add_attachment`.
@@ -2049,10 +2128,42 @@ SENTRY_EXPERIMENTAL_API void sentry_options_set_logs_with_attributes(
 SENTRY_EXPERIMENTAL_API int sentry_options_get_logs_with_attributes(
     const sentry_options_t *opts);
 
+/**
+ * Sets the sample rate for logs of the given `level`, which should be a double
+ * between `0.0` and `1.0`. Logs are sampled evenly rather than randomly: with a
+ * rate of `0.1`, every tenth log of that level is kept.
+ *
+ * Sampled-out logs are dropped before their message is formatted, and the
+ * `sentry_log_X()` call returns `SENTRY_LOG_RETURN_DISCARD`.
+ *
+ * Defaults to `1.0` for all levels.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_options_set_logs_sample_rate(
+    sentry_options_t *opts, sentry_level_t level, double sample_rate);
+SENTRY_EXPERIMENTAL_API double sentry_options_get_logs_sample_rate(
+    const sentry_options_t *opts, sentry_level_t level);
+
+/**
+ * Limits the number of logs per second that are kept for each message
+ * template, meaning each format string passed to `sentry_log_X()`. Templates
+ * are told apart by the address of the format string, so this is meant to be
+ * used with string literals.
+ *
+ * Logs over the limit are dropped before their message is formatted, and the
+ * `sentry_log_X()` call returns `SENTRY_LOG_RETURN_DISCARD`.
+ *
+ * Defaults to `0`, which means no limit.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_options_set_logs_template_rate_limit(
+    sentry_options_t *opts, uint32_t logs_per_second);
+SENTRY_EXPERIMENTAL_API uint32_t sentry_options_get_logs_template_rate_limit(
+    const sentry_options_t *opts);
+
 /**
  * The potential returns of calling any of the sentry_log_X functions
  * - Success means a log was enqueued
- * - Discard means the `before_send_log` function discarded the log
+ * - Discard means the `before_send_log` function discarded the log, or it
+ *   was sampled out or rate limited
  * - Failed means the log wasn't enqueued. This happens if the buffers are full
  * - Disabled means the option `enable_logs` was false.
  */
@@ -2315,6 +2426,30 @@ SENTRY_API void sentry_end_session(void);
 SENTRY_EXPERIMENTAL_API void sentry_end_session_with_status(
     sentry_session_status_t status);
 
+/**
+ * The outcome of a single request, see `sentry_record_request_outcome`.
+ */
+typedef enum {
+    SENTRY_REQUEST_OUTCOME_HEALTHY,
+    SENTRY_REQUEST_OUTCOME_ERRORED,
+    SENTRY_REQUEST_OUTCOME_CRASHED,
+} sentry_request_outcome_t;
+
+/**
+ * Records the outcome of a request, for servers that track release health per
+ * request instead of per process.
+ *
+ * Rather than creating a session for every request, the outcomes are counted
+ * per minute and sent once a minute as session aggregates, so recording an
+ * outcome only costs a few atomic operations. Outcomes that were not sent yet
+ * are sent by `sentry_close`.
+ *
+ * Outcomes are only recorded if a release is set. Servers that use this will
+ * usually also disable `sentry_options_set_auto_session_tracking`.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_record_request_outcome(
+    sentry_request_outcome_t outcome);
+
 /* -- Performance Monitoring/Tracing APIs -- */
 
 /**
@@ -2921,6 +3056,35 @@ SENTRY_EXPERIMENTAL_API void sentry_transaction_iter_headers(
     sentry_transaction_t *tx, sentry_iter_headers_function_t callback,
     void *userdata);
 
+/**
+ * Starts the continuous sampling profiler.
+ *
+ * Every thread of the process is sampled about 100 times per second of CPU
+ * time it consumes, using a `SIGPROF` timer per thread. The samples are sent
+ * as profile chunks roughly every 10 seconds, and every transaction that is
+ * finished while the profiler runs is linked to them via its `profile`
+ * context.
+ *
+ * `sentry_init` has to be called first. The profiler does not install its
+ * signal handler if the application already handles `SIGPROF`.
+ *
+ * Samples are captured by walking the frame pointer chain, which is the only
+ * way to unwind from within the signal handler safely. Stacks therefore end
+ * at the first function that was compiled without frame pointers, so the
+ * application should be built with `-fno-omit-frame-pointer`.
+ *
+ * This is currently only supported on Linux on x86, x86_64 and arm64.
+ * Returns 0 on success.
+ */
+SENTRY_EXPERIMENTAL_API int sentry_profiler_start(void);
+
+/**
+ * Stops the continuous sampling profiler, and sends the last profile chunk.
+ *
+ * The profiler is also stopped by `sentry_close`.
+ */
+SENTRY_EXPERIMENTAL_API void sentry_profiler_stop(void);
+
 /**
  * Returns whether the application has crashed on the last run.
  *
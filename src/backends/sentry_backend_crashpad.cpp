@@ -129,7 +129,6 @@ typedef struct {
     sentry_path_t *breadcrumb1_path;
     sentry_path_t *breadcrumb2_path;
     sentry_path_t *external_report_path;
-    size_t num_breadcrumbs;
     std::atomic<bool> crashed;
     std::atomic<bool> scope_flush;
     sentry_uuid_t crash_event_id;
@@ -236,6 +235,7 @@ flush_external_crash_report(
     }
     sentry__envelope_set_event_id(envelope, crash_event_id);
     if (options->session) {
+        sentry__session_sync_errors(options->session);
         sentry__envelope_add_session(envelope, options->session);
     }
 
@@ -243,20 +243,65 @@ flush_external_crash_report(
     sentry_envelope_free(envelope);
 }
 
+// Breadcrumbs are only kept in the lock-free ringbuffer of the scope, and are
+// written out all at once here instead of touching the disk for every single
+// breadcrumb. This runs from the `FirstChanceHandler` on Linux, and with the
+// coalesced scope flushes on the other platforms.
+static void
+flush_breadcrumbs(
+    const sentry_options_t *options, const crashpad_state_t *state)
+{
+    if (!state->breadcrumb1_path || !state->breadcrumb2_path) {
+        return;
+    }
+
+    sentry_value_t crumbs_event = sentry_value_new_object();
+    SENTRY_WITH_SCOPE (scope) {
+        sentry__scope_apply_to_event(
+            scope, options, crumbs_event, SENTRY_SCOPE_BREADCRUMBS);
+    }
+    sentry_value_t breadcrumbs
+        = sentry_value_get_by_key(crumbs_event, "breadcrumbs");
+
+    // the second file stays empty, as it only exists for the rotation that
+    // older versions did on disk
+    bool failed = sentry__path_write_buffer(state->breadcrumb2_path, "", 0);
+    sentry_filewriter_t *fw = sentry__filewriter_new(state->breadcrumb1_path);
+    failed = failed || !fw;
+    size_t len = sentry_value_get_length(breadcrumbs);
+    for (size_t i = 0; fw && i < len; i++) {
+        size_t mpack_size;
+        char *mpack = sentry_value_to_msgpack(
+            sentry_value_get_by_index(breadcrumbs, i), &mpack_size);
+        if (!mpack) {
+            continue;
+        }
+        if (sentry__filewriter_write(fw, mpack, mpack_size) != 0) {
+            failed = true;
+        }
+        sentry_free(mpack);
+    }
+    sentry__filewriter_free(fw);
+    sentry_value_decref(crumbs_event);
+
+    if (failed) {
+        SENTRY_WARN("flushing breadcrumbs to msgpack failed");
+    }
+}
+
 // This function is necessary for macOS since it has no `FirstChanceHandler`.
 // but it is also necessary on Windows if the WER handler is enabled.
 // This means we have to continuously flush the scope on
 // every change so that `__sentry_event` is ready to upload when the crash
 // happens. With platforms that have a `FirstChanceHandler` we can do that
 // once in the handler. No need to share event- or crashpad-state mutation.
+// Linux always has the handler, so it doesn't flush at all and doesn't need
+// the scope flusher thread either.
+#if !defined(SENTRY_PLATFORM_LINUX)
 static void
 crashpad_backend_flush_scope(
     sentry_backend_t *backend, const sentry_options_t *options)
 {
-#if defined(SENTRY_PLATFORM_LINUX)
-    (void)backend;
-    (void)options;
-#else
     auto *data = static_cast<crashpad_state_t *>(backend->data);
     bool expected = false;
 
@@ -276,12 +321,13 @@ crashpad_backend_flush_scope(
         event, "level", sentry__value_new_level(SENTRY_LEVEL_FATAL));
 
     flush_scope_to_event(data->event_path, options, event);
+    flush_breadcrumbs(options, data);
     if (data->external_report_path) {
         flush_external_crash_report(options, &data->crash_event_id);
     }
     data->scope_flush.store(false, std::memory_order_release);
-#endif
 }
+#endif
 
 #if defined(SENTRY_PLATFORM_LINUX) || defined(SENTRY_PLATFORM_WINDOWS)
 static void
@@ -303,6 +349,7 @@ flush_scope_from_handler(
 
     // now we are the sole flusher and can flush into the crash event
     flush_scope_to_event(state->event_path, options, crash_event);
+    flush_breadcrumbs(options, state);
     if (state->external_report_path) {
         flush_external_crash_report(options, &state->crash_event_id);
     }
@@ -640,43 +687,18 @@ crashpad_backend_shutdown(sentry_backend_t *backend)
 #endif
 }
 
+#if !defined(SENTRY_PLATFORM_LINUX)
+// Without a `FirstChanceHandler` (macOS, and Windows when the WER handler
+// takes over), breadcrumbs have to be on disk before the crash happens. They
+// are written together with the scope, so a burst of breadcrumbs only gets
+// written once. On Linux they are flushed from the handler instead.
 static void
-crashpad_backend_add_breadcrumb(sentry_backend_t *backend,
-    sentry_value_t breadcrumb, const sentry_options_t *options)
+crashpad_backend_add_breadcrumb(sentry_backend_t *UNUSED(backend),
+    sentry_value_t UNUSED(breadcrumb), const sentry_options_t *UNUSED(options))
 {
-    auto *data = static_cast<crashpad_state_t *>(backend->data);
-
-    size_t max_breadcrumbs = options->max_breadcrumbs;
-    if (!max_breadcrumbs) {
-        return;
-    }
-
-    bool first_breadcrumb = data->num_breadcrumbs % max_breadcrumbs == 0;
-
-    const sentry_path_t *breadcrumb_file
-        = data->num_breadcrumbs % (max_breadcrumbs * 2) < max_breadcrumbs
-        ? data->breadcrumb1_path
-        : data->breadcrumb2_path;
-    data->num_breadcrumbs++;
-    if (!breadcrumb_file) {
-        return;
-    }
-
-    size_t mpack_size;
-    char *mpack = sentry_value_to_msgpack(breadcrumb, &mpack_size);
-    if (!mpack) {
-        return;
-    }
-
-    int rv = first_breadcrumb
-        ? sentry__path_write_buffer(breadcrumb_file, mpack, mpack_size)
-        : sentry__path_append_buffer(breadcrumb_file, mpack, mpack_size);
-    sentry_free(mpack);
-
-    if (rv != 0) {
-        SENTRY_WARN("flushing breadcrumb to msgpack failed");
-    }
+    sentry__scope_request_flush();
 }
+#endif
 
 static void
 crashpad_backend_free(sentry_backend_t *backend)
@@ -840,8 +862,10 @@ sentry__backend_new(void)
     backend->shutdown_func = crashpad_backend_shutdown;
     backend->except_func = crashpad_backend_except;
     backend->free_func = crashpad_backend_free;
+#if !defined(SENTRY_PLATFORM_LINUX)
     backend->flush_scope_func = crashpad_backend_flush_scope;
     backend->add_breadcrumb_func = crashpad_backend_add_breadcrumb;
+#endif
     backend->user_consent_changed_func = crashpad_backend_user_consent_changed;
     backend->get_last_crash_func = crashpad_backend_last_crash;
     backend->prune_database_func = crashpad_backend_prune_database;
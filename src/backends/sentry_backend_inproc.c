@@ -4,10 +4,12 @@
 #include "sentry_alloc.h"
 #include "sentry_backend.h"
 #include "sentry_core.h"
+#include "sentry_cpu_relax.h"
 #include "sentry_database.h"
 #include "sentry_envelope.h"
 #include "sentry_logger.h"
 #include "sentry_logs.h"
+#include "sentry_modulefinder.h"
 #include "sentry_options.h"
 #if defined(SENTRY_PLATFORM_WINDOWS)
 #    include "sentry_os.h"
@@ -19,11 +21,133 @@
 #include "sentry_unix_pageallocator.h"
 #include "transports/sentry_disk_transport.h"
 #include <string.h>
+#if defined(SENTRY_PLATFORM_LINUX)
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <sys/syscall.h>
+#    include <time.h>
+#    include <unistd.h>
+#endif
 
 #define SIGNAL_DEF(Sig, Desc) { Sig, #Sig, Desc }
 
 #define MAX_FRAMES 128
 
+// the crash handler allocates from this reserve before mapping new pages
+#define CRASH_ARENA_SIZE (2 * 1024 * 1024)
+
+// how often the crash handler tries to take the skeleton lock, which is only
+// ever held for a few instructions, before it gives up on the skeleton
+#define CRASH_SKELETON_LOCK_SPINS 10000
+
+/**
+ * The crash event skeleton is the scope applied to an empty event, which is
+ * rebuilt outside of the crash handler whenever the scope is flushed. It is
+ * only used as long as `g_crash_skeleton_generation` matches the current scope
+ * generation, and no module was loaded or unloaded since it was built, so that
+ * the handler never reports stale scope data or modules.
+ */
+static volatile long g_crash_skeleton_lock = 0;
+static sentry_value_t g_crash_skeleton;
+static long g_crash_skeleton_generation = -1;
+static long g_crash_skeleton_modules_generation = -1;
+
+// a plain spinlock, as the crash handler can't use a mutex
+static void
+lock_crash_skeleton(void)
+{
+    while (!sentry__atomic_compare_swap(&g_crash_skeleton_lock, 0, 1)) {
+        sentry__cpu_relax();
+    }
+}
+
+/**
+ * Tries to take the skeleton lock a bounded number of times. The crash might
+ * have interrupted the thread that holds it, which would never release it.
+ */
+static bool
+try_lock_crash_skeleton(void)
+{
+    for (int i = 0; i < CRASH_SKELETON_LOCK_SPINS; i++) {
+        if (sentry__atomic_compare_swap(&g_crash_skeleton_lock, 0, 1)) {
+            return true;
+        }
+        sentry__cpu_relax();
+    }
+    return false;
+}
+
+static void
+unlock_crash_skeleton(void)
+{
+    sentry__atomic_store(&g_crash_skeleton_lock, 0);
+}
+
+static void
+reset_crash_skeleton(void)
+{
+    lock_crash_skeleton();
+    sentry_value_t skeleton = g_crash_skeleton;
+    g_crash_skeleton = sentry_value_new_null();
+    g_crash_skeleton_generation = -1;
+    g_crash_skeleton_modules_generation = -1;
+    unlock_crash_skeleton();
+    sentry_value_decref(skeleton);
+}
+
+static void
+flush_crash_skeleton(
+    sentry_backend_t *UNUSED(backend), const sentry_options_t *options)
+{
+    // Refresh the module list first. Should it change again while the
+    // skeleton is built, the skeleton is just considered stale.
+    sentry_value_decref(sentry_get_modules_list());
+    long modules_generation = sentry__modules_generation();
+
+    sentry_value_t skeleton = sentry_value_new_null();
+    long generation = -1;
+    SENTRY_WITH_SCOPE (scope) {
+        generation = sentry__scope_generation();
+        skeleton = sentry__scope_new_event_skeleton(scope, options);
+    }
+
+    lock_crash_skeleton();
+    // concurrent flushes may finish out of order, keep the newer skeleton
+    if (generation - g_crash_skeleton_generation > 0
+        || g_crash_skeleton_generation == -1) {
+        sentry_value_t old = g_crash_skeleton;
+        g_crash_skeleton = skeleton;
+        g_crash_skeleton_generation = generation;
+        g_crash_skeleton_modules_generation = modules_generation;
+        skeleton = old;
+    }
+    unlock_crash_skeleton();
+    sentry_value_decref(skeleton);
+}
+
+/**
+ * Returns a new reference to the crash event skeleton, or null if the scope
+ * or the module list has changed since it was built, or if the skeleton is
+ * locked by the crashed thread.
+ */
+static sentry_value_t
+take_crash_skeleton(void)
+{
+    sentry_value_t skeleton = sentry_value_new_null();
+    if (!try_lock_crash_skeleton()) {
+        return skeleton;
+    }
+    if (g_crash_skeleton_generation != -1
+        && g_crash_skeleton_generation == sentry__scope_generation()
+        && g_crash_skeleton_modules_generation
+            == sentry__modules_generation()) {
+        skeleton = g_crash_skeleton;
+        sentry_value_incref(skeleton);
+    }
+    unlock_crash_skeleton();
+    return skeleton;
+}
+
 #ifdef SENTRY_PLATFORM_UNIX
 struct signal_slot {
     int signum;
@@ -75,10 +199,269 @@ invoke_signal_handler(int signum, siginfo_t *info, void *user_context)
     }
 }
 
+#    if defined(SENTRY_PLATFORM_LINUX)
+// the stacks of all other threads are captured into a preallocated buffer,
+// bounded in the number of threads, frames and the total time we wait
+#        define MAX_DUMPED_THREADS 512
+#        define MAX_DUMPED_FRAMES 64
+#        define THREAD_DUMP_TIMEOUT_MS 500
+#        define THREAD_DUMP_SIGNAL (SIGRTMIN + 3)
+
+#        define THREAD_DUMP_IDLE 0
+#        define THREAD_DUMP_REQUESTED 1
+#        define THREAD_DUMP_CAPTURING 2
+#        define THREAD_DUMP_DONE 3
+#        define THREAD_DUMP_ABANDONED 4
+
+struct thread_dump_slot {
+    pid_t tid;
+    volatile long state;
+    size_t frame_count;
+    void *frames[MAX_DUMPED_FRAMES];
+};
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static struct thread_dump_slot *g_thread_dump = NULL;
+static struct sigaction g_previous_thread_dump_handler;
+
+/**
+ * Runs on every thread that is asked for its stack by the crashing thread.
+ * The slot index is passed along with the signal, and the thread only ever
+ * writes to its own slot, so no locks are involved.
+ */
+static void
+handle_thread_dump_signal(int signum, siginfo_t *info, void *user_context)
+{
+    int saved_errno = errno;
+    int index = info->si_value.sival_int;
+    if (g_thread_dump && info->si_code == SI_QUEUE && info->si_pid == getpid()
+        && index >= 0 && index < MAX_DUMPED_THREADS) {
+        struct thread_dump_slot *slot = &g_thread_dump[index];
+        // the crashing thread might have given up on us already
+        if (slot->tid == (pid_t)syscall(SYS_gettid)
+            && sentry__atomic_compare_swap(&slot->state,
+                THREAD_DUMP_REQUESTED, THREAD_DUMP_CAPTURING)) {
+            sentry_ucontext_t uctx;
+            uctx.signum = signum;
+            uctx.siginfo = info;
+            uctx.user_context = (ucontext_t *)user_context;
+            // Unlike the crashing thread, there is no fallback to
+            // `sentry_unwind_stack`, which is not async-signal-safe. A thread
+            // that can't be unwound from its context is reported without a
+            // stacktrace.
+            slot->frame_count = sentry_unwind_stack_from_ucontext(
+                &uctx, &slot->frames[0], MAX_DUMPED_FRAMES);
+            sentry__atomic_store(&slot->state, THREAD_DUMP_DONE);
+        }
+    }
+    errno = saved_errno;
+}
+
+static void
+startup_thread_dump(const sentry_options_t *options)
+{
+    if (!options->capture_all_threads || g_thread_dump) {
+        return;
+    }
+
+    // we can't share the signal with somebody else
+    struct sigaction previous;
+    if (sigaction(THREAD_DUMP_SIGNAL, NULL, &previous) == -1
+        || previous.sa_handler != SIG_DFL) {
+        SENTRY_WARN("thread dump signal is in use, not capturing all threads");
+        return;
+    }
+    g_thread_dump
+        = sentry_malloc(sizeof(struct thread_dump_slot) * MAX_DUMPED_THREADS);
+    if (!g_thread_dump) {
+        return;
+    }
+    memset(g_thread_dump, 0,
+        sizeof(struct thread_dump_slot) * MAX_DUMPED_THREADS);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = handle_thread_dump_signal;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sigaction(THREAD_DUMP_SIGNAL, &action, &g_previous_thread_dump_handler);
+}
+
+static void
+shutdown_thread_dump(void)
+{
+    if (!g_thread_dump) {
+        return;
+    }
+    sigaction(THREAD_DUMP_SIGNAL, &g_previous_thread_dump_handler, NULL);
+    sentry_free(g_thread_dump);
+    g_thread_dump = NULL;
+}
+
+/**
+ * Enumerates the threads of the process and signals each of them, except the
+ * crashing one, to capture its own stack. Returns the number of requests.
+ */
+static size_t
+request_thread_dumps(pid_t crashed_tid)
+{
+    int fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    pid_t pid = getpid();
+    size_t count = 0;
+    // aligned for the `linux_dirent64` records
+    uint64_t buf[512];
+    long nread;
+    while (count < MAX_DUMPED_THREADS
+        && (nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+        for (long offset = 0; offset < nread && count < MAX_DUMPED_THREADS;) {
+            struct linux_dirent64 *entry
+                = (struct linux_dirent64 *)((char *)buf + offset);
+            offset += entry->d_reclen;
+
+            pid_t tid = 0;
+            const char *c = entry->d_name;
+            for (; *c >= '0' && *c <= '9'; c++) {
+                tid = tid * 10 + (*c - '0');
+            }
+            if (*c || tid <= 0 || tid == crashed_tid) {
+                continue;
+            }
+
+            struct thread_dump_slot *slot = &g_thread_dump[count];
+            slot->tid = tid;
+            slot->frame_count = 0;
+            sentry__atomic_store(&slot->state, THREAD_DUMP_REQUESTED);
+
+            siginfo_t info;
+            memset(&info, 0, sizeof(info));
+            info.si_signo = THREAD_DUMP_SIGNAL;
+            info.si_code = SI_QUEUE;
+            info.si_pid = pid;
+            info.si_uid = getuid();
+            info.si_value.sival_int = (int)count;
+            if (syscall(SYS_rt_tgsigqueueinfo, pid, tid, THREAD_DUMP_SIGNAL,
+                    &info)
+                != 0) {
+                // the thread has exited in the meantime
+                sentry__atomic_store(&slot->state, THREAD_DUMP_IDLE);
+                continue;
+            }
+            count++;
+        }
+    }
+    close(fd);
+    return count;
+}
+
+static uint64_t
+monotonic_msec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Waits until all requested threads have captured their stacks, or the
+ * timeout has passed. Threads that did not even start by then are abandoned.
+ */
+static void
+wait_for_thread_dumps(size_t count)
+{
+    uint64_t deadline = monotonic_msec() + THREAD_DUMP_TIMEOUT_MS;
+    while (true) {
+        bool pending = false;
+        for (size_t i = 0; i < count && !pending; i++) {
+            long state = sentry__atomic_fetch(&g_thread_dump[i].state);
+            pending = state == THREAD_DUMP_REQUESTED
+                || state == THREAD_DUMP_CAPTURING;
+        }
+        if (!pending || monotonic_msec() >= deadline) {
+            break;
+        }
+        struct timespec delay = { 0, 1000000 };
+        nanosleep(&delay, NULL);
+    }
+    for (size_t i = 0; i < count; i++) {
+        sentry__atomic_compare_swap(&g_thread_dump[i].state,
+            THREAD_DUMP_REQUESTED, THREAD_DUMP_ABANDONED);
+    }
+}
+
+static sentry_value_t
+new_thread_with_name(pid_t tid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    char name[32];
+    ssize_t len = -1;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        len = read(fd, name, sizeof(name) - 1);
+        close(fd);
+    }
+    if (len > 0 && name[len - 1] == '\n') {
+        len--;
+    }
+    return sentry_value_new_thread_n(
+        (uint64_t)tid, len > 0 ? name : NULL, len > 0 ? (size_t)len : 0);
+}
+
+/**
+ * Captures the stacks of all threads and adds them to the `event`. The
+ * crashing thread itself is only marked as such, as its stack is already part
+ * of the exception.
+ */
+static void
+add_all_threads(sentry_value_t event)
+{
+    if (!g_thread_dump) {
+        return;
+    }
+
+    pid_t crashed_tid = (pid_t)syscall(SYS_gettid);
+    size_t count = request_thread_dumps(crashed_tid);
+    wait_for_thread_dumps(count);
+    SENTRY_DEBUGF("captured the stacks of %zu other threads", count);
+
+    sentry_value_t crashed = new_thread_with_name(crashed_tid);
+    sentry_value_set_by_key(crashed, "crashed", sentry_value_new_bool(true));
+    sentry_value_set_by_key(crashed, "current", sentry_value_new_bool(true));
+    sentry_event_add_thread(event, crashed);
+
+    for (size_t i = 0; i < count; i++) {
+        struct thread_dump_slot *slot = &g_thread_dump[i];
+        sentry_value_t thread = new_thread_with_name(slot->tid);
+        if (sentry__atomic_fetch(&slot->state) == THREAD_DUMP_DONE
+            && slot->frame_count) {
+            sentry_value_set_by_key(thread, "stacktrace",
+                sentry_value_new_stacktrace(
+                    &slot->frames[0], slot->frame_count));
+        }
+        sentry_event_add_thread(event, thread);
+    }
+}
+#    endif
+
 static int
 startup_inproc_backend(
-    sentry_backend_t *UNUSED(backend), const sentry_options_t *UNUSED(options))
+    sentry_backend_t *UNUSED(backend), const sentry_options_t *options)
 {
+    reset_crash_skeleton();
+    // map the memory for the crash handler while it is still safe to do so
+    sentry__page_allocator_reserve(CRASH_ARENA_SIZE);
+
     // save the old signal handlers
     memset(g_previous_handlers, 0, sizeof(g_previous_handlers));
     for (size_t i = 0; i < SIGNAL_COUNT; ++i) {
@@ -115,6 +498,11 @@ startup_inproc_backend(
     for (size_t i = 0; i < SIGNAL_COUNT; ++i) {
         sigaction(SIGNAL_DEFINITIONS[i].signum, &g_sigaction, NULL);
     }
+#    if defined(SENTRY_PLATFORM_LINUX)
+    startup_thread_dump(options);
+#    else
+    (void)options;
+#    endif
     return 0;
 }
 
@@ -128,6 +516,11 @@ shutdown_inproc_backend(sentry_backend_t *UNUSED(backend))
         g_signal_stack.ss_sp = NULL;
     }
     reset_signal_handlers();
+#    if defined(SENTRY_PLATFORM_LINUX)
+    shutdown_thread_dump();
+#    endif
+    sentry__page_allocator_release_reserve();
+    reset_crash_skeleton();
 }
 
 #elif defined(SENTRY_PLATFORM_WINDOWS)
@@ -175,6 +568,7 @@ startup_inproc_backend(
         && defined(SENTRY_THREAD_STACK_GUARANTEE_AUTO_INIT)
     sentry__set_default_thread_stack_guarantee();
 #    endif
+    reset_crash_skeleton();
     g_previous_handler = SetUnhandledExceptionFilter(&handle_exception);
     SetErrorMode(SEM_FAILCRITICALERRORS);
     return 0;
@@ -188,6 +582,7 @@ shutdown_inproc_backend(sentry_backend_t *UNUSED(backend))
     if (current_handler != &handle_exception) {
         SetUnhandledExceptionFilter(current_handler);
     }
+    reset_crash_skeleton();
 }
 
 #endif
@@ -651,6 +1046,11 @@ handle_ucontext(const sentry_ucontext_t *uctx)
 #endif
 
         sentry_value_t event = make_signal_event(sig_slot, uctx, strategy);
+#ifdef SENTRY_PLATFORM_LINUX
+        if (options->capture_all_threads) {
+            add_all_threads(event);
+        }
+#endif
         bool should_handle = true;
         sentry__write_crash_marker(options);
 
@@ -666,8 +1066,15 @@ handle_ucontext(const sentry_ucontext_t *uctx)
         }
 
         if (should_handle) {
-            sentry_envelope_t *envelope = sentry__prepare_event(
-                options, event, NULL, !options->on_crash_func, NULL);
+            // most of the scope was already applied to the skeleton outside
+            // of the handler, unless it has changed since
+            sentry_value_t skeleton = take_crash_skeleton();
+            sentry_envelope_t *envelope = sentry_value_is_null(skeleton)
+                ? sentry__prepare_event(
+                      options, event, NULL, !options->on_crash_func, NULL)
+                : sentry__prepare_event_from_skeleton(
+                      options, event, skeleton, !options->on_crash_func);
+            sentry_value_decref(skeleton);
             // TODO(tracing): Revisit when investigating transaction flushing
             //                during hard crashes.
 
@@ -702,6 +1109,14 @@ handle_ucontext(const sentry_ucontext_t *uctx)
         sentry__transport_dump_queue(options->transport, options->run);
     }
 
+#ifdef SENTRY_PLATFORM_UNIX
+    sentry_page_allocator_stats_t alloc_stats;
+    sentry__page_allocator_get_stats(&alloc_stats);
+    SENTRY_DEBUGF("crash handler used %zu of %zu reserved bytes and mapped %zu "
+                  "more, with a peak of %zu bytes in use",
+        alloc_stats.reserve_used, alloc_stats.reserve_size,
+        alloc_stats.bytes_mapped, alloc_stats.peak_bytes_in_use);
+#endif
     SENTRY_INFO("crash has been captured");
 
 #ifdef SENTRY_PLATFORM_UNIX
@@ -764,6 +1179,7 @@ sentry__backend_new(void)
     backend->startup_func = startup_inproc_backend;
     backend->shutdown_func = shutdown_inproc_backend;
     backend->except_func = handle_except;
+    backend->flush_scope_func = flush_crash_skeleton;
 
     return backend;
 }
@@ -0,0 +1,322 @@
+#include "sentry_buildid_cache.h"
+
+#include "sentry_alloc.h"
+#include "sentry_logger.h"
+#include "sentry_modulefinder_linux.h"
+#include "sentry_sync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_FILENAME "build-id-cache"
+#define CACHE_VERSION 1
+// the cache starts over with only the new entries once it grows beyond this
+#define CACHE_MAX_ENTRIES 8192
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t record_size;
+} cache_header_t;
+
+/**
+ * A single entry of the cache file. The file consists of a `cache_header_t`
+ * followed by these records, sorted by their key, so that lookups in the
+ * mapped file are a binary search.
+ */
+typedef struct {
+    // the key
+    uint64_t path_hash;
+    uint64_t inode;
+    uint64_t offset;
+    // what has to match for the entry to be valid
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    // the identifiers of the module
+    uint8_t debug_id[16];
+    uint8_t code_id[SENTRY_BUILDID_CACHE_MAX_CODE_ID];
+    uint8_t code_id_len;
+    uint8_t padding[7];
+} cache_record_t;
+
+struct sentry_buildid_cache_s {
+    sentry_path_t *path;
+    sentry_mmap_t mapping;
+    const cache_record_t *records;
+    size_t len;
+    cache_record_t *added;
+    size_t added_len;
+    size_t added_capacity;
+};
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_lock)
+#else
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+#endif
+static sentry_path_t *g_path = NULL;
+
+static uint64_t
+hash_path(const char *path)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *)path; *c; c++) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int
+compare_keys(const cache_record_t *a, const cache_record_t *b)
+{
+    if (a->path_hash != b->path_hash) {
+        return a->path_hash < b->path_hash ? -1 : 1;
+    }
+    if (a->inode != b->inode) {
+        return a->inode < b->inode ? -1 : 1;
+    }
+    if (a->offset != b->offset) {
+        return a->offset < b->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+static int
+compare_records(const void *a, const void *b)
+{
+    return compare_keys(a, b);
+}
+
+static void
+make_key(cache_record_t *record, const char *path, const struct stat *st,
+    uint64_t offset)
+{
+    memset(record, 0, sizeof(cache_record_t));
+    record->path_hash = hash_path(path);
+    record->inode = (uint64_t)st->st_ino;
+    record->offset = offset;
+    record->size = (uint64_t)st->st_size;
+    record->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    record->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+}
+
+static const cache_record_t *
+find_record(
+    const cache_record_t *records, size_t len, const cache_record_t *key)
+{
+    size_t lo = 0;
+    size_t hi = len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_keys(&records[mid], key);
+        if (cmp == 0) {
+            return &records[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+void
+sentry__buildid_cache_set_path(const sentry_path_t *database_path)
+{
+    sentry_path_t *path = database_path
+        ? sentry__path_join_str(database_path, CACHE_FILENAME)
+        : NULL;
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    sentry__path_free(g_path);
+    g_path = path;
+    sentry__mutex_unlock(&g_lock);
+}
+
+sentry_buildid_cache_t *
+sentry__buildid_cache_open(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    sentry_path_t *path = g_path ? sentry__path_clone(g_path) : NULL;
+    sentry__mutex_unlock(&g_lock);
+    if (!path) {
+        return NULL;
+    }
+
+    sentry_buildid_cache_t *cache = SENTRY_MAKE(sentry_buildid_cache_t);
+    if (!cache) {
+        sentry__path_free(path);
+        return NULL;
+    }
+    memset(cache, 0, sizeof(sentry_buildid_cache_t));
+    cache->path = path;
+
+    // a missing or invalid cache file is treated like an empty one
+    if (!sentry__mmap_file(&cache->mapping, path->path)) {
+        return cache;
+    }
+    const cache_header_t *header = cache->mapping.ptr;
+    if (cache->mapping.len < sizeof(cache_header_t)
+        || memcmp(header->magic, "SBIC", 4) != 0
+        || header->version != CACHE_VERSION
+        || header->record_size != sizeof(cache_record_t)
+        || cache->mapping.len
+            != sizeof(cache_header_t)
+                + (size_t)header->count * sizeof(cache_record_t)) {
+        SENTRY_DEBUG("ignoring invalid build-id cache");
+        sentry__mmap_close(&cache->mapping);
+        return cache;
+    }
+    cache->records = (const cache_record_t *)(header + 1);
+    cache->len = header->count;
+    return cache;
+}
+
+bool
+sentry__buildid_cache_get(const sentry_buildid_cache_t *cache,
+    const char *path, const struct stat *st, uint64_t offset,
+    sentry_module_ids_t *ids_out)
+{
+    cache_record_t key;
+    make_key(&key, path, st, offset);
+    const cache_record_t *record
+        = find_record(cache->records, cache->len, &key);
+    if (!record || record->size != key.size
+        || record->mtime_sec != key.mtime_sec
+        || record->mtime_nsec != key.mtime_nsec
+        || record->code_id_len > SENTRY_BUILDID_CACHE_MAX_CODE_ID) {
+        return false;
+    }
+    memcpy(ids_out->code_id, record->code_id, record->code_id_len);
+    ids_out->code_id_len = record->code_id_len;
+    memcpy(ids_out->debug_id.bytes, record->debug_id, 16);
+    return true;
+}
+
+void
+sentry__buildid_cache_put(sentry_buildid_cache_t *cache, const char *path,
+    const struct stat *st, uint64_t offset, const sentry_module_ids_t *ids)
+{
+    if (ids->code_id_len > SENTRY_BUILDID_CACHE_MAX_CODE_ID) {
+        return;
+    }
+    if (cache->added_len == cache->added_capacity) {
+        size_t capacity
+            = cache->added_capacity ? cache->added_capacity * 2 : 64;
+        cache_record_t *added
+            = sentry_malloc(sizeof(cache_record_t) * capacity);
+        if (!added) {
+            return;
+        }
+        if (cache->added) {
+            memcpy(added, cache->added,
+                sizeof(cache_record_t) * cache->added_len);
+            sentry_free(cache->added);
+        }
+        cache->added = added;
+        cache->added_capacity = capacity;
+    }
+    cache_record_t *record = &cache->added[cache->added_len++];
+    make_key(record, path, st, offset);
+    memcpy(record->code_id, ids->code_id, ids->code_id_len);
+    record->code_id_len = (uint8_t)ids->code_id_len;
+    memcpy(record->debug_id, ids->debug_id.bytes, 16);
+}
+
+/**
+ * Merges the new entries into the mapped ones and writes the result to a
+ * temporary file, which then replaces the cache file. Other processes keep
+ * reading whichever version they have mapped.
+ */
+static void
+write_cache(sentry_buildid_cache_t *cache)
+{
+    qsort(cache->added, cache->added_len, sizeof(cache_record_t),
+        compare_records);
+
+    size_t existing = cache->len;
+    if (existing + cache->added_len > CACHE_MAX_ENTRIES) {
+        existing = 0;
+    }
+    size_t buf_len = sizeof(cache_header_t)
+        + (existing + cache->added_len) * sizeof(cache_record_t);
+    char *buf = sentry_malloc(buf_len);
+    if (!buf) {
+        return;
+    }
+
+    // both lists are sorted, entries that were added replace existing ones
+    cache_record_t *records = (cache_record_t *)(buf + sizeof(cache_header_t));
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < existing || j < cache->added_len) {
+        int cmp;
+        if (i == existing) {
+            cmp = 1;
+        } else if (j == cache->added_len) {
+            cmp = -1;
+        } else {
+            cmp = compare_keys(&cache->records[i], &cache->added[j]);
+        }
+        if (cmp < 0) {
+            records[count] = cache->records[i++];
+        } else {
+            records[count] = cache->added[j++];
+            if (cmp == 0) {
+                i++;
+            }
+        }
+        // the same file can be mapped more than once
+        if (!count || compare_keys(&records[count - 1], &records[count])) {
+            count++;
+        }
+    }
+
+    cache_header_t *header = (cache_header_t *)buf;
+    memcpy(header->magic, "SBIC", 4);
+    header->version = CACHE_VERSION;
+    header->count = (uint32_t)count;
+    header->record_size = sizeof(cache_record_t);
+    buf_len = sizeof(cache_header_t) + count * sizeof(cache_record_t);
+
+    char tmp_name[64];
+    snprintf(tmp_name, sizeof(tmp_name), CACHE_FILENAME ".%ld.tmp",
+        (long)getpid());
+    sentry_path_t *dir = sentry__path_dir(cache->path);
+    sentry_path_t *tmp_path = dir ? sentry__path_join_str(dir, tmp_name) : NULL;
+    if (tmp_path && sentry__path_write_buffer(tmp_path, buf, buf_len) == 0) {
+        if (rename(tmp_path->path, cache->path->path) != 0) {
+            SENTRY_DEBUG("failed to replace the build-id cache");
+            sentry__path_remove(tmp_path);
+        } else {
+            SENTRY_DEBUGF("wrote %zu entries to the build-id cache", count);
+        }
+    }
+    sentry__path_free(tmp_path);
+    sentry__path_free(dir);
+    sentry_free(buf);
+}
+
+void
+sentry__buildid_cache_close(sentry_buildid_cache_t *cache)
+{
+    if (!cache) {
+        return;
+    }
+    if (cache->added_len) {
+        write_cache(cache);
+    }
+    if (cache->mapping.ptr) {
+        sentry__mmap_close(&cache->mapping);
+    }
+    sentry__path_free(cache->path);
+    sentry_free(cache->added);
+    sentry_free(cache);
+}
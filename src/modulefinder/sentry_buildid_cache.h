@@ -0,0 +1,61 @@
+#ifndef SENTRY_BUILDID_CACHE_H_INCLUDED
+#define SENTRY_BUILDID_CACHE_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_path.h"
+
+#include <sys/stat.h>
+
+#define SENTRY_BUILDID_CACHE_MAX_CODE_ID 32
+
+/**
+ * The identifiers of a module, as read from its ELF file.
+ */
+typedef struct {
+    uint8_t code_id[SENTRY_BUILDID_CACHE_MAX_CODE_ID];
+    size_t code_id_len;
+    sentry_uuid_t debug_id;
+} sentry_module_ids_t;
+
+/**
+ * An on-disk cache of module identifiers, stored in the database directory
+ * so that the ELF files of modules only have to be parsed on the first run.
+ * Entries are keyed by path, inode and offset, and are only used while the
+ * size and modification time of the file still match.
+ */
+typedef struct sentry_buildid_cache_s sentry_buildid_cache_t;
+
+/**
+ * Sets the database directory the cache file is stored in, or disables the
+ * cache when `database_path` is NULL.
+ */
+void sentry__buildid_cache_set_path(const sentry_path_t *database_path);
+
+/**
+ * Maps the current cache file into memory. Returns NULL if the cache is
+ * disabled.
+ */
+sentry_buildid_cache_t *sentry__buildid_cache_open(void);
+
+/**
+ * Looks up the identifiers of the module at `offset` in the file at `path`,
+ * which has the given `stat` metadata.
+ */
+bool sentry__buildid_cache_get(const sentry_buildid_cache_t *cache,
+    const char *path, const struct stat *st, uint64_t offset,
+    sentry_module_ids_t *ids_out);
+
+/**
+ * Records the identifiers of a module, to be written on close.
+ */
+void sentry__buildid_cache_put(sentry_buildid_cache_t *cache, const char *path,
+    const struct stat *st, uint64_t offset, const sentry_module_ids_t *ids);
+
+/**
+ * Writes out any new entries, replacing the cache file atomically, and frees
+ * the `cache`.
+ */
+void sentry__buildid_cache_close(sentry_buildid_cache_t *cache);
+
+#endif
@@ -1,7 +1,9 @@
 #include "sentry_boot.h"
 
 #include "sentry_core.h"
+#include "sentry_modulefinder.h"
 #include "sentry_string.h"
+#include "sentry_symbolizer.h"
 #include "sentry_sync.h"
 #include "sentry_value.h"
 
@@ -18,6 +20,8 @@
 static bool g_initialized = false;
 static sentry_mutex_t g_mutex = SENTRY__MUTEX_INIT;
 static sentry_value_t g_modules = { 0 };
+// bumped whenever `g_modules` is replaced, see `sentry__modules_generation`
+static volatile long g_generation = 0;
 
 static void
 load_modules(void)
@@ -90,7 +94,8 @@ sentry_get_modules_list(void)
         g_modules = sentry_value_new_list();
         g_initialized = true;
         load_modules();
-        sentry_value_freeze(g_modules);
+        sentry__value_freeze_serialized(g_modules);
+        sentry__atomic_fetch_and_add(&g_generation, 1);
     }
     sentry_value_t modules = g_modules;
     sentry_value_incref(modules);
@@ -105,5 +110,13 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
     sentry__mutex_unlock(&g_mutex);
+    sentry__symbolizer_cache_clear();
+}
+
+long
+sentry__modules_generation(void)
+{
+    return sentry__atomic_fetch(&g_generation);
 }
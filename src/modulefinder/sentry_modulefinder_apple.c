@@ -1,7 +1,9 @@
 #include "sentry_boot.h"
 
 #include "sentry_core.h"
+#include "sentry_modulefinder.h"
 #include "sentry_string.h"
+#include "sentry_symbolizer.h"
 #include "sentry_sync.h"
 #include "sentry_value.h"
 
@@ -33,6 +35,8 @@ typedef struct segment_command_64 mach_segment_command_type;
 static bool g_initialized = false;
 static sentry_mutex_t g_mutex = SENTRY__MUTEX_INIT;
 static sentry_value_t g_modules = { 0 };
+// bumped whenever `g_modules` is replaced, see `sentry__modules_generation`
+static volatile long g_generation = 0;
 
 static void
 add_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
@@ -85,6 +89,7 @@ add_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
     sentry_value_freeze(new_modules);
     sentry_value_decref(g_modules);
     g_modules = new_modules;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
 
     sentry__mutex_unlock(&g_mutex);
 }
@@ -122,6 +127,7 @@ remove_image(const struct mach_header *mh, intptr_t UNUSED(vmaddr_slide))
     sentry_value_decref(g_modules);
     sentry_value_freeze(new_modules);
     g_modules = new_modules;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
 
 done:
     sentry__mutex_unlock(&g_mutex);
@@ -165,5 +171,13 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
     sentry__mutex_unlock(&g_mutex);
+    sentry__symbolizer_cache_clear();
+}
+
+long
+sentry__modules_generation(void)
+{
+    return sentry__atomic_fetch(&g_generation);
 }
@@ -3,9 +3,12 @@
 #endif
 #include "sentry_modulefinder_linux.h"
 
+#include "sentry_buildid_cache.h"
 #include "sentry_core.h"
+#include "sentry_modulefinder.h"
 #include "sentry_path.h"
 #include "sentry_string.h"
+#include "sentry_symbolizer.h"
 #include "sentry_sync.h"
 #include "sentry_utils.h"
 #include "sentry_value.h"
@@ -13,6 +16,7 @@
 #include <arpa/inet.h>
 #include <elf.h>
 #include <fcntl.h>
+#include <link.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -36,6 +40,25 @@ process_vm_readv(pid_t __pid, const struct iovec *__local_iov,
     if (!Ptr)                                                                  \
     goto fail
 
+/**
+ * A module of the registry, with the identity of its mapping and the value
+ * that was created for it. The value is reused for as long as the same file
+ * stays mapped at the same address, so its ELF headers are only parsed once.
+ */
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    uint64_t inode;
+    char *file;
+    sentry_value_t value;
+} registered_module_t;
+
+typedef struct {
+    registered_module_t *modules;
+    size_t len;
+    size_t capacity;
+} module_registry_t;
+
 static bool g_initialized = false;
 #ifdef SENTRY__MUTEX_INIT_DYN
 SENTRY__MUTEX_INIT_DYN(g_mutex)
@@ -43,6 +66,17 @@ SENTRY__MUTEX_INIT_DYN(g_mutex)
 static sentry_mutex_t g_mutex = SENTRY__MUTEX_INIT;
 #endif
 static sentry_value_t g_modules = { 0 };
+static module_registry_t g_registry = { NULL, 0, 0 };
+// the number of `dlopen`s and `dlclose`s when the modules were last read
+static unsigned long long g_adds = 0;
+static unsigned long long g_subs = 0;
+static bool g_has_generation = false;
+// the loaded objects when the modules were last read, see
+// `loaded_objects_fingerprint`, or 0 if that is not known
+static unsigned long g_fingerprint = 0;
+
+// bumped whenever `g_modules` is replaced, see `sentry__modules_generation`
+static volatile long g_generation = 0;
 
 static sentry_slice_t LINUX_GATE = { "linux-gate.so", 13 };
 
@@ -458,35 +492,41 @@ fail:
 
 #undef ELF_SECTION_ITER
 
-bool
-sentry__procmaps_read_ids_from_elf(
-    sentry_value_t value, const sentry_module_t *module)
+/**
+ * Reads the code id and debug id of the module, and writes them into `ids`.
+ * Code ids that don't fit are set on `value` directly, with `code_id_len` set
+ * beyond the maximum so they are not cached.
+ */
+static void
+read_module_ids(const sentry_module_t *module, sentry_module_ids_t *ids,
+    sentry_value_t value)
 {
     // try to get the debug id from the elf headers of the loaded modules
     size_t code_id_size;
     const uint8_t *code_id
         = get_code_id_from_program_header(module, &code_id_size);
     sentry_uuid_t uuid = sentry_uuid_nil();
+    ids->code_id_len = 0;
 
-    if (code_id) {
-        sentry_value_set_by_key(value, "code_id",
-            sentry__value_new_hexstring(code_id, code_id_size));
-
-        memcpy(uuid.bytes, code_id, MIN(code_id_size, 16));
-    } else {
+    if (!code_id) {
         // no code-id found, try the ".note.gnu.build-id" section
         code_id = get_code_id_from_note_section(module, &code_id_size);
-        if (code_id) {
+    }
+    if (code_id) {
+        if (code_id_size <= SENTRY_BUILDID_CACHE_MAX_CODE_ID) {
+            memcpy(ids->code_id, code_id, code_id_size);
+        } else {
             sentry_value_set_by_key(value, "code_id",
                 sentry__value_new_hexstring(code_id, code_id_size));
-
-            memcpy(uuid.bytes, code_id, MIN(code_id_size, 16));
-        } else {
-            // We were not able to locate the code-id, so fall back to
-            // hashing the first page of the ".text" (program code)
-            // section.
-            uuid = get_code_id_from_text_section(module);
         }
+        ids->code_id_len = code_id_size;
+
+        memcpy(uuid.bytes, code_id, MIN(code_id_size, 16));
+    } else {
+        // We were not able to locate the code-id, so fall back to
+        // hashing the first page of the ".text" (program code)
+        // section.
+        uuid = get_code_id_from_text_section(module);
     }
 
     // the usage of these is described here:
@@ -500,13 +540,34 @@ sentry__procmaps_read_ids_from_elf(
     *b = htons(*b);
     uint16_t *c = (uint16_t *)(uuid_bytes + 6);
     *c = htons(*c);
+    ids->debug_id = uuid;
+}
 
-    sentry_value_set_by_key(value, "debug_id", sentry__value_new_uuid(&uuid));
+static void
+set_module_ids(sentry_value_t value, const sentry_module_ids_t *ids)
+{
+    if (ids->code_id_len
+        && ids->code_id_len <= SENTRY_BUILDID_CACHE_MAX_CODE_ID) {
+        sentry_value_set_by_key(value, "code_id",
+            sentry__value_new_hexstring(ids->code_id, ids->code_id_len));
+    }
+    sentry_value_set_by_key(
+        value, "debug_id", sentry__value_new_uuid(&ids->debug_id));
+}
+
+bool
+sentry__procmaps_read_ids_from_elf(
+    sentry_value_t value, const sentry_module_t *module)
+{
+    sentry_module_ids_t ids;
+    read_module_ids(module, &ids, value);
+    set_module_ids(value, &ids);
     return true;
 }
 
 sentry_value_t
-sentry__procmaps_module_to_value(const sentry_module_t *module)
+sentry__procmaps_module_to_value(
+    const sentry_module_t *module, sentry_buildid_cache_t *cache)
 {
     sentry_value_t mod_val = sentry_value_new_object();
     sentry_value_set_by_key(mod_val, "type", sentry_value_new_string("elf"));
@@ -537,13 +598,28 @@ sentry__procmaps_module_to_value(const sentry_module_t *module)
         sentry__procmaps_read_ids_from_elf(mod_val, module);
     } else {
         char *filename = sentry__slice_to_owned(module->file);
+        if (!filename) {
+            sentry_value_decref(mod_val);
+            return sentry_value_new_null();
+        }
+        // the cache spares us from mapping and parsing the file entirely
+        sentry_module_ids_t ids;
+        struct stat st;
+        bool cacheable = cache && stat(filename, &st) == 0;
+        if (cacheable
+            && sentry__buildid_cache_get(
+                cache, filename, &st, module->offset_in_inode, &ids)) {
+            sentry_free(filename);
+            set_module_ids(mod_val, &ids);
+            return mod_val;
+        }
+
         sentry_mmap_t mm;
         if (!sentry__mmap_file(&mm, filename)) {
             sentry_free(filename);
             sentry_value_decref(mod_val);
             return sentry_value_new_null();
         }
-        sentry_free(filename);
 
         sentry_module_t mmapped_module;
         memset(&mmapped_module, 0, sizeof(sentry_module_t));
@@ -553,25 +629,193 @@ sentry__procmaps_module_to_value(const sentry_module_t *module)
             = (uint64_t)mm.ptr + module->offset_in_inode;
         mmapped_module.mappings[0].size = mm.len - module->offset_in_inode;
 
-        sentry__procmaps_read_ids_from_elf(mod_val, &mmapped_module);
+        read_module_ids(&mmapped_module, &ids, mod_val);
+        set_module_ids(mod_val, &ids);
+        if (cacheable) {
+            sentry__buildid_cache_put(
+                cache, filename, &st, module->offset_in_inode, &ids);
+        }
 
         sentry__mmap_close(&mm);
+        sentry_free(filename);
     }
 
     return mod_val;
 }
 
 static void
-try_append_module(sentry_value_t modules, const sentry_module_t *module)
+registry_free(module_registry_t *registry)
+{
+    for (size_t i = 0; i < registry->len; i++) {
+        sentry_free(registry->modules[i].file);
+        sentry_value_decref(registry->modules[i].value);
+    }
+    sentry_free(registry->modules);
+    memset(registry, 0, sizeof(module_registry_t));
+}
+
+/**
+ * Looks up the module mapped at `addr` in the `registry`, which is sorted by
+ * address, just like `/proc/self/maps`.
+ */
+static registered_module_t *
+registry_find(const module_registry_t *registry, uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = registry->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (registry->modules[mid].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < registry->len && registry->modules[lo].addr == addr
+        ? &registry->modules[lo]
+        : NULL;
+}
+
+static bool
+registry_push(module_registry_t *registry, registered_module_t *module)
+{
+    if (registry->len == registry->capacity) {
+        size_t capacity = registry->capacity ? registry->capacity * 2 : 64;
+        registered_module_t *modules
+            = sentry_malloc(sizeof(registered_module_t) * capacity);
+        if (!modules) {
+            return false;
+        }
+        if (registry->modules) {
+            memcpy(modules, registry->modules,
+                sizeof(registered_module_t) * registry->len);
+            sentry_free(registry->modules);
+        }
+        registry->modules = modules;
+        registry->capacity = capacity;
+    }
+    registry->modules[registry->len++] = *module;
+    return true;
+}
+
+/**
+ * Appends the value of `module` to `modules`, and records it in the
+ * `registry`. Modules that are found unchanged in the `previous` registry
+ * keep their value, all others have their ELF headers parsed.
+ */
+static void
+try_append_module(sentry_value_t modules, const sentry_module_t *module,
+    const module_registry_t *previous, module_registry_t *registry,
+    sentry_buildid_cache_t *cache)
 {
     if (!module->file.ptr || !module->num_mappings) {
         return;
     }
 
-    sentry_value_t mod_val = sentry__procmaps_module_to_value(module);
-    if (!sentry_value_is_null(mod_val)) {
-        sentry_value_append(modules, mod_val);
+    const sentry_mapped_region_t *first_mapping = &module->mappings[0];
+    const sentry_mapped_region_t *last_mapping
+        = &module->mappings[module->num_mappings - 1];
+    registered_module_t entry;
+    entry.addr = first_mapping->addr;
+    entry.size = last_mapping->addr + last_mapping->size - first_mapping->addr;
+    entry.inode = module->mappings_inode;
+    entry.file = NULL;
+    entry.value = sentry_value_new_null();
+
+    registered_module_t *known = registry_find(previous, entry.addr);
+    if (known && known->size == entry.size && known->inode == entry.inode
+        && sentry__slice_eqs(module->file, known->file)) {
+        entry.value = known->value;
+        sentry_value_incref(entry.value);
+    } else {
+        entry.value = sentry__procmaps_module_to_value(module, cache);
+    }
+    if (sentry_value_is_null(entry.value)) {
+        return;
+    }
+
+    sentry_value_incref(entry.value);
+    sentry_value_append(modules, entry.value);
+    entry.file = sentry__slice_to_owned(module->file);
+    if (!entry.file || !registry_push(registry, &entry)) {
+        sentry_free(entry.file);
+        sentry_value_decref(entry.value);
+    }
+}
+
+/**
+ * Combines the load addresses of all objects of the dynamic loader into a
+ * fingerprint, by walking its list of objects without calling into it.
+ * Returns 0 if the list is not available.
+ *
+ * Outside of a signal handler, the list may only be walked with the lock of
+ * the dynamic loader held, since `dlclose` frees its entries.
+ */
+static unsigned long
+loaded_objects_fingerprint(void)
+{
+    unsigned long fingerprint = 0;
+#ifdef __GLIBC__
+    for (const struct link_map *map = _r_debug.r_map; map; map = map->l_next) {
+        fingerprint = fingerprint * 31 + (unsigned long)map->l_addr
+            + (unsigned long)(uintptr_t)map->l_name + 1;
+    }
+#endif
+    return fingerprint;
+}
+
+typedef struct {
+    unsigned long long adds;
+    unsigned long long subs;
+    unsigned long fingerprint;
+} loader_state_t;
+
+static int
+read_loader_state(struct dl_phdr_info *info, size_t size, void *data)
+{
+    // only the first module is needed, all of them carry the same counters
+    loader_state_t *state = data;
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs)
+            + sizeof(info->dlpi_subs)) {
+        state->adds = info->dlpi_adds;
+        state->subs = info->dlpi_subs;
+    }
+    // the loader holds its lock while calling this
+    state->fingerprint = loaded_objects_fingerprint();
+    return 1;
+}
+
+/**
+ * Checks whether any module was loaded or unloaded since the modules were
+ * last read, and remembers the current counters. Returns `true` if that can't
+ * be determined.
+ */
+static bool
+modules_changed(void)
+{
+    loader_state_t state = { 0, 0, 0 };
+    dl_iterate_phdr(read_loader_state, &state);
+    g_fingerprint = state.fingerprint;
+    if (!state.adds) {
+        return !g_has_generation;
     }
+    bool changed = !g_has_generation || state.adds != g_adds
+        || state.subs != g_subs;
+    g_adds = state.adds;
+    g_subs = state.subs;
+    g_has_generation = true;
+    return changed;
+}
+
+/**
+ * Checks from a signal handler whether any module was loaded or unloaded
+ * since the modules were last read, without calling into the dynamic loader.
+ * Returns `false` if that can't be determined.
+ */
+static bool
+modules_changed_in_signal_handler(void)
+{
+    return g_fingerprint && loaded_objects_fingerprint() != g_fingerprint;
 }
 
 // copied from:
@@ -623,7 +867,8 @@ is_valid_elf_header(void *start)
 }
 
 static void
-load_modules(sentry_value_t modules)
+load_modules(sentry_value_t modules, const module_registry_t *previous,
+    module_registry_t *registry, sentry_buildid_cache_t *cache)
 {
     int fd = open("/proc/self/maps", O_RDONLY);
     if (fd < 0) {
@@ -708,7 +953,8 @@ load_modules(sentry_value_t modules)
             if (!is_duplicated_mapping(&last_module, &module)) {
                 // try to append the module based on the mappings that
                 // we have found so far
-                try_append_module(modules, &last_module);
+                try_append_module(
+                    modules, &last_module, previous, registry, cache);
 
                 // start a new module based on the current mapping
                 memset(&last_module, 0, sizeof(sentry_module_t));
@@ -719,7 +965,7 @@ load_modules(sentry_value_t modules)
 
         sentry__module_mapping_push(&last_module, &module);
     }
-    try_append_module(modules, &last_module);
+    try_append_module(modules, &last_module, previous, registry, cache);
     sentry_free(contents);
 }
 
@@ -728,14 +974,37 @@ sentry_get_modules_list(void)
 {
     SENTRY__MUTEX_INIT_DYN_ONCE(g_mutex);
     sentry__mutex_lock(&g_mutex);
-    if (!g_initialized) {
-        g_modules = sentry_value_new_list();
+    // A crash inside of `dlopen` or `dlclose` happens with the lock of the
+    // dynamic loader held, so the signal handler must not call into it. It
+    // sticks to the cached modules unless the objects of the loader changed,
+    // and leaves the cache file alone.
+    bool in_signal_handler = !sentry__block_for_signal_handler();
+    // `dlopen` and `dlclose` bump the counters of the dynamic loader, which
+    // tells us when the list is outdated. Only the modules that are new since
+    // then have to be parsed, the others are taken from the registry.
+    bool changed = in_signal_handler ? modules_changed_in_signal_handler()
+                                     : modules_changed();
+    if (changed || !g_initialized) {
+        if (in_signal_handler) {
+            g_fingerprint = loaded_objects_fingerprint();
+        }
+        sentry_value_t modules = sentry_value_new_list();
+        module_registry_t registry = { NULL, 0, 0 };
         SENTRY_DEBUG("trying to read modules from /proc/self/maps");
-        load_modules(g_modules);
+        sentry_buildid_cache_t *cache
+            = in_signal_handler ? NULL : sentry__buildid_cache_open();
+        load_modules(modules, &g_registry, &registry, cache);
+        sentry__buildid_cache_close(cache);
         SENTRY_DEBUGF("read %zu modules from /proc/self/maps",
-            sentry_value_get_length(g_modules));
-        sentry_value_freeze(g_modules);
+            sentry_value_get_length(modules));
+        sentry__value_freeze_serialized(modules);
+
+        sentry_value_decref(g_modules);
+        g_modules = modules;
+        registry_free(&g_registry);
+        g_registry = registry;
         g_initialized = true;
+        sentry__atomic_fetch_and_add(&g_generation, 1);
     }
     sentry_value_t modules = g_modules;
     sentry_value_incref(modules);
@@ -750,6 +1019,25 @@ sentry_clear_modulecache(void)
     sentry__mutex_lock(&g_mutex);
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
+    registry_free(&g_registry);
+    g_has_generation = false;
+    g_fingerprint = 0;
     g_initialized = false;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
     sentry__mutex_unlock(&g_mutex);
+    sentry__symbolizer_cache_clear();
+    sentry__symbolize_elf_clear();
+}
+
+long
+sentry__modules_generation(void)
+{
+    // Nothing refreshes the list between a `dlopen` and a crash, so the
+    // handler checks the objects of the loader itself. The generation the
+    // next `sentry_get_modules_list` moves to is reported right away.
+    if (!sentry__block_for_signal_handler()
+        && modules_changed_in_signal_handler()) {
+        return sentry__atomic_fetch(&g_generation) + 1;
+    }
+    return sentry__atomic_fetch(&g_generation);
 }
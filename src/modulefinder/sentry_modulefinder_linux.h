@@ -35,6 +35,17 @@ typedef struct {
     size_t len;
 } sentry_mmap_t;
 
+/**
+ * Maps the whole file at `path` read-only into memory.
+ * Returns false if the file could not be mapped.
+ */
+bool sentry__mmap_file(sentry_mmap_t *mapping, const char *path);
+
+/**
+ * Unmaps a file that was mapped with `sentry__mmap_file`.
+ */
+void sentry__mmap_close(sentry_mmap_t *mapping);
+
 #ifdef SENTRY_UNITTEST
 bool sentry__procmaps_read_ids_from_elf(
     sentry_value_t value, const sentry_module_t *module);
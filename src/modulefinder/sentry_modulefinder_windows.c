@@ -1,5 +1,7 @@
 #include "sentry_boot.h"
 
+#include "sentry_modulefinder.h"
+#include "sentry_symbolizer.h"
 #include "sentry_sync.h"
 #include "sentry_uuid.h"
 #include "sentry_value.h"
@@ -14,6 +16,8 @@
 static bool g_initialized = false;
 static sentry_mutex_t g_mutex = SENTRY__MUTEX_INIT;
 static sentry_value_t g_modules = { 0 };
+// bumped whenever `g_modules` is replaced, see `sentry__modules_generation`
+static volatile long g_generation = 0;
 
 #define CV_SIGNATURE 0x53445352
 
@@ -183,7 +187,7 @@ load_modules(void)
 
     CloseHandle(snapshot);
 
-    sentry_value_freeze(g_modules);
+    sentry__value_freeze_serialized(g_modules);
 #else
     HMODULE hMods[1024];
     HANDLE hProcess = GetCurrentProcess();
@@ -219,7 +223,7 @@ load_modules(void)
         }
     }
 
-    sentry_value_freeze(g_modules);
+    sentry__value_freeze_serialized(g_modules);
 #endif // SENTRY_PLATFORM_XBOX
 }
 
@@ -230,6 +234,7 @@ sentry_get_modules_list(void)
     if (!g_initialized) {
         load_modules();
         g_initialized = true;
+        sentry__atomic_fetch_and_add(&g_generation, 1);
     }
     sentry_value_t modules = g_modules;
     sentry_value_incref(modules);
@@ -244,5 +249,13 @@ sentry_clear_modulecache(void)
     sentry_value_decref(g_modules);
     g_modules = sentry_value_new_null();
     g_initialized = false;
+    sentry__atomic_fetch_and_add(&g_generation, 1);
     sentry__mutex_unlock(&g_mutex);
+    sentry__symbolizer_cache_clear();
+}
+
+long
+sentry__modules_generation(void)
+{
+    return sentry__atomic_fetch(&g_generation);
 }
@@ -574,3 +574,12 @@ sentry__filewriter_byte_count(const sentry_filewriter_t *filewriter)
 {
     return filewriter->byte_count;
 }
+
+int
+sentry__filewriter_sync(sentry_filewriter_t *filewriter)
+{
+    if (!filewriter) {
+        return 1;
+    }
+    return fsync(filewriter->fd) == 0 ? 0 : 1;
+}
@@ -792,3 +792,12 @@ sentry__filewriter_byte_count(const sentry_filewriter_t *filewriter)
 {
     return filewriter->byte_count;
 }
+
+int
+sentry__filewriter_sync(sentry_filewriter_t *filewriter)
+{
+    if (!filewriter || fflush(filewriter->f) != 0) {
+        return 1;
+    }
+    return _commit(_fileno(filewriter->f)) == 0 ? 0 : 1;
+}
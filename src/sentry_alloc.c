@@ -25,8 +25,9 @@ void
 sentry_free(void *ptr)
 {
 #ifdef WITH_PAGE_ALLOCATOR
-    /* page allocator can't free */
+    /* page allocator only reuses its own blocks */
     if (sentry__page_allocator_enabled()) {
+        sentry__page_allocator_free(ptr);
         return;
     }
 #endif
@@ -12,9 +12,12 @@
 #include "sentry_options.h"
 #include "sentry_path.h"
 #include "sentry_process.h"
+#include "sentry_profiler.h"
+#include "sentry_quota.h"
 #include "sentry_random.h"
 #include "sentry_scope.h"
 #include "sentry_session.h"
+#include "sentry_session_aggregates.h"
 #include "sentry_string.h"
 #include "sentry_sync.h"
 #include "sentry_tracing.h"
@@ -24,6 +27,10 @@
 #include "sentry_value.h"
 #include "transports/sentry_disk_transport.h"
 
+#ifdef SENTRY_PLATFORM_LINUX
+#    include "modulefinder/sentry_buildid_cache.h"
+#endif
+
 #ifdef SENTRY_PLATFORM_WINDOWS
 #    include "sentry_os.h"
 #    include "sentry_screenshot.h"
@@ -204,6 +211,10 @@ sentry_init(sentry_options_t *options)
     }
 
     load_user_consent(options);
+    sentry__quota_start(options);
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__buildid_cache_set_path(options->database_path);
+#endif
 
     if (!options->dsn || !options->dsn->is_valid) {
         const char *raw_dsn = sentry_options_get_dsn(options);
@@ -244,6 +255,10 @@ sentry_init(sentry_options_t *options)
     g_last_crash = sentry__has_crash_marker(options);
     g_options = options;
 
+    if (backend && backend->flush_scope_func) {
+        sentry__scope_flusher_start(options);
+    }
+
     // *after* setting the global options, trigger a scope and consent flush,
     // since at least crashpad needs that. At this point we also freeze the
     // `client_sdk` in the `scope` because some downstream SDKs want to override
@@ -254,7 +269,7 @@ sentry_init(sentry_options_t *options)
                 = sentry_value_new_string(options->sdk_name);
             sentry_value_set_by_key(scope->client_sdk, "name", sdk_name);
         }
-        sentry_value_freeze(scope->client_sdk);
+        sentry__value_freeze_serialized(scope->client_sdk);
         generate_propagation_context(scope->propagation_context);
         scope->attachments = options->attachments;
         options->attachments = NULL;
@@ -283,17 +298,19 @@ sentry_init(sentry_options_t *options)
     // after initializing the transport, we will submit all the unsent envelopes
     // and handle remaining sessions.
     SENTRY_DEBUG("processing and pruning old runs");
-    sentry__process_old_runs(options, last_crash);
+    sentry__process_old_runs_start(options, last_crash);
     if (backend && backend->prune_database_func) {
         backend->prune_database_func(backend);
     }
 
+    sentry__session_persister_start(options);
+    sentry__session_aggregates_start(options);
     if (options->auto_session_tracking) {
         sentry_start_session();
     }
 
     if (options->enable_logs) {
-        sentry__logs_startup();
+        sentry__logs_startup(options);
     }
 
     sentry__mutex_unlock(&g_options_lock);
@@ -304,6 +321,7 @@ fail:
     if (transport) {
         sentry__transport_shutdown(transport, 0);
     }
+    sentry__quota_stop();
     sentry_options_free(options);
     sentry__mutex_unlock(&g_options_lock);
     return 1;
@@ -325,6 +343,8 @@ sentry_flush(uint64_t timeout)
 int
 sentry_close(void)
 {
+    // the old runs and the transport share one `shutdown_timeout`
+    uint64_t old_runs_duration = 0;
     // Shutdown logs system before locking options to ensure logs are flushed.
     // This prevents a potential deadlock on the options during log envelope
     // creation.
@@ -332,7 +352,21 @@ sentry_close(void)
         if (options->enable_logs) {
             sentry__logs_shutdown(options->shutdown_timeout);
         }
-    }
+        // the same goes for the scope flusher, which needs the options to
+        // write out the last scope changes.
+        sentry__scope_flusher_shutdown(options->shutdown_timeout);
+        // old runs are still sent through the transport, which is shut down
+        // below
+        uint64_t old_runs_started = sentry__monotonic_time();
+        sentry__process_old_runs_shutdown(options->shutdown_timeout);
+        old_runs_duration = sentry__monotonic_time() - old_runs_started;
+    }
+    // the session is ended below, which also has to remove its file
+    sentry__session_persister_shutdown();
+    // the aggregates flusher sends the remaining outcomes through the transport
+    sentry__session_aggregates_shutdown();
+    // the profiler sends its last chunk with its own reference to the options
+    sentry__profiler_shutdown();
 
     SENTRY__MUTEX_INIT_DYN_ONCE(g_options_lock);
     // this function is to be called only once, so we do not allow more than one
@@ -349,8 +383,10 @@ sentry_close(void)
         }
 
         if (options->transport) {
-            if (sentry__transport_shutdown(
-                    options->transport, options->shutdown_timeout)
+            uint64_t timeout = old_runs_duration < options->shutdown_timeout
+                ? options->shutdown_timeout - old_runs_duration
+                : 0;
+            if (sentry__transport_shutdown(options->transport, timeout)
                 != 0) {
                 SENTRY_WARN("transport did not shut down cleanly");
             }
@@ -371,6 +407,10 @@ sentry_close(void)
     sentry__mutex_unlock(&g_options_lock);
 
     sentry__scope_cleanup();
+    sentry__quota_stop();
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry__buildid_cache_set_path(NULL);
+#endif
     sentry_clear_modulecache();
 
     return (int)dumped_envelopes;
@@ -482,6 +522,20 @@ sentry__capture_envelope(
     sentry__transport_send_envelope(transport, envelope);
 }
 
+void
+sentry__capture_envelope_with_options(
+    const sentry_options_t *options, sentry_envelope_t *envelope)
+{
+    if (options->require_user_consent
+        && sentry__atomic_fetch((long *)&options->user_consent)
+            != SENTRY_USER_CONSENT_GIVEN) {
+        SENTRY_INFO("discarding envelope due to missing user consent");
+        sentry_envelope_free(envelope);
+        return;
+    }
+    sentry__transport_send_envelope(options->transport, envelope);
+}
+
 void
 sentry_capture_envelope(sentry_envelope_t *envelope)
 {
@@ -580,13 +634,18 @@ sentry__capture_event(sentry_value_t event, sentry_scope_t *local_scope)
                 sentry_options_t *mut_options = sentry__options_lock();
                 // recheck inside the lock since our previous read is racy.
                 if (mut_options->session) {
+                    sentry__session_sync_errors(mut_options->session);
                     sentry__envelope_add_session(
                         envelope, mut_options->session);
                     // we're assuming that if a session is added to an envelope,
                     // it will be sent onwards.  This means we now need to set
                     // the init flag to false because we're no longer in the
                     // initial session update.
-                    mut_options->session->init = false;
+                    if (mut_options->session->init) {
+                        mut_options->session->init = false;
+                        sentry__session_persist(
+                            mut_options->run, mut_options->session);
+                    }
                 }
                 sentry__options_unlock();
             }
@@ -649,10 +708,10 @@ static
     return send;
 }
 
-sentry_envelope_t *
-sentry__prepare_event(const sentry_options_t *options, sentry_value_t event,
+static sentry_envelope_t *
+prepare_event(const sentry_options_t *options, sentry_value_t event,
     sentry_uuid_t *event_id, bool invoke_before_send,
-    sentry_scope_t *local_scope)
+    sentry_scope_t *local_scope, sentry_value_t skeleton)
 {
     sentry_envelope_t *envelope = NULL;
 
@@ -678,7 +737,12 @@ sentry__prepare_event(const sentry_options_t *options, sentry_value_t event,
         if (all_attachments) {
             sentry__attachments_extend(&all_attachments, scope->attachments);
         }
-        sentry__scope_apply_to_event(scope, options, event, mode);
+        if (sentry_value_is_null(skeleton)) {
+            sentry__scope_apply_to_event(scope, options, event, mode);
+        } else {
+            sentry__scope_apply_skeleton_to_event(
+                scope, options, event, skeleton, mode);
+        }
     }
 
     if (options->before_send_func && invoke_before_send) {
@@ -717,6 +781,23 @@ fail:
     return NULL;
 }
 
+sentry_envelope_t *
+sentry__prepare_event(const sentry_options_t *options, sentry_value_t event,
+    sentry_uuid_t *event_id, bool invoke_before_send,
+    sentry_scope_t *local_scope)
+{
+    return prepare_event(options, event, event_id, invoke_before_send,
+        local_scope, sentry_value_new_null());
+}
+
+sentry_envelope_t *
+sentry__prepare_event_from_skeleton(const sentry_options_t *options,
+    sentry_value_t event, sentry_value_t skeleton, bool invoke_before_send)
+{
+    return prepare_event(
+        options, event, NULL, invoke_before_send, NULL, skeleton);
+}
+
 sentry_envelope_t *
 sentry__prepare_transaction(const sentry_options_t *options,
     sentry_value_t transaction, sentry_uuid_t *event_id)
@@ -730,6 +811,7 @@ sentry__prepare_transaction(const sentry_options_t *options,
             & ~SENTRY_SCOPE_STACKTRACES;
         sentry__scope_apply_to_event(scope, options, transaction, mode);
     }
+    sentry__profiler_apply_to_transaction(transaction);
 
     if (options->before_transaction_func) {
         SENTRY_DEBUG("invoking `before_transaction` hook");
@@ -842,7 +924,7 @@ sentry_set_user(sentry_value_t user)
         sentry_options_t *options = sentry__options_lock();
         if (options && options->session) {
             sentry__session_sync_user(options->session, user);
-            sentry__run_write_session(options->run, options->session);
+            sentry__session_persist(options->run, options->session);
         }
         sentry__options_unlock();
     }
@@ -861,6 +943,12 @@ sentry_remove_user(void)
 void
 sentry_add_breadcrumb(sentry_value_t breadcrumb)
 {
+    // this appends to the lock-free ringbuffer of the global scope, and will
+    // avoid triggering *both* scope-change and breadcrumb-add events. The
+    // backend is notified afterwards, so it finds the breadcrumb in the scope.
+    sentry_value_incref(breadcrumb);
+    sentry__scope_add_breadcrumb(breadcrumb);
+
     SENTRY_WITH_OPTIONS (options) {
         if (options->backend && options->backend->add_breadcrumb_func) {
             // the hook will *not* take ownership
@@ -868,12 +956,7 @@ sentry_add_breadcrumb(sentry_value_t breadcrumb)
                 options->backend, breadcrumb, options);
         }
     }
-
-    // the `no_flush` will avoid triggering *both* scope-change and
-    // breadcrumb-add events.
-    SENTRY_WITH_SCOPE_MUT_NO_FLUSH (scope) {
-        sentry_scope_add_breadcrumb(scope, breadcrumb);
-    }
+    sentry_value_decref(breadcrumb);
 }
 
 void
@@ -1452,20 +1535,27 @@ sentry_span_finish_ts(sentry_span_t *opaque_span, uint64_t timestamp)
 
     sentry_value_t span = sentry__value_clone(opaque_span->inner);
 
-    SENTRY_WITH_SCOPE_MUT (scope) {
-        if (scope->span) {
-            sentry_value_t scope_span = scope->span->inner;
-
-            const char *span_id = sentry_value_as_string(
-                sentry_value_get_by_key(span, "span_id"));
-            const char *scope_span_id = sentry_value_as_string(
-                sentry_value_get_by_key(scope_span, "span_id"));
-            if (sentry__string_eq(span_id, scope_span_id)) {
-                sentry__span_decref(scope->span);
-                scope->span = NULL;
-            }
+    // the scope only changes, and needs a flush, if this is its span
+    sentry_scope_t *scope = sentry__scope_lock();
+    bool scope_changed = false;
+    if (scope->span) {
+        sentry_value_t scope_span = scope->span->inner;
+
+        const char *span_id
+            = sentry_value_as_string(sentry_value_get_by_key(span, "span_id"));
+        const char *scope_span_id = sentry_value_as_string(
+            sentry_value_get_by_key(scope_span, "span_id"));
+        if (sentry__string_eq(span_id, scope_span_id)) {
+            sentry__span_decref(scope->span);
+            scope->span = NULL;
+            scope_changed = true;
         }
     }
+    if (scope_changed) {
+        sentry__scope_flush_unlock();
+    } else {
+        sentry__scope_unlock();
+    }
 
     // Note that the current API makes it impossible to set a sampled value
     // that's different from the span's root transaction, but let's just be safe
@@ -61,6 +61,15 @@ sentry_envelope_t *sentry__prepare_event(const sentry_options_t *options,
     sentry_value_t event, sentry_uuid_t *event_id, bool invoke_before_send,
     sentry_scope_t *local_scope);
 
+/**
+ * This does the same as `sentry__prepare_event`, but applies the scope from a
+ * `skeleton` that was prebuilt by `sentry__scope_new_event_skeleton`. This is
+ * meant for crash handlers, which should do as little work as possible.
+ */
+sentry_envelope_t *sentry__prepare_event_from_skeleton(
+    const sentry_options_t *options, sentry_value_t event,
+    sentry_value_t skeleton, bool invoke_before_send);
+
 /**
  * Sends a sentry event, regardless of its type.
  */
@@ -92,6 +101,15 @@ sentry_envelope_t *sentry__prepare_transaction(const sentry_options_t *options,
 void sentry__capture_envelope(
     sentry_transport_t *transport, sentry_envelope_t *envelope);
 
+/**
+ * Submits the `envelope` like `sentry__capture_envelope`, but checks for
+ * consent on the given `options` instead of taking the options lock. This is
+ * meant for background threads that hold their own reference to the options,
+ * since `sentry_init` holds the options lock while shutting them down.
+ */
+void sentry__capture_envelope_with_options(
+    const sentry_options_t *options, sentry_envelope_t *envelope);
+
 /**
  * Generates a new random UUID for events.
  */
@@ -1,9 +1,14 @@
 #include "sentry_database.h"
 #include "sentry_alloc.h"
+#include "sentry_core.h"
 #include "sentry_envelope.h"
 #include "sentry_json.h"
 #include "sentry_options.h"
+#include "sentry_quota.h"
 #include "sentry_session.h"
+#include "sentry_string.h"
+#include "sentry_sync.h"
+#include "sentry_transport.h"
 #include "sentry_uuid.h"
 #include <errno.h>
 #include <string.h>
@@ -62,6 +67,7 @@ sentry__run_new(const sentry_path_t *database_path)
     run->run_path = run_path;
     run->session_path = session_path;
     run->external_path = external_path;
+    run->spool = NULL;
     run->lock = sentry__filelock_new(lock_path);
     if (!run->lock) {
         goto error;
@@ -72,6 +78,7 @@ sentry__run_new(const sentry_path_t *database_path)
         goto error;
     }
     sentry__path_create_dir_all(run->run_path);
+    run->spool = sentry__spool_new(run->run_path);
     return run;
 
 error:
@@ -82,7 +89,11 @@ error:
 void
 sentry__run_clean(sentry_run_t *run)
 {
+    // the open segment would otherwise be left behind
+    sentry__spool_free(run->spool);
+    run->spool = NULL;
     sentry__path_remove_all(run->run_path);
+    sentry__quota_untrack_dir(run->run_path);
     sentry__filelock_unlock(run->lock);
 }
 
@@ -95,6 +106,7 @@ sentry__run_free(sentry_run_t *run)
     sentry__path_free(run->run_path);
     sentry__path_free(run->session_path);
     sentry__path_free(run->external_path);
+    sentry__spool_free(run->spool);
     sentry__filelock_free(run->lock);
     sentry_free(run);
 }
@@ -122,20 +134,67 @@ write_envelope(const sentry_path_t *path, const sentry_envelope_t *envelope)
     }
 
     int rv = sentry_envelope_write_to_path(envelope, output_path);
-    sentry__path_free(output_path);
     if (rv) {
         SENTRY_WARN("writing envelope to file failed");
-        return false;
+    } else {
+        sentry__quota_track(output_path, sentry__path_get_size(output_path));
     }
+    sentry__path_free(output_path);
+    return !rv;
+}
 
-    return true;
+/**
+ * The envelope of a crash is picked up from the run directory by external
+ * tooling, so it is the one that still gets a file of its own.
+ */
+static bool
+is_crash_envelope(const sentry_envelope_t *envelope)
+{
+    sentry_value_t event = sentry_envelope_get_event(envelope);
+    return sentry__string_eq(
+        sentry_value_as_string(sentry_value_get_by_key(event, "level")),
+        "fatal");
 }
 
 bool
 sentry__run_write_envelope(
     const sentry_run_t *run, const sentry_envelope_t *envelope)
 {
-    return write_envelope(run->run_path, envelope);
+    if (is_crash_envelope(envelope) || !run->spool) {
+        return write_envelope(run->run_path, envelope);
+    }
+    // this might be the last thing the process does, so it is synced right
+    // away instead of in a batch
+    bool rv = sentry__run_spool_envelope(run, envelope);
+    sentry__run_sync_spool(run);
+    return rv;
+}
+
+bool
+sentry__run_spool_envelope(
+    const sentry_run_t *run, const sentry_envelope_t *envelope)
+{
+    if (!run->spool) {
+        return false;
+    }
+    size_t buf_len;
+    char *buf = sentry_envelope_serialize(envelope, &buf_len);
+    if (!buf) {
+        return false;
+    }
+    int rv = sentry__spool_append(run->spool, buf, buf_len);
+    sentry_free(buf);
+    if (rv) {
+        SENTRY_WARN("writing envelope to spool failed");
+        return false;
+    }
+    return true;
+}
+
+void
+sentry__run_sync_spool(const sentry_run_t *run)
+{
+    sentry__spool_sync(run->spool);
 }
 
 bool
@@ -181,37 +240,71 @@ sentry__run_clear_session(const sentry_run_t *run)
     return !rv;
 }
 
-void
-sentry__process_old_runs(const sentry_options_t *options, uint64_t last_crash)
+// the budget of a single tick of old run processing
+#define OLD_RUNS_FILES_PER_TICK 16
+#define OLD_RUNS_BYTES_PER_TICK (1024 * 1024)
+// the pause between two ticks, which keeps startup I/O low
+#define OLD_RUNS_TICK_INTERVAL_MS 20
+
+typedef struct {
+    sentry_options_t *options;
+    uint64_t last_crash;
+    sentry_pathiter_t *db_iter;
+    // the run that is currently being drained
+    sentry_path_t *run_dir;
+    sentry_filelock_t *run_lock;
+    sentry_spool_reader_t *run_spool;
+    sentry_pathiter_t *run_iter;
+    sentry_envelope_t *session_envelope;
+    size_t session_num;
+    sentry_threadid_t thread_id;
+    sentry_notify_t wakeup;
+    sentry_notify_t done;
+    volatile long draining;
+    volatile long stop;
+} old_runs_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_old_runs_lock)
+#else
+static sentry_mutex_t g_old_runs_lock = SENTRY__MUTEX_INIT;
+#endif
+static old_runs_t *g_old_runs = NULL;
+
+static void
+prune_external_dir(const sentry_path_t *external_dir)
 {
-    sentry_pathiter_t *db_iter
-        = sentry__path_iter_directory(options->database_path);
-    if (!db_iter) {
-        return;
+    // prune 1h old external crash report files
+    time_t now = time(NULL);
+    sentry_pathiter_t *it = sentry__path_iter_directory(external_dir);
+    const sentry_path_t *file;
+    while (it && (file = sentry__pathiter_next(it)) != NULL) {
+        time_t age = now - sentry__path_get_mtime(file);
+        if (age / 3600 > 0) {
+            sentry__path_remove(file);
+            sentry__quota_untrack(file);
+        }
     }
-    const sentry_path_t *run_dir;
-    sentry_envelope_t *session_envelope = NULL;
-    size_t session_num = 0;
+    sentry__pathiter_free(it);
+}
 
-    while ((run_dir = sentry__pathiter_next(db_iter)) != NULL) {
+/**
+ * Locks the next run directory of a previous process and starts iterating its
+ * files. Returns `false` once there are no more runs.
+ */
+static bool
+open_next_run(old_runs_t *old_runs)
+{
+    const sentry_path_t *run_dir;
+    while ((run_dir = sentry__pathiter_next(old_runs->db_iter)) != NULL) {
         // skip over other files such as the saved consent or the last_crash
         // timestamp
         if (!sentry__path_is_dir(run_dir)) {
             continue;
         }
 
-        // prune 1h old external crash report files
         if (sentry__path_filename_matches(run_dir, "external")) {
-            time_t now = time(NULL);
-            sentry_pathiter_t *it = sentry__path_iter_directory(run_dir);
-            const sentry_path_t *file;
-            while (it && (file = sentry__pathiter_next(it)) != NULL) {
-                time_t age = now - sentry__path_get_mtime(file);
-                if (age / 3600 > 0) {
-                    sentry__path_remove(file);
-                }
-            }
-            sentry__pathiter_free(it);
+            prune_external_dir(run_dir);
             continue;
         }
 
@@ -234,65 +327,244 @@ sentry__process_old_runs(const sentry_options_t *options, uint64_t last_crash)
             continue;
         }
         // make sure we don't delete ourselves if the lock check fails
-        if (strcmp(options->run->run_path->path, run_dir->path) == 0) {
+        if (strcmp(old_runs->options->run->run_path->path, run_dir->path)
+            == 0) {
             continue;
         }
-        sentry_pathiter_t *run_iter = sentry__path_iter_directory(run_dir);
-        const sentry_path_t *file;
-        while (run_iter && (file = sentry__pathiter_next(run_iter)) != NULL) {
-            if (sentry__path_filename_matches(file, "session.json")) {
-                if (!session_envelope) {
-                    session_envelope = sentry__envelope_new();
-                }
-                sentry_session_t *session = sentry__session_from_path(file);
-                if (session) {
-                    // this is just a heuristic: whenever the session was not
-                    // closed properly, and we do have a crash that happened
-                    // *after* the session was started, we will assume that the
-                    // crash corresponds to the session and flag it as crashed.
-                    // this should only happen when using crashpad, and there
-                    // should normally be only a single unclosed session at a
-                    // time.
-                    if (session->status == SENTRY_SESSION_STATUS_OK) {
-                        bool was_crash
-                            = last_crash && last_crash > session->started_us;
-                        if (was_crash) {
-                            session->duration_us
-                                = last_crash - session->started_us;
-                            session->errors += 1;
-                            // we only set at most one unclosed session as
-                            // crashed
-                            last_crash = 0;
-                        }
-                        session->status = was_crash
-                            ? SENTRY_SESSION_STATUS_CRASHED
-                            : SENTRY_SESSION_STATUS_ABNORMAL;
-                    }
-                    sentry__envelope_add_session(session_envelope, session);
-
-                    sentry__session_free(session);
-                    if ((++session_num) >= SENTRY_MAX_ENVELOPE_SESSIONS) {
-                        sentry__capture_envelope(
-                            options->transport, session_envelope);
-                        session_envelope = NULL;
-                        session_num = 0;
-                    }
-                }
-            } else if (sentry__path_ends_with(file, ".envelope")) {
-                sentry_envelope_t *envelope = sentry__envelope_from_path(file);
-                sentry__capture_envelope(options->transport, envelope);
+        old_runs->run_dir = sentry__path_clone(run_dir);
+        old_runs->run_lock = lock;
+        // the spool is drained before any of the files are iterated, since
+        // iterating removes them
+        old_runs->run_spool = sentry__spool_reader_new(run_dir);
+        if (!old_runs->run_spool) {
+            old_runs->run_iter = sentry__path_iter_directory(run_dir);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Unlocks the current run, removing it if all its files were processed.
+ */
+static void
+close_run(old_runs_t *old_runs, bool completed)
+{
+    if (!completed) {
+        sentry__spool_reader_commit(old_runs->run_spool);
+    }
+    sentry__spool_reader_free(old_runs->run_spool);
+    old_runs->run_spool = NULL;
+    sentry__pathiter_free(old_runs->run_iter);
+    old_runs->run_iter = NULL;
+    if (completed) {
+        sentry__path_remove_all(old_runs->run_dir);
+        sentry__quota_untrack_dir(old_runs->run_dir);
+    }
+    sentry__path_free(old_runs->run_dir);
+    old_runs->run_dir = NULL;
+    sentry__filelock_free(old_runs->run_lock);
+    old_runs->run_lock = NULL;
+}
+
+static void
+process_session(old_runs_t *old_runs, const sentry_path_t *file)
+{
+    if (!old_runs->session_envelope) {
+        old_runs->session_envelope = sentry__envelope_new();
+    }
+    sentry_session_t *session = sentry__session_from_path(file);
+    if (!session) {
+        return;
+    }
+    // this is just a heuristic: whenever the session was not closed properly,
+    // and we do have a crash that happened *after* the session was started,
+    // we will assume that the crash corresponds to the session and flag it as
+    // crashed. this should only happen when using crashpad, and there should
+    // normally be only a single unclosed session at a time.
+    if (session->status == SENTRY_SESSION_STATUS_OK) {
+        bool was_crash = old_runs->last_crash
+            && old_runs->last_crash > session->started_us;
+        if (was_crash) {
+            session->duration_us = old_runs->last_crash - session->started_us;
+            session->errors += 1;
+            // we only set at most one unclosed session as crashed
+            old_runs->last_crash = 0;
+        }
+        session->status = was_crash ? SENTRY_SESSION_STATUS_CRASHED
+                                    : SENTRY_SESSION_STATUS_ABNORMAL;
+    }
+    sentry__envelope_add_session(old_runs->session_envelope, session);
+
+    sentry__session_free(session);
+    if ((++old_runs->session_num) >= SENTRY_MAX_ENVELOPE_SESSIONS) {
+        sentry__capture_envelope_with_options(
+            old_runs->options, old_runs->session_envelope);
+        old_runs->session_envelope = NULL;
+        old_runs->session_num = 0;
+    }
+}
+
+/**
+ * Processes old run files until the budget of a tick is used up, returning
+ * `false` once all runs are done.
+ */
+static bool
+process_old_runs_tick(old_runs_t *old_runs)
+{
+    size_t files = 0;
+    size_t bytes = 0;
+    while (files < OLD_RUNS_FILES_PER_TICK && bytes < OLD_RUNS_BYTES_PER_TICK) {
+        if (sentry__atomic_fetch(&old_runs->stop)) {
+            return false;
+        }
+        if (!old_runs->run_dir && !open_next_run(old_runs)) {
+            return false;
+        }
+        if (old_runs->run_spool) {
+            size_t buf_len;
+            char *buf
+                = sentry__spool_reader_next(old_runs->run_spool, &buf_len);
+            if (!buf) {
+                sentry__spool_reader_free(old_runs->run_spool);
+                old_runs->run_spool = NULL;
+                old_runs->run_iter
+                    = sentry__path_iter_directory(old_runs->run_dir);
+                continue;
             }
+            bytes += buf_len;
+            files++;
+            sentry__capture_envelope_with_options(
+                old_runs->options, sentry__envelope_from_raw(buf, buf_len));
+            continue;
+        }
+        const sentry_path_t *file = old_runs->run_iter
+            ? sentry__pathiter_next(old_runs->run_iter)
+            : NULL;
+        if (!file) {
+            close_run(old_runs, true);
+            continue;
+        }
 
-            sentry__path_remove(file);
+        if (sentry__path_filename_matches(file, "session.json")) {
+            process_session(old_runs, file);
+        } else if (sentry__path_ends_with(file, ".envelope")) {
+            // the envelope is sent as is, without parsing it
+            bytes += sentry__path_get_size(file);
+            sentry_envelope_t *envelope = sentry__envelope_from_path(file);
+            sentry__capture_envelope_with_options(old_runs->options, envelope);
+        }
+        files++;
+
+        sentry__path_remove(file);
+        sentry__quota_untrack(file);
+    }
+    return true;
+}
+
+static void
+old_runs_free(old_runs_t *old_runs)
+{
+    sentry__notify_free(&old_runs->wakeup);
+    sentry__notify_free(&old_runs->done);
+    sentry__thread_free(&old_runs->thread_id);
+    sentry_options_free(old_runs->options);
+    sentry_free(old_runs);
+}
+
+static void
+process_old_runs(old_runs_t *old_runs)
+{
+    sentry__quota_scan(old_runs->options->database_path);
+    while (process_old_runs_tick(old_runs)) {
+        // a run that is interrupted continues after the last committed record
+        sentry__spool_reader_commit(old_runs->run_spool);
+        if (!sentry__atomic_fetch(&old_runs->draining)) {
+            sentry__notify_wait(&old_runs->wakeup, OLD_RUNS_TICK_INTERVAL_MS);
         }
-        sentry__pathiter_free(run_iter);
+    }
+    // a run that was not completed is picked up again on the next start
+    if (old_runs->run_dir) {
+        close_run(old_runs, false);
+    }
+    sentry__pathiter_free(old_runs->db_iter);
+    old_runs->db_iter = NULL;
+
+    sentry__capture_envelope_with_options(
+        old_runs->options, old_runs->session_envelope);
+    old_runs->session_envelope = NULL;
+}
+
+SENTRY_THREAD_FN
+old_runs_thread(void *data)
+{
+    old_runs_t *old_runs = data;
+    process_old_runs(old_runs);
+    SENTRY_DEBUG("finished processing old runs");
+    sentry__notify_raise(&old_runs->done);
+    return 0;
+}
+
+void
+sentry__process_old_runs_start(sentry_options_t *options, uint64_t last_crash)
+{
+    sentry_pathiter_t *db_iter
+        = sentry__path_iter_directory(options->database_path);
+    if (!db_iter) {
+        return;
+    }
+    old_runs_t *old_runs = SENTRY_MAKE(old_runs_t);
+    if (!old_runs) {
+        sentry__pathiter_free(db_iter);
+        return;
+    }
+    memset(old_runs, 0, sizeof(old_runs_t));
+    // the thread holds its own reference to the options, so that it keeps
+    // sending while `sentry_close` holds the options lock
+    old_runs->options = sentry__options_incref(options);
+    old_runs->last_crash = last_crash;
+    old_runs->db_iter = db_iter;
+    sentry__notify_init(&old_runs->wakeup);
+    sentry__notify_init(&old_runs->done);
+    sentry__thread_init(&old_runs->thread_id);
+
+    if (sentry__thread_spawn(&old_runs->thread_id, old_runs_thread, old_runs)
+        != 0) {
+        SENTRY_WARN("failed to start the old runs thread, processing inline");
+        sentry__atomic_store(&old_runs->draining, 1);
+        process_old_runs(old_runs);
+        old_runs_free(old_runs);
+        return;
+    }
 
-        sentry__path_remove_all(run_dir);
-        sentry__filelock_free(lock);
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_old_runs_lock);
+    sentry__mutex_lock(&g_old_runs_lock);
+    g_old_runs = old_runs;
+    sentry__mutex_unlock(&g_old_runs_lock);
+}
+
+void
+sentry__process_old_runs_shutdown(uint64_t timeout)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_old_runs_lock);
+    sentry__mutex_lock(&g_old_runs_lock);
+    old_runs_t *old_runs = g_old_runs;
+    g_old_runs = NULL;
+    sentry__mutex_unlock(&g_old_runs_lock);
+    if (!old_runs) {
+        return;
     }
-    sentry__pathiter_free(db_iter);
 
-    sentry__capture_envelope(options->transport, session_envelope);
+    // whatever is left is processed without pauses until the timeout, the
+    // rest stays on disk for the next start
+    sentry__atomic_store(&old_runs->draining, 1);
+    sentry__notify_raise(&old_runs->wakeup);
+    if (!sentry__notify_wait(&old_runs->done, timeout)) {
+        SENTRY_DEBUG("leaving the remaining old runs for the next start");
+        sentry__atomic_store(&old_runs->stop, 1);
+    }
+    sentry__thread_join(old_runs->thread_id);
+    old_runs_free(old_runs);
 }
 
 static const char *g_last_crash_filename = "last_crash";
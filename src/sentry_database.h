@@ -5,6 +5,7 @@
 
 #include "sentry_path.h"
 #include "sentry_session.h"
+#include "sentry_spool.h"
 
 typedef struct sentry_run_s {
     sentry_uuid_t uuid;
@@ -12,6 +13,7 @@ typedef struct sentry_run_s {
     sentry_path_t *session_path;
     sentry_path_t *external_path;
     sentry_filelock_t *lock;
+    sentry_spool_t *spool;
 } sentry_run_t;
 
 /**
@@ -19,6 +21,10 @@ typedef struct sentry_run_s {
  * lockfile:
  * * `<database>/<uuid>.run/`
  * * `<database>/<uuid>.run.lock`
+ *
+ * Envelopes that are written to the run are appended to its spool, which
+ * stores many envelopes in a few segment files:
+ * `<database>/<uuid>.run/spool-<n>.seg`
  */
 sentry_run_t *sentry__run_new(const sentry_path_t *database_path);
 
@@ -35,13 +41,27 @@ void sentry__run_clean(sentry_run_t *run);
 void sentry__run_free(sentry_run_t *run);
 
 /**
- * This will serialize and write the given envelope to disk into a file named
- * like so:
+ * This will serialize and write the given envelope to disk. The envelope of a
+ * crash is written into a file of its own, which external tooling expects,
+ * named like so:
  * `<database>/<uuid>.run/<event-uuid>.envelope`
+ * All other envelopes are appended to the spool of the run.
  */
 bool sentry__run_write_envelope(
     const sentry_run_t *run, const sentry_envelope_t *envelope);
 
+/**
+ * This will serialize and append the given envelope to the spool of the run.
+ * The records are flushed to disk in batches, see `sentry__run_sync_spool`.
+ */
+bool sentry__run_spool_envelope(
+    const sentry_run_t *run, const sentry_envelope_t *envelope);
+
+/**
+ * Flushes all envelopes that were appended to the spool of the run to disk.
+ */
+void sentry__run_sync_spool(const sentry_run_t *run);
+
 /**
  * This will serialize and write the given envelope to disk into a file named
  * like so:
@@ -66,17 +86,28 @@ bool sentry__run_clear_session(const sentry_run_t *run);
 /**
  * This function is essential to send crash reports from previous runs of the
  * program.
- * More specifically, this function will iterate over all the  directories
- * inside the `database_path`. Directories matching `<database>/<uuid>.run/`
- * will be locked, and any files named  `<event-uuid>.envelope` or
- * `session.json` will be queued for sending to the  backend. The files and
- * directories matching these criteria will be deleted afterwards.
+ * More specifically, this function will start a background thread that
+ * iterates over all the directories inside the `database_path`. Directories
+ * matching `<database>/<uuid>.run/` will be locked, and the envelopes in
+ * their spool, as well as any files named `<event-uuid>.envelope` or
+ * `session.json` will be queued for sending to the backend. The files and
+ * directories matching these criteria will be deleted afterwards. The thread
+ * processes a limited number of files and bytes at a time, with pauses in
+ * between, so that startup is not slowed down.
  * The following heuristic is applied to all unclosed sessions: If the session
  * was started before the timestamp given by `last_crash`, the session is closed
  * as "crashed" with an appropriate duration.
  */
-void sentry__process_old_runs(
-    const sentry_options_t *options, uint64_t last_crash);
+void sentry__process_old_runs_start(
+    sentry_options_t *options, uint64_t last_crash);
+
+/**
+ * Processes the remaining old runs without pauses for up to `timeout`
+ * milliseconds, and stops the background thread. Runs that were not processed
+ * by then are left for the next start. The caller takes the time this took
+ * out of the timeout of the transport shutdown.
+ */
+void sentry__process_old_runs_shutdown(uint64_t timeout);
 
 /**
  * This will write the current ISO8601 formatted timestamp into the
@@ -13,6 +13,10 @@
 #include <limits.h>
 #include <string.h>
 
+// the number of distinct frozen values memoized when serializing a log batch,
+// which comfortably covers the attributes shared by all logs
+#define LOGS_MEMO_CAPACITY 16
+
 struct sentry_envelope_item_s {
     sentry_value_t headers;
     sentry_value_t event;
@@ -111,7 +115,8 @@ envelope_item_get_ratelimiter_category(const sentry_envelope_item_t *item)
 {
     const char *ty = sentry_value_as_string(
         sentry_value_get_by_key(item->headers, "type"));
-    if (sentry__string_eq(ty, "session")) {
+    if (sentry__string_eq(ty, "session")
+        || sentry__string_eq(ty, "sessions")) {
         return SENTRY_RL_CATEGORY_SESSION;
     } else if (sentry__string_eq(ty, "transaction")) {
         return SENTRY_RL_CATEGORY_TRANSACTION;
@@ -179,8 +184,8 @@ sentry__envelope_set_header(
     sentry_value_set_by_key(envelope->contents.items.headers, key, value);
 }
 
-sentry_envelope_t *
-sentry__envelope_new(void)
+static sentry_envelope_t *
+envelope_new(void)
 {
     sentry_envelope_t *rv = SENTRY_MAKE(sentry_envelope_t);
     if (!rv) {
@@ -192,17 +197,43 @@ sentry__envelope_new(void)
     rv->contents.items.last_item = NULL;
     rv->contents.items.item_count = 0;
     rv->contents.items.headers = sentry_value_new_object();
+    return rv;
+}
+
+static void
+envelope_set_dsn(sentry_envelope_t *envelope, const sentry_dsn_t *dsn)
+{
+    if (dsn && dsn->is_valid) {
+        sentry__envelope_set_header(
+            envelope, "dsn", sentry_value_new_string(dsn->raw));
+    }
+}
+
+sentry_envelope_t *
+sentry__envelope_new(void)
+{
+    sentry_envelope_t *rv = envelope_new();
+    if (!rv) {
+        return NULL;
+    }
 
     SENTRY_WITH_OPTIONS (options) {
-        if (options->dsn && options->dsn->is_valid) {
-            sentry__envelope_set_header(rv, "dsn",
-                sentry_value_new_string(sentry_options_get_dsn(options)));
-        }
+        envelope_set_dsn(rv, options->dsn);
     }
 
     return rv;
 }
 
+sentry_envelope_t *
+sentry__envelope_new_with_dsn(const sentry_dsn_t *dsn)
+{
+    sentry_envelope_t *rv = envelope_new();
+    if (rv) {
+        envelope_set_dsn(rv, dsn);
+    }
+    return rv;
+}
+
 sentry_envelope_t *
 sentry__envelope_from_path(const sentry_path_t *path)
 {
@@ -212,7 +243,12 @@ sentry__envelope_from_path(const sentry_path_t *path)
         SENTRY_WARNF("failed to read raw envelope from \"%s\"", path->path);
         return NULL;
     }
+    return sentry__envelope_from_raw(buf, buf_len);
+}
 
+sentry_envelope_t *
+sentry__envelope_from_raw(char *buf, size_t buf_len)
+{
     sentry_envelope_t *envelope = SENTRY_MAKE(sentry_envelope_t);
     if (!envelope) {
         sentry_free(buf);
@@ -244,6 +280,112 @@ sentry__envelope_set_event_id(
     sentry__envelope_set_header(envelope, "event_id", value);
 }
 
+/**
+ * The items of an envelope that limit with which other envelopes it can be
+ * coalesced.
+ */
+typedef struct {
+    size_t transactions;
+    size_t logs;
+    size_t sessions;
+    size_t bytes;
+} coalesce_counts_t;
+
+/**
+ * Counts the items of `envelope` into `counts`. Returns `false` if the
+ * envelope contains any item that must not be coalesced.
+ */
+static bool
+count_coalescable_items(
+    const sentry_envelope_t *envelope, coalesce_counts_t *counts)
+{
+    if (envelope->is_raw) {
+        return false;
+    }
+    for (const sentry_envelope_item_t *item
+        = envelope->contents.items.first_item;
+        item; item = item->next) {
+        const char *ty = sentry_value_as_string(
+            sentry_value_get_by_key(item->headers, "type"));
+        if (sentry__string_eq(ty, "transaction")) {
+            counts->transactions++;
+        } else if (sentry__string_eq(ty, "log")) {
+            counts->logs++;
+        } else if (sentry__string_eq(ty, "session")
+            || sentry__string_eq(ty, "sessions")) {
+            counts->sessions++;
+        } else if (!sentry__string_eq(ty, "client_report")) {
+            return false;
+        }
+        counts->bytes += item->payload_len;
+    }
+    return true;
+}
+
+bool
+sentry__envelope_is_coalescable(const sentry_envelope_t *envelope)
+{
+    coalesce_counts_t counts = { 0, 0, 0, 0 };
+    return count_coalescable_items(envelope, &counts)
+        && envelope->contents.items.item_count > 0;
+}
+
+bool
+sentry__envelope_has_coalesce_room(const sentry_envelope_t *envelope)
+{
+    coalesce_counts_t counts = { 0, 0, 0, 0 };
+    return count_coalescable_items(envelope, &counts)
+        && envelope->contents.items.item_count > 0 && !counts.transactions
+        && !counts.logs && counts.sessions * 2 <= SENTRY_MAX_ENVELOPE_SESSIONS;
+}
+
+bool
+sentry__envelope_coalesce(
+    sentry_envelope_t *envelope, sentry_envelope_t *other, size_t max_bytes)
+{
+    coalesce_counts_t counts = { 0, 0, 0, 0 };
+    if (!count_coalescable_items(envelope, &counts)
+        || !count_coalescable_items(other, &counts)) {
+        return false;
+    }
+    // an envelope may carry at most one event-like item, which a transaction
+    // is, and a single container of logs
+    if (counts.transactions > 1 || counts.logs > 1
+        || counts.sessions > SENTRY_MAX_ENVELOPE_SESSIONS
+        || counts.bytes > max_bytes) {
+        return false;
+    }
+
+    // the headers that are specific to a transaction move along with it,
+    // while the `dsn` is the same for all envelopes of a transport
+    static const char *const headers[] = { "event_id", "trace", "sent_at" };
+    for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); i++) {
+        sentry_value_t value = sentry_value_get_by_key(
+            other->contents.items.headers, headers[i]);
+        if (!sentry_value_is_null(value)
+            && sentry_value_is_null(sentry_value_get_by_key(
+                envelope->contents.items.headers, headers[i]))) {
+            sentry_value_incref(value);
+            sentry__envelope_set_header(envelope, headers[i], value);
+        }
+    }
+
+    if (envelope->contents.items.last_item) {
+        envelope->contents.items.last_item->next
+            = other->contents.items.first_item;
+    } else {
+        envelope->contents.items.first_item = other->contents.items.first_item;
+    }
+    if (other->contents.items.last_item) {
+        envelope->contents.items.last_item = other->contents.items.last_item;
+    }
+    envelope->contents.items.item_count += other->contents.items.item_count;
+    other->contents.items.first_item = NULL;
+    other->contents.items.last_item = NULL;
+    other->contents.items.item_count = 0;
+    return true;
+}
+
 sentry_value_t
 sentry_envelope_get_event(const sentry_envelope_t *envelope)
 {
@@ -441,29 +583,44 @@ sentry__envelope_add_transaction(
 }
 
 sentry_envelope_item_t *
-sentry__envelope_add_logs(sentry_envelope_t *envelope, sentry_value_t logs)
+sentry__envelope_add_logs(sentry_envelope_t *envelope,
+    const sentry_value_t *logs, size_t count, size_t size_hint)
 {
     sentry_envelope_item_t *item = envelope_add_item(envelope);
     if (!item) {
         return NULL;
     }
 
-    sentry_jsonwriter_t *jw = sentry__jsonwriter_new_sb(NULL);
+    sentry_stringbuilder_t sb;
+    sentry__stringbuilder_init(&sb);
+    sentry__stringbuilder_reserve(&sb, size_hint);
+    sentry_jsonwriter_t *jw = sentry__jsonwriter_new_sb(&sb);
     if (!jw) {
+        sentry__stringbuilder_cleanup(&sb);
         return NULL;
     }
+    sentry__jsonwriter_enable_memo(jw, LOGS_MEMO_CAPACITY);
 
-    sentry__jsonwriter_write_value(jw, logs);
-    item->payload = sentry__jsonwriter_into_string(jw, &item->payload_len);
+    sentry__jsonwriter_write_object_start(jw);
+    sentry__jsonwriter_write_key(jw, "items");
+    sentry__jsonwriter_write_list_start(jw);
+    for (size_t i = 0; i < count; i++) {
+        sentry__jsonwriter_write_value(jw, logs[i]);
+    }
+    sentry__jsonwriter_write_list_end(jw);
+    sentry__jsonwriter_write_object_end(jw);
+    sentry__jsonwriter_free(jw);
+
+    item->payload_len = sb.len;
+    item->payload = sentry__stringbuilder_into_string(&sb);
     if (!item->payload) {
         return NULL;
     }
 
     sentry__envelope_item_set_header(
         item, "type", sentry_value_new_string("log"));
-    sentry__envelope_item_set_header(item, "item_count",
-        sentry_value_new_int32((int32_t)sentry_value_get_length(
-            sentry_value_get_by_key(logs, "items"))));
+    sentry__envelope_item_set_header(
+        item, "item_count", sentry_value_new_int32((int32_t)count));
     sentry__envelope_item_set_header(item, "content_type",
         sentry_value_new_string("application/vnd.sentry.items.log+json"));
     sentry_value_t length = sentry_value_new_int32((int32_t)item->payload_len);
@@ -505,6 +662,39 @@ sentry__envelope_add_user_report(
     return item;
 }
 
+sentry_envelope_item_t *
+sentry__envelope_add_profile_chunk(
+    sentry_envelope_t *envelope, sentry_value_t profile_chunk)
+{
+    sentry_envelope_item_t *item = envelope_add_item(envelope);
+    if (!item) {
+        return NULL;
+    }
+
+    sentry_jsonwriter_t *jw = sentry__jsonwriter_new_sb(NULL);
+    if (!jw) {
+        return NULL;
+    }
+
+    sentry__jsonwriter_write_value(jw, profile_chunk);
+    item->payload = sentry__jsonwriter_into_string(jw, &item->payload_len);
+    if (!item->payload) {
+        return NULL;
+    }
+
+    sentry__envelope_item_set_header(
+        item, "type", sentry_value_new_string("profile_chunk"));
+    // the platform decides how the chunk is rate limited and ingested
+    sentry_value_t platform
+        = sentry_value_get_by_key(profile_chunk, "platform");
+    sentry_value_incref(platform);
+    sentry__envelope_item_set_header(item, "platform", platform);
+    sentry_value_t length = sentry_value_new_int32((int32_t)item->payload_len);
+    sentry__envelope_item_set_header(item, "length", length);
+
+    return item;
+}
+
 sentry_envelope_item_t *
 sentry__envelope_add_user_feedback(
     sentry_envelope_t *envelope, sentry_value_t user_feedback)
@@ -549,6 +739,26 @@ sentry__envelope_add_session(
         envelope, payload, payload_len, "session");
 }
 
+sentry_envelope_item_t *
+sentry__envelope_add_session_aggregates(
+    sentry_envelope_t *envelope, sentry_value_t aggregates)
+{
+    if (!envelope || sentry_value_is_null(aggregates)) {
+        return NULL;
+    }
+    sentry_jsonwriter_t *jw = sentry__jsonwriter_new_sb(NULL);
+    if (!jw) {
+        return NULL;
+    }
+    sentry__jsonwriter_write_value(jw, aggregates);
+    size_t payload_len = 0;
+    char *payload = sentry__jsonwriter_into_string(jw, &payload_len);
+
+    // NOTE: function will check for `payload` internally and free it on error
+    return envelope_add_from_owned_buffer(
+        envelope, payload, payload_len, "sessions");
+}
+
 static const char *
 str_from_attachment_type(sentry_attachment_type_t attachment_type)
 {
@@ -1020,6 +1230,7 @@ sentry__envelope_item_get_header(
 {
     return sentry_value_get_by_key(item->headers, key);
 }
+#endif
 
 const char *
 sentry__envelope_item_get_payload(
@@ -1030,4 +1241,3 @@ sentry__envelope_item_get_payload(
     }
     return item->payload;
 }
-#endif
@@ -20,11 +20,25 @@ typedef struct sentry_envelope_item_s sentry_envelope_item_t;
  */
 sentry_envelope_t *sentry__envelope_new(void);
 
+/**
+ * Create a new empty envelope with the given `dsn` header, without looking at
+ * the global options. Background threads that hold their own reference to
+ * the options use this, as the options lock might be held by whoever is
+ * waiting for them.
+ */
+sentry_envelope_t *sentry__envelope_new_with_dsn(const sentry_dsn_t *dsn);
+
 /**
  * This loads a previously serialized envelope from disk.
  */
 sentry_envelope_t *sentry__envelope_from_path(const sentry_path_t *path);
 
+/**
+ * Creates an envelope from a previously serialized envelope in `buf`, taking
+ * ownership of the buffer. The envelope is sent as is, without parsing it.
+ */
+sentry_envelope_t *sentry__envelope_from_raw(char *buf, size_t buf_len);
+
 /**
  * This returns the UUID of the event associated with this envelope.
  * If there is no event inside this envelope, or the envelope was previously
@@ -38,6 +52,31 @@ sentry_uuid_t sentry__envelope_get_event_id(const sentry_envelope_t *envelope);
 void sentry__envelope_set_event_id(
     sentry_envelope_t *envelope, const sentry_uuid_t *event_id);
 
+/**
+ * Returns `true` if `envelope` only contains items that may be sent together
+ * with the items of other envelopes: transactions, logs, sessions, session
+ * aggregates and client reports.
+ */
+bool sentry__envelope_is_coalescable(const sentry_envelope_t *envelope);
+
+/**
+ * Returns `true` if another envelope with the same items as `envelope` could
+ * still be coalesced into it. This is not the case for transactions and logs,
+ * since an envelope carries at most one of each.
+ */
+bool sentry__envelope_has_coalesce_room(const sentry_envelope_t *envelope);
+
+/**
+ * Moves all items of `other` to the end of `envelope`, leaving `other` empty.
+ *
+ * This only happens if both envelopes are coalescable, the merged envelope
+ * still has at most one transaction, one log item and the maximum number of
+ * sessions, and the payloads of its items add up to at most `max_bytes`.
+ * Returns `true` if the items were moved.
+ */
+bool sentry__envelope_coalesce(
+    sentry_envelope_t *envelope, sentry_envelope_t *other, size_t max_bytes);
+
 /**
  * Add an event to this envelope.
  */
@@ -57,10 +96,20 @@ sentry_envelope_item_t *sentry__envelope_add_user_report(
     sentry_envelope_t *envelope, sentry_value_t user_report);
 
 /**
- * Add a list of logs to this envelope.
+ * Add a batch of `count` logs to this envelope, as a single `log` item.
+ *
+ * The logs are serialized straight into a buffer pre-sized to `size_hint`
+ * bytes. Frozen attribute objects which are shared between the logs are only
+ * serialized once and copied for every further occurrence.
+ */
+sentry_envelope_item_t *sentry__envelope_add_logs(sentry_envelope_t *envelope,
+    const sentry_value_t *logs, size_t count, size_t size_hint);
+
+/**
+ * Add a profile chunk to this envelope.
  */
-sentry_envelope_item_t *sentry__envelope_add_logs(
-    sentry_envelope_t *envelope, sentry_value_t logs);
+sentry_envelope_item_t *sentry__envelope_add_profile_chunk(
+    sentry_envelope_t *envelope, sentry_value_t profile_chunk);
 
 /**
  * Add a user feedback to this envelope.
@@ -74,6 +123,13 @@ sentry_envelope_item_t *sentry__envelope_add_user_feedback(
 sentry_envelope_item_t *sentry__envelope_add_session(
     sentry_envelope_t *envelope, const sentry_session_t *session);
 
+/**
+ * Add a `sessions` item with the given session `aggregates` payload to this
+ * envelope.
+ */
+sentry_envelope_item_t *sentry__envelope_add_session_aggregates(
+    sentry_envelope_t *envelope, sentry_value_t aggregates);
+
 /**
  * Add an attachment to this envelope.
  */
@@ -129,6 +185,13 @@ void sentry__envelope_serialize_into_stringbuilder(
 MUST_USE int sentry_envelope_write_to_path(
     const sentry_envelope_t *envelope, const sentry_path_t *path);
 
+/**
+ * Returns the payload of an envelope item, writing its size into
+ * `payload_len_out`.
+ */
+const char *sentry__envelope_item_get_payload(
+    const sentry_envelope_item_t *item, size_t *payload_len_out);
+
 // these for now are only needed for tests
 #ifdef SENTRY_UNITTEST
 size_t sentry__envelope_get_item_count(const sentry_envelope_t *envelope);
@@ -136,8 +199,6 @@ const sentry_envelope_item_t *sentry__envelope_get_item(
     const sentry_envelope_t *envelope, size_t idx);
 sentry_value_t sentry__envelope_item_get_header(
     const sentry_envelope_item_t *item, const char *key);
-const char *sentry__envelope_item_get_payload(
-    const sentry_envelope_item_t *item, size_t *payload_len_out);
 #endif
 
 #endif
@@ -21,6 +21,10 @@
 #include "sentry_utils.h"
 #include "sentry_value.h"
 
+#ifdef SENTRY_PLATFORM_UNIX
+#    include <unistd.h>
+#endif
+
 typedef struct {
     void (*free)(sentry_jsonwriter_t *writer);
     void (*write_str)(sentry_jsonwriter_t *writer, const char *str);
@@ -29,16 +33,37 @@ typedef struct {
     char *(*into_string)(sentry_jsonwriter_t *jw, size_t *len_out);
 } sentry_jsonwriter_ops_t;
 
+/**
+ * Where a memoized frozen value was first written to the output, see
+ * `sentry__jsonwriter_enable_memo`.
+ */
+typedef struct {
+    const void *key;
+    size_t offset;
+    size_t len;
+} memo_entry_t;
+
 struct sentry_jsonwriter_s {
     union {
         sentry_stringbuilder_t *sb;
         sentry_filewriter_t *fw;
+#ifdef SENTRY_PLATFORM_UNIX
+        struct {
+            char *buf;
+            size_t len;
+            size_t cap;
+            int fd;
+        } fd;
+#endif
     } output;
     uint64_t want_comma;
     uint32_t depth;
     bool last_was_key;
     bool owns_sb;
     sentry_jsonwriter_ops_t *ops;
+    memo_entry_t *memo;
+    size_t memo_len;
+    size_t memo_cap;
 };
 
 static void
@@ -152,6 +177,9 @@ sentry__jsonwriter_new_sb(sentry_stringbuilder_t *sb)
     rv->output.sb = sb;
     rv->want_comma = 0;
     rv->depth = 0;
+    rv->memo = NULL;
+    rv->memo_len = 0;
+    rv->memo_cap = 0;
     rv->last_was_key = 0;
     rv->owns_sb = owns_sb;
     rv->ops = &sb_ops;
@@ -178,15 +206,137 @@ sentry__jsonwriter_new_fw(sentry_filewriter_t *fw)
     rv->output.fw = fw;
     rv->want_comma = 0;
     rv->depth = 0;
+    rv->memo = NULL;
+    rv->memo_len = 0;
+    rv->memo_cap = 0;
     rv->last_was_key = 0;
     rv->owns_sb = owns_sb;
     rv->ops = &file_ops;
     return rv;
 }
 
+#ifdef SENTRY_PLATFORM_UNIX
+static void
+jsonwriter_free_fd(sentry_jsonwriter_t *jw)
+{
+    if (!jw) {
+        return;
+    }
+    sentry_free(jw->output.fd.buf);
+    sentry_free(jw);
+}
+
+static void
+write_buf_fd(sentry_jsonwriter_t *jw, const char *buf, size_t len)
+{
+    while (len > 0) {
+        if (jw->output.fd.len == jw->output.fd.cap) {
+            sentry__jsonwriter_flush(jw);
+        }
+        size_t space = jw->output.fd.cap - jw->output.fd.len;
+        size_t n = len < space ? len : space;
+        memcpy(jw->output.fd.buf + jw->output.fd.len, buf, n);
+        jw->output.fd.len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void
+write_char_fd(sentry_jsonwriter_t *jw, char c)
+{
+    write_buf_fd(jw, &c, sizeof(char));
+}
+
+static void
+write_str_fd(sentry_jsonwriter_t *jw, const char *str)
+{
+    write_buf_fd(jw, str, strlen(str));
+}
+
+static char *
+into_string_fd(sentry_jsonwriter_t *UNUSED(jw), size_t *len_out)
+{
+    UNREACHABLE("A fd-based jsonwriter can't convert into string");
+
+    *len_out = 0;
+    return NULL;
+}
+
+static sentry_jsonwriter_ops_t fd_ops = {
+    .free = jsonwriter_free_fd,
+    .write_char = write_char_fd,
+    .write_str = write_str_fd,
+    .write_buf = write_buf_fd,
+    .into_string = into_string_fd,
+};
+
+sentry_jsonwriter_t *
+sentry__jsonwriter_new_fd(size_t buf_len)
+{
+    if (!buf_len) {
+        return NULL;
+    }
+    sentry_jsonwriter_t *rv = SENTRY_MAKE(sentry_jsonwriter_t);
+    if (!rv) {
+        return NULL;
+    }
+    rv->output.fd.buf = sentry_malloc(buf_len);
+    if (!rv->output.fd.buf) {
+        sentry_free(rv);
+        return NULL;
+    }
+
+    rv->output.fd.len = 0;
+    rv->output.fd.cap = buf_len;
+    rv->output.fd.fd = -1;
+    rv->want_comma = 0;
+    rv->depth = 0;
+    rv->memo = NULL;
+    rv->memo_len = 0;
+    rv->memo_cap = 0;
+    rv->last_was_key = 0;
+    rv->owns_sb = false;
+    rv->ops = &fd_ops;
+    return rv;
+}
+
+void
+sentry__jsonwriter_set_fd(sentry_jsonwriter_t *jw, int fd)
+{
+    jw->output.fd.fd = fd;
+    jw->output.fd.len = 0;
+    sentry__jsonwriter_reset(jw);
+}
+
+int
+sentry__jsonwriter_flush(sentry_jsonwriter_t *jw)
+{
+    const char *buf = jw->output.fd.buf;
+    size_t remaining = jw->output.fd.len;
+    jw->output.fd.len = 0;
+    if (jw->output.fd.fd < 0) {
+        return remaining ? 1 : 0;
+    }
+
+    while (remaining > 0) {
+        ssize_t n = write(jw->output.fd.fd, buf, remaining);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        buf += n;
+        remaining -= (size_t)n;
+    }
+    return remaining ? 1 : 0;
+}
+#endif
+
 void
 sentry__jsonwriter_free(sentry_jsonwriter_t *jw)
 {
+    sentry_free(jw->memo);
     jw->ops->free(jw);
 }
 
@@ -204,12 +354,29 @@ sentry__jsonwriter_into_string(sentry_jsonwriter_t *jw, size_t *len_out)
     return jw->ops->into_string(jw, len_out);
 }
 
+void
+sentry__jsonwriter_write_raw(
+    sentry_jsonwriter_t *jw, const char *buf, size_t len)
+{
+    jw->ops->write_buf(jw, buf, len);
+}
+
 static bool
 at_max_depth(const sentry_jsonwriter_t *jw)
 {
     return jw->depth >= 64;
 }
 
+void
+sentry__jsonwriter_enable_memo(sentry_jsonwriter_t *jw, size_t capacity)
+{
+    if (jw->ops != &sb_ops || jw->memo) {
+        return;
+    }
+    jw->memo = sentry_malloc(sizeof(memo_entry_t) * capacity);
+    jw->memo_cap = jw->memo ? capacity : 0;
+}
+
 static void
 set_comma(sentry_jsonwriter_t *jw, bool val)
 {
@@ -342,6 +509,69 @@ can_write_item(sentry_jsonwriter_t *jw)
     return true;
 }
 
+bool
+sentry__jsonwriter_write_memoized(sentry_jsonwriter_t *jw, const void *key)
+{
+    for (size_t i = 0; i < jw->memo_len; i++) {
+        const memo_entry_t *entry = &jw->memo[i];
+        if (entry->key != key) {
+            continue;
+        }
+        if (!can_write_item(jw)) {
+            return true;
+        }
+        // reserve first: the source is the very buffer we are appending to
+        sentry_stringbuilder_t *sb = jw->output.sb;
+        char *dst = sentry__stringbuilder_reserve(sb, entry->len + 1);
+        if (dst) {
+            memcpy(dst, sb->buf + entry->offset, entry->len);
+            sb->len += entry->len;
+            sb->buf[sb->len] = '\0';
+        }
+        return true;
+    }
+    return false;
+}
+
+size_t
+sentry__jsonwriter_memo_start(const sentry_jsonwriter_t *jw)
+{
+    // this is called right after opening the object or list, so the opening
+    // bracket is the last character written
+    if (!jw->memo_cap || !jw->output.sb->len) {
+        return 0;
+    }
+    return jw->output.sb->len - 1;
+}
+
+void
+sentry__jsonwriter_memoize(
+    sentry_jsonwriter_t *jw, const void *key, size_t start)
+{
+    // nothing was written if we closed a value beyond the maximum depth
+    if (jw->memo_len >= jw->memo_cap || at_max_depth(jw)) {
+        return;
+    }
+    memo_entry_t *entry = &jw->memo[jw->memo_len++];
+    entry->key = key;
+    entry->offset = start;
+    entry->len = jw->output.sb->len - start;
+}
+
+bool
+sentry__jsonwriter_write_serialized(
+    sentry_jsonwriter_t *jw, const char *json, size_t len, size_t depth)
+{
+    // the writer would have cut off the innermost items of the value
+    if (jw->depth + depth >= 64) {
+        return false;
+    }
+    if (can_write_item(jw)) {
+        jw->ops->write_buf(jw, json, len);
+    }
+    return true;
+}
+
 void
 sentry__jsonwriter_write_null(sentry_jsonwriter_t *jw)
 {
@@ -22,6 +22,31 @@ sentry_jsonwriter_t *sentry__jsonwriter_new_sb(sentry_stringbuilder_t *sb);
  */
 sentry_jsonwriter_t *sentry__jsonwriter_new_fw(sentry_filewriter_t *fw);
 
+#ifdef SENTRY_PLATFORM_UNIX
+/**
+ * This creates a new JSON writer.
+ *
+ * It serializes into a fixed-size buffer of `buf_len` bytes, which is written
+ * to a file descriptor (see `sentry__jsonwriter_set_fd`) whenever it fills up.
+ * All memory is allocated here, so that re-targeting, writing and flushing the
+ * writer afterwards is async-signal-safe.
+ */
+sentry_jsonwriter_t *sentry__jsonwriter_new_fd(size_t buf_len);
+
+/**
+ * Points a writer created by `sentry__jsonwriter_new_fd` at `fd`, dropping any
+ * unflushed output and resetting its internal state. The writer does not take
+ * ownership of `fd`.
+ */
+void sentry__jsonwriter_set_fd(sentry_jsonwriter_t *jw, int fd);
+
+/**
+ * Writes all buffered output of a writer created by `sentry__jsonwriter_new_fd`
+ * to its file descriptor. Returns 0 on success.
+ */
+int sentry__jsonwriter_flush(sentry_jsonwriter_t *jw);
+#endif
+
 /**
  * Deallocates a JSON writer.
  */
@@ -38,6 +63,49 @@ void sentry__jsonwriter_reset(sentry_jsonwriter_t *jw);
  */
 char *sentry__jsonwriter_into_string(sentry_jsonwriter_t *jw, size_t *len_out);
 
+/**
+ * Write `buf` verbatim, bypassing the JSON structure tracking. This is meant
+ * for separators between top-level values, like the newlines in an envelope.
+ */
+void sentry__jsonwriter_write_raw(
+    sentry_jsonwriter_t *jw, const char *buf, size_t len);
+
+/**
+ * Makes a writer backed by a string builder remember where it wrote up to
+ * `capacity` frozen objects and lists. Any further occurrence of the same
+ * frozen value is then copied from the existing output instead of being
+ * serialized again. Frozen values can't change, so this is only a matter of
+ * identity.
+ */
+void sentry__jsonwriter_enable_memo(sentry_jsonwriter_t *jw, size_t capacity);
+
+/**
+ * Writes the output memoized for `key`, returning `false` if there is none.
+ */
+bool sentry__jsonwriter_write_memoized(
+    sentry_jsonwriter_t *jw, const void *key);
+
+/**
+ * Returns the start offset to pass to `sentry__jsonwriter_memoize` when called
+ * right after opening an object or list.
+ */
+size_t sentry__jsonwriter_memo_start(const sentry_jsonwriter_t *jw);
+
+/**
+ * Memoizes everything written since `start` as the output for `key`, if there
+ * is still room for it.
+ */
+void sentry__jsonwriter_memoize(
+    sentry_jsonwriter_t *jw, const void *key, size_t start);
+
+/**
+ * Writes `json`, the serialized form of a value with `depth` levels of nested
+ * objects and lists, as the next item. Returns `false` without writing
+ * anything if the value would exceed the maximum depth at this position.
+ */
+bool sentry__jsonwriter_write_serialized(
+    sentry_jsonwriter_t *jw, const char *json, size_t len, size_t depth);
+
 /**
  * Write a `null` into the JSON.
  */
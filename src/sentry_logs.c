@@ -2,27 +2,47 @@
 #include "sentry_core.h"
 #include "sentry_cpu_relax.h"
 #include "sentry_envelope.h"
+#include "sentry_json.h"
 #include "sentry_options.h"
 #include "sentry_os.h"
 #include "sentry_scope.h"
 #include "sentry_sync.h"
+#include "sentry_uuid.h"
+#include "sentry_value.h"
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
-#ifdef SENTRY_UNITTEST
-#    define QUEUE_LENGTH 5
-#else
-#    define QUEUE_LENGTH 100
-#endif
 #define FLUSH_TIMER 5
 
+// After a flush the batching thread keeps swapping and flushing as long as the
+// active buffer is filled to the low watermark, so that producers under high
+// contention don't run into a full buffer while the thread goes back to sleep.
+#define FLUSH_LOW_WATERMARK (SENTRY_LOGS_QUEUE_LENGTH / 2)
+
+// initial guess of the serialized size of a log, refined with every batch
+#define INITIAL_LOG_SIZE_HINT 512
+
+// number of message templates that can be rate limited at the same time, and
+// how many slots are probed before giving up on limiting a template
+#define TEMPLATE_LIMIT_SLOTS 256
+#define TEMPLATE_LIMIT_PROBES 8
+
 #ifdef SENTRY_PLATFORM_WINDOWS
 #    include <windows.h>
 #    define sleep_ms(MILLISECONDS) Sleep(MILLISECONDS)
 #else
+#    include <fcntl.h>
+#    include <sys/stat.h>
 #    include <unistd.h>
 #    define sleep_ms(MILLISECONDS) usleep(MILLISECONDS * 1000)
 #endif
+
+// size of the preallocated buffer used to serialize logs during a crash
+#define CRASH_WRITER_BUFFER_SIZE 4096
+// how long a crash waits for a flush that is in progress on another thread
+#define CRASH_FLUSH_LOCK_TIMEOUT_MS 10
+
 /**
  * Thread lifecycle states for the logs batching thread.
  */
@@ -36,19 +56,45 @@ typedef enum {
 } sentry_logs_thread_state_t;
 
 typedef struct {
-    sentry_value_t logs[QUEUE_LENGTH];
+    sentry_value_t logs[SENTRY_LOGS_QUEUE_LENGTH];
     long index; // (atomic) index for producer threads to get a unique slot
     long adding; // (atomic) count of in-flight writers on this buffer
     long sealed; // (atomic) 0=writeable, 1=sealed (meaning we drop)
 } log_buffer_t;
 
+/**
+ * Rate limiting state of a single message template. `key` is the (truncated)
+ * address of its format string, and `count` is the number of logs seen in the
+ * one-second `window`.
+ */
+typedef struct {
+    long key;
+    long window;
+    long count;
+} template_limit_t;
+
+static long g_sample_counters[SENTRY_LOG_LEVEL_COUNT];
+static template_limit_t g_template_limits[TEMPLATE_LIMIT_SLOTS];
+
 static struct {
     log_buffer_t buffers[2]; // double buffer
     long active_idx; // (atomic) index to the active buffer
     long flushing; // (atomic) reentrancy guard to the flusher
     long thread_state; // (atomic) sentry_logs_thread_state_t
-    sentry_cond_t request_flush; // condition variable to schedule a flush
+    size_t bytes_per_log; // size hint for serializing a batch, flusher only
+    sentry_notify_t request_flush; // level-triggered flag to schedule a flush
+    bool request_flush_initialized;
     sentry_threadid_t batching_thread; // the batching thread
+#ifdef SENTRY_PLATFORM_UNIX
+    // preallocated at startup, so that a crash can write logs without
+    // allocating
+    sentry_jsonwriter_t *crash_writer;
+    sentry_path_t *crash_envelope_path;
+    // also opened at startup, and renamed to `crash_envelope_path` once a
+    // crash has written logs into it
+    sentry_path_t *crash_temp_path;
+    int crash_fd;
+#endif
 } g_logs_state = {
     {
         {
@@ -65,6 +111,10 @@ static struct {
     .active_idx = 0,
     .flushing = 0,
     .thread_state = SENTRY_LOGS_THREAD_STOPPED,
+    .bytes_per_log = INITIAL_LOG_SIZE_HINT,
+#ifdef SENTRY_PLATFORM_UNIX
+    .crash_fd = -1,
+#endif
 };
 
 // checks whether the currently active buffer should be flushed.
@@ -80,96 +130,100 @@ check_for_flush_condition(void)
     long current_active = sentry__atomic_fetch(&g_logs_state.active_idx);
     log_buffer_t *current_buf = &g_logs_state.buffers[current_active];
 
-    // Check if current active buffer is also full
-    // We could even lower the threshold for high-contention scenarios
-    return sentry__atomic_fetch(&current_buf->index) >= QUEUE_LENGTH;
+    // Check if current active buffer filled up while we were flushing
+    return sentry__atomic_fetch(&current_buf->index) >= FLUSH_LOW_WATERMARK;
 }
 
-// Use a sleep spinner around a monotonic timer so we don't syscall sleep from
-// a signal handler. While this is strictly needed only there, there is no
-// reason not to use the same implementation across platforms.
-static void
-crash_safe_sleep_ms(uint64_t delay_ms)
+static bool
+acquire_flush_lock(bool crash_safe)
 {
-    const uint64_t start = sentry__monotonic_time();
-    const uint64_t end = start + delay_ms;
-    while (sentry__monotonic_time() < end) {
+    if (!crash_safe) {
+        // Normal mode: try once and return if already flushing
+        return !sentry__atomic_store(&g_logs_state.flushing, 1);
+    }
+
+    // In crash-safe mode, spin without sleeping for a small, fixed time. The
+    // flush in progress may well be on the crashed thread, which will never
+    // release the lock, so the crash must not wait for it any longer.
+    const uint64_t deadline
+        = sentry__monotonic_time() + CRASH_FLUSH_LOCK_TIMEOUT_MS;
+    while (!sentry__atomic_compare_swap(&g_logs_state.flushing, 0, 1)) {
+        if (sentry__monotonic_time() >= deadline) {
+            SENTRY_WARN("flush_logs_queue: timeout waiting for flushing "
+                        "lock in crash-safe mode");
+            return false;
+        }
         for (int i = 0; i < 64; i++) {
             sentry__cpu_relax();
         }
     }
+    return true;
 }
 
-static void
-flush_logs_queue(bool crash_safe)
+// makes the other buffer active, seals the previously active one and waits for
+// its in-flight producers. returns the sealed buffer and writes the number of
+// logs it holds into `n_out`. must only be called while holding `flushing`.
+static log_buffer_t *
+swap_buffers(long *n_out)
 {
-    if (crash_safe) {
-        // In crash-safe mode, spin lock with timeout and backoff
-        int attempts = 0;
-        while (!sentry__atomic_compare_swap(&g_logs_state.flushing, 0, 1)) {
-            const int max_attempts = 200;
-            if (++attempts > max_attempts) {
-                SENTRY_WARN("flush_logs_queue: timeout waiting for flushing "
-                            "lock in crash-safe mode");
-                return;
-            }
+    // prep both buffers
+    long old_buf_idx = sentry__atomic_fetch(&g_logs_state.active_idx);
+    long new_buf_idx = 1 - old_buf_idx;
+    log_buffer_t *old_buf = &g_logs_state.buffers[old_buf_idx];
+    log_buffer_t *new_buf = &g_logs_state.buffers[new_buf_idx];
 
-            // backoff max-wait with max_attempts = 200 based sleep slots:
-            // 9ms + 450ms + 1010ms = 1500ish ms
-            const uint32_t sleep_time = (attempts < 10) ? 1
-                : (attempts < 100)                      ? 5
-                                                        : 10;
-            crash_safe_sleep_ms(sleep_time);
-        }
-    } else {
-        // Normal mode: try once and return if already flushing
-        const long already_flushing
-            = sentry__atomic_store(&g_logs_state.flushing, 1);
-        if (already_flushing) {
-            return;
-        }
-    }
-    do {
-        // prep both buffers
-        long old_buf_idx = sentry__atomic_fetch(&g_logs_state.active_idx);
-        long new_buf_idx = 1 - old_buf_idx;
-        log_buffer_t *old_buf = &g_logs_state.buffers[old_buf_idx];
-        log_buffer_t *new_buf = &g_logs_state.buffers[new_buf_idx];
+    // reset new buffer...
+    sentry__atomic_store(&new_buf->index, 0);
+    sentry__atomic_store(&new_buf->adding, 0);
+    sentry__atomic_store(&new_buf->sealed, 0);
 
-        // reset new buffer...
-        sentry__atomic_store(&new_buf->index, 0);
-        sentry__atomic_store(&new_buf->adding, 0);
-        sentry__atomic_store(&new_buf->sealed, 0);
+    // ...and make it active (after this we're good to go producer side)
+    sentry__atomic_store(&g_logs_state.active_idx, new_buf_idx);
 
-        // ...and make it active (after this we're good to go producer side)
-        sentry__atomic_store(&g_logs_state.active_idx, new_buf_idx);
+    // seal old buffer
+    sentry__atomic_store(&old_buf->sealed, 1);
 
-        // seal old buffer
-        sentry__atomic_store(&old_buf->sealed, 1);
+    // Wait for all in-flight producers of the old buffer
+    while (sentry__atomic_fetch(&old_buf->adding) > 0) {
+        sentry__cpu_relax();
+    }
 
-        // Wait for all in-flight producers of the old buffer
-        while (sentry__atomic_fetch(&old_buf->adding) > 0) {
-            sentry__cpu_relax();
-        }
+    long n = sentry__atomic_store(&old_buf->index, 0);
+    if (n > SENTRY_LOGS_QUEUE_LENGTH) {
+        n = SENTRY_LOGS_QUEUE_LENGTH;
+    }
+    *n_out = n;
+    return old_buf;
+}
 
-        long n = sentry__atomic_store(&old_buf->index, 0);
-        if (n > QUEUE_LENGTH) {
-            n = QUEUE_LENGTH;
-        }
+static void
+flush_logs_queue(bool crash_safe)
+{
+    if (!acquire_flush_lock(crash_safe)) {
+        return;
+    }
+    do {
+        long n;
+        log_buffer_t *old_buf = swap_buffers(&n);
 
         if (n > 0) {
-            // now we can do the actual batching of the old buffer
-
-            sentry_value_t logs = sentry_value_new_object();
-            sentry_value_t log_items = sentry_value_new_list();
-            int i;
-            for (i = 0; i < n; i++) {
-                sentry_value_append(log_items, old_buf->logs[i]);
-            }
-            sentry_value_set_by_key(logs, "items", log_items);
-
+            // now we can do the actual batching of the old buffer, serializing
+            // the logs straight out of it
             sentry_envelope_t *envelope = sentry__envelope_new();
-            sentry__envelope_add_logs(envelope, logs);
+            const sentry_envelope_item_t *item = sentry__envelope_add_logs(
+                envelope, old_buf->logs, (size_t)n,
+                (size_t)n * g_logs_state.bytes_per_log);
+            if (item) {
+                // leave some headroom, so that a slightly larger batch doesn't
+                // need to grow the buffer again
+                size_t payload_len = 0;
+                sentry__envelope_item_get_payload(item, &payload_len);
+                g_logs_state.bytes_per_log
+                    = (payload_len + payload_len / 8) / (size_t)n + 1;
+            }
+            for (long i = 0; i < n; i++) {
+                sentry_value_decref(old_buf->logs[i]);
+            }
 
             SENTRY_WITH_OPTIONS (options) {
                 if (crash_safe) {
@@ -182,13 +236,139 @@ flush_logs_queue(bool crash_safe)
                     sentry__capture_envelope(options->transport, envelope);
                 }
             }
-            sentry_value_decref(logs);
         }
     } while (check_for_flush_condition());
 
     sentry__atomic_store(&g_logs_state.flushing, 0);
 }
 
+#ifdef SENTRY_PLATFORM_UNIX
+static void
+write_crash_item_header(sentry_jsonwriter_t *jw, long item_count)
+{
+    sentry__jsonwriter_reset(jw);
+    sentry__jsonwriter_write_object_start(jw);
+    sentry__jsonwriter_write_key(jw, "type");
+    sentry__jsonwriter_write_str(jw, "log");
+    sentry__jsonwriter_write_key(jw, "item_count");
+    sentry__jsonwriter_write_int32(jw, (int32_t)item_count);
+    sentry__jsonwriter_write_key(jw, "content_type");
+    sentry__jsonwriter_write_str(jw, "application/vnd.sentry.items.log+json");
+    sentry__jsonwriter_write_object_end(jw);
+    sentry__jsonwriter_write_raw(jw, "\n", 1);
+}
+
+/**
+ * Serializes the pending logs as an envelope straight into the file that was
+ * opened in `sentry__logs_startup`, using the preallocated writer.
+ *
+ * Each sealed buffer becomes its own `log` item. Items omit the `length`
+ * header and are newline-terminated instead, so nothing has to be buffered
+ * beyond the fixed-size writer. The file is only renamed to an envelope once
+ * there is at least one log in it.
+ */
+static void
+flush_logs_queue_to_disk(void)
+{
+    sentry_jsonwriter_t *jw = g_logs_state.crash_writer;
+    int fd = g_logs_state.crash_fd;
+    if (!jw || fd < 0 || !acquire_flush_lock(true)) {
+        return;
+    }
+
+    bool written = false;
+    do {
+        long n;
+        log_buffer_t *old_buf = swap_buffers(&n);
+        if (n <= 0) {
+            continue;
+        }
+
+        if (!written) {
+            written = true;
+            sentry__jsonwriter_set_fd(jw, fd);
+            // envelope headers are empty, the DSN comes from the transport
+            sentry__jsonwriter_write_raw(jw, "{}\n", 3);
+        }
+
+        write_crash_item_header(jw, n);
+        sentry__jsonwriter_reset(jw);
+        sentry__jsonwriter_write_object_start(jw);
+        sentry__jsonwriter_write_key(jw, "items");
+        sentry__jsonwriter_write_list_start(jw);
+        for (long i = 0; i < n; i++) {
+            sentry__jsonwriter_write_value(jw, old_buf->logs[i]);
+            sentry_value_decref(old_buf->logs[i]);
+        }
+        sentry__jsonwriter_write_list_end(jw);
+        sentry__jsonwriter_write_object_end(jw);
+        sentry__jsonwriter_write_raw(jw, "\n", 1);
+    } while (check_for_flush_condition());
+
+    if (written) {
+        if (sentry__jsonwriter_flush(jw) != 0) {
+            SENTRY_WARN("writing crash logs envelope failed");
+        }
+        sentry__jsonwriter_set_fd(jw, -1);
+        if (rename(g_logs_state.crash_temp_path->path,
+                g_logs_state.crash_envelope_path->path)
+            != 0) {
+            SENTRY_WARN("failed to rename crash logs envelope");
+        }
+    }
+
+    sentry__atomic_store(&g_logs_state.flushing, 0);
+}
+
+static void
+prepare_crash_writer(const sentry_options_t *options)
+{
+    g_logs_state.crash_writer
+        = sentry__jsonwriter_new_fd(CRASH_WRITER_BUFFER_SIZE);
+
+    sentry_uuid_t uuid = sentry_uuid_new_v4();
+    char *filename = sentry__uuid_as_filename(&uuid, ".envelope");
+    if (!filename) {
+        return;
+    }
+    g_logs_state.crash_envelope_path
+        = sentry__path_join_str(options->run->run_path, filename);
+    sentry_free(filename);
+    // the file only gets its `.envelope` extension once it has logs in it,
+    // so an empty file never gets sent with the old runs
+    g_logs_state.crash_temp_path = g_logs_state.crash_envelope_path
+        ? sentry__path_append_str(g_logs_state.crash_envelope_path, ".tmp")
+        : NULL;
+    if (!g_logs_state.crash_temp_path) {
+        return;
+    }
+    g_logs_state.crash_fd = open(g_logs_state.crash_temp_path->path,
+        O_WRONLY | O_CREAT | O_TRUNC,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if (g_logs_state.crash_fd < 0) {
+        SENTRY_WARN("failed to open crash logs envelope");
+    }
+}
+
+static void
+free_crash_writer(void)
+{
+    if (g_logs_state.crash_writer) {
+        sentry__jsonwriter_free(g_logs_state.crash_writer);
+        g_logs_state.crash_writer = NULL;
+    }
+    if (g_logs_state.crash_fd >= 0) {
+        close(g_logs_state.crash_fd);
+        g_logs_state.crash_fd = -1;
+        sentry__path_remove(g_logs_state.crash_temp_path);
+    }
+    sentry__path_free(g_logs_state.crash_temp_path);
+    g_logs_state.crash_temp_path = NULL;
+    sentry__path_free(g_logs_state.crash_envelope_path);
+    g_logs_state.crash_envelope_path = NULL;
+}
+#endif
+
 #define ENQUEUE_MAX_RETRIES 2
 
 static bool
@@ -233,23 +413,21 @@ enqueue_log(sentry_value_t log)
         // Now we can finally request a slot and check if the log fits in this
         // buffer.
         const long log_idx = sentry__atomic_fetch_and_add(&active->index, 1);
-        if (log_idx < QUEUE_LENGTH) {
+        if (log_idx < SENTRY_LOGS_QUEUE_LENGTH) {
             // got a slot, write log to the buffer and unblock flusher
             active->logs[log_idx] = log;
             sentry__atomic_fetch_and_add(&active->adding, -1);
 
-            // Check if active buffer is now full and trigger flush. We could
-            // introduce additional watermarks here to trigger the flush earlier
-            // under high contention.
-            // TODO replace with a level-triggered flag
-            if (log_idx == QUEUE_LENGTH - 1) {
-                sentry__cond_wake(&g_logs_state.request_flush);
+            // Trigger a flush once the buffer reaches the high watermark.
+            // The flag stays raised until the batching thread consumes it, so
+            // this can't get lost while the thread is busy flushing.
+            if (log_idx + 1 >= SENTRY_LOGS_FLUSH_HIGH_WATERMARK) {
+                sentry__notify_raise(&g_logs_state.request_flush);
             }
             return true;
         }
-        // ping the batching thread to flush, since we could miss a cond_wake
-        // on adding the last item
-        sentry__cond_wake(&g_logs_state.request_flush);
+        // the buffer is full, make sure the batching thread is on it
+        sentry__notify_raise(&g_logs_state.request_flush);
         // Buffer is already full, roll back our increments and retry or drop.
         sentry__atomic_fetch_and_add(&active->adding, -1);
         if (attempt == ENQUEUE_MAX_RETRIES) {
@@ -265,9 +443,6 @@ batching_thread_func(void *data)
 {
     (void)data;
     SENTRY_DEBUG("Starting batching thread");
-    sentry_mutex_t task_lock;
-    sentry__mutex_init(&task_lock);
-    sentry__mutex_lock(&task_lock);
 
     // Transition from STARTING to RUNNING using compare-and-swap
     // CAS ensures atomic state verification: only succeeds if state is STARTING
@@ -278,17 +453,15 @@ batching_thread_func(void *data)
             (long)SENTRY_LOGS_THREAD_STARTING,
             (long)SENTRY_LOGS_THREAD_RUNNING)) {
         SENTRY_DEBUG("logs thread detected shutdown during startup, exiting");
-        sentry__mutex_unlock(&task_lock);
-        sentry__mutex_free(&task_lock);
         return 0;
     }
 
     // Main loop: run while state is RUNNING
     while (sentry__atomic_fetch(&g_logs_state.thread_state)
         == SENTRY_LOGS_THREAD_RUNNING) {
-        // Sleep for 5 seconds or until request_flush hits
-        const int triggered_by = sentry__cond_wait_timeout(
-            &g_logs_state.request_flush, &task_lock, 5000);
+        // Sleep for 5 seconds or until request_flush is raised
+        const bool triggered = sentry__notify_wait(
+            &g_logs_state.request_flush, FLUSH_TIMER * 1000);
 
         // Check if we should still be running
         if (sentry__atomic_fetch(&g_logs_state.thread_state)
@@ -296,37 +469,16 @@ batching_thread_func(void *data)
             break;
         }
 
-        switch (triggered_by) {
-        case 0:
-#ifdef SENTRY_PLATFORM_WINDOWS
-            if (GetLastError() == ERROR_TIMEOUT) {
-                SENTRY_TRACE("Logs flushed by timeout");
-                break;
-            }
-#endif
+        if (triggered) {
             SENTRY_TRACE("Logs flushed by filled buffer");
-            break;
-#ifdef SENTRY_PLATFORM_UNIX
-        case ETIMEDOUT:
+        } else {
             SENTRY_TRACE("Logs flushed by timeout");
-            break;
-#endif
-#ifdef SENTRY_PLATFORM_WINDOWS
-        case 1:
-            SENTRY_TRACE("Logs flushed by filled buffer");
-            break;
-#endif
-        default:
-            SENTRY_WARN("Logs flush trigger returned unexpected value");
-            continue;
         }
 
         // Try to flush logs
         flush_logs_queue(false);
     }
 
-    sentry__mutex_unlock(&task_lock);
-    sentry__mutex_free(&task_lock);
     SENTRY_DEBUG("batching thread exiting");
     return 0;
 }
@@ -562,6 +714,63 @@ add_attribute(sentry_value_t attributes, sentry_value_t value, const char *type,
     sentry_value_set_by_key(attributes, name, param_obj);
 }
 
+#define SHARED_ATTRIBUTE_COUNT 4
+static const char *const SHARED_ATTRIBUTE_NAMES[SHARED_ATTRIBUTE_COUNT] = {
+    "sentry.environment",
+    "sentry.release",
+    "sentry.sdk.name",
+    "sentry.sdk.version",
+};
+
+/**
+ * Creates the frozen attribute objects that are the same for every log, and
+ * are thus shared by all of them instead of being created per log. Being
+ * frozen also means that they are only serialized once per batch.
+ */
+static sentry_value_t
+new_shared_attributes(const sentry_options_t *options)
+{
+    const char *values[SHARED_ATTRIBUTE_COUNT] = {
+        options->environment,
+        options->release,
+        sentry_options_get_sdk_name(options),
+        sentry_sdk_version(),
+    };
+    sentry_value_t shared = sentry_value_new_object();
+    for (size_t i = 0; i < SHARED_ATTRIBUTE_COUNT; i++) {
+        if (!values[i]) {
+            continue;
+        }
+        sentry_value_t attribute = sentry_value_new_object();
+        sentry_value_set_by_key(
+            attribute, "value", sentry_value_new_string(values[i]));
+        sentry_value_set_by_key(
+            attribute, "type", sentry_value_new_string("string"));
+        sentry_value_set_by_key(shared, SHARED_ATTRIBUTE_NAMES[i], attribute);
+    }
+    sentry_value_freeze(shared);
+    return shared;
+}
+
+/**
+ * Adds the shared attributes. They describe the SDK that sent the log, so they
+ * replace any attribute of the same name the log already has.
+ */
+static void
+add_shared_attributes(sentry_value_t attributes, sentry_value_t shared)
+{
+    for (size_t i = 0; i < SHARED_ATTRIBUTE_COUNT; i++) {
+        const char *name = SHARED_ATTRIBUTE_NAMES[i];
+        sentry_value_t attribute = sentry_value_get_by_key(shared, name);
+        if (sentry_value_is_null(attribute)) {
+            sentry_value_remove_by_key(attributes, name);
+            continue;
+        }
+        sentry_value_incref(attribute);
+        sentry_value_set_by_key(attributes, name, attribute);
+    }
+}
+
 /**
  * Extracts data from the scope and options, and adds it to the attributes
  * as well as directly setting `trace_id` for the log.
@@ -572,7 +781,7 @@ add_attribute(sentry_value_t attributes, sentry_value_t value, const char *type,
 static void
 add_scope_and_options_data(sentry_value_t log, sentry_value_t attributes)
 {
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_SCOPE (scope) {
         sentry_value_t trace_id = sentry_value_get_by_key(
             sentry_value_get_by_key(scope->propagation_context, "trace"),
             "trace_id");
@@ -649,22 +858,8 @@ add_scope_and_options_data(sentry_value_t log, sentry_value_t attributes)
     }
 
     SENTRY_WITH_OPTIONS (options) {
-        if (options->environment) {
-            add_attribute(attributes,
-                sentry_value_new_string(options->environment), "string",
-                "sentry.environment");
-        }
-        if (options->release) {
-            add_attribute(attributes, sentry_value_new_string(options->release),
-                "string", "sentry.release");
-        }
-        add_attribute(attributes,
-            sentry_value_new_string(sentry_options_get_sdk_name(options)),
-            "string", "sentry.sdk.name");
+        add_shared_attributes(attributes, options->logs_shared_attributes);
     }
-
-    add_attribute(attributes, sentry_value_new_string(sentry_sdk_version()),
-        "string", "sentry.sdk.version");
 }
 
 static sentry_value_t
@@ -779,15 +974,110 @@ debug_print_log(sentry_level_t level, const char *log_body)
     }
 }
 
+/**
+ * Keeps `sample_rate` of the logs of `level`, spread evenly: a log is kept
+ * whenever the running count times the rate crosses an integer. Costs a single
+ * atomic increment, and no work at all for the default rate of `1.0`.
+ */
+static bool
+sample_log(sentry_level_t level, double sample_rate)
+{
+    if (sample_rate >= 1.0) {
+        return true;
+    }
+    if (sample_rate <= 0.0) {
+        return false;
+    }
+    const unsigned long n = (unsigned long)sentry__atomic_fetch_and_add(
+        &g_sample_counters[SENTRY_LOG_LEVEL_INDEX(level)], 1);
+    return (unsigned long)((double)(n + 1) * sample_rate)
+        != (unsigned long)((double)n * sample_rate);
+}
+
+/**
+ * Counts a log against the per-second limit of its format string. The limits
+ * live in a fixed-size open-addressing table keyed by the format string
+ * address, and slots are claimed with a compare-and-swap. A template that
+ * can't get a slot is not limited.
+ */
+static bool
+within_template_rate_limit(const char *message, long limit)
+{
+    // On platforms where `long` is narrower than a pointer, templates that are
+    // exactly a multiple of 4GiB apart share a limit, which we accept.
+    const long key = (long)(uintptr_t)message;
+    if (limit <= 0 || key == 0) {
+        return true;
+    }
+    const long window = (long)(sentry__monotonic_time() / 1000);
+    // string literals are rarely more than a few bytes apart, so mix the
+    // address before picking a slot
+    const uint64_t hash = (uint64_t)(uintptr_t)message * 0x9E3779B97F4A7C15ULL;
+    const size_t first = (size_t)(hash >> 56);
+    for (size_t i = 0; i < TEMPLATE_LIMIT_PROBES; i++) {
+        template_limit_t *slot
+            = &g_template_limits[(first + i) % TEMPLATE_LIMIT_SLOTS];
+        long slot_key = sentry__atomic_fetch(&slot->key);
+        if (slot_key == 0 && sentry__atomic_compare_swap(&slot->key, 0, key)) {
+            slot_key = key;
+        } else if (slot_key == 0) {
+            slot_key = sentry__atomic_fetch(&slot->key);
+        }
+        if (slot_key != key) {
+            continue;
+        }
+
+        // whoever moves the slot into the new window resets its count. Racing
+        // logs might still be counted against the old window, which is fine.
+        const long slot_window = sentry__atomic_fetch(&slot->window);
+        if (slot_window != window
+            && sentry__atomic_compare_swap(
+                &slot->window, slot_window, window)) {
+            sentry__atomic_store(&slot->count, 0);
+        }
+        return sentry__atomic_fetch_and_add(&slot->count, 1) < limit;
+    }
+    return true;
+}
+
+/**
+ * Releases the attributes the caller passed along with a log that is dropped
+ * before `construct_log` could take them over.
+ */
+static void
+discard_log_attributes(va_list args)
+{
+    va_list args_copy;
+    va_copy(args_copy, args);
+    sentry_value_decref(va_arg(args_copy, sentry_value_t));
+    va_end(args_copy);
+}
+
 log_return_value_t
 sentry__logs_log(sentry_level_t level, const char *message, va_list args)
 {
     bool enable_logs = false;
+    bool with_attributes = false;
+    double sample_rate = 1.0;
+    long template_limit = 0;
     SENTRY_WITH_OPTIONS (options) {
-        if (options->enable_logs)
+        with_attributes = sentry_options_get_logs_with_attributes(options);
+        if (options->enable_logs) {
             enable_logs = true;
+            sample_rate = sentry_options_get_logs_sample_rate(options, level);
+            template_limit = (long)options->logs_template_rate_limit;
+        }
     }
     if (enable_logs) {
+        // drop sampled-out and rate limited logs before doing any real work
+        if (!sample_log(level, sample_rate)
+            || !within_template_rate_limit(message, template_limit)) {
+            if (with_attributes) {
+                discard_log_attributes(args);
+            }
+            return SENTRY_LOG_RETURN_DISCARD;
+        }
+
         bool discarded = false;
         // create log from message
         sentry_value_t log = construct_log(level, message, args);
@@ -816,6 +1106,9 @@ sentry__logs_log(sentry_level_t level, const char *message, va_list args)
         }
         return SENTRY_LOG_RETURN_SUCCESS;
     }
+    if (with_attributes) {
+        discard_log_attributes(args);
+    }
     return SENTRY_LOG_RETURN_DISABLED;
 }
 
@@ -886,15 +1179,30 @@ sentry_log_fatal(const char *message, ...)
 }
 
 void
-sentry__logs_startup(void)
+sentry__logs_startup(sentry_options_t *options)
 {
+    sentry_value_decref(options->logs_shared_attributes);
+    options->logs_shared_attributes = new_shared_attributes(options);
+    memset(g_sample_counters, 0, sizeof(g_sample_counters));
+    memset(g_template_limits, 0, sizeof(g_template_limits));
+
     // Mark thread as starting before actually spawning so thread can transition
     // to RUNNING. This prevents shutdown from thinking the thread was never
     // started if it races with the thread's initialization.
     sentry__atomic_store(
         &g_logs_state.thread_state, (long)SENTRY_LOGS_THREAD_STARTING);
 
-    sentry__cond_init(&g_logs_state.request_flush);
+    // The flag is never freed, as producers that raced with a previous
+    // shutdown may still raise it. It is initialized by the first startup,
+    // before any producer can see logs enabled.
+    if (!g_logs_state.request_flush_initialized) {
+        sentry__notify_init(&g_logs_state.request_flush);
+        g_logs_state.request_flush_initialized = true;
+    }
+
+#ifdef SENTRY_PLATFORM_UNIX
+    prepare_crash_writer(options);
+#endif
 
     sentry__thread_init(&g_logs_state.batching_thread);
     int spawn_result = sentry__thread_spawn(
@@ -903,10 +1211,11 @@ sentry__logs_startup(void)
     if (spawn_result == 1) {
         SENTRY_ERROR("Failed to start batching thread");
         // Failed to spawn, reset to STOPPED
-        // Note: condition variable doesn't need explicit cleanup for static
-        // storage (pthread_cond_t on POSIX and CONDITION_VARIABLE on Windows)
         sentry__atomic_store(
             &g_logs_state.thread_state, (long)SENTRY_LOGS_THREAD_STOPPED);
+#ifdef SENTRY_PLATFORM_UNIX
+        free_crash_writer();
+#endif
     }
 }
 
@@ -926,11 +1235,14 @@ sentry__logs_shutdown(uint64_t timeout)
     // If thread was never started, nothing to do
     if (old_state == SENTRY_LOGS_THREAD_STOPPED) {
         SENTRY_DEBUG("logs thread was not started, skipping shutdown");
+#ifdef SENTRY_PLATFORM_UNIX
+        free_crash_writer();
+#endif
         return;
     }
 
     // Thread was started (either STARTING or RUNNING), signal it to stop
-    sentry__cond_wake(&g_logs_state.request_flush);
+    sentry__notify_raise(&g_logs_state.request_flush);
 
     // Always join the thread to avoid leaks
     sentry__thread_join(g_logs_state.batching_thread);
@@ -940,6 +1252,10 @@ sentry__logs_shutdown(uint64_t timeout)
 
     sentry__thread_free(&g_logs_state.batching_thread);
 
+#ifdef SENTRY_PLATFORM_UNIX
+    free_crash_writer();
+#endif
+
     SENTRY_DEBUG("logs system shutdown complete");
 }
 
@@ -962,7 +1278,12 @@ sentry__logs_flush_crash_safe(void)
     // Perform crash-safe flush directly to disk to avoid transport queuing
     // This is safe because we're in a crash scenario and the main thread
     // is likely dead or dying anyway
+#ifdef SENTRY_PLATFORM_UNIX
+    // we are in a signal handler, so only use the preallocated writer
+    flush_logs_queue_to_disk();
+#else
     flush_logs_queue(true);
+#endif
 
     SENTRY_DEBUG("crash-safe logs flush complete");
 }
@@ -3,13 +3,35 @@
 
 #include "sentry_boot.h"
 
+/**
+ * The number of logs that fit into a single batch.
+ */
+#ifdef SENTRY_UNITTEST
+#    define SENTRY_LOGS_QUEUE_LENGTH 5
+#else
+#    define SENTRY_LOGS_QUEUE_LENGTH 100
+#endif
+
+/**
+ * The number of queued logs that wakes up the batching thread for a flush.
+ * It leaves producers a quarter of the batch to fill while the thread wakes
+ * up. The unit tests batch a handful of logs and expect them to be flushed
+ * together, so they only wake up the thread once the batch is full.
+ */
+#ifdef SENTRY_UNITTEST
+#    define SENTRY_LOGS_FLUSH_HIGH_WATERMARK SENTRY_LOGS_QUEUE_LENGTH
+#else
+#    define SENTRY_LOGS_FLUSH_HIGH_WATERMARK (SENTRY_LOGS_QUEUE_LENGTH * 3 / 4)
+#endif
+
 log_return_value_t sentry__logs_log(
     sentry_level_t level, const char *message, va_list args);
 
 /**
- * Sets up the logs timer/flush thread
+ * Sets up the logs timer/flush thread, and the attributes derived from
+ * `options` which are shared by all logs.
  */
-void sentry__logs_startup(void);
+void sentry__logs_startup(sentry_options_t *options);
 
 /**
  * Instructs the logs timer/flush thread to shut down.
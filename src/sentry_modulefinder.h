@@ -0,0 +1,15 @@
+#ifndef SENTRY_MODULEFINDER_H_INCLUDED
+#define SENTRY_MODULEFINDER_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * Returns a counter that changes whenever the cached module list is replaced,
+ * because modules were loaded or unloaded, or by `sentry_clear_modulecache`.
+ * Anything derived from the module list can compare it to know when it is
+ * stale. This is safe in a signal handler, where it also detects modules that
+ * were loaded or unloaded since the list was last read, where supported.
+ */
+long sentry__modules_generation(void);
+
+#endif
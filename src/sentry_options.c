@@ -49,6 +49,7 @@ sentry_options_new(void)
     opts->auto_session_tracking = true;
     opts->system_crash_reporter_enabled = false;
     opts->attach_screenshot = false;
+    opts->capture_all_threads = false;
     opts->crashpad_wait_for_upload = false;
     opts->enable_logging_when_crashed = true;
     opts->propagate_traceparent = false;
@@ -71,6 +72,10 @@ sentry_options_new(void)
     opts->traces_sample_rate = 0.0;
     opts->max_spans = SENTRY_SPANS_MAX;
     opts->handler_strategy = SENTRY_HANDLER_STRATEGY_DEFAULT;
+    opts->logs_shared_attributes = sentry_value_new_null();
+    for (size_t i = 0; i < SENTRY_LOG_LEVEL_COUNT; i++) {
+        opts->logs_sample_rates[i] = 1.0;
+    }
 
     return opts;
 }
@@ -106,6 +111,7 @@ sentry_options_free(sentry_options_t *opts)
     sentry__backend_free(opts->backend);
     sentry__attachments_free(opts->attachments);
     sentry__run_free(opts->run);
+    sentry_value_decref(opts->logs_shared_attributes);
 
     sentry_free(opts);
 }
@@ -546,6 +552,12 @@ sentry_options_set_attach_screenshot(sentry_options_t *opts, int val)
     opts->attach_screenshot = !!val;
 }
 
+void
+sentry_options_set_capture_all_threads(sentry_options_t *opts, int val)
+{
+    opts->capture_all_threads = !!val;
+}
+
 void
 sentry_options_set_handler_path(sentry_options_t *opts, const char *path)
 {
@@ -576,6 +588,30 @@ sentry_options_set_database_path_n(
     opts->database_path = sentry__path_from_str_n(path, path_len);
 }
 
+void
+sentry_options_set_database_max_size(sentry_options_t *opts, size_t max_size)
+{
+    opts->database_max_size = max_size;
+}
+
+size_t
+sentry_options_get_database_max_size(const sentry_options_t *opts)
+{
+    return opts->database_max_size;
+}
+
+void
+sentry_options_set_database_max_files(sentry_options_t *opts, size_t max_files)
+{
+    opts->database_max_files = max_files;
+}
+
+size_t
+sentry_options_get_database_max_files(const sentry_options_t *opts)
+{
+    return opts->database_max_files;
+}
+
 void
 sentry_options_set_external_crash_reporter_path(
     sentry_options_t *opts, const char *path)
@@ -757,6 +793,44 @@ sentry_options_get_logs_with_attributes(const sentry_options_t *opts)
     return opts->logs_with_attributes;
 }
 
+void
+sentry_options_set_logs_sample_rate(
+    sentry_options_t *opts, sentry_level_t level, double sample_rate)
+{
+    if (level < SENTRY_LEVEL_TRACE || level > SENTRY_LEVEL_FATAL) {
+        return;
+    }
+    if (sample_rate < 0.0) {
+        sample_rate = 0.0;
+    } else if (sample_rate > 1.0) {
+        sample_rate = 1.0;
+    }
+    opts->logs_sample_rates[SENTRY_LOG_LEVEL_INDEX(level)] = sample_rate;
+}
+
+double
+sentry_options_get_logs_sample_rate(
+    const sentry_options_t *opts, sentry_level_t level)
+{
+    if (level < SENTRY_LEVEL_TRACE || level > SENTRY_LEVEL_FATAL) {
+        return 1.0;
+    }
+    return opts->logs_sample_rates[SENTRY_LOG_LEVEL_INDEX(level)];
+}
+
+void
+sentry_options_set_logs_template_rate_limit(
+    sentry_options_t *opts, uint32_t logs_per_second)
+{
+    opts->logs_template_rate_limit = logs_per_second;
+}
+
+uint32_t
+sentry_options_get_logs_template_rate_limit(const sentry_options_t *opts)
+{
+    return opts->logs_template_rate_limit;
+}
+
 #ifdef SENTRY_PLATFORM_LINUX
 
 sentry_handler_strategy_t
@@ -13,6 +13,11 @@
 // https://docs.sentry.io/error-reporting/configuration/?platform=native#shutdown-timeout
 #define SENTRY_DEFAULT_SHUTDOWN_TIMEOUT 2000
 
+// the number of `sentry_level_t` values, from `TRACE` to `FATAL`
+#define SENTRY_LOG_LEVEL_COUNT (SENTRY_LEVEL_FATAL - SENTRY_LEVEL_TRACE + 1)
+// maps a `sentry_level_t` to an index into per-level arrays
+#define SENTRY_LOG_LEVEL_INDEX(Level) ((Level) - SENTRY_LEVEL_TRACE)
+
 struct sentry_backend_s;
 
 /**
@@ -35,12 +40,15 @@ struct sentry_options_s {
     sentry_path_t *external_crash_reporter;
     sentry_logger_t logger;
     size_t max_breadcrumbs;
+    size_t database_max_size;
+    size_t database_max_files;
     bool debug;
     bool auto_session_tracking;
     bool require_user_consent;
     bool symbolize_stacktraces;
     bool system_crash_reporter_enabled;
     bool attach_screenshot;
+    bool capture_all_threads;
     bool crashpad_wait_for_upload;
     bool enable_logging_when_crashed;
     bool propagate_traceparent;
@@ -68,6 +76,8 @@ struct sentry_options_s {
     // takes the first varg as a `sentry_value_t` object containing attributes
     // if no custom attributes are to be passed, use `sentry_value_new_object()`
     bool logs_with_attributes;
+    double logs_sample_rates[SENTRY_LOG_LEVEL_COUNT];
+    uint32_t logs_template_rate_limit;
 
     /* everything from here on down are options which are stored here but
        not exposed through the options API */
@@ -78,6 +88,8 @@ struct sentry_options_s {
     long refcount;
     uint64_t shutdown_timeout;
     sentry_handler_strategy_t handler_strategy;
+    // frozen attributes shared by all logs, see `sentry__logs_startup`
+    sentry_value_t logs_shared_attributes;
 
 #ifdef SENTRY_PLATFORM_NX
     void (*network_connect_func)(void);
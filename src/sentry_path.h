@@ -249,6 +249,13 @@ size_t sentry__filewriter_write(
  */
 size_t sentry__filewriter_byte_count(const sentry_filewriter_t *filewriter);
 
+/**
+ * Flushes everything written so far through to the storage device.
+ *
+ * Returns 0 on success.
+ */
+int sentry__filewriter_sync(sentry_filewriter_t *filewriter);
+
 /**
  * Frees the filewriter and closes the handle.
  */
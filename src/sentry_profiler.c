@@ -0,0 +1,874 @@
+#include "sentry_profiler.h"
+#include "sentry_logger.h"
+
+#ifdef SENTRY_PLATFORM_LINUX
+#    include "sentry_alloc.h"
+#    include "sentry_core.h"
+#    include "sentry_envelope.h"
+#    include "sentry_options.h"
+#    include "sentry_sync.h"
+#    include "sentry_unwinder.h"
+#    include "sentry_utils.h"
+#    include "sentry_uuid.h"
+#    include "sentry_value.h"
+
+#    include <dirent.h>
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <signal.h>
+#    include <stdio.h>
+#    include <stdlib.h>
+#    include <string.h>
+#    include <sys/prctl.h>
+#    include <sys/syscall.h>
+#    include <time.h>
+#    include <unistd.h>
+
+// glibc before 2.35 does not expose the thread id member under its proper name
+#    ifndef sigev_notify_thread_id
+#        define sigev_notify_thread_id _sigev_un._tid
+#    endif
+
+// every thread is sampled at 101Hz of the CPU time it consumes, which avoids
+// sampling in lockstep with periodic work of the application
+#    define SAMPLING_INTERVAL_NS (1000000000L / 101)
+#    define MAX_THREADS 128
+#    define MAX_FRAMES 64
+// the collector drains the samples every 100ms, so a ring of 32 samples
+// leaves plenty of room for a thread that got more CPU time than expected
+#    define RING_CAPACITY 32
+#    define COLLECT_INTERVAL_MS 100
+#    define THREAD_SCAN_INTERVAL_MS 1000
+#    define CHUNK_DURATION_MS 10000
+
+// Samples are taken by walking the frame pointer chain, starting at the
+// registers of the interrupted thread, which is supported on these
+// architectures. The other unwinders are not async-signal-safe.
+#    if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#        define HAS_SAMPLING_UNWINDER
+#    endif
+
+/**
+ * A single sample, the stack of one thread at one point in time.
+ */
+typedef struct {
+    uint64_t timestamp;
+    size_t frame_count;
+    void *frames[MAX_FRAMES];
+} sample_t;
+
+/**
+ * The samples of a single thread. The signal handler of that thread is the
+ * only producer, advancing `head`, and the collector thread is the only
+ * consumer, advancing `tail`, so neither side ever has to wait for the other.
+ * Samples that don't fit into the ring are dropped.
+ */
+typedef struct {
+    volatile long head;
+    volatile long tail;
+    volatile long dropped;
+    sample_t samples[RING_CAPACITY];
+} sample_ring_t;
+
+/**
+ * A thread that is being sampled. The slot index is passed along with every
+ * timer signal, so the handler finds its ring without any lookup. Only `tid`
+ * and `ring` are read by the signal handler, all other members are private to
+ * the collector thread.
+ */
+typedef struct {
+    volatile long tid;
+    sample_ring_t *ring;
+    timer_t timer;
+    bool has_timer;
+    bool seen;
+    char name[16];
+} thread_slot_t;
+
+/**
+ * An open addressing hash map from a 64-bit key to an index into the frames
+ * or stacks of a chunk.
+ */
+typedef struct {
+    uint64_t *keys;
+    uint32_t *values;
+    size_t capacity;
+    size_t len;
+} index_map_t;
+
+/**
+ * The profile chunk that is currently being recorded. Frames are deduplicated
+ * by their instruction address, and stacks by their sequence of frames, which
+ * are kept in `stack_frames` so that hash collisions can be told apart.
+ */
+typedef struct {
+    sentry_value_t samples;
+    sentry_value_t stacks;
+    sentry_value_t frames;
+    sentry_value_t thread_metadata;
+    index_map_t frame_map;
+    index_map_t stack_map;
+    uint32_t *stack_frames;
+    size_t stack_frames_len;
+    size_t stack_frames_capacity;
+    uint32_t *stack_offsets;
+    size_t stack_offsets_capacity;
+    uint32_t stack_count;
+    size_t sample_count;
+    uint64_t started;
+} profile_chunk_t;
+
+typedef struct {
+    sentry_options_t *options;
+    sentry_threadid_t thread_id;
+    sentry_notify_t notify;
+    volatile long stop;
+    pid_t collector_tid;
+    char profiler_id[37];
+} profiler_t;
+
+static thread_slot_t g_threads[MAX_THREADS];
+static volatile long g_sampling = 0;
+static volatile long g_handlers_in_flight = 0;
+static bool g_handler_installed = false;
+
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+static profiler_t *g_profiler = NULL;
+
+static uint64_t
+hash_u64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void
+record_sample(int index, const sentry_ucontext_t *uctx)
+{
+    if (index < 0 || index >= MAX_THREADS) {
+        return;
+    }
+    thread_slot_t *slot = &g_threads[index];
+    sample_ring_t *ring = slot->ring;
+    if (!ring
+        || sentry__atomic_fetch(&slot->tid) != (long)syscall(SYS_gettid)) {
+        return;
+    }
+
+    long head = sentry__atomic_fetch(&ring->head);
+    if (head - sentry__atomic_fetch(&ring->tail) >= RING_CAPACITY) {
+        sentry__atomic_fetch_and_add(&ring->dropped, 1);
+        return;
+    }
+    sample_t *sample = &ring->samples[(unsigned long)head % RING_CAPACITY];
+
+    size_t frame_count = sentry__unwind_stack_framepointer_from_ucontext(
+        uctx, sample->frames, MAX_FRAMES);
+    if (!frame_count) {
+        return;
+    }
+    sample->frame_count = frame_count;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    sample->timestamp
+        = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+
+    sentry__atomic_store(&ring->head, head + 1);
+}
+
+static void
+handle_sigprof(int signum, siginfo_t *info, void *user_context)
+{
+    int saved_errno = errno;
+    // the collector waits for all handlers to leave before it frees the rings
+    sentry__atomic_fetch_and_add(&g_handlers_in_flight, 1);
+    if (info->si_code == SI_TIMER && sentry__atomic_fetch(&g_sampling)) {
+        sentry_ucontext_t uctx;
+        uctx.signum = signum;
+        uctx.siginfo = info;
+        uctx.user_context = (ucontext_t *)user_context;
+        record_sample(info->si_value.sival_int, &uctx);
+    }
+    sentry__atomic_fetch_and_add(&g_handlers_in_flight, -1);
+    errno = saved_errno;
+}
+
+/**
+ * Installs the `SIGPROF` handler, unless the application uses the signal
+ * itself. The handler stays installed once the profiler was started, since a
+ * timer signal might still be pending after the profiler was stopped, and the
+ * default disposition would terminate the process.
+ */
+static bool
+install_signal_handler(void)
+{
+    if (g_handler_installed) {
+        return true;
+    }
+    struct sigaction previous;
+    if (sigaction(SIGPROF, NULL, &previous) == -1
+        || ((previous.sa_flags & SA_SIGINFO)
+            || (previous.sa_handler != SIG_DFL
+                && previous.sa_handler != SIG_IGN))) {
+        SENTRY_WARN("SIGPROF is in use, not starting the profiler");
+        return false;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = handle_sigprof;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SIGPROF, &action, NULL) == -1) {
+        return false;
+    }
+    g_handler_installed = true;
+    return true;
+}
+
+static bool
+start_thread_timer(thread_slot_t *slot, int index)
+{
+    pid_t tid = (pid_t)slot->tid;
+    // `MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED)` from the kernel, the CPU
+    // clock of an arbitrary thread of our process
+    clockid_t clock = (clockid_t)((~(unsigned int)tid) << 3) | 6;
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_value.sival_int = index;
+    sev.sigev_notify_thread_id = tid;
+    if (timer_create(clock, &sev, &slot->timer) == -1) {
+        return false;
+    }
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = SAMPLING_INTERVAL_NS;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(slot->timer, 0, &spec, NULL) == -1) {
+        timer_delete(slot->timer);
+        return false;
+    }
+    slot->has_timer = true;
+    return true;
+}
+
+static void
+stop_thread_timer(thread_slot_t *slot)
+{
+    if (slot->has_timer) {
+        timer_delete(slot->timer);
+        slot->has_timer = false;
+    }
+}
+
+static void
+read_thread_name(pid_t tid, char name[16])
+{
+    name[0] = '\0';
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t len = read(fd, name, 15);
+    close(fd);
+    if (len <= 0) {
+        return;
+    }
+    if (name[len - 1] == '\n') {
+        len--;
+    }
+    name[len] = '\0';
+}
+
+static thread_slot_t *
+find_thread_slot(pid_t tid, int *index_out)
+{
+    thread_slot_t *free_slot = NULL;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_slot_t *slot = &g_threads[i];
+        if (slot->tid == tid) {
+            *index_out = i;
+            return slot;
+        }
+        if (!free_slot && !slot->tid) {
+            free_slot = slot;
+            *index_out = i;
+        }
+    }
+    return free_slot;
+}
+
+/**
+ * Starts sampling the threads that were spawned, and stops the timers of the
+ * threads that exited since the last scan.
+ */
+static void
+scan_threads(profiler_t *profiler)
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return;
+    }
+    for (int i = 0; i < MAX_THREADS; i++) {
+        g_threads[i].seen = false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        if (tid <= 0 || tid == profiler->collector_tid) {
+            continue;
+        }
+        int index = 0;
+        thread_slot_t *slot = find_thread_slot(tid, &index);
+        if (!slot) {
+            continue;
+        }
+        slot->seen = true;
+        if (slot->tid == tid) {
+            continue;
+        }
+
+        if (!slot->ring) {
+            slot->ring = sentry_malloc(sizeof(sample_ring_t));
+            if (!slot->ring) {
+                slot->seen = false;
+                continue;
+            }
+            slot->ring->head = 0;
+            slot->ring->tail = 0;
+            slot->ring->dropped = 0;
+        }
+        read_thread_name(tid, slot->name);
+        sentry__atomic_store(&slot->tid, tid);
+        if (!start_thread_timer(slot, index)) {
+            sentry__atomic_store(&slot->tid, 0);
+            slot->seen = false;
+        }
+    }
+    closedir(dir);
+
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_slot_t *slot = &g_threads[i];
+        if (slot->tid && !slot->seen) {
+            stop_thread_timer(slot);
+            // a slot is only reused once all its samples were collected
+            if (slot->ring->head == slot->ring->tail) {
+                sentry__atomic_store(&slot->tid, 0);
+            }
+        }
+    }
+}
+
+static void
+index_map_free(index_map_t *map)
+{
+    sentry_free(map->keys);
+    sentry_free(map->values);
+    memset(map, 0, sizeof(index_map_t));
+}
+
+static bool
+index_map_grow(index_map_t *map)
+{
+    size_t capacity = map->capacity ? map->capacity * 2 : 256;
+    uint64_t *keys = sentry_malloc(sizeof(uint64_t) * capacity);
+    uint32_t *values = sentry_malloc(sizeof(uint32_t) * capacity);
+    if (!keys || !values) {
+        sentry_free(keys);
+        sentry_free(values);
+        return false;
+    }
+    memset(values, 0xff, sizeof(uint32_t) * capacity);
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->values[i] == UINT32_MAX) {
+            continue;
+        }
+        size_t pos = hash_u64(map->keys[i]) & (capacity - 1);
+        while (values[pos] != UINT32_MAX) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        keys[pos] = map->keys[i];
+        values[pos] = map->values[i];
+    }
+    sentry_free(map->keys);
+    sentry_free(map->values);
+    map->keys = keys;
+    map->values = values;
+    map->capacity = capacity;
+    return true;
+}
+
+static void
+chunk_init(profile_chunk_t *chunk)
+{
+    memset(chunk, 0, sizeof(profile_chunk_t));
+    chunk->samples = sentry_value_new_list();
+    chunk->stacks = sentry_value_new_list();
+    chunk->frames = sentry_value_new_list();
+    chunk->thread_metadata = sentry_value_new_object();
+    chunk->started = sentry__monotonic_time();
+}
+
+static void
+chunk_cleanup(profile_chunk_t *chunk)
+{
+    sentry_value_decref(chunk->samples);
+    sentry_value_decref(chunk->stacks);
+    sentry_value_decref(chunk->frames);
+    sentry_value_decref(chunk->thread_metadata);
+    index_map_free(&chunk->frame_map);
+    index_map_free(&chunk->stack_map);
+    sentry_free(chunk->stack_frames);
+    sentry_free(chunk->stack_offsets);
+}
+
+/**
+ * Returns the index of the frame with the instruction address `ip`, adding it
+ * to the chunk if it is new. Returns `UINT32_MAX` when out of memory.
+ */
+static uint32_t
+intern_frame(profile_chunk_t *chunk, uint64_t ip)
+{
+    index_map_t *map = &chunk->frame_map;
+    if ((map->len + 1) * 2 > map->capacity && !index_map_grow(map)) {
+        return UINT32_MAX;
+    }
+    size_t pos = hash_u64(ip) & (map->capacity - 1);
+    while (map->values[pos] != UINT32_MAX) {
+        if (map->keys[pos] == ip) {
+            return map->values[pos];
+        }
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+
+    sentry_value_t frame = sentry_value_new_object();
+    sentry_value_set_by_key(
+        frame, "instruction_addr", sentry__value_new_addr(ip));
+    if (sentry_value_append(chunk->frames, frame) != 0) {
+        return UINT32_MAX;
+    }
+    map->keys[pos] = ip;
+    map->values[pos] = (uint32_t)map->len++;
+    return map->values[pos];
+}
+
+static bool
+reserve_u32(uint32_t **buf, size_t *capacity, size_t needed)
+{
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity ? *capacity : 1024;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    uint32_t *new_buf = sentry_malloc(sizeof(uint32_t) * new_capacity);
+    if (!new_buf) {
+        return false;
+    }
+    if (*buf) {
+        memcpy(new_buf, *buf, sizeof(uint32_t) * *capacity);
+        sentry_free(*buf);
+    }
+    *buf = new_buf;
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Returns the index of the stack made of the `len` frames in `frames`, adding
+ * it to the chunk if it is new. Returns `UINT32_MAX` when out of memory.
+ */
+static uint32_t
+intern_stack(profile_chunk_t *chunk, const uint32_t *frames, size_t len)
+{
+    uint64_t hash = len;
+    for (size_t i = 0; i < len; i++) {
+        hash = hash_u64(hash ^ frames[i]);
+    }
+
+    index_map_t *map = &chunk->stack_map;
+    if ((map->len + 1) * 2 > map->capacity && !index_map_grow(map)) {
+        return UINT32_MAX;
+    }
+    size_t pos = hash_u64(hash) & (map->capacity - 1);
+    while (map->values[pos] != UINT32_MAX) {
+        if (map->keys[pos] == hash) {
+            uint32_t index = map->values[pos];
+            const uint32_t *existing
+                = &chunk->stack_frames[chunk->stack_offsets[index]];
+            size_t existing_len = chunk->stack_offsets[index + 1]
+                - chunk->stack_offsets[index];
+            if (existing_len == len
+                && memcmp(existing, frames, sizeof(uint32_t) * len) == 0) {
+                return index;
+            }
+        }
+        pos = (pos + 1) & (map->capacity - 1);
+    }
+
+    if (!reserve_u32(&chunk->stack_frames, &chunk->stack_frames_capacity,
+            chunk->stack_frames_len + len)
+        || !reserve_u32(&chunk->stack_offsets, &chunk->stack_offsets_capacity,
+            (size_t)chunk->stack_count + 2)) {
+        return UINT32_MAX;
+    }
+    sentry_value_t stack = sentry__value_new_list_with_size(len);
+    for (size_t i = 0; i < len; i++) {
+        sentry_value_append(stack, sentry_value_new_int32((int32_t)frames[i]));
+    }
+    if (sentry_value_append(chunk->stacks, stack) != 0) {
+        return UINT32_MAX;
+    }
+
+    uint32_t index = chunk->stack_count++;
+    memcpy(&chunk->stack_frames[chunk->stack_frames_len], frames,
+        sizeof(uint32_t) * len);
+    chunk->stack_offsets[index] = (uint32_t)chunk->stack_frames_len;
+    chunk->stack_frames_len += len;
+    chunk->stack_offsets[index + 1] = (uint32_t)chunk->stack_frames_len;
+    map->keys[pos] = hash;
+    map->values[pos] = index;
+    map->len++;
+    return index;
+}
+
+static void
+add_sample(profile_chunk_t *chunk, const thread_slot_t *slot,
+    const sample_t *sample)
+{
+    uint32_t frames[MAX_FRAMES];
+    for (size_t i = 0; i < sample->frame_count; i++) {
+        frames[i] = intern_frame(chunk, (uint64_t)(size_t)sample->frames[i]);
+        if (frames[i] == UINT32_MAX) {
+            return;
+        }
+    }
+    uint32_t stack_id = intern_stack(chunk, frames, sample->frame_count);
+    if (stack_id == UINT32_MAX) {
+        return;
+    }
+
+    char tid[16];
+    snprintf(tid, sizeof(tid), "%ld", slot->tid);
+    if (sentry_value_is_null(
+            sentry_value_get_by_key(chunk->thread_metadata, tid))) {
+        sentry_value_t metadata = sentry_value_new_object();
+        if (slot->name[0]) {
+            sentry_value_set_by_key(
+                metadata, "name", sentry_value_new_string(slot->name));
+        }
+        sentry_value_set_by_key(chunk->thread_metadata, tid, metadata);
+    }
+
+    sentry_value_t value = sentry__value_new_object_with_size(3);
+    sentry_value_set_by_key(value, "timestamp",
+        sentry_value_new_double((double)sample->timestamp / 1000000.0));
+    sentry_value_set_by_key(
+        value, "stack_id", sentry_value_new_int32((int32_t)stack_id));
+    sentry_value_set_by_key(value, "thread_id", sentry_value_new_string(tid));
+    sentry_value_append(chunk->samples, value);
+    chunk->sample_count++;
+}
+
+/**
+ * Moves the samples of all threads from their rings into the chunk.
+ */
+static void
+collect_samples(profile_chunk_t *chunk)
+{
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_slot_t *slot = &g_threads[i];
+        sample_ring_t *ring = slot->ring;
+        if (!slot->tid || !ring) {
+            continue;
+        }
+        long head = sentry__atomic_fetch(&ring->head);
+        long tail = ring->tail;
+        for (; tail != head; tail++) {
+            add_sample(chunk, slot,
+                &ring->samples[(unsigned long)tail % RING_CAPACITY]);
+        }
+        sentry__atomic_store(&ring->tail, tail);
+
+        long dropped = sentry__atomic_store(&ring->dropped, 0);
+        if (dropped) {
+            SENTRY_DEBUGF("profiler dropped %ld samples of thread %ld",
+                dropped, slot->tid);
+        }
+    }
+}
+
+static void
+send_chunk(const profiler_t *profiler, profile_chunk_t *chunk)
+{
+    if (!chunk->sample_count) {
+        return;
+    }
+    const sentry_options_t *options = profiler->options;
+
+    sentry_value_t value = sentry_value_new_object();
+    sentry_value_set_by_key(value, "version", sentry_value_new_string("2"));
+    sentry_value_set_by_key(
+        value, "profiler_id", sentry_value_new_string(profiler->profiler_id));
+    sentry_uuid_t chunk_id = sentry_uuid_new_v4();
+    char chunk_id_str[37];
+    sentry__internal_uuid_as_string(&chunk_id, chunk_id_str);
+    sentry_value_set_by_key(
+        value, "chunk_id", sentry_value_new_string(chunk_id_str));
+    sentry_value_set_by_key(
+        value, "platform", sentry_value_new_string("native"));
+    if (options->release) {
+        sentry_value_set_by_key(
+            value, "release", sentry_value_new_string(options->release));
+    }
+    if (options->environment) {
+        sentry_value_set_by_key(value, "environment",
+            sentry_value_new_string(options->environment));
+    }
+
+    sentry_value_t client_sdk = sentry_value_new_object();
+    sentry_value_set_by_key(
+        client_sdk, "name", sentry_value_new_string(options->sdk_name));
+    sentry_value_set_by_key(
+        client_sdk, "version", sentry_value_new_string(SENTRY_SDK_VERSION));
+    sentry_value_set_by_key(value, "client_sdk", client_sdk);
+
+    sentry_value_t debug_meta = sentry_value_new_object();
+    sentry_value_set_by_key(debug_meta, "images", sentry_get_modules_list());
+    sentry_value_set_by_key(value, "debug_meta", debug_meta);
+
+    sentry_value_t profile = sentry_value_new_object();
+    sentry_value_set_by_key(profile, "samples", chunk->samples);
+    sentry_value_set_by_key(profile, "stacks", chunk->stacks);
+    sentry_value_set_by_key(profile, "frames", chunk->frames);
+    sentry_value_set_by_key(
+        profile, "thread_metadata", chunk->thread_metadata);
+    chunk->samples = sentry_value_new_null();
+    chunk->stacks = sentry_value_new_null();
+    chunk->frames = sentry_value_new_null();
+    chunk->thread_metadata = sentry_value_new_null();
+    sentry_value_set_by_key(value, "profile", profile);
+
+    // neither may take the options lock, which `sentry_init` holds while it
+    // waits for this thread to finish
+    sentry_envelope_t *envelope = sentry__envelope_new_with_dsn(options->dsn);
+    if (!envelope || !sentry__envelope_add_profile_chunk(envelope, value)) {
+        SENTRY_WARN("dropping profile chunk");
+        sentry_envelope_free(envelope);
+    } else {
+        SENTRY_DEBUGF("sending profile chunk with %zu samples",
+            chunk->sample_count);
+        sentry__capture_envelope_with_options(options, envelope);
+    }
+    sentry_value_decref(value);
+}
+
+/**
+ * Stops all timers, and waits until no signal handler can touch the rings
+ * anymore.
+ */
+static void
+stop_sampling(void)
+{
+    for (int i = 0; i < MAX_THREADS; i++) {
+        stop_thread_timer(&g_threads[i]);
+    }
+    sentry__atomic_store(&g_sampling, 0);
+    while (sentry__atomic_fetch(&g_handlers_in_flight)) {
+        sched_yield();
+    }
+}
+
+static void
+free_thread_slots(void)
+{
+    for (int i = 0; i < MAX_THREADS; i++) {
+        sentry_free(g_threads[i].ring);
+    }
+    memset(g_threads, 0, sizeof(g_threads));
+}
+
+SENTRY_THREAD_FN
+profiler_thread(void *data)
+{
+    profiler_t *profiler = data;
+    prctl(PR_SET_NAME, "sentry-profiler", 0, 0, 0);
+    profiler->collector_tid = (pid_t)syscall(SYS_gettid);
+
+    profile_chunk_t chunk;
+    chunk_init(&chunk);
+    sentry__atomic_store(&g_sampling, 1);
+
+    uint64_t last_scan = 0;
+    while (true) {
+        bool stopping = sentry__atomic_fetch(&profiler->stop) != 0;
+        uint64_t now = sentry__monotonic_time();
+        if (stopping) {
+            stop_sampling();
+        } else if (!last_scan || now - last_scan >= THREAD_SCAN_INTERVAL_MS) {
+            scan_threads(profiler);
+            last_scan = now;
+        }
+
+        collect_samples(&chunk);
+        if (stopping || now - chunk.started >= CHUNK_DURATION_MS) {
+            send_chunk(profiler, &chunk);
+            chunk_cleanup(&chunk);
+            if (stopping) {
+                break;
+            }
+            chunk_init(&chunk);
+        }
+        sentry__notify_wait(&profiler->notify, COLLECT_INTERVAL_MS);
+    }
+
+    free_thread_slots();
+    return 0;
+}
+
+static void
+profiler_free(profiler_t *profiler)
+{
+    sentry__notify_free(&profiler->notify);
+    sentry__thread_free(&profiler->thread_id);
+    sentry_options_free(profiler->options);
+    sentry_free(profiler);
+}
+
+int
+sentry_profiler_start(void)
+{
+    sentry_options_t *options = (sentry_options_t *)sentry__options_getref();
+    if (!options) {
+        SENTRY_WARN("sentry_profiler_start called before sentry_init");
+        return 1;
+    }
+
+    sentry__mutex_lock(&g_lock);
+    if (g_profiler) {
+        sentry__mutex_unlock(&g_lock);
+        sentry_options_free(options);
+        return 0;
+    }
+    profiler_t *profiler = NULL;
+#    ifndef HAS_SAMPLING_UNWINDER
+    SENTRY_WARN("the profiler is not supported on this architecture");
+    goto fail;
+#    endif
+    if (!install_signal_handler()) {
+        goto fail;
+    }
+
+    profiler = SENTRY_MAKE(profiler_t);
+    if (!profiler) {
+        goto fail;
+    }
+    memset(profiler, 0, sizeof(profiler_t));
+    // the profiler holds on to its own reference of the options, so that it
+    // can send the last chunk while `sentry_close` holds the options lock
+    profiler->options = options;
+    sentry__notify_init(&profiler->notify);
+    sentry__thread_init(&profiler->thread_id);
+    sentry_uuid_t profiler_id = sentry_uuid_new_v4();
+    sentry__internal_uuid_as_string(&profiler_id, profiler->profiler_id);
+
+    if (sentry__thread_spawn(&profiler->thread_id, profiler_thread, profiler)
+        != 0) {
+        goto fail;
+    }
+    SENTRY_DEBUGF("started profiler %s", profiler->profiler_id);
+    g_profiler = profiler;
+    sentry__mutex_unlock(&g_lock);
+    return 0;
+
+fail:
+    sentry__mutex_unlock(&g_lock);
+    if (profiler) {
+        profiler_free(profiler);
+    } else {
+        sentry_options_free(options);
+    }
+    return 1;
+}
+
+void
+sentry_profiler_stop(void)
+{
+    // the collector never takes the lock, so we can hold it while joining,
+    // which keeps a concurrent start from sampling alongside it
+    sentry__mutex_lock(&g_lock);
+    profiler_t *profiler = g_profiler;
+    g_profiler = NULL;
+    if (profiler) {
+        sentry__atomic_store(&profiler->stop, 1);
+        sentry__notify_raise(&profiler->notify);
+        sentry__thread_join(profiler->thread_id);
+        SENTRY_DEBUGF("stopped profiler %s", profiler->profiler_id);
+        profiler_free(profiler);
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__profiler_shutdown(void)
+{
+    sentry_profiler_stop();
+}
+
+void
+sentry__profiler_apply_to_transaction(sentry_value_t transaction)
+{
+    sentry__mutex_lock(&g_lock);
+    if (g_profiler) {
+        sentry_value_t contexts
+            = sentry_value_get_by_key(transaction, "contexts");
+        if (sentry_value_is_null(contexts)) {
+            contexts = sentry_value_new_object();
+            sentry_value_set_by_key(transaction, "contexts", contexts);
+        }
+        sentry_value_t profile = sentry_value_new_object();
+        sentry_value_set_by_key(profile, "profiler_id",
+            sentry_value_new_string(g_profiler->profiler_id));
+        sentry_value_set_by_key(contexts, "profile", profile);
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+#else
+
+int
+sentry_profiler_start(void)
+{
+    SENTRY_WARN("the profiler is not supported on this platform");
+    return 1;
+}
+
+void
+sentry_profiler_stop(void)
+{
+}
+
+void
+sentry__profiler_shutdown(void)
+{
+}
+
+void
+sentry__profiler_apply_to_transaction(sentry_value_t UNUSED(transaction))
+{
+}
+
+#endif
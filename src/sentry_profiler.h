@@ -0,0 +1,18 @@
+#ifndef SENTRY_PROFILER_H_INCLUDED
+#define SENTRY_PROFILER_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * Stops the profiler if it is running, and ships the last profile chunk.
+ * This is called as part of `sentry_close`.
+ */
+void sentry__profiler_shutdown(void);
+
+/**
+ * Links the `transaction` to the running profiler, by adding its profiler id
+ * to the `profile` context. Does nothing if the profiler is not running.
+ */
+void sentry__profiler_apply_to_transaction(sentry_value_t transaction);
+
+#endif
@@ -0,0 +1,412 @@
+#include "sentry_quota.h"
+
+#include "sentry_alloc.h"
+#include "sentry_logger.h"
+#include "sentry_options.h"
+#include "sentry_sync.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define QUOTA_BUCKETS 4096
+
+/**
+ * The categories of files, in the order in which they are evicted.
+ */
+typedef enum {
+    QUOTA_SPOOL,
+    QUOTA_RUN,
+    QUOTA_EXTERNAL,
+    QUOTA_CATEGORY_COUNT,
+} quota_category_t;
+
+/**
+ * A tracked file. Files that may be evicted are kept in the list of their
+ * category, ordered from the oldest to the newest.
+ */
+typedef struct quota_entry_s {
+    sentry_path_t *path;
+    uint64_t hash;
+    size_t size;
+    bool evictable;
+    struct quota_entry_s *bucket_next;
+    struct quota_entry_s *prev;
+    struct quota_entry_s *next;
+} quota_entry_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_lock)
+#else
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+#endif
+static bool g_enabled = false;
+static size_t g_max_size = 0;
+static size_t g_max_files = 0;
+static sentry_path_t *g_run_path = NULL;
+static size_t g_size = 0;
+static size_t g_files = 0;
+static quota_entry_t *g_buckets[QUOTA_BUCKETS];
+// the sentinels of the eviction lists, `next` is the oldest entry
+static quota_entry_t g_lists[QUOTA_CATEGORY_COUNT];
+
+static uint64_t
+hash_path(const char *path)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *)path; *c; c++) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool
+is_separator(char c)
+{
+#ifdef SENTRY_PLATFORM_WINDOWS
+    return c == '\\' || c == '/';
+#else
+    return c == '/';
+#endif
+}
+
+static bool
+is_inside(const sentry_path_t *path, const sentry_path_t *dir)
+{
+    size_t dir_len = strlen(dir->path);
+    return strncmp(path->path, dir->path, dir_len) == 0
+        && is_separator(path->path[dir_len]);
+}
+
+static quota_category_t
+get_category(const sentry_path_t *path)
+{
+    const char *filename = sentry__path_filename(path);
+    if (strncmp(filename, "spool", strlen("spool")) == 0) {
+        return QUOTA_SPOOL;
+    }
+    sentry_path_t *dir = sentry__path_dir(path);
+    bool external = dir && sentry__path_filename_matches(dir, "external");
+    sentry__path_free(dir);
+    return external ? QUOTA_EXTERNAL : QUOTA_RUN;
+}
+
+static quota_entry_t *
+lookup(const sentry_path_t *path, uint64_t hash)
+{
+    quota_entry_t *entry = g_buckets[hash % QUOTA_BUCKETS];
+    while (entry
+        && (entry->hash != hash || strcmp(entry->path->path, path->path))) {
+        entry = entry->bucket_next;
+    }
+    return entry;
+}
+
+static void
+remove_entry(quota_entry_t *entry)
+{
+    quota_entry_t **link = &g_buckets[entry->hash % QUOTA_BUCKETS];
+    while (*link != entry) {
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+    if (entry->evictable) {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+    }
+    g_size -= entry->size;
+    g_files--;
+    sentry__path_free(entry->path);
+    sentry_free(entry);
+}
+
+/**
+ * Evicts the oldest files of the lowest category until the tracked files are
+ * within the quota again, or only files of the current run are left.
+ */
+static void
+enforce_quota(void)
+{
+    while ((g_max_size && g_size > g_max_size)
+        || (g_max_files && g_files > g_max_files)) {
+        quota_entry_t *victim = NULL;
+        for (int i = 0; i < QUOTA_CATEGORY_COUNT && !victim; i++) {
+            if (g_lists[i].next != &g_lists[i]) {
+                victim = g_lists[i].next;
+            }
+        }
+        if (!victim) {
+            return;
+        }
+        SENTRY_DEBUGF("database quota exceeded, removing \"%s\"",
+            victim->path->path);
+        sentry__path_remove(victim->path);
+        remove_entry(victim);
+    }
+}
+
+static void
+track(const sentry_path_t *path, size_t size)
+{
+    uint64_t hash = hash_path(path->path);
+    quota_entry_t *entry = lookup(path, hash);
+    if (entry) {
+        g_size = g_size - entry->size + size;
+        entry->size = size;
+        return;
+    }
+
+    entry = SENTRY_MAKE(quota_entry_t);
+    if (!entry) {
+        return;
+    }
+    memset(entry, 0, sizeof(quota_entry_t));
+    entry->path = sentry__path_clone(path);
+    if (!entry->path) {
+        sentry_free(entry);
+        return;
+    }
+    entry->hash = hash;
+    entry->size = size;
+    entry->bucket_next = g_buckets[hash % QUOTA_BUCKETS];
+    g_buckets[hash % QUOTA_BUCKETS] = entry;
+    g_size += size;
+    g_files++;
+
+    entry->evictable = !g_run_path || !is_inside(path, g_run_path);
+    if (entry->evictable) {
+        quota_entry_t *list = &g_lists[get_category(path)];
+        entry->prev = list->prev;
+        entry->next = list;
+        list->prev->next = entry;
+        list->prev = entry;
+    }
+}
+
+static void
+clear(void)
+{
+    for (size_t i = 0; i < QUOTA_BUCKETS; i++) {
+        while (g_buckets[i]) {
+            remove_entry(g_buckets[i]);
+        }
+    }
+    for (int i = 0; i < QUOTA_CATEGORY_COUNT; i++) {
+        g_lists[i].prev = &g_lists[i];
+        g_lists[i].next = &g_lists[i];
+    }
+    sentry__path_free(g_run_path);
+    g_run_path = NULL;
+    g_enabled = false;
+}
+
+void
+sentry__quota_start(const sentry_options_t *options)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    clear();
+    g_max_size = options->database_max_size;
+    g_max_files = options->database_max_files;
+    if (g_max_size || g_max_files) {
+        g_enabled = true;
+        g_run_path = options->run ? sentry__path_clone(options->run->run_path)
+                                  : NULL;
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+typedef struct {
+    sentry_path_t *path;
+    time_t mtime;
+    size_t size;
+} scanned_file_t;
+
+typedef struct {
+    scanned_file_t *files;
+    size_t len;
+    size_t capacity;
+} scanned_files_t;
+
+static void
+scan_dir(scanned_files_t *scanned, const sentry_path_t *dir)
+{
+    sentry_pathiter_t *iter = sentry__path_iter_directory(dir);
+    const sentry_path_t *file;
+    while (iter && (file = sentry__pathiter_next(iter)) != NULL) {
+        if (!sentry__path_is_file(file)) {
+            continue;
+        }
+        if (scanned->len == scanned->capacity) {
+            size_t capacity = scanned->capacity ? scanned->capacity * 2 : 64;
+            scanned_file_t *files
+                = sentry_malloc(sizeof(scanned_file_t) * capacity);
+            if (!files) {
+                break;
+            }
+            if (scanned->files) {
+                memcpy(files, scanned->files,
+                    sizeof(scanned_file_t) * scanned->len);
+                sentry_free(scanned->files);
+            }
+            scanned->files = files;
+            scanned->capacity = capacity;
+        }
+        scanned_file_t *scanned_file = &scanned->files[scanned->len];
+        scanned_file->path = sentry__path_clone(file);
+        if (!scanned_file->path) {
+            continue;
+        }
+        scanned_file->mtime = sentry__path_get_mtime(file);
+        scanned_file->size = sentry__path_get_size(file);
+        scanned->len++;
+    }
+    sentry__pathiter_free(iter);
+}
+
+/**
+ * Scans the run directory `dir` of a previous run, unless its lock is held by
+ * another process that is still running, just like
+ * `sentry__process_old_runs` skips such runs.
+ */
+static void
+scan_old_run(scanned_files_t *scanned, const sentry_path_t *dir)
+{
+    sentry_path_t *lockfile = sentry__path_append_str(dir, ".lock");
+    if (!lockfile) {
+        return;
+    }
+    sentry_filelock_t *lock = sentry__filelock_new(lockfile);
+    if (!lock) {
+        return;
+    }
+    if (sentry__filelock_try_lock(lock)) {
+        scan_dir(scanned, dir);
+        sentry__filelock_unlock(lock);
+    }
+    sentry__filelock_free(lock);
+}
+
+static int
+compare_mtime(const void *a, const void *b)
+{
+    time_t mtime_a = ((const scanned_file_t *)a)->mtime;
+    time_t mtime_b = ((const scanned_file_t *)b)->mtime;
+    return mtime_a < mtime_b ? -1 : (mtime_a > mtime_b ? 1 : 0);
+}
+
+void
+sentry__quota_scan(const sentry_path_t *database_path)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    bool enabled = g_enabled;
+    sentry_path_t *run_path
+        = g_run_path ? sentry__path_clone(g_run_path) : NULL;
+    sentry__mutex_unlock(&g_lock);
+    if (!enabled) {
+        sentry__path_free(run_path);
+        return;
+    }
+
+    // the directories are walked without holding the lock, files that are
+    // written in the meantime are tracked only once
+    scanned_files_t scanned = { NULL, 0, 0 };
+    sentry_pathiter_t *iter = sentry__path_iter_directory(database_path);
+    const sentry_path_t *dir;
+    while (iter && (dir = sentry__pathiter_next(iter)) != NULL) {
+        if (!sentry__path_is_dir(dir)) {
+            continue;
+        }
+        if (sentry__path_filename_matches(dir, "external")
+            || (run_path && strcmp(dir->path, run_path->path) == 0)) {
+            scan_dir(&scanned, dir);
+        } else if (sentry__path_ends_with(dir, ".run")) {
+            scan_old_run(&scanned, dir);
+        }
+    }
+    sentry__pathiter_free(iter);
+    sentry__path_free(run_path);
+    qsort(scanned.files, scanned.len, sizeof(scanned_file_t), compare_mtime);
+
+    sentry__mutex_lock(&g_lock);
+    if (g_enabled) {
+        for (size_t i = 0; i < scanned.len; i++) {
+            track(scanned.files[i].path, scanned.files[i].size);
+        }
+        SENTRY_DEBUGF("database contains %zu files with %zu bytes", g_files,
+            g_size);
+        enforce_quota();
+    }
+    sentry__mutex_unlock(&g_lock);
+
+    for (size_t i = 0; i < scanned.len; i++) {
+        sentry__path_free(scanned.files[i].path);
+    }
+    sentry_free(scanned.files);
+}
+
+void
+sentry__quota_track(const sentry_path_t *path, size_t size)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    if (g_enabled) {
+        track(path, size);
+        enforce_quota();
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__quota_untrack(const sentry_path_t *path)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    if (g_enabled) {
+        quota_entry_t *entry = lookup(path, hash_path(path->path));
+        if (entry) {
+            remove_entry(entry);
+        }
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__quota_untrack_dir(const sentry_path_t *path)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    for (size_t i = 0; g_enabled && i < QUOTA_BUCKETS; i++) {
+        quota_entry_t **link = &g_buckets[i];
+        while (*link) {
+            quota_entry_t *entry = *link;
+            if (is_inside(entry->path, path)) {
+                // this unlinks the entry from the bucket
+                remove_entry(entry);
+            } else {
+                link = &entry->bucket_next;
+            }
+        }
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__quota_get_usage(size_t *size_out, size_t *files_out)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    *size_out = g_size;
+    *files_out = g_files;
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__quota_stop(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    clear();
+    sentry__mutex_unlock(&g_lock);
+}
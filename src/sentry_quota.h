@@ -0,0 +1,65 @@
+#ifndef SENTRY_QUOTA_H_INCLUDED
+#define SENTRY_QUOTA_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_path.h"
+
+/**
+ * The disk quota of the database directory keeps a running count of the size
+ * and number of the files that the SDK stores there, so that the limits set
+ * with `sentry_options_set_database_max_size` and
+ * `sentry_options_set_database_max_files` can be checked on every write
+ * without walking the directory.
+ *
+ * Once a limit is exceeded, files of previous runs are evicted, lowest
+ * priority first and oldest first within the same priority: spooled envelopes,
+ * then all other files of previous runs, and finally the crash reports of the
+ * external crash reporter. Files of the current run count towards the limits,
+ * but are never evicted, and runs that are locked by another process that is
+ * still running are not counted at all.
+ *
+ * The reports of the `crashpad` backend are left out, as they are owned by its
+ * `CrashReportDatabase`, which prunes them with its own limits.
+ */
+
+/**
+ * Enables the quota with the limits from the `options`, forgetting about all
+ * previously tracked files. Does nothing if no limit is set.
+ */
+void sentry__quota_start(const sentry_options_t *options);
+
+/**
+ * Starts tracking all files of the current run, of previous runs that are not
+ * locked by another process and of the `external` directory in
+ * `database_path`, evicting files if they exceed the quota.
+ */
+void sentry__quota_scan(const sentry_path_t *database_path);
+
+/**
+ * Records that the file at `path` was written and now has `size` bytes, and
+ * evicts files if the quota is exceeded.
+ */
+void sentry__quota_track(const sentry_path_t *path, size_t size);
+
+/**
+ * Records that the file at `path` was removed.
+ */
+void sentry__quota_untrack(const sentry_path_t *path);
+
+/**
+ * Records that the directory at `path` was removed with all its files.
+ */
+void sentry__quota_untrack_dir(const sentry_path_t *path);
+
+/**
+ * Retrieves the tracked size and number of files.
+ */
+void sentry__quota_get_usage(size_t *size_out, size_t *files_out);
+
+/**
+ * Disables the quota and frees its state.
+ */
+void sentry__quota_stop(void);
+
+#endif
@@ -1,6 +1,17 @@
 #include "sentry_ringbuffer.h"
 #include "sentry_alloc.h"
+#include "sentry_cpu_relax.h"
 #include "sentry_logger.h"
+#include "sentry_sync.h"
+
+#define RB_UNALLOCATED 0
+#define RB_ALLOCATING 1
+#define RB_ALLOCATED 2
+
+// slots are only ever held for a handful of instructions, but we must not
+// spin forever if the owner got interrupted by a signal handler that now
+// wants the same slot.
+#define SLOT_LOCK_SPINS (1 << 16)
 
 sentry_ringbuffer_t *
 sentry__ringbuffer_new(size_t max_size)
@@ -10,9 +21,11 @@ sentry__ringbuffer_new(size_t max_size)
         return NULL;
     }
 
-    rb->list = sentry_value_new_list();
+    rb->slots = NULL;
+    rb->capacity = 0;
     rb->max_size = max_size;
-    rb->start_idx = 0;
+    rb->head = 0;
+    rb->alloc_state = RB_UNALLOCATED;
 
     return rb;
 }
@@ -24,10 +37,79 @@ sentry__ringbuffer_free(sentry_ringbuffer_t *rb)
         return;
     }
 
-    sentry_value_decref(rb->list);
+    if (rb->slots) {
+        for (size_t i = 0; i < rb->capacity; i++) {
+            sentry_value_decref(rb->slots[i].value);
+        }
+    }
+    sentry_free(rb->slots);
     sentry_free(rb);
 }
 
+static bool
+ensure_slots(sentry_ringbuffer_t *rb)
+{
+    while (true) {
+        long state = sentry__atomic_fetch(&rb->alloc_state);
+        if (state == RB_ALLOCATED) {
+            return true;
+        }
+        if (state == RB_ALLOCATING
+            || !sentry__atomic_compare_swap(
+                &rb->alloc_state, RB_UNALLOCATED, RB_ALLOCATING)) {
+            // somebody else is allocating or resizing right now
+            sentry__cpu_relax();
+            continue;
+        }
+
+        size_t capacity = rb->max_size;
+        sentry_ringbuffer_slot_t *slots
+            = sentry_malloc(sizeof(sentry_ringbuffer_slot_t) * capacity);
+        if (!slots) {
+            sentry__atomic_store(&rb->alloc_state, RB_UNALLOCATED);
+            return false;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            slots[i].busy = 0;
+            slots[i].seq = 0;
+            slots[i].value = sentry_value_new_null();
+            slots[i].timestamp = 0;
+        }
+        rb->slots = slots;
+        rb->capacity = capacity;
+        sentry__atomic_store(&rb->alloc_state, RB_ALLOCATED);
+        return true;
+    }
+}
+
+static bool
+lock_slot(sentry_ringbuffer_slot_t *slot)
+{
+    for (long i = 0; i < SLOT_LOCK_SPINS; i++) {
+        if (sentry__atomic_compare_swap(&slot->busy, 0, 1)) {
+            return true;
+        }
+        sentry__cpu_relax();
+    }
+    return false;
+}
+
+static void
+unlock_slot(sentry_ringbuffer_slot_t *slot)
+{
+    sentry__atomic_store(&slot->busy, 0);
+}
+
+/**
+ * Whether sequence number `a` was published after `b`, taking wrap-around
+ * of the ticket counter into account.
+ */
+static bool
+seq_is_newer(long a, long b)
+{
+    return a != 0 && (long)((unsigned long)a - (unsigned long)b) > 0;
+}
+
 int
 sentry__ringbuffer_append(sentry_ringbuffer_t *rb, sentry_value_t value)
 {
@@ -36,43 +118,139 @@ sentry__ringbuffer_append(sentry_ringbuffer_t *rb, sentry_value_t value)
         return -1;
     }
 
-    size_t current_len = sentry_value_get_length(rb->list);
+    if (!rb->max_size || !ensure_slots(rb)) {
+        SENTRY_WARNF(
+            "Failed to append to ringbuffer with max_size (%zu)", rb->max_size);
+        sentry_value_decref(value);
+        return -1;
+    }
 
-    if (current_len < rb->max_size) {
-        return sentry_value_append(rb->list, value);
-    } else if (current_len == rb->max_size) {
-        sentry_value_set_by_index(rb->list, rb->start_idx, value);
-        rb->start_idx = (rb->start_idx + 1) % rb->max_size;
+    uint64_t timestamp = sentry__value_get_usec_timestamp(value);
+    unsigned long ticket
+        = (unsigned long)sentry__atomic_fetch_and_add(&rb->head, 1);
+    long seq = (long)(ticket + 1);
+    sentry_ringbuffer_slot_t *slot = &rb->slots[ticket % rb->capacity];
 
-        return 0;
-    } else {
-        SENTRY_WARNF("Ringbuffer list size (%zu) exceeds max_size (%zu)",
-            current_len, rb->max_size);
+    if (!lock_slot(slot)) {
         sentry_value_decref(value);
         return -1;
     }
+    sentry_value_t replaced;
+    if (seq_is_newer(slot->seq, seq)) {
+        // a writer that claimed this slot one lap later was faster than us,
+        // so our value is already outdated
+        replaced = value;
+    } else {
+        replaced = slot->value;
+        slot->value = value;
+        slot->timestamp = timestamp;
+        sentry__atomic_store(&slot->seq, seq);
+    }
+    unlock_slot(slot);
+
+    // the oldest value might be the last reference to a big object, so don't
+    // free it while holding the slot
+    sentry_value_decref(replaced);
+    return 0;
 }
 
-sentry_value_t
-sentry__ringbuffer_to_list(const sentry_ringbuffer_t *rb)
+size_t
+sentry__ringbuffer_len(sentry_ringbuffer_t *rb)
 {
     if (!rb) {
-        return sentry_value_new_null();
+        return 0;
     }
+    unsigned long head = (unsigned long)sentry__atomic_fetch(&rb->head);
+    size_t capacity
+        = sentry__atomic_fetch(&rb->alloc_state) == RB_ALLOCATED
+        ? rb->capacity
+        : rb->max_size;
+    return head < capacity ? (size_t)head : capacity;
+}
 
-    size_t current_len = sentry_value_get_length(rb->list);
+size_t
+sentry__ringbuffer_snapshot(
+    sentry_ringbuffer_t *rb, sentry_ringbuffer_snapshot_t *snapshot)
+{
+    snapshot->items = snapshot->inline_items;
+    snapshot->len = 0;
+    if (!rb || sentry__atomic_fetch(&rb->alloc_state) != RB_ALLOCATED) {
+        return 0;
+    }
+
+    unsigned long head = (unsigned long)sentry__atomic_fetch(&rb->head);
+    size_t count = head < rb->capacity ? (size_t)head : rb->capacity;
+    if (count == 0) {
+        return 0;
+    }
+    sentry_ringbuffer_item_t *items = snapshot->inline_items;
+    if (count > SENTRY_RINGBUFFER_INLINE_ITEMS) {
+        items = sentry_malloc(sizeof(sentry_ringbuffer_item_t) * count);
+        if (!items) {
+            return 0;
+        }
+    }
 
-    sentry_value_t result = sentry_value_new_list();
+    // only take the values that were published with exactly the tickets we
+    // look at. Slots that are still being written to, or that have already
+    // been overwritten since we read `head`, are skipped.
+    size_t len = 0;
+    for (unsigned long ticket = head - count; ticket != head; ticket++) {
+        sentry_ringbuffer_slot_t *slot = &rb->slots[ticket % rb->capacity];
+        if (!lock_slot(slot)) {
+            continue;
+        }
+        if (slot->seq == (long)(ticket + 1)) {
+            sentry_value_incref(slot->value);
+            items[len].value = slot->value;
+            items[len].timestamp = slot->timestamp;
+            len++;
+        }
+        unlock_slot(slot);
+    }
 
-    for (size_t i = 0; i < current_len; i++) {
-        size_t idx = (rb->start_idx + i) % current_len;
-        sentry_value_t item = sentry_value_get_by_index(rb->list, idx);
-        sentry_value_incref(item);
-        sentry_value_append(result, item);
+    if (len == 0 && items != snapshot->inline_items) {
+        sentry_free(items);
+        return 0;
     }
+    snapshot->items = items;
+    snapshot->len = len;
+    return len;
+}
+
+void
+sentry__ringbuffer_snapshot_free(sentry_ringbuffer_snapshot_t *snapshot)
+{
+    for (size_t i = 0; i < snapshot->len; i++) {
+        sentry_value_decref(snapshot->items[i].value);
+    }
+    if (snapshot->items != snapshot->inline_items) {
+        sentry_free(snapshot->items);
+    }
+    snapshot->items = snapshot->inline_items;
+    snapshot->len = 0;
+}
+
+#ifdef SENTRY_UNITTEST
+sentry_value_t
+sentry__ringbuffer_to_list(sentry_ringbuffer_t *rb)
+{
+    if (!rb) {
+        return sentry_value_new_null();
+    }
+
+    sentry_ringbuffer_snapshot_t snapshot;
+    size_t len = sentry__ringbuffer_snapshot(rb, &snapshot);
+    sentry_value_t result = sentry__value_new_list_with_size(len);
+    for (size_t i = 0; i < len; i++) {
+        sentry_value_incref(snapshot.items[i].value);
+        sentry_value_append(result, snapshot.items[i].value);
+    }
+    sentry__ringbuffer_snapshot_free(&snapshot);
 
     return result;
 }
+#endif
 
 void
 sentry__ringbuffer_set_max_size(sentry_ringbuffer_t *rb, size_t max_size)
@@ -81,12 +259,13 @@ sentry__ringbuffer_set_max_size(sentry_ringbuffer_t *rb, size_t max_size)
         return;
     }
 
-    size_t current_len = sentry_value_get_length(rb->list);
-
     // If there are already values in the ringbuffer, don't change anything
     // This function is only meant to be called during initialization
-    if (current_len > 0) {
+    if (sentry__atomic_fetch(&rb->head) != 0
+        || !sentry__atomic_compare_swap(
+            &rb->alloc_state, RB_UNALLOCATED, RB_ALLOCATING)) {
         return;
     }
     rb->max_size = max_size;
+    sentry__atomic_store(&rb->alloc_state, RB_UNALLOCATED);
 }
@@ -4,19 +4,46 @@
 #include "sentry_boot.h"
 #include "sentry_value.h"
 
+/**
+ * A single record of a ringbuffer snapshot: the value itself, and its
+ * `timestamp` in microseconds since the epoch, or 0 if it doesn't have one.
+ */
+typedef struct {
+    sentry_value_t value;
+    uint64_t timestamp;
+} sentry_ringbuffer_item_t;
+
+/**
+ * A slot of the ringbuffer. `seq` is the ticket that was last published into
+ * the slot plus one, or 0 if the slot was never written. `busy` guards the
+ * value while it is being swapped out or referenced by a reader.
+ */
+typedef struct {
+    volatile long busy;
+    volatile long seq;
+    sentry_value_t value;
+    uint64_t timestamp;
+} sentry_ringbuffer_slot_t;
+
 /**
  * A ringbuffer for storing values with a fixed maximum size.
  *
- * This encapsulates the list of arbitrary sentry_value_t items and wraps it
- * with ring-buffer behavior. This list grows exponentially until it reaches
- * max_size, after which it behaves entirely like a fixed-size ringbuffer.
+ * Any number of threads can append to it concurrently, without taking a lock:
+ * Each append claims a ticket by atomically incrementing `head`, which selects
+ * its slot, and publishes the value there together with the ticket. Readers
+ * take a snapshot of the last `capacity` tickets, and skip the slots that have
+ * not been published yet, or have already been overwritten by a newer ticket.
  *
- * This is currently not thread-safe.
+ * The `capacity` slots are allocated on the first append, according to the
+ * `max_size` at that time. The timestamp of each value is parsed once when it
+ * is appended, so that records can be ordered by plain integer comparisons.
  */
 typedef struct sentry_ringbuffer_s {
-    sentry_value_t list;
+    sentry_ringbuffer_slot_t *slots;
+    size_t capacity;
     size_t max_size;
-    size_t start_idx;
+    volatile long head;
+    volatile long alloc_state;
 } sentry_ringbuffer_t;
 
 /**
@@ -27,6 +54,7 @@ sentry_ringbuffer_t *sentry__ringbuffer_new(size_t max_size);
 
 /**
  * Free a ringbuffer and decref all its contents.
+ * Nobody may use the ringbuffer concurrently.
  */
 void sentry__ringbuffer_free(sentry_ringbuffer_t *rb);
 
@@ -37,11 +65,46 @@ void sentry__ringbuffer_free(sentry_ringbuffer_t *rb);
  */
 int sentry__ringbuffer_append(sentry_ringbuffer_t *rb, sentry_value_t value);
 
+/**
+ * Returns the number of values in the ringbuffer, including the ones that are
+ * still being appended.
+ */
+size_t sentry__ringbuffer_len(sentry_ringbuffer_t *rb);
+
+// snapshots of up to the default number of breadcrumbs don't allocate
+#define SENTRY_RINGBUFFER_INLINE_ITEMS 100
+
+/**
+ * A snapshot of the records of a ringbuffer. `items` points either to
+ * `inline_items`, or to an allocation for snapshots that don't fit there.
+ */
+typedef struct {
+    sentry_ringbuffer_item_t *items;
+    size_t len;
+    sentry_ringbuffer_item_t inline_items[SENTRY_RINGBUFFER_INLINE_ITEMS];
+} sentry_ringbuffer_snapshot_t;
+
+/**
+ * Takes a snapshot of the values in the ringbuffer in chronological order.
+ *
+ * Returns the number of records in `snapshot`, which holds a reference to each
+ * value. It has to be released with `sentry__ringbuffer_snapshot_free`.
+ */
+size_t sentry__ringbuffer_snapshot(
+    sentry_ringbuffer_t *rb, sentry_ringbuffer_snapshot_t *snapshot);
+
+/**
+ * Decrefs the values of a snapshot and frees its allocation, if any.
+ */
+void sentry__ringbuffer_snapshot_free(sentry_ringbuffer_snapshot_t *snapshot);
+
+#ifdef SENTRY_UNITTEST
 /**
  * Convert the ringbuffer to a regular list in chronological order.
  * Returns a new list containing all values in the ringbuffer.
  */
-sentry_value_t sentry__ringbuffer_to_list(const sentry_ringbuffer_t *rb);
+sentry_value_t sentry__ringbuffer_to_list(sentry_ringbuffer_t *rb);
+#endif
 
 /**
  * Update the maximum size of the ringbuffer. This only works during
@@ -3,6 +3,7 @@
 #include "sentry_attachment.h"
 #include "sentry_backend.h"
 #include "sentry_core.h"
+#include "sentry_cpu_relax.h"
 #include "sentry_database.h"
 #include "sentry_options.h"
 #include "sentry_os.h"
@@ -25,6 +26,18 @@
 
 static bool g_scope_initialized = false;
 static sentry_scope_t g_scope = { 0 };
+// Breadcrumbs are added to the global scope without taking its lock. These
+// make sure that the ringbuffer isn't freed while somebody is appending.
+static volatile long g_breadcrumbs_open = 0;
+static volatile long g_breadcrumb_writers = 0;
+
+// Backends that persist the scope on every change get those flushes
+// coalesced on a background thread. The flusher is guarded by `g_lock`.
+static sentry_bgworker_t *g_scope_flusher = NULL;
+static volatile long g_scope_dirty = 0;
+// Incremented on every change that is flushed, so that backends can tell
+// whether data they derived from the scope is still current.
+static volatile long g_scope_generation = 0;
 #ifdef SENTRY__MUTEX_INIT_DYN
 SENTRY__MUTEX_INIT_DYN(g_lock)
 #else
@@ -99,6 +112,7 @@ get_scope(void)
     g_scope.client_sdk = get_client_sdk();
 
     g_scope_initialized = true;
+    sentry__atomic_store(&g_breadcrumbs_open, 1);
 
     return &g_scope;
 }
@@ -129,6 +143,10 @@ sentry__scope_cleanup(void)
     sentry__mutex_lock(&g_lock);
     if (g_scope_initialized) {
         g_scope_initialized = false;
+        sentry__atomic_store(&g_breadcrumbs_open, 0);
+        while (sentry__atomic_fetch(&g_breadcrumb_writers) != 0) {
+            sentry__cpu_relax();
+        }
         cleanup_scope(&g_scope);
     }
     sentry__mutex_unlock(&g_lock);
@@ -150,18 +168,117 @@ sentry__scope_unlock(void)
 }
 
 void
-sentry__scope_flush_unlock(void)
+sentry__scope_add_breadcrumb(sentry_value_t breadcrumb)
 {
+    sentry__atomic_fetch_and_add(&g_breadcrumb_writers, 1);
+    if (sentry__atomic_fetch(&g_breadcrumbs_open)) {
+        sentry__ringbuffer_append(g_scope.breadcrumbs, breadcrumb);
+        sentry__atomic_fetch_and_add(&g_breadcrumb_writers, -1);
+        return;
+    }
+    sentry__atomic_fetch_and_add(&g_breadcrumb_writers, -1);
+
+    // the global scope doesn't exist yet, so create it under the lock
+    sentry_scope_t *scope = sentry__scope_lock();
+    sentry_scope_add_breadcrumb(scope, breadcrumb);
     sentry__scope_unlock();
+}
+
+static void
+flush_scope_now(void)
+{
     SENTRY_WITH_OPTIONS (options) {
-        // we try to unlock the scope as soon as possible. The
-        // backend will do its own `WITH_SCOPE` internally.
+        // the backend will do its own `WITH_SCOPE` internally.
         if (options->backend && options->backend->flush_scope_func) {
             options->backend->flush_scope_func(options->backend, options);
         }
     }
 }
 
+static void
+flush_scope_task(void *UNUSED(task_data), void *state)
+{
+    // The flusher holds its own reference to the options, as `sentry_init`
+    // shuts it down while holding the global options lock.
+    sentry_options_t *options = state;
+
+    // everything that changed up to here is covered by this flush
+    if (sentry__atomic_store(&g_scope_dirty, 0)) {
+        options->backend->flush_scope_func(options->backend, options);
+    }
+}
+
+static void
+free_flusher_options(void *state)
+{
+    sentry_options_free(state);
+}
+
+void
+sentry__scope_flusher_start(sentry_options_t *options)
+{
+    sentry_bgworker_t *flusher = sentry__bgworker_new(
+        sentry__options_incref(options), free_flusher_options);
+    if (!flusher) {
+        return;
+    }
+    sentry__bgworker_setname(flusher, "sentry-scope");
+    if (sentry__bgworker_start(flusher) != 0) {
+        sentry__bgworker_decref(flusher);
+        return;
+    }
+
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    g_scope_flusher = flusher;
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__scope_flusher_shutdown(uint64_t timeout)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    sentry_bgworker_t *flusher = g_scope_flusher;
+    g_scope_flusher = NULL;
+    sentry__mutex_unlock(&g_lock);
+
+    if (!flusher) {
+        return;
+    }
+    // this runs any pending flush before the worker exits
+    if (sentry__bgworker_shutdown(flusher, timeout) != 0) {
+        SENTRY_WARN("scope flusher did not shut down cleanly");
+    }
+    sentry__bgworker_decref(flusher);
+}
+
+void
+sentry__scope_flush_unlock(void)
+{
+    sentry__atomic_fetch_and_add(&g_scope_generation, 1);
+    if (!g_scope_flusher) {
+        // we try to unlock the scope as soon as possible.
+        sentry__scope_unlock();
+        flush_scope_now();
+        return;
+    }
+
+    // Only the first change after a flush schedules another one. Any further
+    // changes until that flush runs are written out by it as well.
+    if (sentry__atomic_store(&g_scope_dirty, 1) == 0) {
+        sentry__bgworker_submit(g_scope_flusher, flush_scope_task, NULL, NULL);
+    }
+    sentry__scope_unlock();
+}
+
+void
+sentry__scope_request_flush(void)
+{
+    sentry__scope_lock();
+    sentry__scope_flush_unlock();
+}
+
 sentry_scope_t *
 sentry_local_scope_new(void)
 {
@@ -268,6 +385,20 @@ sentry__symbolize_stacktrace(sentry_value_t stacktrace)
     }
 
     size_t len = sentry_value_get_length(frames);
+    if (!len) {
+        return;
+    }
+    // all frames are resolved in one batch, so that the symbolizer only has
+    // to look at the loaded modules once per stacktrace. Frames that were
+    // seen before are taken from the cache.
+    void **addrs = sentry_malloc(sizeof(void *) * len);
+    sentry_value_t *frame_values = sentry_malloc(sizeof(sentry_value_t) * len);
+    void **data = sentry_malloc(sizeof(void *) * len);
+    if (!addrs || !frame_values || !data) {
+        goto done;
+    }
+
+    size_t count = 0;
     for (size_t i = 0; i < len; i++) {
         sentry_value_t frame = sentry_value_get_by_index(frames, i);
 
@@ -283,8 +414,17 @@ sentry__symbolize_stacktrace(sentry_value_t stacktrace)
         if (!addr) {
             continue;
         }
-        sentry__symbolize((void *)addr, sentry__symbolize_frame, &frame);
+        addrs[count] = (void *)addr;
+        frame_values[count] = frame;
+        data[count] = &frame_values[count];
+        count++;
     }
+    sentry__symbolize_cached(addrs, count, sentry__symbolize_frame, data);
+
+done:
+    sentry_free(addrs);
+    sentry_free(frame_values);
+    sentry_free(data);
 }
 #endif
 
@@ -313,56 +453,66 @@ sentry__scope_get_span_or_transaction(void)
 #endif
 
 static int
-cmp_breadcrumb(sentry_value_t a, sentry_value_t b, bool *error)
+cmp_breadcrumb(uint64_t timestamp_a, uint64_t timestamp_b, bool *error)
 {
-    sentry_value_t timestamp_a = sentry_value_get_by_key(a, "timestamp");
-    sentry_value_t timestamp_b = sentry_value_get_by_key(b, "timestamp");
-    if (sentry_value_is_null(timestamp_a)) {
+    if (!timestamp_a) {
         *error = true;
         return -1;
     }
-    if (sentry_value_is_null(timestamp_b)) {
+    if (!timestamp_b) {
         *error = true;
         return 1;
     }
 
-    return strcmp(sentry_value_as_string(timestamp_a),
-        sentry_value_as_string(timestamp_b));
+    return timestamp_a < timestamp_b ? -1 : timestamp_a > timestamp_b ? 1 : 0;
 }
 
-static bool
-append_breadcrumb(sentry_value_t target, sentry_value_t source, size_t index)
+static void
+append_breadcrumb(sentry_value_t target, sentry_value_t breadcrumb)
 {
-    int rv = sentry_value_append(
-        target, sentry_value_get_by_index_owned(source, index));
-    if (rv != 0) {
+    sentry_value_incref(breadcrumb);
+    if (sentry_value_append(target, breadcrumb) != 0) {
         SENTRY_ERROR("Failed to merge breadcrumbs");
-        sentry_value_decref(target);
-        return false;
     }
-    return true;
 }
 
+/**
+ * Merges the breadcrumbs already on the event with a snapshot of the scopes'
+ * ringbuffer, in timestamp order, keeping only the newest `max`.
+ *
+ * The ringbuffer already knows the timestamp of each of its records, so only
+ * the event breadcrumbs, if any, need to have their timestamps parsed.
+ */
 static sentry_value_t
-merge_breadcrumbs(sentry_value_t list_a, sentry_value_t list_b, size_t max)
+merge_breadcrumbs(sentry_value_t list_a, sentry_ringbuffer_t *rb_b, size_t max)
 {
     size_t len_a = sentry_value_get_type(list_a) == SENTRY_VALUE_TYPE_LIST
         ? sentry_value_get_length(list_a)
         : 0;
-    size_t len_b = sentry_value_get_type(list_b) == SENTRY_VALUE_TYPE_LIST
-        ? sentry_value_get_length(list_b)
-        : 0;
+    sentry_ringbuffer_snapshot_t snapshot_b;
+    size_t len_b = sentry__ringbuffer_snapshot(rb_b, &snapshot_b);
+    const sentry_ringbuffer_item_t *items_b = snapshot_b.items;
 
     if (len_a == 0 && len_b == 0) {
         return sentry_value_new_null();
-    } else if (len_a == 0) {
-        sentry_value_incref(list_b);
-        return list_b;
     } else if (len_b == 0) {
         sentry_value_incref(list_a);
         return list_a;
     }
 
+    uint64_t *timestamps_a = NULL;
+    if (len_a > 0) {
+        timestamps_a = sentry_malloc(sizeof(uint64_t) * len_a);
+        if (!timestamps_a) {
+            sentry__ringbuffer_snapshot_free(&snapshot_b);
+            return sentry_value_new_null();
+        }
+        for (size_t i = 0; i < len_a; i++) {
+            timestamps_a[i] = sentry__value_get_usec_timestamp(
+                sentry_value_get_by_index(list_a, i));
+        }
+    }
+
     bool error = false;
     size_t idx_a = 0;
     size_t idx_b = 0;
@@ -372,10 +522,9 @@ merge_breadcrumbs(sentry_value_t list_a, sentry_value_t list_b, size_t max)
 
     // skip oldest breadcrumbs to fit max
     while (idx_a < len_a && idx_b < len_b && idx_a + idx_b < skip) {
-        sentry_value_t item_a = sentry_value_get_by_index(list_a, idx_a);
-        sentry_value_t item_b = sentry_value_get_by_index(list_b, idx_b);
-
-        if (cmp_breadcrumb(item_a, item_b, &error) <= 0) {
+        if (cmp_breadcrumb(
+                timestamps_a[idx_a], items_b[idx_b].timestamp, &error)
+            <= 0) {
             idx_a++;
         } else {
             idx_b++;
@@ -390,29 +539,23 @@ merge_breadcrumbs(sentry_value_t list_a, sentry_value_t list_b, size_t max)
 
     // merge the remaining breadcrumbs in timestamp order
     while (idx_a < len_a && idx_b < len_b) {
-        sentry_value_t item_a = sentry_value_get_by_index(list_a, idx_a);
-        sentry_value_t item_b = sentry_value_get_by_index(list_b, idx_b);
-
-        if (cmp_breadcrumb(item_a, item_b, &error) <= 0) {
-            if (!append_breadcrumb(result, list_a, idx_a++)) {
-                return sentry_value_new_null();
-            }
+        if (cmp_breadcrumb(
+                timestamps_a[idx_a], items_b[idx_b].timestamp, &error)
+            <= 0) {
+            append_breadcrumb(
+                result, sentry_value_get_by_index(list_a, idx_a++));
         } else {
-            if (!append_breadcrumb(result, list_b, idx_b++)) {
-                return sentry_value_new_null();
-            }
+            append_breadcrumb(result, items_b[idx_b++].value);
         }
     }
     while (idx_a < len_a) {
-        if (!append_breadcrumb(result, list_a, idx_a++)) {
-            return sentry_value_new_null();
-        }
+        append_breadcrumb(result, sentry_value_get_by_index(list_a, idx_a++));
     }
     while (idx_b < len_b) {
-        if (!append_breadcrumb(result, list_b, idx_b++)) {
-            return sentry_value_new_null();
-        }
+        append_breadcrumb(result, items_b[idx_b++].value);
     }
+    sentry_free(timestamps_a);
+    sentry__ringbuffer_snapshot_free(&snapshot_b);
 
     if (error) {
         SENTRY_WARN("Detected missing timestamps while merging breadcrumbs. "
@@ -422,6 +565,35 @@ merge_breadcrumbs(sentry_value_t list_a, sentry_value_t list_b, size_t max)
     return result;
 }
 
+static void
+apply_mode_to_event(const sentry_scope_t *scope,
+    const sentry_options_t *options, sentry_value_t event,
+    sentry_scope_mode_t mode)
+{
+    if (mode & SENTRY_SCOPE_BREADCRUMBS) {
+        sentry_value_t event_breadcrumbs
+            = sentry_value_get_by_key(event, "breadcrumbs");
+        sentry_value_set_by_key(event, "breadcrumbs",
+            merge_breadcrumbs(event_breadcrumbs, scope->breadcrumbs,
+                options->max_breadcrumbs));
+    }
+
+#if !defined(SENTRY_PLATFORM_NX)
+    if (mode & SENTRY_SCOPE_MODULES) {
+        sentry_value_t modules = sentry_get_modules_list();
+        if (!sentry_value_is_null(modules)) {
+            sentry_value_t debug_meta = sentry_value_new_object();
+            sentry_value_set_by_key(debug_meta, "images", modules);
+            sentry_value_set_by_key(event, "debug_meta", debug_meta);
+        }
+    }
+
+    if (mode & SENTRY_SCOPE_STACKTRACES) {
+        sentry__foreach_stacktrace(event, sentry__symbolize_stacktrace);
+    }
+#endif
+}
+
 void
 sentry__scope_apply_to_event(const sentry_scope_t *scope,
     const sentry_options_t *options, sentry_value_t event,
@@ -516,31 +688,7 @@ sentry__scope_apply_to_event(const sentry_scope_t *scope,
     }
     sentry_value_decref(contexts);
 
-    if (mode & SENTRY_SCOPE_BREADCRUMBS) {
-        sentry_value_t event_breadcrumbs
-            = sentry_value_get_by_key(event, "breadcrumbs");
-        sentry_value_t scope_breadcrumbs
-            = sentry__ringbuffer_to_list(scope->breadcrumbs);
-        sentry_value_set_by_key(event, "breadcrumbs",
-            merge_breadcrumbs(event_breadcrumbs, scope_breadcrumbs,
-                options->max_breadcrumbs));
-        sentry_value_decref(scope_breadcrumbs);
-    }
-
-#if !defined(SENTRY_PLATFORM_NX)
-    if (mode & SENTRY_SCOPE_MODULES) {
-        sentry_value_t modules = sentry_get_modules_list();
-        if (!sentry_value_is_null(modules)) {
-            sentry_value_t debug_meta = sentry_value_new_object();
-            sentry_value_set_by_key(debug_meta, "images", modules);
-            sentry_value_set_by_key(event, "debug_meta", debug_meta);
-        }
-    }
-
-    if (mode & SENTRY_SCOPE_STACKTRACES) {
-        sentry__foreach_stacktrace(event, sentry__symbolize_stacktrace);
-    }
-#endif
+    apply_mode_to_event(scope, options, event, mode);
 
 #undef PLACE_CLONED_VALUE
 #undef PLACE_VALUE
@@ -549,6 +697,71 @@ sentry__scope_apply_to_event(const sentry_scope_t *scope,
 #undef IS_NULL
 }
 
+sentry_value_t
+sentry__scope_new_event_skeleton(
+    const sentry_scope_t *scope, const sentry_options_t *options)
+{
+    sentry_value_t skeleton = sentry_value_new_object();
+    sentry__scope_apply_to_event(
+        scope, options, skeleton, SENTRY_SCOPE_MODULES);
+    return skeleton;
+}
+
+void
+sentry__scope_apply_skeleton_to_event(const sentry_scope_t *scope,
+    const sentry_options_t *options, sentry_value_t event,
+    sentry_value_t skeleton, sentry_scope_mode_t mode)
+{
+    // these are shared with the skeleton, just like they are shared with the
+    // scope when applying it directly
+    static const char *const placed_keys[] = { "platform", "release", "dist",
+        "environment", "user", "fingerprint", "transaction", "sdk",
+        "debug_meta" };
+    // and these get copied, as events are free to modify them
+    static const char *const merged_keys[] = { "tags", "extra", "contexts" };
+
+    for (size_t i = 0; i < sizeof(placed_keys) / sizeof(placed_keys[0]); i++) {
+        sentry_value_t value
+            = sentry_value_get_by_key(skeleton, placed_keys[i]);
+        if (sentry_value_is_null(value)
+            || !sentry_value_is_null(
+                sentry_value_get_by_key(event, placed_keys[i]))) {
+            continue;
+        }
+        sentry_value_incref(value);
+        sentry_value_set_by_key(event, placed_keys[i], value);
+    }
+    if (sentry_value_is_null(sentry_value_get_by_key(event, "type"))
+        && sentry_value_is_null(sentry_value_get_by_key(event, "level"))) {
+        sentry_value_t level = sentry_value_get_by_key(skeleton, "level");
+        sentry_value_incref(level);
+        sentry_value_set_by_key(event, "level", level);
+    }
+    for (size_t i = 0; i < sizeof(merged_keys) / sizeof(merged_keys[0]); i++) {
+        sentry_value_t value
+            = sentry_value_get_by_key(skeleton, merged_keys[i]);
+        sentry_value_t event_value
+            = sentry_value_get_by_key(event, merged_keys[i]);
+        if (sentry_value_is_null(event_value)) {
+            if (!sentry_value_is_null(value)) {
+                sentry_value_set_by_key(
+                    event, merged_keys[i], sentry__value_clone(value));
+            }
+        } else {
+            sentry__value_merge_objects(event_value, value);
+        }
+    }
+
+    // the module list is part of the skeleton already
+    apply_mode_to_event(scope, options, event, mode & ~SENTRY_SCOPE_MODULES);
+}
+
+long
+sentry__scope_generation(void)
+{
+    return sentry__atomic_fetch(&g_scope_generation);
+}
+
 void
 sentry_scope_add_breadcrumb(sentry_scope_t *scope, sentry_value_t breadcrumb)
 {
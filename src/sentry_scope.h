@@ -65,6 +65,13 @@ sentry_scope_t *sentry__scope_lock(void);
  */
 void sentry__scope_unlock(void);
 
+/**
+ * Adds a breadcrumb to the global scope. Unlike the other scope mutations,
+ * this does not take the scope lock, so it can be called from many threads at
+ * a high rate.
+ */
+void sentry__scope_add_breadcrumb(sentry_value_t breadcrumb);
+
 /**
  * This will free all the data attached to the global scope
  */
@@ -74,9 +81,31 @@ void sentry__scope_cleanup(void);
  * This will notify any backend of scope changes.
  * This function must be called while holding the scope lock, and it will be
  * unlocked internally.
+ *
+ * While the scope flusher is running, this only marks the scope as dirty, and
+ * the backend is notified from the flusher thread. Bursts of changes are then
+ * coalesced into a single flush.
  */
 void sentry__scope_flush_unlock(void);
 
+/**
+ * Notifies the backend of a change that was made without the scope lock, like
+ * an added breadcrumb, the same way `sentry__scope_flush_unlock` does.
+ */
+void sentry__scope_request_flush(void);
+
+/**
+ * Starts the background thread that coalesces the scope flushes of the
+ * backend. This is meant for backends that persist the scope on every change.
+ * The flusher keeps a reference to `options` until it is shut down.
+ */
+void sentry__scope_flusher_start(sentry_options_t *options);
+
+/**
+ * Runs any pending scope flush and stops the scope flusher thread.
+ */
+void sentry__scope_flusher_shutdown(uint64_t timeout);
+
 /**
  * Deallocates a (local) scope.
  */
@@ -92,6 +121,32 @@ void sentry__scope_apply_to_event(const sentry_scope_t *scope,
     const sentry_options_t *options, sentry_value_t event,
     sentry_scope_mode_t mode);
 
+/**
+ * Prebuilds everything that `sentry__scope_apply_to_event` would add to an
+ * event from the given `scope`, including the module list but without the
+ * breadcrumbs. This is meant to be done ahead of time, outside of a crash
+ * handler.
+ */
+sentry_value_t sentry__scope_new_event_skeleton(
+    const sentry_scope_t *scope, const sentry_options_t *options);
+
+/**
+ * This does the same as `sentry__scope_apply_to_event`, but takes the data of
+ * the scope from a `skeleton` created by `sentry__scope_new_event_skeleton`.
+ * Only the breadcrumbs and stacktraces are still taken from the `scope`
+ * according to `mode`.
+ */
+void sentry__scope_apply_skeleton_to_event(const sentry_scope_t *scope,
+    const sentry_options_t *options, sentry_value_t event,
+    sentry_value_t skeleton, sentry_scope_mode_t mode);
+
+/**
+ * Returns the generation of the global scope, which changes whenever the
+ * scope is flushed. This must be called with the scope locked to relate it to
+ * the data in the scope.
+ */
+long sentry__scope_generation(void);
+
 void sentry__scope_set_fingerprint_va(
     sentry_scope_t *scope, const char *fingerprint, va_list va);
 void sentry__scope_set_fingerprint_nva(sentry_scope_t *scope,
@@ -6,12 +6,44 @@
 #include "sentry_options.h"
 #include "sentry_scope.h"
 #include "sentry_string.h"
+#include "sentry_sync.h"
 #include "sentry_utils.h"
 #include "sentry_value.h"
 
 #include <assert.h>
 #include <string.h>
 
+#ifdef SENTRY_UNITTEST
+#    define SESSION_PERSIST_INTERVAL_MS 50
+#else
+#    define SESSION_PERSIST_INTERVAL_MS 1000
+#endif
+
+// The errors of the current session are counted here instead of in the
+// session itself, so that recording an error does not need any lock.
+static volatile long g_session_errors = 0;
+
+typedef struct {
+    sentry_options_t *options;
+    sentry_threadid_t thread_id;
+    sentry_notify_t wakeup;
+    sentry_notify_t stopping;
+    volatile long stop;
+} session_persister_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_persist_lock)
+#else
+static sentry_mutex_t g_persist_lock = SENTRY__MUTEX_INIT;
+#endif
+// These are guarded by `g_persist_lock`. The persister works on its own copy
+// of the current session, since it must not take the options lock: that is
+// held by `sentry_init` while shutting the persister down.
+static sentry_options_t *g_persist_options = NULL;
+static session_persister_t *g_persister = NULL;
+static sentry_session_t *g_pending_session = NULL;
+static bool g_session_dirty = false;
+
 static const char *
 status_as_string(sentry_session_status_t status)
 {
@@ -211,6 +243,180 @@ sentry__session_from_path(const sentry_path_t *path)
     return rv;
 }
 
+static sentry_session_t *
+session_clone(const sentry_session_t *session)
+{
+    sentry_session_t *rv = SENTRY_MAKE(sentry_session_t);
+    if (!rv) {
+        return NULL;
+    }
+    *rv = *session;
+    rv->release = sentry__string_clone(session->release);
+    rv->environment = sentry__string_clone(session->environment);
+    sentry_value_incref(rv->distinct_id);
+    return rv;
+}
+
+/**
+ * Writes the pending session if it changed, or if errors were recorded since
+ * it was last written.
+ */
+static void
+write_pending_session(const sentry_run_t *run)
+{
+    sentry__mutex_lock(&g_persist_lock);
+    if (g_pending_session) {
+        uint64_t errors = (uint64_t)sentry__atomic_fetch(&g_session_errors);
+        if (g_session_dirty || g_pending_session->errors != errors) {
+            g_pending_session->errors = errors;
+            sentry__run_write_session(run, g_pending_session);
+        }
+    }
+    g_session_dirty = false;
+    sentry__mutex_unlock(&g_persist_lock);
+}
+
+SENTRY_THREAD_FN
+session_persister_thread(void *data)
+{
+    session_persister_t *persister = data;
+    uint64_t last_write = 0;
+    while (!sentry__atomic_fetch(&persister->stop)) {
+        sentry__notify_wait(&persister->wakeup, SESSION_PERSIST_INTERVAL_MS);
+        // writes are at least an interval apart, and changes in between are
+        // coalesced into the next one
+        uint64_t since_last_write = sentry__monotonic_time() - last_write;
+        if (since_last_write < SESSION_PERSIST_INTERVAL_MS) {
+            sentry__notify_wait(&persister->stopping,
+                SESSION_PERSIST_INTERVAL_MS - since_last_write);
+        }
+        if (sentry__atomic_fetch(&persister->stop)) {
+            break;
+        }
+        write_pending_session(persister->options->run);
+        last_write = sentry__monotonic_time();
+    }
+    return 0;
+}
+
+/**
+ * Starts the persister thread. Must be called with `g_persist_lock` held.
+ */
+static void
+start_persister(void)
+{
+    session_persister_t *persister = SENTRY_MAKE(session_persister_t);
+    if (!persister) {
+        return;
+    }
+    memset(persister, 0, sizeof(session_persister_t));
+    persister->options = sentry__options_incref(g_persist_options);
+    sentry__notify_init(&persister->wakeup);
+    sentry__notify_init(&persister->stopping);
+    sentry__thread_init(&persister->thread_id);
+
+    if (sentry__thread_spawn(&persister->thread_id, session_persister_thread,
+            persister)
+        != 0) {
+        // sessions are written right away instead, without trying again
+        SENTRY_WARN("failed to start the session persister");
+        sentry_options_free(g_persist_options);
+        g_persist_options = NULL;
+        sentry__notify_free(&persister->wakeup);
+        sentry__notify_free(&persister->stopping);
+        sentry__thread_free(&persister->thread_id);
+        sentry_options_free(persister->options);
+        sentry_free(persister);
+        return;
+    }
+    g_persister = persister;
+}
+
+void
+sentry__session_persist(
+    const sentry_run_t *run, const sentry_session_t *session)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_persist_lock);
+    sentry__mutex_lock(&g_persist_lock);
+    if (session && !g_persister && g_persist_options) {
+        start_persister();
+    }
+    session_persister_t *persister = g_persister;
+    if (persister) {
+        sentry__session_free(g_pending_session);
+        g_pending_session = session ? session_clone(session) : NULL;
+        g_session_dirty = true;
+    }
+    // the session file is removed right away, since the session might be
+    // ending because of a crash
+    if (!session) {
+        sentry__run_clear_session(run);
+    } else if (!persister) {
+        sentry__run_write_session(run, session);
+    }
+    sentry__mutex_unlock(&g_persist_lock);
+
+    if (persister && session) {
+        sentry__notify_raise(&persister->wakeup);
+    }
+}
+
+void
+sentry__session_persister_start(sentry_options_t *options)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_persist_lock);
+    sentry__mutex_lock(&g_persist_lock);
+    sentry_options_free(g_persist_options);
+    g_persist_options = sentry__options_incref(options);
+    sentry__mutex_unlock(&g_persist_lock);
+}
+
+void
+sentry__session_persister_shutdown(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_persist_lock);
+    sentry__mutex_lock(&g_persist_lock);
+    session_persister_t *persister = g_persister;
+    sentry_options_t *options = g_persist_options;
+    g_persist_options = NULL;
+    sentry__mutex_unlock(&g_persist_lock);
+    sentry_options_free(options);
+    if (!persister) {
+        return;
+    }
+
+    sentry__atomic_store(&persister->stop, 1);
+    sentry__notify_raise(&persister->wakeup);
+    sentry__notify_raise(&persister->stopping);
+    sentry__thread_join(persister->thread_id);
+
+    // the last change is written out right away
+    write_pending_session(persister->options->run);
+    sentry__mutex_lock(&g_persist_lock);
+    g_persister = NULL;
+    sentry__session_free(g_pending_session);
+    g_pending_session = NULL;
+    sentry__mutex_unlock(&g_persist_lock);
+
+    sentry__notify_free(&persister->wakeup);
+    sentry__notify_free(&persister->stopping);
+    sentry__thread_free(&persister->thread_id);
+    sentry_options_free(persister->options);
+    sentry_free(persister);
+}
+
+#ifdef SENTRY_UNITTEST
+bool
+sentry__session_persister_is_running(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_persist_lock);
+    sentry__mutex_lock(&g_persist_lock);
+    bool rv = g_persister != NULL;
+    sentry__mutex_unlock(&g_persist_lock);
+    return rv;
+}
+#endif
+
 void
 sentry_start_session(void)
 {
@@ -220,8 +426,9 @@ sentry_start_session(void)
         if (options) {
             options->session = sentry__session_new();
             if (options->session) {
+                sentry__atomic_store(&g_session_errors, 0);
                 sentry__session_sync_user(options->session, scope->user);
-                sentry__run_write_session(options->run, options->session);
+                sentry__session_persist(options->run, options->session);
             }
         }
     }
@@ -231,11 +438,15 @@ sentry_start_session(void)
 void
 sentry__record_errors_on_current_session(uint32_t error_count)
 {
-    sentry_options_t *options = sentry__options_lock();
-    if (options && options->session) {
-        options->session->errors += error_count;
+    sentry__atomic_fetch_and_add(&g_session_errors, (long)error_count);
+}
+
+void
+sentry__session_sync_errors(sentry_session_t *session)
+{
+    if (session) {
+        session->errors = (uint64_t)sentry__atomic_fetch(&g_session_errors);
     }
-    sentry__options_unlock();
 }
 
 static sentry_session_t *
@@ -246,7 +457,8 @@ sentry__end_session_internal(void)
     if (options) {
         session = options->session;
         options->session = NULL;
-        sentry__run_clear_session(options->run);
+        sentry__session_sync_errors(session);
+        sentry__session_persist(options->run, NULL);
     }
     sentry__options_unlock();
 
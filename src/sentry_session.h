@@ -7,6 +7,7 @@
 #include "sentry_utils.h"
 
 struct sentry_jsonwriter_s;
+struct sentry_run_s;
 
 /**
  * This represents a session, with the number of errors, a status and other
@@ -60,9 +61,52 @@ sentry_session_t *sentry__end_current_session_with_status(
 
 /**
  * This will add `error_count` new errors to the current session.
+ *
+ * The errors are counted with a single atomic increment, outside of the
+ * session, so this does not take any lock. See
+ * `sentry__session_sync_errors`.
  */
 void sentry__record_errors_on_current_session(uint32_t error_count);
 
+/**
+ * Updates the error count of the current `session` with the errors recorded
+ * so far. This has to be called with the options lock held, before the
+ * current session is serialized.
+ */
+void sentry__session_sync_errors(sentry_session_t *session);
+
+/**
+ * Writes the current `session` to the `run`, or removes the session file if
+ * `session` is NULL. This has to be called with the options lock held
+ * whenever the current session changes.
+ *
+ * While the session persister is running, this only hands a copy of the
+ * session to the persister, and removing the session file is the only write
+ * that happens right away.
+ */
+void sentry__session_persist(
+    const struct sentry_run_s *run, const sentry_session_t *session);
+
+/**
+ * Enables the background thread that writes the current session to the run
+ * whenever it changed, at most once per second. New errors are picked up
+ * without notifying the thread, so that recording them stays cheap.
+ * The thread is only started once a session is first persisted, so that it
+ * costs nothing when sessions are not used.
+ * The persister keeps a reference to `options` until it is shut down.
+ */
+void sentry__session_persister_start(sentry_options_t *options);
+
+/**
+ * Writes out any pending change of the session and stops the persister
+ * thread.
+ */
+void sentry__session_persister_shutdown(void);
+
+#ifdef SENTRY_UNITTEST
+bool sentry__session_persister_is_running(void);
+#endif
+
 /**
  * This will update a sessions `distinct_id`, which is based on the user.
  */
@@ -0,0 +1,272 @@
+#include "sentry_session_aggregates.h"
+
+#include "sentry_alloc.h"
+#include "sentry_core.h"
+#include "sentry_envelope.h"
+#include "sentry_logger.h"
+#include "sentry_options.h"
+#include "sentry_sync.h"
+#include "sentry_utils.h"
+#include "sentry_value.h"
+
+#include <string.h>
+
+#define AGGREGATE_SLOTS 4
+#define AGGREGATE_FLUSH_INTERVAL_MS (60 * 1000)
+#define USEC_PER_MINUTE ((uint64_t)60 * 1000 * 1000)
+#define OUTCOME_COUNT (SENTRY_REQUEST_OUTCOME_CRASHED + 1)
+
+// the keys of the aggregate counters, indexed by `sentry_request_outcome_t`
+static const char *const OUTCOME_KEYS[OUTCOME_COUNT]
+    = { "exited", "errored", "crashed" };
+
+/**
+ * The outcomes that were recorded in one minute. The slots are reused in a
+ * round-robin fashion, and the counts of the previous minute are moved to the
+ * pending aggregates before a slot is reused.
+ *
+ * An outcome that is recorded right while its slot is being reused may end up
+ * counted for the next minute, but it is never lost.
+ */
+typedef struct {
+    volatile long minute;
+    volatile long counts[OUTCOME_COUNT];
+} aggregate_slot_t;
+
+typedef struct {
+    sentry_options_t *options;
+    sentry_threadid_t thread_id;
+    sentry_notify_t stopping;
+    sentry_value_t aggregates;
+    bool running;
+} aggregates_flusher_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_lock)
+#else
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+#endif
+// `g_flusher` and its `aggregates` are guarded by `g_lock`, while the slots
+// are only ever reused with the lock held.
+static aggregates_flusher_t *g_flusher = NULL;
+static aggregate_slot_t g_slots[AGGREGATE_SLOTS];
+static volatile long g_recording = 0;
+
+static long
+current_minute(void)
+{
+    return (long)(sentry__usec_time() / USEC_PER_MINUTE);
+}
+
+/**
+ * Resets the counts of `slot`, appending them to `aggregates` unless that is
+ * null. Must be called with `g_lock` held.
+ */
+static void
+drain_slot(aggregate_slot_t *slot, sentry_value_t aggregates)
+{
+    long counts[OUTCOME_COUNT];
+    bool has_counts = false;
+    for (int i = 0; i < OUTCOME_COUNT; i++) {
+        counts[i] = sentry__atomic_store(&slot->counts[i], 0);
+        has_counts = has_counts || counts[i] != 0;
+    }
+    if (!has_counts || sentry_value_is_null(aggregates)) {
+        return;
+    }
+
+    sentry_value_t aggregate = sentry_value_new_object();
+    uint64_t started
+        = (uint64_t)sentry__atomic_fetch(&slot->minute) * USEC_PER_MINUTE;
+    sentry_value_set_by_key(aggregate, "started",
+        sentry__value_new_string_owned(sentry__usec_time_to_iso8601(started)));
+    for (int i = 0; i < OUTCOME_COUNT; i++) {
+        if (counts[i]) {
+            sentry_value_set_by_key(aggregate, OUTCOME_KEYS[i],
+                sentry_value_new_int32((int32_t)counts[i]));
+        }
+    }
+    sentry_value_append(aggregates, aggregate);
+}
+
+/**
+ * Sends the outcomes of all minutes that are over, or of all minutes
+ * including the current one if `all` is set, as a single `sessions` item.
+ */
+static void
+flush_aggregates(aggregates_flusher_t *flusher, bool all)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    long minute = current_minute();
+    for (size_t i = 0; i < AGGREGATE_SLOTS; i++) {
+        if (all || sentry__atomic_fetch(&g_slots[i].minute) < minute) {
+            drain_slot(&g_slots[i], flusher->aggregates);
+        }
+    }
+    sentry_value_t aggregates = flusher->aggregates;
+    flusher->aggregates = sentry_value_new_list();
+    sentry__mutex_unlock(&g_lock);
+
+    if (sentry_value_get_length(aggregates) == 0) {
+        sentry_value_decref(aggregates);
+        return;
+    }
+    const sentry_options_t *options = flusher->options;
+    sentry_value_t attrs = sentry_value_new_object();
+    sentry_value_set_by_key(
+        attrs, "release", sentry_value_new_string(options->release));
+    if (options->environment) {
+        sentry_value_set_by_key(attrs, "environment",
+            sentry_value_new_string(options->environment));
+    }
+    sentry_value_t payload = sentry_value_new_object();
+    sentry_value_set_by_key(payload, "attrs", attrs);
+    sentry_value_set_by_key(payload, "aggregates", aggregates);
+
+    // this must not take the options lock, which `sentry_init` holds while
+    // shutting the flusher down
+    sentry_envelope_t *envelope = sentry__envelope_new_with_dsn(options->dsn);
+    if (!envelope
+        || !sentry__envelope_add_session_aggregates(envelope, payload)) {
+        SENTRY_WARN("dropping session aggregates");
+        sentry_envelope_free(envelope);
+    } else {
+        sentry__capture_envelope_with_options(options, envelope);
+    }
+    sentry_value_decref(payload);
+}
+
+SENTRY_THREAD_FN
+aggregates_flusher_thread(void *data)
+{
+    aggregates_flusher_t *flusher = data;
+    while (!sentry__notify_wait(
+        &flusher->stopping, AGGREGATE_FLUSH_INTERVAL_MS)) {
+        flush_aggregates(flusher, false);
+    }
+    return 0;
+}
+
+static void
+flusher_free(aggregates_flusher_t *flusher)
+{
+    sentry_value_decref(flusher->aggregates);
+    sentry__notify_free(&flusher->stopping);
+    sentry__thread_free(&flusher->thread_id);
+    sentry_options_free(flusher->options);
+    sentry_free(flusher);
+}
+
+/**
+ * Starts the flusher thread, or stops recording if that fails. Must be called
+ * with `g_lock` held.
+ */
+static void
+start_flusher(void)
+{
+    if (sentry__thread_spawn(
+            &g_flusher->thread_id, aggregates_flusher_thread, g_flusher)
+        != 0) {
+        SENTRY_WARN("failed to start the session aggregates flusher");
+        sentry__atomic_store(&g_recording, 0);
+        flusher_free(g_flusher);
+        g_flusher = NULL;
+        return;
+    }
+    g_flusher->running = true;
+}
+
+static void
+claim_slot(aggregate_slot_t *slot, long minute)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    // the first outcome always claims a slot, which is when the flusher is
+    // started
+    if (g_flusher && !g_flusher->running) {
+        start_flusher();
+    }
+    if (sentry__atomic_fetch(&slot->minute) != minute) {
+        drain_slot(slot,
+            g_flusher ? g_flusher->aggregates : sentry_value_new_null());
+        sentry__atomic_store(&slot->minute, minute);
+    }
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry_record_request_outcome(sentry_request_outcome_t outcome)
+{
+    if ((unsigned)outcome >= OUTCOME_COUNT
+        || !sentry__atomic_fetch(&g_recording)) {
+        return;
+    }
+    long minute = current_minute();
+    aggregate_slot_t *slot = &g_slots[minute % AGGREGATE_SLOTS];
+    if (sentry__atomic_fetch(&slot->minute) != minute) {
+        claim_slot(slot, minute);
+    }
+    sentry__atomic_fetch_and_add(&slot->counts[outcome], 1);
+}
+
+void
+sentry__session_aggregates_start(sentry_options_t *options)
+{
+    if (!options->release) {
+        return;
+    }
+    aggregates_flusher_t *flusher = SENTRY_MAKE(aggregates_flusher_t);
+    if (!flusher) {
+        return;
+    }
+    memset(flusher, 0, sizeof(aggregates_flusher_t));
+    flusher->options = sentry__options_incref(options);
+    flusher->aggregates = sentry_value_new_list();
+    sentry__notify_init(&flusher->stopping);
+    sentry__thread_init(&flusher->thread_id);
+
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    for (size_t i = 0; i < AGGREGATE_SLOTS; i++) {
+        drain_slot(&g_slots[i], sentry_value_new_null());
+        sentry__atomic_store(&g_slots[i].minute, 0);
+    }
+    // the thread is only started once the first outcome is recorded
+    g_flusher = flusher;
+    sentry__atomic_store(&g_recording, 1);
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__session_aggregates_shutdown(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    aggregates_flusher_t *flusher = g_flusher;
+    g_flusher = NULL;
+    sentry__atomic_store(&g_recording, 0);
+    sentry__mutex_unlock(&g_lock);
+    if (!flusher) {
+        return;
+    }
+
+    if (flusher->running) {
+        sentry__notify_raise(&flusher->stopping);
+        sentry__thread_join(flusher->thread_id);
+    }
+    flush_aggregates(flusher, true);
+    flusher_free(flusher);
+}
+
+#ifdef SENTRY_UNITTEST
+bool
+sentry__session_aggregates_is_running(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    bool rv = g_flusher && g_flusher->running;
+    sentry__mutex_unlock(&g_lock);
+    return rv;
+}
+#endif
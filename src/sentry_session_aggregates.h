@@ -0,0 +1,27 @@
+#ifndef SENTRY_SESSION_AGGREGATES_H_INCLUDED
+#define SENTRY_SESSION_AGGREGATES_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * Starts recording the outcomes of `sentry_record_request_outcome`. The
+ * background thread that sends them as session aggregates once a minute is
+ * only started when the first outcome is recorded.
+ * The flusher keeps a reference to `options` until it is shut down.
+ *
+ * Outcomes are not recorded if no release is configured, since sessions
+ * without a release are rejected anyway.
+ */
+void sentry__session_aggregates_start(sentry_options_t *options);
+
+/**
+ * Stops recording outcomes, and sends all outcomes recorded so far, including
+ * the ones of the current minute. This is called as part of `sentry_close`.
+ */
+void sentry__session_aggregates_shutdown(void);
+
+#ifdef SENTRY_UNITTEST
+bool sentry__session_aggregates_is_running(void);
+#endif
+
+#endif
@@ -0,0 +1,398 @@
+#include "sentry_spool.h"
+
+#include "sentry_alloc.h"
+#include "sentry_logger.h"
+#include "sentry_quota.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SENTRY_UNITTEST
+#    define SPOOL_SEGMENT_SIZE 4096
+#    define SPOOL_MAX_SEGMENTS 4
+#else
+#    define SPOOL_SEGMENT_SIZE (1024 * 1024)
+#    define SPOOL_MAX_SEGMENTS 64
+#endif
+// records are flushed to disk after this many appends
+#define SPOOL_SYNC_RECORDS 32
+#define SPOOL_MAX_RECORD_SIZE (64 * 1024 * 1024)
+
+#define SPOOL_RECORD_MAGIC 0x31525053 // "SPR1"
+#define SPOOL_INDEX_MAGIC 0x31495053 // "SPI1"
+#define SPOOL_INDEX_FILENAME "spool.index"
+#define SEGMENT_PREFIX "spool-"
+#define SEGMENT_SUFFIX ".seg"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;
+} record_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t offset;
+    uint32_t crc;
+} spool_index_t;
+
+struct sentry_spool_s {
+    sentry_path_t *path;
+    sentry_path_t *segment_path;
+    sentry_filewriter_t *segment;
+    uint32_t first_seq;
+    uint32_t next_seq;
+    size_t unsynced;
+};
+
+struct sentry_spool_reader_s {
+    sentry_path_t *path;
+    uint32_t seq;
+    uint32_t last_seq;
+    char *segment;
+    size_t segment_len;
+    size_t offset;
+};
+
+static uint32_t
+compute_crc32(const char *buf, size_t len)
+{
+    static const uint32_t table[16] = { 0x00000000, 0x1db71064, 0x3b6e20c8,
+        0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c, 0xedb88320,
+        0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278,
+        0xbdbdf21c };
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (unsigned char)buf[i];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+        crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+    return ~crc;
+}
+
+static sentry_path_t *
+segment_path(const sentry_path_t *path, uint32_t seq)
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), SEGMENT_PREFIX "%08u" SEGMENT_SUFFIX,
+        (unsigned)seq);
+    return sentry__path_join_str(path, filename);
+}
+
+static bool
+parse_segment_seq(const sentry_path_t *file, uint32_t *seq_out)
+{
+    const char *filename = sentry__path_filename(file);
+    size_t prefix_len = strlen(SEGMENT_PREFIX);
+    if (strncmp(filename, SEGMENT_PREFIX, prefix_len) != 0) {
+        return false;
+    }
+    char *end;
+    unsigned long seq = strtoul(filename + prefix_len, &end, 10);
+    if (end == filename + prefix_len || strcmp(end, SEGMENT_SUFFIX) != 0) {
+        return false;
+    }
+    *seq_out = (uint32_t)seq;
+    return true;
+}
+
+/**
+ * Finds the lowest and highest sequence number of the segments in `path`.
+ * Returns `false` if there are none.
+ */
+static bool
+find_segments(const sentry_path_t *path, uint32_t *first, uint32_t *last)
+{
+    bool found = false;
+    sentry_pathiter_t *iter = sentry__path_iter_directory(path);
+    const sentry_path_t *file;
+    while (iter && (file = sentry__pathiter_next(iter)) != NULL) {
+        uint32_t seq;
+        if (!parse_segment_seq(file, &seq)) {
+            continue;
+        }
+        if (!found || seq < *first) {
+            *first = seq;
+        }
+        if (!found || seq > *last) {
+            *last = seq;
+        }
+        found = true;
+    }
+    sentry__pathiter_free(iter);
+    return found;
+}
+
+sentry_spool_t *
+sentry__spool_new(const sentry_path_t *path)
+{
+    sentry_spool_t *spool = SENTRY_MAKE(sentry_spool_t);
+    if (!spool) {
+        return NULL;
+    }
+    memset(spool, 0, sizeof(sentry_spool_t));
+    spool->path = sentry__path_clone(path);
+    if (!spool->path) {
+        sentry_free(spool);
+        return NULL;
+    }
+    uint32_t last_seq;
+    if (find_segments(path, &spool->first_seq, &last_seq)) {
+        spool->next_seq = last_seq + 1;
+    }
+    return spool;
+}
+
+static void
+sync_segment(sentry_spool_t *spool)
+{
+    if (sentry__filewriter_sync(spool->segment) != 0) {
+        SENTRY_WARN("failed to flush spool segment");
+    }
+    spool->unsynced = 0;
+    sentry__quota_track(spool->segment_path,
+        sentry__filewriter_byte_count(spool->segment));
+}
+
+static void
+close_segment(sentry_spool_t *spool)
+{
+    if (!spool->segment) {
+        return;
+    }
+    if (spool->unsynced) {
+        sync_segment(spool);
+    }
+    sentry__filewriter_free(spool->segment);
+    spool->segment = NULL;
+    sentry__path_free(spool->segment_path);
+    spool->segment_path = NULL;
+}
+
+static int
+open_segment(sentry_spool_t *spool)
+{
+    close_segment(spool);
+    spool->segment_path = segment_path(spool->path, spool->next_seq);
+    if (!spool->segment_path) {
+        return 1;
+    }
+    spool->segment = sentry__filewriter_new(spool->segment_path);
+    if (!spool->segment) {
+        SENTRY_WARN("failed to create spool segment");
+        sentry__path_free(spool->segment_path);
+        spool->segment_path = NULL;
+        return 1;
+    }
+    spool->next_seq++;
+
+    while (spool->next_seq - spool->first_seq > SPOOL_MAX_SEGMENTS) {
+        SENTRY_WARN("spool is full, dropping its oldest segment");
+        sentry_path_t *path = segment_path(spool->path, spool->first_seq++);
+        if (path) {
+            sentry__path_remove(path);
+            sentry__quota_untrack(path);
+            sentry__path_free(path);
+        }
+    }
+    return 0;
+}
+
+int
+sentry__spool_append(sentry_spool_t *spool, const char *buf, size_t len)
+{
+    if (!spool || len > SPOOL_MAX_RECORD_SIZE) {
+        return 1;
+    }
+    size_t record_len = sizeof(record_header_t) + len;
+    if (!spool->segment
+        || (sentry__filewriter_byte_count(spool->segment) > 0
+            && sentry__filewriter_byte_count(spool->segment) + record_len
+                > SPOOL_SEGMENT_SIZE)) {
+        if (open_segment(spool) != 0) {
+            return 1;
+        }
+    }
+
+    record_header_t header;
+    header.magic = SPOOL_RECORD_MAGIC;
+    header.len = (uint32_t)len;
+    header.crc = compute_crc32(buf, len);
+    if (sentry__filewriter_write(
+            spool->segment, (const char *)&header, sizeof(header))
+            != 0
+        || sentry__filewriter_write(spool->segment, buf, len) != 0) {
+        // the partial record invalidates the rest of the segment
+        SENTRY_WARN("failed to write to spool segment");
+        close_segment(spool);
+        return 1;
+    }
+
+    if (++spool->unsynced >= SPOOL_SYNC_RECORDS) {
+        sync_segment(spool);
+    }
+    return 0;
+}
+
+void
+sentry__spool_sync(sentry_spool_t *spool)
+{
+    if (spool && spool->segment && spool->unsynced) {
+        sync_segment(spool);
+    }
+}
+
+void
+sentry__spool_free(sentry_spool_t *spool)
+{
+    if (!spool) {
+        return;
+    }
+    close_segment(spool);
+    sentry__path_free(spool->path);
+    sentry_free(spool);
+}
+
+sentry_spool_reader_t *
+sentry__spool_reader_new(const sentry_path_t *path)
+{
+    uint32_t first_seq;
+    uint32_t last_seq;
+    if (!find_segments(path, &first_seq, &last_seq)) {
+        return NULL;
+    }
+    sentry_spool_reader_t *reader = SENTRY_MAKE(sentry_spool_reader_t);
+    if (!reader) {
+        return NULL;
+    }
+    memset(reader, 0, sizeof(sentry_spool_reader_t));
+    reader->path = sentry__path_clone(path);
+    if (!reader->path) {
+        sentry_free(reader);
+        return NULL;
+    }
+    reader->seq = first_seq;
+    reader->last_seq = last_seq;
+
+    // continue after the records that were already consumed
+    sentry_path_t *index_path
+        = sentry__path_join_str(path, SPOOL_INDEX_FILENAME);
+    size_t index_len = 0;
+    char *buf = index_path
+        ? sentry__path_read_to_buffer(index_path, &index_len)
+        : NULL;
+    sentry__path_free(index_path);
+    spool_index_t index;
+    if (buf && index_len == sizeof(spool_index_t)) {
+        memcpy(&index, buf, sizeof(spool_index_t));
+        if (index.magic == SPOOL_INDEX_MAGIC
+            && index.crc
+                == compute_crc32(
+                    (const char *)&index, offsetof(spool_index_t, crc))
+            && index.seq >= first_seq) {
+            reader->seq = index.seq;
+            reader->offset = index.offset;
+        }
+    }
+    sentry_free(buf);
+    return reader;
+}
+
+static bool
+load_segment(sentry_spool_reader_t *reader)
+{
+    while (reader->seq <= reader->last_seq) {
+        sentry_path_t *path = segment_path(reader->path, reader->seq);
+        reader->segment = path
+            ? sentry__path_read_to_buffer(path, &reader->segment_len)
+            : NULL;
+        sentry__path_free(path);
+        if (reader->segment) {
+            return true;
+        }
+        // the segment was dropped in the meantime
+        reader->seq++;
+        reader->offset = 0;
+    }
+    return false;
+}
+
+char *
+sentry__spool_reader_next(sentry_spool_reader_t *reader, size_t *len_out)
+{
+    if (!reader) {
+        return NULL;
+    }
+    while (reader->segment || load_segment(reader)) {
+        size_t remaining = reader->offset < reader->segment_len
+            ? reader->segment_len - reader->offset
+            : 0;
+        if (remaining >= sizeof(record_header_t)) {
+            record_header_t header;
+            const char *record = reader->segment + reader->offset;
+            memcpy(&header, record, sizeof(record_header_t));
+            const char *payload = record + sizeof(record_header_t);
+            if (header.magic == SPOOL_RECORD_MAGIC
+                && header.len <= remaining - sizeof(record_header_t)
+                && header.crc == compute_crc32(payload, header.len)) {
+                char *rv = sentry_malloc(header.len + 1);
+                if (!rv) {
+                    return NULL;
+                }
+                memcpy(rv, payload, header.len);
+                rv[header.len] = '\0';
+                reader->offset += sizeof(record_header_t) + header.len;
+                *len_out = header.len;
+                return rv;
+            }
+            SENTRY_WARN("ignoring the invalid tail of a spool segment");
+        } else if (remaining) {
+            SENTRY_WARN("ignoring the truncated tail of a spool segment");
+        }
+
+        sentry_free(reader->segment);
+        reader->segment = NULL;
+        reader->seq++;
+        reader->offset = 0;
+    }
+    return NULL;
+}
+
+void
+sentry__spool_reader_commit(sentry_spool_reader_t *reader)
+{
+    if (!reader) {
+        return;
+    }
+    spool_index_t index;
+    index.magic = SPOOL_INDEX_MAGIC;
+    index.seq = reader->seq;
+    index.offset = (uint32_t)reader->offset;
+    index.crc
+        = compute_crc32((const char *)&index, offsetof(spool_index_t, crc));
+
+    // losing the index only means that records are read again
+    sentry_path_t *index_path
+        = sentry__path_join_str(reader->path, SPOOL_INDEX_FILENAME);
+    if (index_path
+        && sentry__path_write_buffer(
+               index_path, (const char *)&index, sizeof(spool_index_t))
+            != 0) {
+        SENTRY_WARN("failed to write spool index");
+    }
+    sentry__path_free(index_path);
+}
+
+void
+sentry__spool_reader_free(sentry_spool_reader_t *reader)
+{
+    if (!reader) {
+        return;
+    }
+    sentry_free(reader->segment);
+    sentry__path_free(reader->path);
+    sentry_free(reader);
+}
@@ -0,0 +1,69 @@
+#ifndef SENTRY_SPOOL_H_INCLUDED
+#define SENTRY_SPOOL_H_INCLUDED
+
+#include "sentry_boot.h"
+
+#include "sentry_path.h"
+
+/**
+ * An append-only log of records, stored as a sequence of segment files named
+ * `spool-<n>.seg` inside a directory. Each record is prefixed with its length
+ * and a checksum, so that a record that was only partially written when the
+ * process died is detected and ignored, together with the rest of its
+ * segment.
+ *
+ * Segments are rotated once they reach a size limit, and the oldest segments
+ * are dropped once there are too many. The small `spool.index` file records
+ * how far the spool has been read, so that reading can continue where it was
+ * left off.
+ */
+typedef struct sentry_spool_s sentry_spool_t;
+typedef struct sentry_spool_reader_s sentry_spool_reader_t;
+
+/**
+ * Opens a spool for appending in the directory at `path`. New records always
+ * go into a new segment, existing segments are never written to again.
+ */
+sentry_spool_t *sentry__spool_new(const sentry_path_t *path);
+
+/**
+ * Appends a record to the spool. Records are flushed to disk in batches, on
+ * rotation, and when the spool is freed.
+ *
+ * Returns 0 on success.
+ */
+int sentry__spool_append(sentry_spool_t *spool, const char *buf, size_t len);
+
+/**
+ * Flushes all appended records to disk.
+ */
+void sentry__spool_sync(sentry_spool_t *spool);
+
+/**
+ * Flushes all appended records to disk and frees the `spool`.
+ */
+void sentry__spool_free(sentry_spool_t *spool);
+
+/**
+ * Opens the spool in the directory at `path` for reading, starting after the
+ * last committed record. Returns NULL if there are no segments.
+ */
+sentry_spool_reader_t *sentry__spool_reader_new(const sentry_path_t *path);
+
+/**
+ * Returns a copy of the next valid record, or NULL once all segments are
+ * read. The length of the record is written to `len_out`.
+ */
+char *sentry__spool_reader_next(sentry_spool_reader_t *reader, size_t *len_out);
+
+/**
+ * Records in the index that all records returned so far have been consumed.
+ */
+void sentry__spool_reader_commit(sentry_spool_reader_t *reader);
+
+/**
+ * Frees the `reader`, without committing.
+ */
+void sentry__spool_reader_free(sentry_spool_reader_t *reader);
+
+#endif
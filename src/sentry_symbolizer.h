@@ -18,4 +18,68 @@ typedef struct sentry_frame_info_s {
 bool sentry__symbolize(
     void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data);
 
+/**
+ * This will symbolize all `count` addresses in `addrs` in one go, and call
+ * `func` with the frame info of every address that could be resolved, and the
+ * entry of `data` at the same index. Returns the number of resolved addresses.
+ * In a signal handler, only the exported symbols known to `dladdr` are used.
+ */
+size_t sentry__symbolize_batch(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data);
+
+/**
+ * Counters of the symbolizer cache.
+ */
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t len;
+} sentry_symbolizer_cache_stats_t;
+
+/**
+ * Works like `sentry__symbolize_batch`, but first looks up every address in
+ * a bounded cache of previous results, which is shared between all threads.
+ * The least recently used results are evicted once the cache is full.
+ * The cache is neither read nor updated in a signal handler.
+ */
+size_t sentry__symbolize_cached(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data);
+
+/**
+ * Drops all cached symbolization results. This is called as part of
+ * `sentry_clear_modulecache`.
+ */
+void sentry__symbolizer_cache_clear(void);
+
+/**
+ * Writes the current counters of the symbolizer cache into `stats`.
+ */
+void sentry__symbolizer_cache_get_stats(sentry_symbolizer_cache_stats_t *stats);
+
+#ifdef SENTRY_PLATFORM_LINUX
+/**
+ * Symbolizes the `addrs` using the symbol tables of the loaded ELF modules,
+ * which are read and indexed once per module. Unlike `dladdr`, this also
+ * resolves static functions. Writes whether each address was resolved into
+ * `resolved`, and returns the number of resolved addresses.
+ */
+size_t sentry__symbolize_elf(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data,
+    bool *resolved);
+
+/**
+ * Unmaps the files of all modules and drops their symbols. This is called as
+ * part of `sentry_clear_modulecache`.
+ */
+void sentry__symbolize_elf_clear(void);
+
+#    ifdef SENTRY_UNITTEST
+/**
+ * Returns the number of modules whose files are currently mapped.
+ */
+size_t sentry__symbolize_elf_mapped_count(void);
+#    endif
+#endif
+
 #endif
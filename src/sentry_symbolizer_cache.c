@@ -0,0 +1,278 @@
+#include "sentry_alloc.h"
+#include "sentry_logger.h"
+#include "sentry_modulefinder.h"
+#include "sentry_symbolizer.h"
+#include "sentry_sync.h"
+
+#include <string.h>
+
+#ifdef SENTRY_UNITTEST
+#    define CACHE_CAPACITY 8
+#else
+#    define CACHE_CAPACITY 4096
+#endif
+#define CACHE_BUCKETS (CACHE_CAPACITY * 2)
+
+/**
+ * The symbolization result of a single instruction address. Addresses that
+ * could not be resolved are cached as well, so that they are not looked up
+ * over and over again. The strings are stored right after the entry.
+ */
+typedef struct cache_entry_s {
+    uintptr_t addr;
+    bool resolved;
+    void *load_addr;
+    void *symbol_addr;
+    const char *symbol;
+    const char *object_name;
+    struct cache_entry_s *bucket_next;
+    struct cache_entry_s *lru_prev;
+    struct cache_entry_s *lru_next;
+} cache_entry_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_lock)
+#else
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+#endif
+static cache_entry_t *g_buckets[CACHE_BUCKETS];
+// the sentinel of the LRU list, its `lru_next` is the most recently used entry
+static cache_entry_t g_lru = { 0, false, NULL, NULL, NULL, NULL, NULL, &g_lru,
+    &g_lru };
+static sentry_symbolizer_cache_stats_t g_stats = { 0, 0, 0, 0 };
+// the module generation the cached results belong to. Once modules were
+// loaded or unloaded, an address might belong to a different module.
+static long g_generation = 0;
+
+static size_t
+bucket_index(uintptr_t addr)
+{
+    uint64_t hash = (uint64_t)addr * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(hash >> 32) % CACHE_BUCKETS;
+}
+
+static void
+lru_unlink(cache_entry_t *entry)
+{
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+}
+
+static void
+lru_push_front(cache_entry_t *entry)
+{
+    entry->lru_prev = &g_lru;
+    entry->lru_next = g_lru.lru_next;
+    g_lru.lru_next->lru_prev = entry;
+    g_lru.lru_next = entry;
+}
+
+static cache_entry_t *
+lookup(uintptr_t addr)
+{
+    cache_entry_t *entry = g_buckets[bucket_index(addr)];
+    while (entry && entry->addr != addr) {
+        entry = entry->bucket_next;
+    }
+    if (entry) {
+        lru_unlink(entry);
+        lru_push_front(entry);
+    }
+    return entry;
+}
+
+static void
+remove_entry(cache_entry_t *entry)
+{
+    cache_entry_t **link = &g_buckets[bucket_index(entry->addr)];
+    while (*link != entry) {
+        link = &(*link)->bucket_next;
+    }
+    *link = entry->bucket_next;
+    lru_unlink(entry);
+    sentry_free(entry);
+    g_stats.len--;
+}
+
+static char *
+copy_string(char *dst, const char *src)
+{
+    size_t len = strlen(src) + 1;
+    memcpy(dst, src, len);
+    return dst + len;
+}
+
+/**
+ * Caches the result for `addr`, `info` is NULL if it could not be resolved.
+ * The least recently used entry makes room if the cache is full.
+ */
+static void
+insert(uintptr_t addr, const sentry_frame_info_t *info)
+{
+    if (lookup(addr)) {
+        // the same address appeared multiple times in a batch
+        return;
+    }
+
+    size_t symbol_len = info && info->symbol ? strlen(info->symbol) + 1 : 0;
+    size_t object_name_len
+        = info && info->object_name ? strlen(info->object_name) + 1 : 0;
+    cache_entry_t *entry
+        = sentry_malloc(sizeof(cache_entry_t) + symbol_len + object_name_len);
+    if (!entry) {
+        return;
+    }
+    memset(entry, 0, sizeof(cache_entry_t));
+    entry->addr = addr;
+    if (info) {
+        char *strings = (char *)(entry + 1);
+        entry->resolved = true;
+        entry->load_addr = info->load_addr;
+        entry->symbol_addr = info->symbol_addr;
+        if (info->symbol) {
+            entry->symbol = strings;
+            strings = copy_string(strings, info->symbol);
+        }
+        if (info->object_name) {
+            entry->object_name = strings;
+            copy_string(strings, info->object_name);
+        }
+    }
+
+    if (g_stats.len >= CACHE_CAPACITY) {
+        remove_entry(g_lru.lru_prev);
+        g_stats.evictions++;
+    }
+    size_t index = bucket_index(addr);
+    entry->bucket_next = g_buckets[index];
+    g_buckets[index] = entry;
+    lru_push_front(entry);
+    g_stats.len++;
+}
+
+static void
+remove_all_entries(void)
+{
+    while (g_lru.lru_next != &g_lru) {
+        remove_entry(g_lru.lru_next);
+    }
+}
+
+typedef struct {
+    void (*func)(const sentry_frame_info_t *, void *);
+    void *data;
+    uintptr_t addr;
+    long generation;
+    bool resolved;
+} pending_frame_t;
+
+static void
+cache_and_forward(const sentry_frame_info_t *info, void *data)
+{
+    pending_frame_t *pending = data;
+    sentry__mutex_lock(&g_lock);
+    // the modules might have changed while this was being symbolized
+    if (pending->generation == g_generation) {
+        insert(pending->addr, info);
+    }
+    sentry__mutex_unlock(&g_lock);
+    pending->resolved = true;
+    pending->func(info, pending->data);
+}
+
+size_t
+sentry__symbolize_cached(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data)
+{
+    if (!count) {
+        return 0;
+    }
+    // the cache is bypassed in a signal handler, where it can't be locked
+    if (!sentry__block_for_signal_handler()) {
+        return sentry__symbolize_batch(addrs, count, func, data);
+    }
+    void **miss_addrs = sentry_malloc(sizeof(void *) * count);
+    pending_frame_t *pending = sentry_malloc(sizeof(pending_frame_t) * count);
+    void **pending_data = sentry_malloc(sizeof(void *) * count);
+    if (!miss_addrs || !pending || !pending_data) {
+        sentry_free(miss_addrs);
+        sentry_free(pending);
+        sentry_free(pending_data);
+        return sentry__symbolize_batch(addrs, count, func, data);
+    }
+
+    size_t resolved_count = 0;
+    size_t miss_count = 0;
+    long generation = sentry__modules_generation();
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    if (generation != g_generation) {
+        remove_all_entries();
+        g_generation = generation;
+    }
+    for (size_t i = 0; i < count; i++) {
+        cache_entry_t *entry = lookup((uintptr_t)addrs[i]);
+        if (!entry) {
+            g_stats.misses++;
+            miss_addrs[miss_count] = addrs[i];
+            pending[miss_count].func = func;
+            pending[miss_count].data = data[i];
+            pending[miss_count].addr = (uintptr_t)addrs[i];
+            pending[miss_count].generation = generation;
+            pending[miss_count].resolved = false;
+            pending_data[miss_count] = &pending[miss_count];
+            miss_count++;
+            continue;
+        }
+        g_stats.hits++;
+        if (entry->resolved) {
+            sentry_frame_info_t frame_info;
+            memset(&frame_info, 0, sizeof(sentry_frame_info_t));
+            frame_info.load_addr = entry->load_addr;
+            frame_info.symbol_addr = entry->symbol_addr;
+            frame_info.instruction_addr = addrs[i];
+            frame_info.symbol = entry->symbol;
+            frame_info.object_name = entry->object_name;
+            func(&frame_info, data[i]);
+            resolved_count++;
+        }
+    }
+    sentry__mutex_unlock(&g_lock);
+
+    if (miss_count) {
+        resolved_count += sentry__symbolize_batch(
+            miss_addrs, miss_count, cache_and_forward, pending_data);
+        sentry__mutex_lock(&g_lock);
+        for (size_t i = 0; generation == g_generation && i < miss_count; i++) {
+            if (!pending[i].resolved) {
+                insert(pending[i].addr, NULL);
+            }
+        }
+        sentry__mutex_unlock(&g_lock);
+    }
+
+    sentry_free(miss_addrs);
+    sentry_free(pending);
+    sentry_free(pending_data);
+    return resolved_count;
+}
+
+void
+sentry__symbolizer_cache_clear(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    SENTRY_DEBUGF("clearing symbolizer cache after %zu hits and %zu misses",
+        g_stats.hits, g_stats.misses);
+    remove_all_entries();
+    sentry__mutex_unlock(&g_lock);
+}
+
+void
+sentry__symbolizer_cache_get_stats(sentry_symbolizer_cache_stats_t *stats)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    *stats = g_stats;
+    sentry__mutex_unlock(&g_lock);
+}
@@ -6,6 +6,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef SENTRY_PLATFORM_LINUX
+#    include <linux/futex.h>
+#    include <sys/syscall.h>
+#    include <time.h>
+#    include <unistd.h>
+#endif
+
 #ifdef SENTRY_PLATFORM_WINDOWS
 typedef HRESULT(WINAPI *pSetThreadDescription)(
     HANDLE hThread, PCWSTR lpThreadDescription);
@@ -101,6 +108,148 @@ thread_setname(sentry_threadid_t thread_id, const char *thread_name)
 }
 #endif
 
+#if defined(SENTRY_PLATFORM_LINUX)
+void
+sentry__notify_init(sentry_notify_t *notify)
+{
+    notify->raised = 0;
+    notify->waiters = 0;
+}
+
+void
+sentry__notify_free(sentry_notify_t *UNUSED(notify))
+{
+}
+
+void
+sentry__notify_raise(sentry_notify_t *notify)
+{
+    // Only the transition from lowered to raised needs to wake anyone, and
+    // only if the consumer announced that it is (about to go) asleep. Both
+    // sides use sequentially consistent operations, so either the waiter sees
+    // the raised flag, or we see the waiter.
+    if (__atomic_exchange_n(&notify->raised, 1, __ATOMIC_SEQ_CST) == 0
+        && __atomic_load_n(&notify->waiters, __ATOMIC_SEQ_CST) > 0) {
+        syscall(SYS_futex, &notify->raised, FUTEX_WAKE_PRIVATE, 1, NULL, NULL,
+            0);
+    }
+}
+
+bool
+sentry__notify_wait(sentry_notify_t *notify, uint64_t timeout)
+{
+    if (__atomic_exchange_n(&notify->raised, 0, __ATOMIC_SEQ_CST)) {
+        return true;
+    }
+
+    uint64_t deadline = sentry__monotonic_time() + timeout;
+    bool raised = false;
+    __atomic_fetch_add(&notify->waiters, 1, __ATOMIC_SEQ_CST);
+    while (true) {
+        if (__atomic_exchange_n(&notify->raised, 0, __ATOMIC_SEQ_CST)) {
+            raised = true;
+            break;
+        }
+        uint64_t now = sentry__monotonic_time();
+        if (now >= deadline) {
+            break;
+        }
+        uint64_t remaining = deadline - now;
+        struct timespec ts;
+        ts.tv_sec = (time_t)(remaining / 1000);
+        ts.tv_nsec = (long)((remaining % 1000) * 1000000);
+        // this returns right away if the flag was raised in between
+        syscall(SYS_futex, &notify->raised, FUTEX_WAIT_PRIVATE, 0, &ts, NULL,
+            0);
+    }
+    __atomic_fetch_add(&notify->waiters, -1, __ATOMIC_SEQ_CST);
+    return raised;
+}
+#elif defined(SENTRY_PLATFORM_WINDOWS)
+void
+sentry__notify_init(sentry_notify_t *notify)
+{
+    // an auto-reset event is exactly a level-triggered flag for one waiter
+    notify->event = CreateEventW(NULL, FALSE, FALSE, NULL);
+}
+
+void
+sentry__notify_free(sentry_notify_t *notify)
+{
+    if (notify->event) {
+        CloseHandle(notify->event);
+        notify->event = NULL;
+    }
+}
+
+void
+sentry__notify_raise(sentry_notify_t *notify)
+{
+    SetEvent(notify->event);
+}
+
+bool
+sentry__notify_wait(sentry_notify_t *notify, uint64_t timeout)
+{
+    DWORD msecs = timeout >= INFINITE ? INFINITE - 1 : (DWORD)timeout;
+    return WaitForSingleObject(notify->event, msecs) == WAIT_OBJECT_0;
+}
+#else
+void
+sentry__notify_init(sentry_notify_t *notify)
+{
+    pthread_mutex_init(&notify->lock, NULL);
+    pthread_cond_init(&notify->cond, NULL);
+    sentry__atomic_store(&notify->raised, 0);
+}
+
+void
+sentry__notify_free(sentry_notify_t *notify)
+{
+    pthread_cond_destroy(&notify->cond);
+    pthread_mutex_destroy(&notify->lock);
+}
+
+void
+sentry__notify_raise(sentry_notify_t *notify)
+{
+    if (!sentry__block_for_signal_handler()) {
+        // we can't take the lock inside the signal handler, but the waiter
+        // will pick up the raised flag at the latest on its next timeout.
+        sentry__atomic_store(&notify->raised, 1);
+        return;
+    }
+    pthread_mutex_lock(&notify->lock);
+    sentry__atomic_store(&notify->raised, 1);
+    pthread_cond_signal(&notify->cond);
+    pthread_mutex_unlock(&notify->lock);
+}
+
+bool
+sentry__notify_wait(sentry_notify_t *notify, uint64_t timeout)
+{
+    struct timeval now;
+    struct timespec deadline;
+    gettimeofday(&now, NULL);
+    uint64_t nsecs = (uint64_t)now.tv_usec * 1000ULL
+        + (timeout % 1000ULL) * 1000000ULL;
+    deadline.tv_sec = now.tv_sec + (time_t)(timeout / 1000ULL)
+        + (time_t)(nsecs / 1000000000ULL);
+    deadline.tv_nsec = (long)(nsecs % 1000000000ULL);
+
+    pthread_mutex_lock(&notify->lock);
+    while (!sentry__atomic_fetch(&notify->raised)) {
+        if (pthread_cond_timedwait(&notify->cond, &notify->lock, &deadline)
+            == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool raised = sentry__atomic_store(&notify->raised, 0) != 0;
+    pthread_mutex_unlock(&notify->lock);
+    return raised;
+}
+#endif
+
 /**
  * Queue operations, locking and Reference counting:
  *
@@ -119,6 +268,9 @@ thread_setname(sentry_threadid_t thread_id, const char *thread_name)
  * Each access to the queue itself must be done using the `task_lock`.
  * There are two signals, `submit` *to* the worker, signaling a new task, and
  * `done` *from* the worker signaling that it will close down and can be joined.
+ * `submit` is a level-triggered flag, so submitters don't wake the worker
+ * while holding the `task_lock`, and a submit racing with the worker going to
+ * sleep is never missed.
  */
 
 struct sentry_bgworker_task_s;
@@ -150,7 +302,7 @@ sentry__task_decref(sentry_bgworker_task_t *task)
 struct sentry_bgworker_s {
     sentry_threadid_t thread_id;
     char *thread_name;
-    sentry_cond_t submit_signal;
+    sentry_notify_t submit_signal;
     sentry_cond_t done_signal;
     sentry_mutex_t task_lock;
     sentry_bgworker_task_t *first_task;
@@ -174,7 +326,7 @@ sentry__bgworker_new(void *state, void (*free_state)(void *state))
     memset(bgw, 0, sizeof(sentry_bgworker_t));
     sentry__thread_init(&bgw->thread_id);
     sentry__mutex_init(&bgw->task_lock);
-    sentry__cond_init(&bgw->submit_signal);
+    sentry__notify_init(&bgw->submit_signal);
     sentry__cond_init(&bgw->done_signal);
     bgw->state = state;
     bgw->free_state = free_state;
@@ -206,6 +358,7 @@ sentry__bgworker_decref(sentry_bgworker_t *bgw)
         bgw->free_state(bgw->state);
     }
     sentry__thread_free(&bgw->thread_id);
+    sentry__notify_free(&bgw->submit_signal);
     sentry__mutex_free(&bgw->task_lock);
     sentry_free(bgw->thread_name);
     sentry_free(bgw);
@@ -254,9 +407,9 @@ worker_thread(void *data)
 
         sentry_bgworker_task_t *task = bgw->first_task;
         if (!task) {
-            // this will implicitly release the lock, and re-acquire on wake
-            sentry__cond_wait_timeout(
-                &bgw->submit_signal, &bgw->task_lock, 1000);
+            sentry__mutex_unlock(&bgw->task_lock);
+            sentry__notify_wait(&bgw->submit_signal, 1000);
+            sentry__mutex_lock(&bgw->task_lock);
             continue;
         }
 
@@ -445,8 +598,8 @@ sentry__bgworker_submit(sentry_bgworker_t *bgw,
         bgw->last_task->next_task = task;
     }
     bgw->last_task = task;
-    sentry__cond_wake(&bgw->submit_signal);
     sentry__mutex_unlock(&bgw->task_lock);
+    sentry__notify_raise(&bgw->submit_signal);
 
     return 0;
 }
@@ -489,6 +642,16 @@ sentry__bgworker_foreach_matching(sentry_bgworker_t *bgw,
     return dropped;
 }
 
+bool
+sentry__bgworker_has_pending_tasks(sentry_bgworker_t *bgw)
+{
+    sentry__mutex_lock(&bgw->task_lock);
+    bool rv = !sentry__atomic_fetch(&bgw->running)
+        || (bgw->first_task && bgw->first_task->next_task);
+    sentry__mutex_unlock(&bgw->task_lock);
+    return rv;
+}
+
 void
 sentry__bgworker_setname(sentry_bgworker_t *bgw, const char *thread_name)
 {
@@ -412,6 +412,52 @@ sentry__atomic_compare_swap(volatile long *val, long expected, long desired)
 #endif
 }
 
+/**
+ * A level-triggered wakeup flag, meant to be waited on by a single consumer
+ * thread.
+ *
+ * Unlike a bare condition variable, raising the flag while nobody waits is
+ * not lost: it stays raised until the next wait consumes it. Producers thus
+ * don't need to hold any lock to notify, and raising an already raised flag
+ * is a single atomic operation. On Linux this is backed by a futex, so a raise
+ * only enters the kernel when the consumer is actually asleep.
+ */
+typedef struct {
+#if defined(SENTRY_PLATFORM_LINUX)
+    volatile int raised;
+    volatile int waiters;
+#elif defined(SENTRY_PLATFORM_WINDOWS)
+    HANDLE event;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // atomic, as a signal handler raises it without taking the lock
+    volatile long raised;
+#endif
+} sentry_notify_t;
+
+/**
+ * Initializes the flag in its lowered state.
+ */
+void sentry__notify_init(sentry_notify_t *notify);
+
+/**
+ * Frees any resources held by the flag. There must be no concurrent waiter.
+ */
+void sentry__notify_free(sentry_notify_t *notify);
+
+/**
+ * Raises the flag, waking up the waiting thread if there is one.
+ */
+void sentry__notify_raise(sentry_notify_t *notify);
+
+/**
+ * Waits up to `timeout` milliseconds for the flag to be raised, and lowers it
+ * again. Returns immediately if the flag was raised in the meantime.
+ * Returns `true` if the flag was raised, and `false` on timeout.
+ */
+bool sentry__notify_wait(sentry_notify_t *notify, uint64_t timeout);
+
 struct sentry_bgworker_s;
 typedef struct sentry_bgworker_s sentry_bgworker_t;
 
@@ -489,4 +535,11 @@ size_t sentry__bgworker_foreach_matching(sentry_bgworker_t *bgw,
     sentry_task_exec_func_t exec_func,
     bool (*callback)(void *task_data, void *data), void *data);
 
+/**
+ * Returns `true` if tasks are queued behind the one that is currently being
+ * executed, which includes a pending flush or shutdown, or if the worker is
+ * not running.
+ */
+bool sentry__bgworker_has_pending_tasks(sentry_bgworker_t *bgw);
+
 #endif
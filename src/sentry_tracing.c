@@ -50,7 +50,7 @@ transaction_context_new_n(sentry_slice_t name, sentry_slice_t operation)
     sentry_value_set_by_key(transaction_context, "transaction",
         sentry_value_new_string_n(name.ptr, name.len));
 
-    SENTRY_WITH_SCOPE_MUT (scope) {
+    SENTRY_WITH_SCOPE (scope) {
         if (!scope->trace_managed
             && !sentry_value_is_null(
                 sentry_value_get_by_key(scope->propagation_context, "trace"))) {
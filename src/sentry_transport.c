@@ -9,7 +9,19 @@
 #    include "zlib.h"
 #endif
 
+#ifdef SENTRY_PLATFORM_WINDOWS
+#    include <windows.h>
+#    define sleep_ms(MILLISECONDS) Sleep(MILLISECONDS)
+#else
+#    include <unistd.h>
+#    define sleep_ms(MILLISECONDS) usleep(MILLISECONDS * 1000)
+#endif
+
 #define ENVELOPE_MIME "application/x-sentry-envelope"
+// how long a coalescable envelope waits for others to be queued behind it,
+// and the payload size up to which queued envelopes are merged into it
+#define COALESCE_LINGER_MS 10
+#define COALESCE_MAX_BYTES (256 * 1024)
 #ifdef SENTRY_TRANSPORT_COMPRESSION
 // The headers we use are: `x-sentry-auth`, `content-type`, `content-encoding`,
 // `content-length`
@@ -158,6 +170,57 @@ sentry_transport_free(sentry_transport_t *transport)
     sentry_free(transport);
 }
 
+typedef struct {
+    sentry_envelope_t *envelope;
+    bool done;
+} coalesce_state_t;
+
+static bool
+coalesce_queued_envelope(void *task_data, void *data)
+{
+    coalesce_state_t *state = data;
+    sentry_envelope_t *queued = task_data;
+    // the envelope that is being sent is still the first task of the queue
+    if (state->done || queued == state->envelope) {
+        return false;
+    }
+    // envelopes are never reordered, so merging stops at the first one that
+    // cannot be merged
+    if (!sentry__envelope_coalesce(
+            state->envelope, queued, COALESCE_MAX_BYTES)) {
+        state->done = true;
+        return false;
+    }
+    // the now empty envelope is freed along with its task
+    return true;
+}
+
+void
+sentry__transport_coalesce_queued(sentry_bgworker_t *bgworker,
+    sentry_task_exec_func_t send_task, sentry_envelope_t *envelope)
+{
+    if (!bgworker || !sentry__envelope_is_coalescable(envelope)) {
+        return;
+    }
+    // lingering only pays off if an envelope like this one could still be
+    // merged, and it ends as soon as anything is queued, so that it never
+    // holds up envelopes that are already waiting, a flush or a shutdown
+    if (sentry__envelope_has_coalesce_room(envelope)) {
+        uint64_t started = sentry__monotonic_time();
+        while (!sentry__bgworker_has_pending_tasks(bgworker)
+            && sentry__monotonic_time() - started < COALESCE_LINGER_MS) {
+            sleep_ms(1);
+        }
+    }
+
+    coalesce_state_t state = { envelope, false };
+    size_t coalesced = sentry__bgworker_foreach_matching(
+        bgworker, send_task, coalesce_queued_envelope, &state);
+    if (coalesced) {
+        SENTRY_DEBUGF("coalesced %zu queued envelopes", coalesced);
+    }
+}
+
 #ifdef SENTRY_UNITTEST
 void *
 sentry__transport_get_bgworker(sentry_transport_t *transport)
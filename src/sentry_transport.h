@@ -4,13 +4,14 @@
 #include "sentry_boot.h"
 #include "sentry_database.h"
 #include "sentry_ratelimiter.h"
+#include "sentry_sync.h"
 #include "sentry_utils.h"
 
 /**
  * Sets the dump function of the transport.
  *
  * This function is called during a hard crash to dump any internal send queue
- * to disk, using `sentry__run_write_envelope`. The function runs inside a
+ * to disk, using `sentry__run_spool_envelope`. The function runs inside a
  * signal handler, and appropriate restrictions apply.
  */
 void sentry__transport_set_dump_func(sentry_transport_t *transport,
@@ -56,6 +57,22 @@ sentry_transport_t *sentry__transport_new_default(void);
 size_t sentry__transport_dump_queue(
     sentry_transport_t *transport, sentry_run_t *run);
 
+/**
+ * Coalesces the envelopes that are queued right behind `envelope` in the
+ * `bgworker` of an HTTP transport into `envelope`, so that they are sent with
+ * a single request. This is called by the `send_task` of the worker, right
+ * before `envelope` is sent.
+ *
+ * Only envelopes of transactions, logs, sessions and client reports are
+ * coalesced. If `envelope` is one of them, this merges queued envelopes in
+ * order, until the first one that does not fit. If nothing is queued yet and
+ * an envelope like `envelope` could still be merged into it, this first
+ * lingers for a few milliseconds to give related envelopes a chance to be
+ * queued.
+ */
+void sentry__transport_coalesce_queued(sentry_bgworker_t *bgworker,
+    sentry_task_exec_func_t send_task, sentry_envelope_t *envelope);
+
 #ifdef SENTRY_UNITTEST
 /**
  * Test helper function to get the bgworker from a transport.
@@ -2,6 +2,7 @@
 #include "sentry_core.h"
 #include "sentry_unix_spinlock.h"
 
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -12,6 +13,24 @@
 
 #define ALIGN 8
 
+// freed blocks are kept in per-class free lists, from 16 up to 4096 bytes
+#define MIN_CLASS_SHIFT 4
+#define NUM_SIZE_CLASSES 9
+#define MAX_CLASS_SIZE ((size_t)1 << (MIN_CLASS_SHIFT + NUM_SIZE_CLASSES - 1))
+
+/**
+ * Every block is preceded by its usable size, which also determines its size
+ * class when it is freed. While a block is free, its first bytes link it into
+ * the free list.
+ */
+struct block_header {
+    size_t size;
+};
+
+struct free_block {
+    struct free_block *next;
+};
+
 struct page_header;
 struct page_header {
     struct page_header *next;
@@ -24,12 +43,22 @@ struct page_allocator_s {
     char *current_page;
     size_t page_offset;
     size_t pages_allocated;
+    struct free_block *free_lists[NUM_SIZE_CLASSES];
+    // blocks larger than the biggest size class
+    struct free_block *free_large;
 };
 
 static struct page_allocator_s g_page_allocator_backing = { 0 };
 static struct page_allocator_s *g_alloc = NULL;
 static sentry_spinlock_t g_lock = SENTRY__SPINLOCK_INIT;
 
+// the reserve is mapped ahead of time and used up before any new pages
+static char *g_reserve = NULL;
+static size_t g_reserve_size = 0;
+static size_t g_reserve_offset = 0;
+
+static sentry_page_allocator_stats_t g_stats = { 0 };
+
 bool
 sentry__page_allocator_enabled(void)
 {
@@ -47,6 +76,40 @@ sentry__page_allocator_enable(void)
         g_alloc->current_page = NULL;
         g_alloc->page_offset = 0;
         g_alloc->pages_allocated = 0;
+        memset(g_alloc->free_lists, 0, sizeof(g_alloc->free_lists));
+        g_alloc->free_large = NULL;
+    }
+    sentry__spinlock_unlock(&g_lock);
+}
+
+void
+sentry__page_allocator_reserve(size_t size)
+{
+    size_t page_size = getpagesize();
+    size = (size + page_size - 1) / page_size * page_size;
+
+    sentry__spinlock_lock(&g_lock);
+    if (!g_reserve && size) {
+        void *rv = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (rv != MAP_FAILED) {
+            g_reserve = rv;
+            g_reserve_size = size;
+            g_reserve_offset = 0;
+        }
+    }
+    sentry__spinlock_unlock(&g_lock);
+}
+
+void
+sentry__page_allocator_release_reserve(void)
+{
+    sentry__spinlock_lock(&g_lock);
+    if (g_reserve && !g_alloc) {
+        munmap(g_reserve, g_reserve_size);
+        g_reserve = NULL;
+        g_reserve_size = 0;
+        g_reserve_offset = 0;
     }
     sentry__spinlock_unlock(&g_lock);
 }
@@ -76,24 +139,39 @@ get_pages(size_t num_pages)
     return rv;
 }
 
-void *
-sentry__page_allocator_alloc(size_t size)
+/**
+ * Returns the size class for a block of `size` bytes, or -1 if it is too big
+ * for any of them.
+ */
+static int
+size_class(size_t size)
 {
-    if (!size) {
-        return NULL;
+    if (size > MAX_CLASS_SIZE) {
+        return -1;
     }
+    int cls = 0;
+    while (((size_t)1 << (MIN_CLASS_SHIFT + cls)) < size) {
+        cls++;
+    }
+    return cls;
+}
 
-    // make sure the requested size is correctly aligned
-    size_t diff = size % ALIGN;
-    size = size + ALIGN - diff;
-
+/**
+ * Cuts a new block of `size` bytes, including its header, from the reserve,
+ * the current page, or freshly mapped pages in that order.
+ */
+static char *
+carve_block(size_t size)
+{
     char *rv = NULL;
-
-    sentry__spinlock_lock(&g_lock);
-
-    // current page is large enough
-    if (g_alloc->current_page
+    if (g_reserve && g_reserve_size - g_reserve_offset >= size) {
+        // the reserve still has room
+        rv = g_reserve + g_reserve_offset;
+        g_reserve_offset += size;
+        g_stats.reserve_used = g_reserve_offset;
+    } else if (g_alloc->current_page
         && g_alloc->page_size - g_alloc->page_offset >= size) {
+        // current page is large enough
         rv = g_alloc->current_page + g_alloc->page_offset;
         g_alloc->page_offset += size;
         if (g_alloc->page_offset == g_alloc->page_size) {
@@ -118,6 +196,74 @@ sentry__page_allocator_alloc(size_t size)
                 ? rv + g_alloc->page_size * (pages - 1)
                 : NULL;
             rv += sizeof(struct page_header);
+            g_stats.bytes_mapped += actual_size;
+        }
+    }
+    return rv;
+}
+
+/**
+ * Takes the first large free block that fits `size` without wasting more than
+ * half of it.
+ */
+static struct free_block *
+take_large_block(size_t size)
+{
+    for (struct free_block **link = &g_alloc->free_large; *link;
+         link = &(*link)->next) {
+        struct block_header *header = (struct block_header *)*link - 1;
+        if (header->size >= size && header->size / 2 <= size) {
+            struct free_block *block = *link;
+            *link = block->next;
+            return block;
+        }
+    }
+    return NULL;
+}
+
+void *
+sentry__page_allocator_alloc(size_t size)
+{
+    if (!size) {
+        return NULL;
+    }
+
+    int cls = size_class(size);
+    if (cls >= 0) {
+        size = (size_t)1 << (MIN_CLASS_SHIFT + cls);
+    } else {
+        size = (size + ALIGN - 1) / ALIGN * ALIGN;
+    }
+
+    char *rv = NULL;
+
+    sentry__spinlock_lock(&g_lock);
+
+    struct free_block *block = NULL;
+    if (cls >= 0 && g_alloc->free_lists[cls]) {
+        block = g_alloc->free_lists[cls];
+        g_alloc->free_lists[cls] = block->next;
+    } else if (cls < 0) {
+        block = take_large_block(size);
+    }
+
+    if (block) {
+        rv = (char *)block;
+        g_stats.reused++;
+    } else {
+        char *raw = carve_block(sizeof(struct block_header) + size);
+        if (raw) {
+            ((struct block_header *)raw)->size = size;
+            rv = raw + sizeof(struct block_header);
+        }
+    }
+
+    if (rv) {
+        size = ((struct block_header *)rv - 1)->size;
+        g_stats.allocations++;
+        g_stats.bytes_in_use += size;
+        if (g_stats.bytes_in_use > g_stats.peak_bytes_in_use) {
+            g_stats.peak_bytes_in_use = g_stats.bytes_in_use;
         }
     }
 
@@ -125,6 +271,59 @@ sentry__page_allocator_alloc(size_t size)
     return rv;
 }
 
+/**
+ * Whether `ptr` was handed out by the page allocator, as opposed to `malloc`
+ * before the page allocator was enabled.
+ */
+static bool
+owns_block(const char *ptr)
+{
+    if (g_reserve && ptr >= g_reserve && ptr < g_reserve + g_reserve_size) {
+        return true;
+    }
+    for (struct page_header *cur = g_alloc->last_page; cur; cur = cur->next) {
+        const char *start = (const char *)cur;
+        if (ptr >= start && ptr < start + cur->num_pages * g_alloc->page_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+sentry__page_allocator_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    sentry__spinlock_lock(&g_lock);
+    if (g_alloc && owns_block(ptr)) {
+        struct free_block *block = ptr;
+        size_t size = ((struct block_header *)ptr - 1)->size;
+        int cls = size_class(size);
+        if (cls >= 0) {
+            block->next = g_alloc->free_lists[cls];
+            g_alloc->free_lists[cls] = block;
+        } else {
+            block->next = g_alloc->free_large;
+            g_alloc->free_large = block;
+        }
+        g_stats.frees++;
+        g_stats.bytes_in_use -= size;
+    }
+    sentry__spinlock_unlock(&g_lock);
+}
+
+void
+sentry__page_allocator_get_stats(sentry_page_allocator_stats_t *stats)
+{
+    sentry__spinlock_lock(&g_lock);
+    *stats = g_stats;
+    stats->reserve_size = g_reserve_size;
+    sentry__spinlock_unlock(&g_lock);
+}
+
 #ifdef SENTRY_UNITTEST
 void
 sentry__page_allocator_disable(void)
@@ -137,6 +336,8 @@ sentry__page_allocator_disable(void)
         next = cur->next;
         munmap(cur, cur->num_pages * g_alloc->page_size);
     }
+    g_reserve_offset = 0;
+    memset(&g_stats, 0, sizeof(g_stats));
     g_alloc = NULL;
 }
 #endif
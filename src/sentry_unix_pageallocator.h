@@ -3,6 +3,25 @@
 
 #include "sentry_boot.h"
 
+/**
+ * Usage statistics of the page allocator since it was enabled. These help to
+ * size the reserve, so that a crash handler doesn't need to map new pages.
+ */
+typedef struct {
+    // size of the reserve, and how much of it was cut into blocks
+    size_t reserve_size;
+    size_t reserve_used;
+    // bytes of pages that were mapped after the reserve ran out
+    size_t bytes_mapped;
+    // bytes of the blocks that are currently handed out, and the maximum
+    size_t bytes_in_use;
+    size_t peak_bytes_in_use;
+    size_t allocations;
+    size_t frees;
+    // allocations that were served by a previously freed block
+    size_t reused;
+} sentry_page_allocator_stats_t;
+
 /**
  * Returns the state of the page allocator.
  */
@@ -15,12 +34,40 @@ bool sentry__page_allocator_enabled(void);
  */
 void sentry__page_allocator_enable(void);
 
+/**
+ * Maps `size` bytes up front, which the page allocator hands out first once it
+ * is enabled. A crash handler then doesn't need to map any new pages unless
+ * the reserve is exhausted. This must not be called from a signal handler.
+ */
+void sentry__page_allocator_reserve(size_t size);
+
+/**
+ * Unmaps the reserve again, unless the page allocator is enabled and might
+ * have handed it out already.
+ */
+void sentry__page_allocator_release_reserve(void);
+
 /**
  * This is a replacement for `malloc`, but will return an allocation from
  * anonymously mapped pages.
+ *
+ * Small allocations are rounded up to a power-of-two size class, and are
+ * served from the free list of that class before any new memory is used.
  */
 void *sentry__page_allocator_alloc(size_t size);
 
+/**
+ * This is a replacement for `free`. Blocks of the page allocator are put on
+ * a free list for reuse, their pages are never unmapped. Anything that was
+ * allocated before the page allocator was enabled is leaked instead.
+ */
+void sentry__page_allocator_free(void *ptr);
+
+/**
+ * Copies the current usage statistics into `stats`.
+ */
+void sentry__page_allocator_get_stats(sentry_page_allocator_stats_t *stats);
+
 #ifdef SENTRY_UNITTEST
 /**
  * This disables the page allocator, which invalidates every allocation that was
@@ -0,0 +1,18 @@
+#ifndef SENTRY_UNWINDER_H_INCLUDED
+#define SENTRY_UNWINDER_H_INCLUDED
+
+#include "sentry_boot.h"
+
+/**
+ * Walks the frame pointer chain of the thread that was interrupted at `uctx`,
+ * starting with its instruction pointer. Unlike the other unwinders, this is
+ * async-signal-safe and can be used on threads that did not crash, as every
+ * frame record is read without the risk of faulting.
+ *
+ * This is currently only supported on Linux on x86, x86-64 and arm64, and
+ * returns 0 elsewhere.
+ */
+size_t sentry__unwind_stack_framepointer_from_ucontext(
+    const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames);
+
+#endif
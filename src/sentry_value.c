@@ -67,8 +67,10 @@
 #define CONST_TRUE 0x6
 #define CONST_NULL 0xa
 
-#define THING_TYPE_MASK 0x7f
+#define THING_TYPE_MASK 0x3f
 #define THING_TYPE_FROZEN 0x80
+// a frozen list or object that carries its pre-serialized output
+#define THING_TYPE_SERIALIZED 0x40
 #define THING_TYPE_LIST 0
 #define THING_TYPE_OBJECT 1
 #define THING_TYPE_STRING 2
@@ -106,6 +108,30 @@ typedef struct {
     size_t allocated;
 } obj_t;
 
+/**
+ * The output of a value frozen with `sentry__value_freeze_serialized`. It is
+ * stored right after the `list_t` or `obj_t` of the value, so that the
+ * payload can still be used as such.
+ */
+typedef struct {
+    char *json;
+    size_t json_len;
+    char *msgpack;
+    size_t msgpack_len;
+    // the nesting of lists and objects, including the value itself
+    size_t depth;
+} serialized_t;
+
+typedef struct {
+    list_t list;
+    serialized_t serialized;
+} serialized_list_t;
+
+typedef struct {
+    obj_t obj;
+    serialized_t serialized;
+} serialized_obj_t;
+
 static const char *
 level_as_string(sentry_level_t level)
 {
@@ -160,9 +186,30 @@ thing_get_type(const thing_t *thing)
     return thing->type & (uint8_t)THING_TYPE_MASK;
 }
 
+static serialized_t *
+thing_get_serialized(const thing_t *thing)
+{
+    if (!(thing->type & THING_TYPE_SERIALIZED)) {
+        return NULL;
+    }
+    switch (thing_get_type(thing)) {
+    case THING_TYPE_LIST:
+        return &((serialized_list_t *)thing->payload._ptr)->serialized;
+    case THING_TYPE_OBJECT:
+        return &((serialized_obj_t *)thing->payload._ptr)->serialized;
+    default:
+        return NULL;
+    }
+}
+
 static void
 thing_free(thing_t *thing)
 {
+    serialized_t *serialized = thing_get_serialized(thing);
+    if (serialized) {
+        sentry_free(serialized->json);
+        sentry_free(serialized->msgpack);
+    }
     switch (thing_get_type(thing)) {
     case THING_TYPE_LIST: {
         list_t *list = thing->payload._ptr;
@@ -1142,12 +1189,26 @@ sentry__jsonwriter_write_value(sentry_jsonwriter_t *jw, sentry_value_t value)
             return;
         }
 
+        const serialized_t *serialized = thing_get_serialized(thing);
+        if (serialized
+            && sentry__jsonwriter_write_serialized(jw, serialized->json,
+                serialized->json_len, serialized->depth)) {
+            break;
+        }
+        const bool frozen = thing_is_frozen(thing);
+        if (frozen && sentry__jsonwriter_write_memoized(jw, thing)) {
+            break;
+        }
         const list_t *l = thing->payload._ptr;
         sentry__jsonwriter_write_list_start(jw);
+        const size_t start = sentry__jsonwriter_memo_start(jw);
         for (size_t i = 0; i < l->len; i++) {
             sentry__jsonwriter_write_value(jw, l->items[i]);
         }
         sentry__jsonwriter_write_list_end(jw);
+        if (frozen) {
+            sentry__jsonwriter_memoize(jw, thing, start);
+        }
         break;
     }
     case SENTRY_VALUE_TYPE_OBJECT: {
@@ -1157,13 +1218,27 @@ sentry__jsonwriter_write_value(sentry_jsonwriter_t *jw, sentry_value_t value)
             return;
         }
 
+        const serialized_t *serialized = thing_get_serialized(thing);
+        if (serialized
+            && sentry__jsonwriter_write_serialized(jw, serialized->json,
+                serialized->json_len, serialized->depth)) {
+            break;
+        }
+        const bool frozen = thing_is_frozen(thing);
+        if (frozen && sentry__jsonwriter_write_memoized(jw, thing)) {
+            break;
+        }
         const obj_t *o = thing->payload._ptr;
         sentry__jsonwriter_write_object_start(jw);
+        const size_t start = sentry__jsonwriter_memo_start(jw);
         for (size_t i = 0; i < o->len; i++) {
             sentry__jsonwriter_write_key(jw, o->pairs[i].k);
             sentry__jsonwriter_write_value(jw, o->pairs[i].v);
         }
         sentry__jsonwriter_write_object_end(jw);
+        if (frozen) {
+            sentry__jsonwriter_memoize(jw, thing, start);
+        }
         break;
     }
     }
@@ -1207,7 +1282,14 @@ value_to_msgpack(mpack_writer_t *writer, sentry_value_t value)
         break;
     }
     case SENTRY_VALUE_TYPE_LIST: {
-        const list_t *l = value_as_thing(value)->payload._ptr;
+        const thing_t *thing = value_as_thing(value);
+        const serialized_t *serialized = thing_get_serialized(thing);
+        if (serialized) {
+            mpack_write_object_bytes(
+                writer, serialized->msgpack, serialized->msgpack_len);
+            break;
+        }
+        const list_t *l = thing->payload._ptr;
 
         mpack_start_array(writer, (uint32_t)l->len);
         for (size_t i = 0; i < l->len; i++) {
@@ -1217,7 +1299,14 @@ value_to_msgpack(mpack_writer_t *writer, sentry_value_t value)
         break;
     }
     case SENTRY_VALUE_TYPE_OBJECT: {
-        const obj_t *o = value_as_thing(value)->payload._ptr;
+        const thing_t *thing = value_as_thing(value);
+        const serialized_t *serialized = thing_get_serialized(thing);
+        if (serialized) {
+            mpack_write_object_bytes(
+                writer, serialized->msgpack, serialized->msgpack_len);
+            break;
+        }
+        const obj_t *o = thing->payload._ptr;
 
         mpack_start_map(writer, (uint32_t)o->len);
         for (size_t i = 0; i < o->len; i++) {
@@ -1243,6 +1332,89 @@ sentry_value_to_msgpack(sentry_value_t value, size_t *size_out)
     return buf;
 }
 
+static size_t
+value_depth(sentry_value_t value)
+{
+    const thing_t *thing = value_as_thing(value);
+    if (!thing) {
+        return 0;
+    }
+    size_t max_depth = 0;
+    switch (thing_get_type(thing)) {
+    case THING_TYPE_LIST: {
+        const list_t *l = thing->payload._ptr;
+        for (size_t i = 0; i < l->len; i++) {
+            size_t depth = value_depth(l->items[i]);
+            max_depth = depth > max_depth ? depth : max_depth;
+        }
+        return max_depth + 1;
+    }
+    case THING_TYPE_OBJECT: {
+        const obj_t *o = thing->payload._ptr;
+        for (size_t i = 0; i < o->len; i++) {
+            size_t depth = value_depth(o->pairs[i].v);
+            max_depth = depth > max_depth ? depth : max_depth;
+        }
+        return max_depth + 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+void
+sentry__value_freeze_serialized(sentry_value_t value)
+{
+    thing_t *thing = value_as_unfrozen_thing(value);
+    if (!thing) {
+        return;
+    }
+    int type = thing_get_type(thing);
+    if (type != THING_TYPE_LIST && type != THING_TYPE_OBJECT) {
+        sentry_value_freeze(value);
+        return;
+    }
+
+    serialized_t serialized;
+    serialized.json = sentry_value_to_json(value);
+    serialized.json_len = serialized.json ? strlen(serialized.json) : 0;
+    serialized.msgpack
+        = sentry_value_to_msgpack(value, &serialized.msgpack_len);
+    serialized.depth = value_depth(value);
+
+    // the payload is moved into a larger allocation that is followed by the
+    // serialized output, all other code keeps using it as `list_t`/`obj_t`
+    void *payload = NULL;
+    if (serialized.json && serialized.msgpack) {
+        if (type == THING_TYPE_LIST) {
+            serialized_list_t *l = SENTRY_MAKE(serialized_list_t);
+            if (l) {
+                l->list = *(list_t *)thing->payload._ptr;
+                l->serialized = serialized;
+                payload = l;
+            }
+        } else {
+            serialized_obj_t *o = SENTRY_MAKE(serialized_obj_t);
+            if (o) {
+                o->obj = *(obj_t *)thing->payload._ptr;
+                o->serialized = serialized;
+                payload = o;
+            }
+        }
+    }
+    if (!payload) {
+        sentry_free(serialized.json);
+        sentry_free(serialized.msgpack);
+        sentry_value_freeze(value);
+        return;
+    }
+
+    sentry_free(thing->payload._ptr);
+    thing->payload._ptr = payload;
+    thing_freeze(thing);
+    thing->type |= THING_TYPE_SERIALIZED;
+}
+
 sentry_value_t
 sentry__value_new_string_owned(char *s)
 {
@@ -1394,6 +1566,23 @@ sentry_value_new_message_event(
         sentry__guarded_strlen(logger), text, sentry__guarded_strlen(text));
 }
 
+uint64_t
+sentry__value_get_usec_timestamp(sentry_value_t value)
+{
+    sentry_value_t timestamp = sentry_value_get_by_key(value, "timestamp");
+    switch (sentry_value_get_type(timestamp)) {
+    case SENTRY_VALUE_TYPE_STRING:
+        return sentry__iso8601_to_usec(sentry_value_as_string(timestamp));
+    case SENTRY_VALUE_TYPE_INT32:
+    case SENTRY_VALUE_TYPE_DOUBLE: {
+        double seconds = sentry_value_as_double(timestamp);
+        return seconds > 0.0 ? (uint64_t)(seconds * 1000000.0) : 0;
+    }
+    default:
+        return 0;
+    }
+}
+
 static void
 timestamp_value(sentry_value_t value)
 {
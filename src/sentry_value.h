@@ -62,6 +62,13 @@ sentry_value_t sentry__value_new_level(sentry_level_t level);
  */
 sentry_value_t sentry__value_new_list_with_size(size_t size);
 
+/**
+ * Returns the `timestamp` of an object like a breadcrumb in microseconds
+ * since the epoch. Both ISO8601 strings and numeric seconds are accepted.
+ * Returns 0 if the object has no valid timestamp.
+ */
+uint64_t sentry__value_get_usec_timestamp(sentry_value_t value);
+
 /**
  * Creates a new Object Value with a capacity of `size`.
  */
@@ -85,6 +92,18 @@ char *sentry__value_stringify(sentry_value_t value);
  */
 sentry_value_t sentry__value_clone(sentry_value_t value);
 
+/**
+ * Freezes the given list or object and serializes it once, so that every
+ * later JSON or msgpack serialization splices the pre-serialized output
+ * instead of walking the value again. This is meant for large values that are
+ * attached to many events, like the module list.
+ *
+ * This has to be called before the value is shared with other threads, since
+ * it replaces the internal storage of the value. It does nothing for values
+ * that are already frozen.
+ */
+void sentry__value_freeze_serialized(sentry_value_t value);
+
 /**
  * Deep-merges object src into dst.
  *
@@ -0,0 +1,528 @@
+#ifndef _GNU_SOURCE
+#    define _GNU_SOURCE 1
+#endif
+#include "sentry_boot.h"
+
+#include "sentry_alloc.h"
+#include "sentry_logger.h"
+#include "sentry_string.h"
+#include "sentry_symbolizer.h"
+#include "sentry_sync.h"
+#include "modulefinder/sentry_modulefinder_linux.h"
+
+#include <elf.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// build ids are usually 20 bytes, longer ones are only compared by their prefix
+#define MAX_BUILD_ID_LEN 32
+
+/**
+ * A function symbol, with its address relative to the load bias of the
+ * module. The name points into the mapped file of the module.
+ */
+typedef struct {
+    uintptr_t addr;
+    uintptr_t size;
+    const char *name;
+} elf_symbol_t;
+
+/**
+ * A module that is currently loaded. Its symbol table is only read the first
+ * time an address inside of it is symbolized.
+ */
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t bias;
+    char *path;
+    uint8_t build_id[MAX_BUILD_ID_LEN];
+    size_t build_id_len;
+    bool symbols_loaded;
+    sentry_mmap_t mm;
+    elf_symbol_t *symbols;
+    size_t symbol_count;
+} elf_module_t;
+
+typedef struct {
+    elf_module_t *modules;
+    size_t len;
+    size_t capacity;
+} elf_module_list_t;
+
+#ifdef SENTRY__MUTEX_INIT_DYN
+SENTRY__MUTEX_INIT_DYN(g_lock)
+#else
+static sentry_mutex_t g_lock = SENTRY__MUTEX_INIT;
+#endif
+static elf_module_list_t g_modules = { NULL, 0, 0 };
+static unsigned long long g_adds = 0;
+static unsigned long long g_subs = 0;
+static char *g_exe_path = NULL;
+
+static void
+free_module(elf_module_t *module)
+{
+    if (module->mm.ptr) {
+        sentry__mmap_close(&module->mm);
+    }
+    sentry_free(module->symbols);
+    sentry_free(module->path);
+}
+
+static int
+compare_symbols(const void *a, const void *b)
+{
+    const elf_symbol_t *sym_a = a;
+    const elf_symbol_t *sym_b = b;
+    if (sym_a->addr != sym_b->addr) {
+        return sym_a->addr < sym_b->addr ? -1 : 1;
+    }
+    // the biggest symbol at an address comes last, and is thus preferred
+    if (sym_a->size != sym_b->size) {
+        return sym_a->size < sym_b->size ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Finds the GNU build id in the `len` bytes of notes at `notes`, and copies
+ * it into `build_id`. Every note is checked against the bounds, as the notes
+ * of a file on disk might be anything.
+ */
+static size_t
+read_build_id(const char *notes, size_t len, size_t alignment,
+    uint8_t build_id[MAX_BUILD_ID_LEN])
+{
+    if (alignment != 8) {
+        alignment = 4;
+    }
+    size_t offset = 0;
+    while (len - offset >= sizeof(ElfW(Nhdr))) {
+        // the note header is the same for both ELF classes
+        const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)(notes + offset);
+        size_t name_size = ((size_t)note->n_namesz + alignment - 1)
+            & ~(alignment - 1);
+        size_t desc_size = ((size_t)note->n_descsz + alignment - 1)
+            & ~(alignment - 1);
+        offset += sizeof(ElfW(Nhdr));
+        if (name_size > len - offset || desc_size > len - offset - name_size) {
+            return 0;
+        }
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+            && memcmp(notes + offset, "GNU", 4) == 0 && note->n_descsz) {
+            size_t id_len = note->n_descsz < MAX_BUILD_ID_LEN
+                ? note->n_descsz
+                : MAX_BUILD_ID_LEN;
+            memcpy(build_id, notes + offset + name_size, id_len);
+            return id_len;
+        }
+        offset += name_size + desc_size;
+    }
+    return 0;
+}
+
+/**
+ * Checks whether the mapped file of `module` is the one that is loaded,
+ * which might not be the case if it was replaced on disk since. Modules
+ * without a build id can't be checked, and are assumed to match.
+ */
+static bool
+has_matching_build_id(const elf_module_t *module, const ElfW(Shdr) * sections,
+    size_t section_count)
+{
+    if (!module->build_id_len) {
+        return true;
+    }
+    const char *file = module->mm.ptr;
+    size_t file_len = module->mm.len;
+    for (size_t i = 0; i < section_count; i++) {
+        const ElfW(Shdr) *section = &sections[i];
+        if (section->sh_type != SHT_NOTE || section->sh_offset > file_len
+            || section->sh_size > file_len - section->sh_offset) {
+            continue;
+        }
+        uint8_t build_id[MAX_BUILD_ID_LEN];
+        size_t build_id_len = read_build_id(file + section->sh_offset,
+            section->sh_size, section->sh_addralign, build_id);
+        if (build_id_len) {
+            return build_id_len == module->build_id_len
+                && memcmp(build_id, module->build_id, build_id_len) == 0;
+        }
+    }
+    return false;
+}
+
+/**
+ * Collects the function symbols of the symbol table section `symtab`, whose
+ * names are in the section it links to.
+ */
+static bool
+read_symbol_table(elf_module_t *module, const ElfW(Shdr) * sections,
+    size_t section_count, const ElfW(Shdr) * symtab)
+{
+    const char *file = module->mm.ptr;
+    size_t file_len = module->mm.len;
+    if (symtab->sh_link >= section_count
+        || symtab->sh_entsize != sizeof(ElfW(Sym))
+        || symtab->sh_offset > file_len
+        || symtab->sh_size > file_len - symtab->sh_offset) {
+        return false;
+    }
+    const ElfW(Shdr) *strtab = &sections[symtab->sh_link];
+    if (strtab->sh_offset > file_len
+        || strtab->sh_size > file_len - strtab->sh_offset
+        || strtab->sh_size == 0) {
+        return false;
+    }
+    const char *names = file + strtab->sh_offset;
+    // the string table has to be terminated, so that no name runs past it
+    if (names[strtab->sh_size - 1] != '\0') {
+        return false;
+    }
+
+    const ElfW(Sym) *syms = (const ElfW(Sym) *)(file + symtab->sh_offset);
+    size_t sym_count = symtab->sh_size / sizeof(ElfW(Sym));
+    elf_symbol_t *symbols = sentry_malloc(sizeof(elf_symbol_t) * sym_count);
+    if (!symbols) {
+        return false;
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < sym_count; i++) {
+        const ElfW(Sym) *sym = &syms[i];
+        // the symbol type is encoded the same way for both ELF classes
+        if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC
+            || sym->st_shndx == SHN_UNDEF || !sym->st_value
+            || sym->st_name >= strtab->sh_size || !names[sym->st_name]) {
+            continue;
+        }
+        symbols[len].addr = (uintptr_t)sym->st_value;
+        symbols[len].size = (uintptr_t)sym->st_size;
+        symbols[len].name = names + sym->st_name;
+        len++;
+    }
+    if (!len) {
+        sentry_free(symbols);
+        return false;
+    }
+    qsort(symbols, len, sizeof(elf_symbol_t), compare_symbols);
+    module->symbols = symbols;
+    module->symbol_count = len;
+    return true;
+}
+
+/**
+ * Maps the file of `module` and reads its symbols. The full `.symtab` also
+ * has the static functions, the `.dynsym` that every shared object keeps
+ * only covers the exported ones, so it is only used for stripped files.
+ */
+static void
+load_symbols(elf_module_t *module)
+{
+    module->symbols_loaded = true;
+    if (!sentry__mmap_file(&module->mm, module->path)) {
+        return;
+    }
+    const char *file = module->mm.ptr;
+    size_t file_len = module->mm.len;
+    const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)file;
+    if (file_len < sizeof(ElfW(Ehdr))
+        || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+#if __SIZEOF_POINTER__ == 8
+        || ehdr->e_ident[EI_CLASS] != ELFCLASS64
+#else
+        || ehdr->e_ident[EI_CLASS] != ELFCLASS32
+#endif
+        || ehdr->e_shentsize != sizeof(ElfW(Shdr))
+        || ehdr->e_shoff > file_len
+        || (size_t)ehdr->e_shnum * sizeof(ElfW(Shdr))
+            > file_len - ehdr->e_shoff) {
+        goto fail;
+    }
+
+    const ElfW(Shdr) *sections = (const ElfW(Shdr) *)(file + ehdr->e_shoff);
+    if (!has_matching_build_id(module, sections, ehdr->e_shnum)) {
+        SENTRY_DEBUGF("not symbolizing \"%s\", as the file on disk is not the "
+                      "loaded module",
+            module->path);
+        goto fail;
+    }
+    const ElfW(Shdr) *symtab = NULL;
+    const ElfW(Shdr) *dynsym = NULL;
+    for (size_t i = 0; i < ehdr->e_shnum; i++) {
+        if (sections[i].sh_type == SHT_SYMTAB) {
+            symtab = &sections[i];
+        } else if (sections[i].sh_type == SHT_DYNSYM) {
+            dynsym = &sections[i];
+        }
+    }
+    if (symtab && read_symbol_table(module, sections, ehdr->e_shnum, symtab)) {
+        return;
+    }
+    if (dynsym && read_symbol_table(module, sections, ehdr->e_shnum, dynsym)) {
+        return;
+    }
+
+fail:
+    sentry__mmap_close(&module->mm);
+}
+
+static const elf_symbol_t *
+find_symbol(const elf_module_t *module, uintptr_t addr)
+{
+    if (!module->symbol_count || addr < module->symbols[0].addr) {
+        return NULL;
+    }
+    // find the last symbol that starts at or before `addr`
+    size_t lo = 0;
+    size_t hi = module->symbol_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (module->symbols[mid].addr <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const elf_symbol_t *symbol = &module->symbols[lo];
+    if (addr - symbol->addr < symbol->size
+        || (!symbol->size && addr == symbol->addr)) {
+        return symbol;
+    }
+    return NULL;
+}
+
+static const char *
+get_exe_path(void)
+{
+    if (!g_exe_path) {
+        char buf[4096];
+        ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+        if (len <= 0) {
+            return NULL;
+        }
+        buf[len] = '\0';
+        g_exe_path = sentry__string_clone(buf);
+    }
+    return g_exe_path;
+}
+
+typedef struct {
+    bool checked_generation;
+    bool unchanged;
+    size_t visited;
+    elf_module_list_t modules;
+} refresh_state_t;
+
+static int
+collect_module(struct dl_phdr_info *info, size_t size, void *data)
+{
+    refresh_state_t *state = data;
+    if (!state->checked_generation) {
+        state->checked_generation = true;
+        if (size >= offsetof(struct dl_phdr_info, dlpi_subs)
+                    + sizeof(info->dlpi_subs)) {
+            if (g_modules.modules && info->dlpi_adds == g_adds
+                && info->dlpi_subs == g_subs) {
+                state->unchanged = true;
+                return 1;
+            }
+            g_adds = info->dlpi_adds;
+            g_subs = info->dlpi_subs;
+        }
+    }
+
+    // the main executable is reported without a name
+    const char *path = info->dlpi_name;
+    if (!path || !*path) {
+        path = state->visited == 0 ? get_exe_path() : NULL;
+    }
+    state->visited++;
+    if (!path || !*path) {
+        return 0;
+    }
+
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        uintptr_t segment_start = info->dlpi_addr + phdr->p_vaddr;
+        uintptr_t segment_end = segment_start + phdr->p_memsz;
+        start = segment_start < start ? segment_start : start;
+        end = segment_end > end ? segment_end : end;
+    }
+    if (start >= end) {
+        return 0;
+    }
+
+    elf_module_list_t *modules = &state->modules;
+    if (modules->len == modules->capacity) {
+        size_t capacity = modules->capacity ? modules->capacity * 2 : 64;
+        elf_module_t *new_modules
+            = sentry_malloc(sizeof(elf_module_t) * capacity);
+        if (!new_modules) {
+            return 1;
+        }
+        if (modules->modules) {
+            memcpy(new_modules, modules->modules,
+                sizeof(elf_module_t) * modules->len);
+            sentry_free(modules->modules);
+        }
+        modules->modules = new_modules;
+        modules->capacity = capacity;
+    }
+    elf_module_t *module = &modules->modules[modules->len];
+    memset(module, 0, sizeof(elf_module_t));
+    module->start = start & ~(uintptr_t)(getpagesize() - 1);
+    module->end = end;
+    module->bias = info->dlpi_addr;
+    for (size_t i = 0; i < info->dlpi_phnum && !module->build_id_len; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_NOTE) {
+            module->build_id_len = read_build_id(
+                (const char *)(info->dlpi_addr + phdr->p_vaddr),
+                phdr->p_memsz, phdr->p_align, module->build_id);
+        }
+    }
+    module->path = sentry__string_clone(path);
+    if (module->path) {
+        modules->len++;
+    }
+    return 0;
+}
+
+/**
+ * Updates the list of loaded modules if any were loaded or unloaded since the
+ * last time. The symbols of modules that are still loaded are kept.
+ */
+static void
+refresh_modules(void)
+{
+    refresh_state_t state;
+    memset(&state, 0, sizeof(state));
+    dl_iterate_phdr(collect_module, &state);
+    if (state.unchanged || !state.modules.len) {
+        sentry_free(state.modules.modules);
+        return;
+    }
+
+    for (size_t i = 0; i < g_modules.len; i++) {
+        elf_module_t *old = &g_modules.modules[i];
+        for (size_t j = 0; old->symbols_loaded && j < state.modules.len; j++) {
+            elf_module_t *module = &state.modules.modules[j];
+            if (module->start == old->start && module->bias == old->bias
+                && module->build_id_len == old->build_id_len
+                && memcmp(module->build_id, old->build_id,
+                       module->build_id_len)
+                    == 0
+                && strcmp(module->path, old->path) == 0) {
+                module->symbols_loaded = true;
+                module->mm = old->mm;
+                module->symbols = old->symbols;
+                module->symbol_count = old->symbol_count;
+                old->mm.ptr = NULL;
+                old->symbols = NULL;
+                break;
+            }
+        }
+        free_module(old);
+    }
+    sentry_free(g_modules.modules);
+    g_modules = state.modules;
+}
+
+static void
+clear_modules(void)
+{
+    for (size_t i = 0; i < g_modules.len; i++) {
+        free_module(&g_modules.modules[i]);
+    }
+    sentry_free(g_modules.modules);
+    memset(&g_modules, 0, sizeof(g_modules));
+    g_adds = 0;
+    g_subs = 0;
+}
+
+static elf_module_t *
+find_module(uintptr_t addr)
+{
+    for (size_t i = 0; i < g_modules.len; i++) {
+        elf_module_t *module = &g_modules.modules[i];
+        if (addr >= module->start && addr < module->end) {
+            return module;
+        }
+    }
+    return NULL;
+}
+
+size_t
+sentry__symbolize_elf(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data,
+    bool *resolved)
+{
+    size_t resolved_count = 0;
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    refresh_modules();
+    for (size_t i = 0; i < count; i++) {
+        resolved[i] = false;
+        uintptr_t addr = (uintptr_t)addrs[i];
+        elf_module_t *module = addr ? find_module(addr) : NULL;
+        if (!module) {
+            continue;
+        }
+        if (!module->symbols_loaded) {
+            load_symbols(module);
+        }
+        const elf_symbol_t *symbol = find_symbol(module, addr - module->bias);
+        if (!symbol) {
+            continue;
+        }
+
+        sentry_frame_info_t frame_info;
+        memset(&frame_info, 0, sizeof(sentry_frame_info_t));
+        frame_info.load_addr = (void *)module->start;
+        frame_info.symbol_addr = (void *)(module->bias + symbol->addr);
+        frame_info.instruction_addr = addrs[i];
+        frame_info.symbol = symbol->name;
+        frame_info.object_name = module->path;
+        func(&frame_info, data[i]);
+        resolved[i] = true;
+        resolved_count++;
+    }
+    sentry__mutex_unlock(&g_lock);
+    return resolved_count;
+}
+
+void
+sentry__symbolize_elf_clear(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    clear_modules();
+    sentry_free(g_exe_path);
+    g_exe_path = NULL;
+    sentry__mutex_unlock(&g_lock);
+}
+
+#ifdef SENTRY_UNITTEST
+size_t
+sentry__symbolize_elf_mapped_count(void)
+{
+    SENTRY__MUTEX_INIT_DYN_ONCE(g_lock);
+    sentry__mutex_lock(&g_lock);
+    size_t count = 0;
+    for (size_t i = 0; i < g_modules.len; i++) {
+        if (g_modules.modules[i].mm.ptr) {
+            count++;
+        }
+    }
+    sentry__mutex_unlock(&g_lock);
+    return count;
+}
+#endif
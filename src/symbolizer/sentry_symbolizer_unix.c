@@ -1,6 +1,7 @@
 #include "sentry_boot.h"
 
 #include "sentry_symbolizer.h"
+#include "sentry_sync.h"
 
 #include <dlfcn.h>
 #include <string.h>
@@ -191,8 +192,8 @@ dladdr(void *s, Dl_info *i)
 }
 #endif
 
-bool
-sentry__symbolize(
+static bool
+symbolize_dladdr(
     void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data)
 {
     Dl_info info;
@@ -220,3 +221,52 @@ sentry__symbolize(
 
     return true;
 }
+
+bool
+sentry__symbolize(
+    void *addr, void (*func)(const sentry_frame_info_t *, void *), void *data)
+{
+#ifdef SENTRY_PLATFORM_LINUX
+    bool resolved = false;
+    if (sentry__block_for_signal_handler()
+        && sentry__symbolize_elf(&addr, 1, func, &data, &resolved)) {
+        return true;
+    }
+#endif
+    return symbolize_dladdr(addr, func, data);
+}
+
+size_t
+sentry__symbolize_batch(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data)
+{
+    size_t resolved_count = 0;
+#ifdef SENTRY_PLATFORM_LINUX
+    // Reading the symbol tables takes locks, maps whole files and allocates
+    // a lot, none of which may happen in a signal handler.
+    bool *resolved = NULL;
+    if (sentry__block_for_signal_handler()) {
+        resolved = sentry_malloc(sizeof(bool) * count);
+    }
+    if (resolved) {
+        resolved_count
+            = sentry__symbolize_elf(addrs, count, func, data, resolved);
+    }
+#endif
+    // whatever could not be resolved from the symbol tables, for example code
+    // that was not loaded from a file, is left to the dynamic loader
+    for (size_t i = 0; i < count; i++) {
+#ifdef SENTRY_PLATFORM_LINUX
+        if (resolved && resolved[i]) {
+            continue;
+        }
+#endif
+        if (symbolize_dladdr(addrs[i], func, data[i])) {
+            resolved_count++;
+        }
+    }
+#ifdef SENTRY_PLATFORM_LINUX
+    sentry_free(resolved);
+#endif
+    return resolved_count;
+}
@@ -64,3 +64,16 @@ sentry__symbolize(
 
     return true;
 }
+
+size_t
+sentry__symbolize_batch(void *const *addrs, size_t count,
+    void (*func)(const sentry_frame_info_t *, void *), void *const *data)
+{
+    size_t resolved_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sentry__symbolize(addrs[i], func, data[i])) {
+            resolved_count++;
+        }
+    }
+    return resolved_count;
+}
@@ -25,6 +25,8 @@ typedef struct curl_transport_state_s {
     char *ca_certs;
     sentry_rate_limiter_t *ratelimiter;
     bool debug;
+    // the worker owning this state, to coalesce the envelopes in its queue
+    sentry_bgworker_t *bgworker;
 #ifdef SENTRY_PLATFORM_NX
     void *nx_state;
 #endif
@@ -189,6 +191,9 @@ sentry__curl_send_task(void *_envelope, void *_state)
     sentry_envelope_t *envelope = (sentry_envelope_t *)_envelope;
     curl_bgworker_state_t *state = (curl_bgworker_state_t *)_state;
 
+    sentry__transport_coalesce_queued(
+        state->bgworker, sentry__curl_send_task, envelope);
+
 #ifdef SENTRY_PLATFORM_NX
     if (!sentry_nx_curl_connect(state->nx_state)) {
         return; // TODO should we dump the envelope to disk?
@@ -302,17 +307,18 @@ sentry__curl_transport_send_envelope(
 static bool
 sentry__curl_dump_task(void *envelope, void *run)
 {
-    sentry__run_write_envelope(
-        (sentry_run_t *)run, (sentry_envelope_t *)envelope);
-    return true;
+    return sentry__run_spool_envelope(
+        (const sentry_run_t *)run, (sentry_envelope_t *)envelope);
 }
 
 size_t
 sentry__curl_dump_queue(sentry_run_t *run, void *transport_state)
 {
     sentry_bgworker_t *bgworker = (sentry_bgworker_t *)transport_state;
-    return sentry__bgworker_foreach_matching(
+    size_t dumped = sentry__bgworker_foreach_matching(
         bgworker, sentry__curl_send_task, sentry__curl_dump_task, run);
+    sentry__run_sync_spool(run);
+    return dumped;
 }
 
 sentry_transport_t *
@@ -329,6 +335,7 @@ sentry__transport_new_default(void)
     if (!bgworker) {
         return NULL;
     }
+    state->bgworker = bgworker;
 
     sentry_transport_t *transport
         = sentry_transport_new(sentry__curl_transport_send_envelope);
@@ -28,6 +28,8 @@ typedef struct {
     HINTERNET connect;
     HINTERNET request;
     bool debug;
+    // the worker owning this state, to coalesce the envelopes in its queue
+    sentry_bgworker_t *bgworker;
 } winhttp_bgworker_state_t;
 
 static winhttp_bgworker_state_t *
@@ -193,6 +195,9 @@ sentry__winhttp_send_task(void *_envelope, void *_state)
     sentry_envelope_t *envelope = (sentry_envelope_t *)_envelope;
     winhttp_bgworker_state_t *state = (winhttp_bgworker_state_t *)_state;
 
+    sentry__transport_coalesce_queued(
+        state->bgworker, sentry__winhttp_send_task, envelope);
+
     uint64_t started = sentry__monotonic_time();
 
     char *user_agent = sentry__string_from_wstr(state->user_agent);
@@ -368,17 +373,18 @@ sentry__winhttp_transport_send_envelope(
 static bool
 sentry__winhttp_dump_task(void *envelope, void *run)
 {
-    sentry__run_write_envelope(
-        (sentry_run_t *)run, (sentry_envelope_t *)envelope);
-    return true;
+    return sentry__run_spool_envelope(
+        (const sentry_run_t *)run, (sentry_envelope_t *)envelope);
 }
 
 static size_t
 sentry__winhttp_dump_queue(sentry_run_t *run, void *transport_state)
 {
     sentry_bgworker_t *bgworker = (sentry_bgworker_t *)transport_state;
-    return sentry__bgworker_foreach_matching(
+    size_t dumped = sentry__bgworker_foreach_matching(
         bgworker, sentry__winhttp_send_task, sentry__winhttp_dump_task, run);
+    sentry__run_sync_spool(run);
+    return dumped;
 }
 
 sentry_transport_t *
@@ -395,6 +401,7 @@ sentry__transport_new_default(void)
     if (!bgworker) {
         return NULL;
     }
+    state->bgworker = bgworker;
 
     sentry_transport_t *transport
         = sentry_transport_new(sentry__winhttp_transport_send_envelope);
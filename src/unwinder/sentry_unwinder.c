@@ -12,6 +12,7 @@
         }                                                                      \
     } while (0)
 
+DEFINE_UNWINDER(framepointer);
 DEFINE_UNWINDER(libunwindstack);
 DEFINE_UNWINDER(libbacktrace);
 DEFINE_UNWINDER(dbghelp);
@@ -22,6 +23,9 @@ static size_t
 unwind_stack(
     void *addr, const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames)
 {
+#ifdef SENTRY_WITH_UNWINDER_FRAMEPOINTER
+    TRY_UNWINDER(framepointer);
+#endif
 #ifdef SENTRY_WITH_UNWINDER_LIBUNWINDSTACK
     TRY_UNWINDER(libunwindstack);
 #endif
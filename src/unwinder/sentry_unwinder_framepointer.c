@@ -0,0 +1,329 @@
+#include "sentry_boot.h"
+
+#include "sentry_unwinder.h"
+
+// The frame pointer chain is walked on the architectures where every frame
+// starts with the saved frame pointer, directly followed by the return
+// address. This only yields complete stacks for code that was compiled with
+// `-fno-omit-frame-pointer`, which is the default on macOS and arm64.
+#if (defined(SENTRY_PLATFORM_LINUX) || defined(SENTRY_PLATFORM_DARWIN))       \
+    && defined(__GNUC__)                                                       \
+    && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#    define HAS_FRAME_POINTER_UNWINDER
+#endif
+
+#ifdef HAS_FRAME_POINTER_UNWINDER
+#    include "sentry_sync.h"
+
+#    include <pthread.h>
+#    include <stdint.h>
+#    ifdef SENTRY_PLATFORM_DARWIN
+#        include <dlfcn.h>
+#        include <mach-o/getsect.h>
+#    else
+#        include <link.h>
+#        include <sys/syscall.h>
+#        include <sys/uio.h>
+#        include <unistd.h>
+#    endif
+
+// a walk with fewer frames most likely stopped at code without frame pointers
+#    define MIN_FRAMES 2
+
+struct frame_record {
+    struct frame_record *next;
+    void *return_address;
+};
+
+/**
+ * The stack bounds of the current thread. Querying them can be expensive, for
+ * example glibc parses `/proc/self/maps` for the main thread, so they are
+ * cached per thread.
+ */
+static __thread uintptr_t g_stack_low = 0;
+static __thread uintptr_t g_stack_high = 0;
+
+static bool
+get_stack_bounds(uintptr_t *low, uintptr_t *high)
+{
+    if (!g_stack_high) {
+#    if defined(SENTRY_PLATFORM_DARWIN)
+        pthread_t self = pthread_self();
+        uintptr_t top = (uintptr_t)pthread_get_stackaddr_np(self);
+        g_stack_low = top - pthread_get_stacksize_np(self);
+        g_stack_high = top;
+#    else
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+            return false;
+        }
+        void *addr = NULL;
+        size_t size = 0;
+        int rv = pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        if (rv != 0 || !addr || !size) {
+            return false;
+        }
+        g_stack_low = (uintptr_t)addr;
+        g_stack_high = (uintptr_t)addr + size;
+#    endif
+    }
+    *low = g_stack_low;
+    *high = g_stack_high;
+    return true;
+}
+
+/**
+ * Reads the frame record at `fp`. Within known stack bounds, the record is
+ * read directly. Otherwise the `fault_safe` read goes through
+ * `process_vm_readv`, which reports unmapped memory as an error instead of
+ * faulting, and being a plain system call, is async-signal-safe.
+ */
+static bool
+read_frame_record(uintptr_t fp, bool fault_safe, struct frame_record *record)
+{
+    if (!fault_safe) {
+        *record = *(const struct frame_record *)fp;
+        return true;
+    }
+#    ifdef SENTRY_PLATFORM_LINUX
+    struct iovec local = { record, sizeof(struct frame_record) };
+    struct iovec remote = { (void *)fp, sizeof(struct frame_record) };
+    return syscall(SYS_process_vm_readv, (long)getpid(), &local, 1UL,
+               &remote, 1UL, 0UL)
+        == (long)sizeof(struct frame_record);
+#    else
+    return false;
+#    endif
+}
+
+/**
+ * Walks the frame pointer chain, starting at the frame record `fp`. Every
+ * record has to lie within `low` and `high`, above the previous one, so that
+ * a corrupt chain can't loop or make us read arbitrary memory.
+ */
+static size_t
+walk_frame_pointers(uintptr_t fp, uintptr_t low, uintptr_t high,
+    bool fault_safe, void **ptrs, size_t max_frames)
+{
+    size_t frame_count = 0;
+    while (frame_count < max_frames && fp >= low
+        && fp <= high - sizeof(struct frame_record)
+        && fp % sizeof(void *) == 0) {
+        struct frame_record record;
+        if (!read_frame_record(fp, fault_safe, &record)
+            || !record.return_address) {
+            break;
+        }
+        ptrs[frame_count++] = record.return_address;
+
+        uintptr_t next = (uintptr_t)record.next;
+        if (next <= fp) {
+            break;
+        }
+        fp = next;
+    }
+    return frame_count;
+}
+
+/**
+ * Unwinds from the frame record at `addr`, or from `own_fp`, the frame of the
+ * SDK function that was called to unwind, if `addr` is null.
+ */
+static size_t
+unwind_frame_pointers(
+    uintptr_t own_fp, void *addr, void **ptrs, size_t max_frames)
+{
+    uintptr_t low;
+    uintptr_t high;
+    if (!get_stack_bounds(&low, &high)) {
+        return 0;
+    }
+    // everything below our own frame is dead
+    uintptr_t fp = own_fp;
+    if (fp > low) {
+        low = fp;
+    }
+    if (addr) {
+        fp = (uintptr_t)addr;
+    }
+    return walk_frame_pointers(fp, low, high, false, ptrs, max_frames);
+}
+
+#    ifdef SENTRY_PLATFORM_LINUX
+static bool
+get_frame_registers(
+    const ucontext_t *uctx, uintptr_t *ip, uintptr_t *fp, uintptr_t *sp)
+{
+#        if defined(__x86_64__)
+    *ip = (uintptr_t)uctx->uc_mcontext.gregs[REG_RIP];
+    *fp = (uintptr_t)uctx->uc_mcontext.gregs[REG_RBP];
+    *sp = (uintptr_t)uctx->uc_mcontext.gregs[REG_RSP];
+#        elif defined(__i386__)
+    *ip = (uintptr_t)uctx->uc_mcontext.gregs[REG_EIP];
+    *fp = (uintptr_t)uctx->uc_mcontext.gregs[REG_EBP];
+    *sp = (uintptr_t)uctx->uc_mcontext.gregs[REG_ESP];
+#        else
+    *ip = (uintptr_t)uctx->uc_mcontext.pc;
+    *fp = (uintptr_t)uctx->uc_mcontext.regs[29];
+    *sp = (uintptr_t)uctx->uc_mcontext.sp;
+#        endif
+    return true;
+}
+#    endif
+
+// only its address is used, to find the module that contains the SDK
+static const char g_sentry_module_marker = 0;
+
+/**
+ * The address range of the module that contains the SDK. It is resolved once,
+ * by the first walk that needs it, so that checking the end of a walk doesn't
+ * ask the dynamic loader every time. Concurrent walks resolve the same range.
+ */
+static volatile long g_sentry_module_start = 0;
+static volatile long g_sentry_module_end = 0;
+
+#    ifndef SENTRY_PLATFORM_DARWIN
+static int
+find_sentry_module(struct dl_phdr_info *info, size_t UNUSED(size), void *data)
+{
+    uintptr_t *range = data;
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
+        }
+        uintptr_t segment_start = info->dlpi_addr + phdr->p_vaddr;
+        if (segment_start < start) {
+            start = segment_start;
+        }
+        if (segment_start + phdr->p_memsz > end) {
+            end = segment_start + phdr->p_memsz;
+        }
+    }
+    uintptr_t marker = (uintptr_t)&g_sentry_module_marker;
+    if (marker < start || marker >= end) {
+        return 0;
+    }
+    range[0] = start;
+    range[1] = end;
+    return 1;
+}
+#    endif
+
+static bool
+get_sentry_module_range(uintptr_t *start, uintptr_t *end)
+{
+    if (!sentry__atomic_fetch(&g_sentry_module_end)) {
+        uintptr_t range[2] = { 0, 0 };
+#    ifdef SENTRY_PLATFORM_DARWIN
+        // return addresses always point into the code of the SDK
+        Dl_info info;
+        unsigned long size = 0;
+        if (dladdr(&g_sentry_module_marker, &info)) {
+            uint8_t *text = getsegmentdata(info.dli_fbase, "__TEXT", &size);
+            range[0] = (uintptr_t)text;
+            range[1] = text ? (uintptr_t)text + size : 0;
+        }
+#    else
+        dl_iterate_phdr(find_sentry_module, range);
+#    endif
+        if (!range[1]) {
+            return false;
+        }
+        sentry__atomic_store(&g_sentry_module_start, (long)range[0]);
+        sentry__atomic_store(&g_sentry_module_end, (long)range[1]);
+    }
+    *start = (uintptr_t)sentry__atomic_fetch(&g_sentry_module_start);
+    *end = (uintptr_t)sentry__atomic_fetch(&g_sentry_module_end);
+    return true;
+}
+
+/**
+ * Checks whether `addr` lies in the module that contains the SDK.
+ */
+static bool
+is_sentry_address(void *addr)
+{
+    uintptr_t start;
+    uintptr_t end;
+    if (!get_sentry_module_range(&start, &end)) {
+        return false;
+    }
+    return (uintptr_t)addr >= start && (uintptr_t)addr < end;
+}
+#endif
+
+size_t
+sentry__unwind_stack_framepointer(
+    void *addr, const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames)
+{
+#ifdef HAS_FRAME_POINTER_UNWINDER
+    // a crashed thread can't safely query its stack bounds, so we leave that
+    // to the other unwinders
+    if (uctx) {
+        return 0;
+    }
+
+    // The SDK itself is built with frame pointers, so a walk that ends early
+    // or doesn't get past the SDK ran into code without them. The stack is
+    // then left to the unwinders that read the unwind info.
+    size_t frame_count = unwind_frame_pointers(
+        (uintptr_t)__builtin_frame_address(0), addr, ptrs, max_frames);
+    if (frame_count < MIN_FRAMES
+        || (frame_count < max_frames
+            && is_sentry_address(ptrs[frame_count - 1]))) {
+        return 0;
+    }
+    return frame_count;
+#else
+    (void)addr;
+    (void)uctx;
+    (void)ptrs;
+    (void)max_frames;
+    return 0;
+#endif
+}
+
+size_t
+sentry__unwind_stack_framepointer_from_ucontext(
+    const sentry_ucontext_t *uctx, void **ptrs, size_t max_frames)
+{
+#if defined(HAS_FRAME_POINTER_UNWINDER) && defined(SENTRY_PLATFORM_LINUX)
+    uintptr_t ip;
+    uintptr_t fp;
+    uintptr_t sp;
+    if (!max_frames || !uctx->user_context
+        || !get_frame_registers(uctx->user_context, &ip, &fp, &sp) || !ip) {
+        return 0;
+    }
+    // the stack bounds can't be queried in a signal handler, so the records
+    // are only known to lie above the interrupted stack pointer
+    ptrs[0] = (void *)ip;
+    return 1
+        + walk_frame_pointers(
+            fp, sp, UINTPTR_MAX, true, ptrs + 1, max_frames - 1);
+#else
+    (void)uctx;
+    (void)ptrs;
+    (void)max_frames;
+    return 0;
+#endif
+}
+
+size_t
+sentry_unwind_stack_frame_pointers(
+    void *fp, void **stacktrace_out, size_t max_len)
+{
+#ifdef HAS_FRAME_POINTER_UNWINDER
+    return unwind_frame_pointers((uintptr_t)__builtin_frame_address(0), fp,
+        stacktrace_out, max_len);
+#else
+    (void)fp;
+    (void)stacktrace_out;
+    (void)max_len;
+    return 0;
+#endif
+}
@@ -39,8 +39,6 @@ sentry__unwind_stack_libunwind(
         unw_word_t ip = 0;
         unw_get_reg(&cursor, UNW_REG_IP, &ip);
         ptrs[frame_idx] = (void *)ip;
-        unw_word_t sp = 0;
-        unw_get_reg(&cursor, UNW_REG_SP, &sp);
         frame_idx++;
     }
     return frame_idx + 1;
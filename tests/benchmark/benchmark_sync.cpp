@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <sentry.h>
+
+extern "C" {
+#include "sentry_logs.h"
+#include "sentry_sync.h"
+}
+
+static void
+set_executed(void *task_data, void *)
+{
+    sentry__atomic_store((volatile long *)task_data, 1);
+}
+
+// measures the time from submitting a task to an idle worker until the worker
+// picked it up, which is dominated by the wakeup of the sleeping worker.
+static void
+benchmark_bgworker_wakeup(benchmark::State &state)
+{
+    sentry_bgworker_t *bgw = sentry__bgworker_new(nullptr, nullptr);
+    sentry__bgworker_start(bgw);
+
+    volatile long executed = 0;
+    for (auto _ : state) {
+        sentry__atomic_store(&executed, 0);
+        sentry__bgworker_submit(bgw, set_executed, nullptr, (void *)&executed);
+        while (!sentry__atomic_fetch(&executed)) { }
+    }
+
+    sentry__bgworker_shutdown(bgw, 1000);
+    sentry__bgworker_decref(bgw);
+}
+
+BENCHMARK(benchmark_bgworker_wakeup)->Unit(benchmark::kMicrosecond);
+
+static volatile long g_flushed;
+
+static void
+mark_flushed(sentry_envelope_t *envelope, void *)
+{
+    sentry__atomic_store(&g_flushed, 1);
+    sentry_envelope_free(envelope);
+}
+
+// measures the time from the log that fills the buffer to the high watermark
+// until its batch arrives at the transport, which covers waking up the logs
+// batching thread and the flush itself.
+static void
+benchmark_logs_wakeup_to_flush(benchmark::State &state)
+{
+    sentry_options_t *options = sentry_options_new();
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+    sentry_options_set_transport(
+        options, sentry_transport_new(mark_flushed));
+    sentry_init(options);
+
+    for (auto _ : state) {
+        for (int i = 1; i < SENTRY_LOGS_FLUSH_HIGH_WATERMARK; i++) {
+            sentry_log_info("benchmark log");
+        }
+        sentry__atomic_store(&g_flushed, 0);
+        auto start = std::chrono::steady_clock::now();
+        sentry_log_info("benchmark log");
+        while (!sentry__atomic_fetch(&g_flushed)) { }
+        auto end = std::chrono::steady_clock::now();
+        state.SetIterationTime(
+            std::chrono::duration<double>(end - start).count());
+    }
+
+    sentry_close();
+}
+
+BENCHMARK(benchmark_logs_wakeup_to_flush)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,62 @@
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#include "sentry_boot.h"
+}
+
+#define MAX_FRAMES 128
+
+typedef size_t (*unwind_func_t)(void **ptrs, size_t max_frames);
+
+static size_t
+unwind_default(void **ptrs, size_t max_frames)
+{
+    return sentry_unwind_stack(nullptr, ptrs, max_frames);
+}
+
+static size_t
+unwind_frame_pointers(void **ptrs, size_t max_frames)
+{
+    return sentry_unwind_stack_frame_pointers(nullptr, ptrs, max_frames);
+}
+
+// recurses `depth` times before capturing, so that the stack is deep enough
+// to measure the cost per step.
+static size_t
+capture_at_depth(unwind_func_t unwind, int depth, void **ptrs)
+{
+    if (depth > 0) {
+        size_t rv = capture_at_depth(unwind, depth - 1, ptrs);
+        benchmark::DoNotOptimize(rv);
+        return rv;
+    }
+    return unwind(ptrs, MAX_FRAMES);
+}
+
+// measures the capture latency of repeated stack captures from the same call
+// site, which is what attaching stacktraces to handled errors or logs does.
+static void
+benchmark_unwind_stack(benchmark::State &state)
+{
+    void *ptrs[MAX_FRAMES];
+    for (auto _ : state) {
+        size_t frame_count
+            = capture_at_depth(unwind_default, (int)state.range(0), ptrs);
+        benchmark::DoNotOptimize(frame_count);
+    }
+}
+
+BENCHMARK(benchmark_unwind_stack)->Arg(8)->Arg(32);
+
+static void
+benchmark_unwind_stack_frame_pointers(benchmark::State &state)
+{
+    void *ptrs[MAX_FRAMES];
+    for (auto _ : state) {
+        size_t frame_count = capture_at_depth(
+            unwind_frame_pointers, (int)state.range(0), ptrs);
+        benchmark::DoNotOptimize(frame_count);
+    }
+}
+
+BENCHMARK(benchmark_unwind_stack_frame_pointers)->Arg(8)->Arg(32);
@@ -198,6 +198,31 @@ def test_inproc_crash_stdout_before_send(cmake):
     assert_before_send(envelope)
 
 
+@pytest.mark.skipif(
+    not sys.platform.startswith("linux"),
+    reason="capturing all threads is only supported on linux",
+)
+def test_inproc_crash_stdout_all_threads(cmake):
+    tmp_path, output = run_crash_stdout_for(
+        "inproc", cmake, ["capture-all-threads", "idle-threads"]
+    )
+
+    envelope = Envelope.deserialize(output)
+
+    assert_meta(envelope, integration="inproc")
+    assert_inproc_crash(envelope)
+
+    threads = envelope.get_event()["threads"]["values"]
+    crashed = [thread for thread in threads if thread.get("crashed")]
+    assert len(crashed) == 1
+    # the example spawns 50 idle threads on top of the sentry workers
+    others = [thread for thread in threads if "stacktrace" in thread]
+    assert len(others) >= 50
+    for thread in others:
+        assert thread["id"]
+        assert len(thread["stacktrace"]["frames"]) > 0
+
+
 def test_inproc_crash_stdout_discarding_on_crash(cmake):
     tmp_path, output = run_crash_stdout_for("inproc", cmake, ["discarding-on-crash"])
 
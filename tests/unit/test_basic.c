@@ -1,10 +1,13 @@
 #include "sentry_core.h"
 #include "sentry_database.h"
+#include "sentry_envelope.h"
 #include "sentry_options.h"
+#include "sentry_spool.h"
 #include "sentry_string.h"
 #include "sentry_sync.h"
 #include "sentry_testsupport.h"
 #include "sentry_transport.h"
+#include "sentry_value.h"
 
 static void
 send_envelope_test_basic(sentry_envelope_t *envelope, void *data)
@@ -346,3 +349,177 @@ SENTRY_TEST(basic_transport_thread_name)
 
     sentry_close();
 }
+
+static void
+count_old_run_envelopes(sentry_envelope_t *envelope, void *data)
+{
+    // this is called from the old runs thread
+    sentry__atomic_fetch_and_add((volatile long *)data, 1);
+    sentry_envelope_free(envelope);
+}
+
+static size_t
+count_files(const sentry_path_t *dir)
+{
+    size_t count = 0;
+    sentry_pathiter_t *it = sentry__path_iter_directory(dir);
+    while (it && sentry__pathiter_next(it)) {
+        count++;
+    }
+    sentry__pathiter_free(it);
+    return count;
+}
+
+static void
+init_with_old_runs(const sentry_path_t *database_path, volatile long *sent,
+    uint64_t shutdown_timeout)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_shutdown_timeout(options, shutdown_timeout);
+#ifdef SENTRY_PLATFORM_WINDOWS
+    sentry_options_set_database_pathw(options, database_path->path_w);
+#else
+    sentry_options_set_database_path(options, database_path->path);
+#endif
+    sentry_transport_t *transport
+        = sentry_transport_new(count_old_run_envelopes);
+    sentry_transport_set_state(transport, (void *)sent);
+    sentry_options_set_transport(options, transport);
+    sentry_init(options);
+}
+
+SENTRY_TEST(process_old_runs)
+{
+    sentry_path_t *database_path
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-old-runs");
+    TEST_ASSERT(!!database_path);
+    sentry__path_remove_all(database_path);
+    sentry_path_t *run_path = sentry__path_join_str(
+        database_path, "9fd7a0cd-0bfb-4d57-93a4-4a6be4ec1c5b.run");
+    TEST_ASSERT(!sentry__path_create_dir_all(run_path));
+
+    const size_t envelope_count = 100;
+    const char *payload = "{}\n{\"type\":\"attachment\",\"length\":2}\nhi";
+    for (size_t i = 0; i < envelope_count; i++) {
+        char filename[32];
+        snprintf(filename, sizeof(filename), "%zu.envelope", i);
+        sentry_path_t *path = sentry__path_join_str(run_path, filename);
+        TEST_ASSERT(!sentry__path_write_buffer(path, payload, strlen(payload)));
+        sentry__path_free(path);
+    }
+
+    // without any time to spare, whatever was not sent stays on disk
+    volatile long sent = 0;
+    init_with_old_runs(database_path, &sent, 0);
+    sentry_close();
+    size_t remaining = count_files(run_path);
+    TEST_CHECK_INT_EQUAL(
+        (size_t)sentry__atomic_fetch(&sent) + remaining, envelope_count);
+
+    // and is picked up by the next start
+    init_with_old_runs(database_path, &sent, 2000);
+    sentry_close();
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&sent), envelope_count);
+    TEST_CHECK(!sentry__path_is_dir(run_path));
+
+    sentry__path_remove_all(database_path);
+    sentry__path_free(run_path);
+    sentry__path_free(database_path);
+}
+
+SENTRY_TEST(run_write_envelope_spool)
+{
+    sentry_path_t *database_path
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-run-spool");
+    TEST_ASSERT(!!database_path);
+    sentry__path_remove_all(database_path);
+    sentry__path_create_dir_all(database_path);
+    sentry_run_t *run = sentry__run_new(database_path);
+    TEST_ASSERT(!!run);
+
+    // envelopes without an event, such as logs, go into the spool
+    for (int i = 0; i < 2; i++) {
+        sentry_envelope_t *envelope = sentry__envelope_new();
+        sentry_value_t log = sentry_value_new_object();
+        sentry_value_set_by_key(log, "body", sentry_value_new_string("honk"));
+        TEST_CHECK(!!sentry__envelope_add_logs(envelope, &log, 1, 0));
+        TEST_CHECK(sentry__run_write_envelope(run, envelope));
+        sentry_value_decref(log);
+        sentry_envelope_free(envelope);
+    }
+    // as do events, while the one of a crash gets its own file
+    for (int i = 0; i < 2; i++) {
+        sentry_envelope_t *envelope = sentry__envelope_new();
+        sentry_value_t event = sentry_value_new_event();
+        if (i) {
+            sentry_value_set_by_key(
+                event, "level", sentry__value_new_level(SENTRY_LEVEL_FATAL));
+        }
+        TEST_CHECK(!!sentry__envelope_add_event(envelope, event));
+        TEST_CHECK(sentry__run_write_envelope(run, envelope));
+        sentry_envelope_free(envelope);
+    }
+
+    size_t envelope_files = 0;
+    sentry_pathiter_t *it = sentry__path_iter_directory(run->run_path);
+    const sentry_path_t *file;
+    while (it && (file = sentry__pathiter_next(it)) != NULL) {
+        if (sentry__path_ends_with(file, ".envelope")) {
+            envelope_files++;
+        }
+    }
+    sentry__pathiter_free(it);
+    TEST_CHECK_INT_EQUAL(envelope_files, 1);
+
+    size_t records = 0;
+    sentry_spool_reader_t *reader = sentry__spool_reader_new(run->run_path);
+    TEST_ASSERT(!!reader);
+    size_t buf_len;
+    char *buf;
+    while ((buf = sentry__spool_reader_next(reader, &buf_len)) != NULL) {
+        sentry_envelope_t *spooled = sentry__envelope_from_raw(buf, buf_len);
+        TEST_CHECK(!!spooled);
+        sentry_envelope_free(spooled);
+        records++;
+    }
+    sentry__spool_reader_free(reader);
+    TEST_CHECK_INT_EQUAL(records, 3);
+
+    sentry__run_clean(run);
+    sentry__run_free(run);
+    sentry__path_remove_all(database_path);
+    sentry__path_free(database_path);
+}
+
+SENTRY_TEST(process_old_runs_spool)
+{
+    sentry_path_t *database_path
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-old-spool");
+    TEST_ASSERT(!!database_path);
+    sentry__path_remove_all(database_path);
+    sentry_path_t *run_path = sentry__path_join_str(
+        database_path, "3b7e1f5a-7d52-4c1e-9c3e-1d2f4a6b8c0d.run");
+    TEST_ASSERT(!sentry__path_create_dir_all(run_path));
+
+    const size_t envelope_count = 100;
+    const char *payload = "{}\n{\"type\":\"attachment\",\"length\":2}\nhi";
+    sentry_spool_t *spool = sentry__spool_new(run_path);
+    TEST_ASSERT(!!spool);
+    for (size_t i = 0; i < envelope_count; i++) {
+        TEST_CHECK_INT_EQUAL(
+            sentry__spool_append(spool, payload, strlen(payload)), 0);
+    }
+    sentry__spool_free(spool);
+
+    volatile long sent = 0;
+    init_with_old_runs(database_path, &sent, 2000);
+    sentry_close();
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&sent), envelope_count);
+    TEST_CHECK(!sentry__path_is_dir(run_path));
+
+    sentry__path_remove_all(database_path);
+    sentry__path_free(run_path);
+    sentry__path_free(database_path);
+}
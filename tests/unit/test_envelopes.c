@@ -676,3 +676,110 @@ SENTRY_TEST(deserialize_envelope_invalid)
     snprintf(buf, sizeof(buf), "{}\n{\"length\":%zu}\n", SIZE_MAX);
     TEST_CHECK(!sentry_envelope_deserialize(buf, strlen(buf)));
 }
+
+static sentry_envelope_t *
+create_envelope_with_item(const char *type)
+{
+    sentry_envelope_t *envelope = sentry__envelope_new();
+    TEST_ASSERT(!!envelope);
+    char payload[] = "{}";
+    sentry__envelope_add_from_buffer(
+        envelope, payload, sizeof(payload) - 1, type);
+    return envelope;
+}
+
+static void
+check_item_types(const sentry_envelope_t *envelope, const char *const *types,
+    size_t count)
+{
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(envelope), count);
+    for (size_t i = 0; i < count; i++) {
+        const sentry_envelope_item_t *item
+            = sentry__envelope_get_item(envelope, i);
+        sentry_value_t type = sentry__envelope_item_get_header(item, "type");
+        TEST_CHECK_STRING_EQUAL(sentry_value_as_string(type), types[i]);
+    }
+}
+
+SENTRY_TEST(envelope_coalescing)
+{
+    sentry_envelope_t *envelope = create_envelope_with_item("session");
+    sentry_envelope_t *transaction = create_envelope_with_item("transaction");
+    sentry_uuid_t event_id
+        = sentry_uuid_from_string("c993afb6-b4ac-48a6-b61b-2558e601d65d");
+    sentry__envelope_set_event_id(transaction, &event_id);
+    sentry_envelope_t *logs = create_envelope_with_item("log");
+
+    // only sessions and client reports are worth waiting for more of
+    TEST_CHECK(sentry__envelope_has_coalesce_room(envelope));
+    TEST_CHECK(!sentry__envelope_has_coalesce_room(transaction));
+    TEST_CHECK(!sentry__envelope_has_coalesce_room(logs));
+
+    TEST_CHECK(sentry__envelope_coalesce(envelope, transaction, SIZE_MAX));
+    TEST_CHECK(sentry__envelope_coalesce(envelope, logs, SIZE_MAX));
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(transaction), 0);
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(logs), 0);
+    const char *const types[] = { "session", "transaction", "log" };
+    check_item_types(envelope, types, 3);
+    // the transaction brings its event id along
+    sentry_uuid_t coalesced_id = sentry__envelope_get_event_id(envelope);
+    TEST_CHECK(memcmp(&coalesced_id, &event_id, sizeof(sentry_uuid_t)) == 0);
+    sentry_envelope_free(transaction);
+    sentry_envelope_free(logs);
+
+    // at most one transaction and one log item per envelope
+    transaction = create_envelope_with_item("transaction");
+    logs = create_envelope_with_item("log");
+    TEST_CHECK(!sentry__envelope_coalesce(envelope, transaction, SIZE_MAX));
+    TEST_CHECK(!sentry__envelope_coalesce(envelope, logs, SIZE_MAX));
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(transaction), 1);
+    sentry_envelope_free(transaction);
+    sentry_envelope_free(logs);
+
+    // events and attachments are never coalesced
+    sentry_envelope_t *event = create_envelope_with_item("event");
+    TEST_CHECK(!sentry__envelope_is_coalescable(event));
+    TEST_CHECK(!sentry__envelope_coalesce(envelope, event, SIZE_MAX));
+    TEST_CHECK(!sentry__envelope_coalesce(event, envelope, SIZE_MAX));
+    sentry_envelope_free(event);
+
+    // neither are envelopes that would exceed the size limit
+    sentry_envelope_t *sessions = create_envelope_with_item("sessions");
+    TEST_CHECK(!sentry__envelope_coalesce(envelope, sessions, 7));
+    TEST_CHECK(sentry__envelope_coalesce(envelope, sessions, 8));
+    sentry_envelope_free(sessions);
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(envelope), 4);
+
+    sentry_envelope_free(envelope);
+}
+
+static void
+noop_send_task(void *UNUSED(envelope), void *UNUSED(state))
+{
+}
+
+SENTRY_TEST(transport_coalesces_queued_envelopes)
+{
+    // the worker is never started, so the envelopes stay queued
+    sentry_bgworker_t *bgw = sentry__bgworker_new(NULL, NULL);
+    TEST_ASSERT(!!bgw);
+    const char *const queued_types[]
+        = { "session", "log", "transaction", "event", "session" };
+    sentry_envelope_t *first = NULL;
+    for (size_t i = 0; i < 5; i++) {
+        sentry_envelope_t *envelope
+            = create_envelope_with_item(queued_types[i]);
+        first = first ? first : envelope;
+        sentry__bgworker_submit(bgw, noop_send_task,
+            (void (*)(void *))sentry_envelope_free, envelope);
+    }
+
+    // merging stops at the event, so the order of envelopes is kept, and
+    // nothing lingers since envelopes are queued already
+    TEST_CHECK(sentry__bgworker_has_pending_tasks(bgw));
+    sentry__transport_coalesce_queued(bgw, noop_send_task, first);
+    const char *const types[] = { "session", "log", "transaction" };
+    check_item_types(first, types, 3);
+
+    sentry__bgworker_decref(bgw);
+}
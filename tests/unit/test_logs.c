@@ -1,7 +1,12 @@
 #include "sentry_logs.h"
 #include "sentry_testsupport.h"
 
+#include "sentry_database.h"
 #include "sentry_envelope.h"
+#include "sentry_json.h"
+#include "sentry_options.h"
+#include "sentry_path.h"
+#include "sentry_scope.h"
 #include <string.h>
 
 #ifdef SENTRY_PLATFORM_WINDOWS
@@ -75,6 +80,28 @@ SENTRY_TEST(basic_logging_functionality)
     TEST_CHECK_INT_EQUAL(validation_data.called_count, 2);
 }
 
+SENTRY_TEST(logs_leave_scope_unchanged)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+    sentry_options_set_transport(
+        options, sentry_transport_new(validate_logs_envelope));
+    transport_validation_data_t validation_data = { 0, false };
+    sentry_transport_set_state(options->transport, &validation_data);
+    sentry_init(options);
+    sentry__logs_wait_for_thread_startup();
+
+    // logging only reads the scope, so it must not schedule a scope flush
+    long generation = sentry__scope_generation();
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK_INT_EQUAL(sentry_log_info("Info message"), 0);
+    }
+    TEST_CHECK_INT_EQUAL(sentry__scope_generation(), generation);
+
+    sentry_close();
+}
+
 SENTRY_TEST(logs_disabled_by_default)
 {
     transport_validation_data_t validation_data = { 0, false };
@@ -324,6 +351,78 @@ SENTRY_TEST(logs_force_flush)
     TEST_CHECK_INT_EQUAL(validation_data.called_count, 6);
 }
 
+SENTRY_TEST(logs_crash_safe_flush)
+{
+#ifndef SENTRY_PLATFORM_UNIX
+    SKIP_TEST();
+#else
+    transport_validation_data_t validation_data = { 0, false };
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+
+    sentry_transport_t *transport
+        = sentry_transport_new(validate_logs_envelope);
+    sentry_transport_set_state(transport, &validation_data);
+    sentry_options_set_transport(options, transport);
+
+    sentry_init(options);
+    sentry__logs_wait_for_thread_startup();
+
+    TEST_CHECK_INT_EQUAL(sentry_log_info("Info message"), 0);
+    TEST_CHECK_INT_EQUAL(sentry_log_warn("Warning %s", "\"quoted\"\n"), 0);
+    sentry__logs_flush_crash_safe();
+
+    size_t envelope_count = 0;
+    SENTRY_WITH_OPTIONS (opts) {
+        sentry_pathiter_t *it
+            = sentry__path_iter_directory(opts->run->run_path);
+        const sentry_path_t *file;
+        while (it && (file = sentry__pathiter_next(it)) != NULL) {
+            if (!sentry__path_ends_with(file, ".envelope")) {
+                continue;
+            }
+            envelope_count++;
+            sentry_envelope_t *envelope
+                = sentry_envelope_read_from_file(file->path);
+            TEST_ASSERT(!!envelope);
+            TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(envelope), 1);
+            const sentry_envelope_item_t *item
+                = sentry__envelope_get_item(envelope, 0);
+            TEST_CHECK_STRING_EQUAL(sentry_value_as_string(
+                                        sentry__envelope_item_get_header(
+                                            item, "type")),
+                "log");
+            TEST_CHECK_INT_EQUAL(
+                sentry_value_as_int32(
+                    sentry__envelope_item_get_header(item, "item_count")),
+                2);
+
+            size_t payload_len = 0;
+            const char *payload
+                = sentry__envelope_item_get_payload(item, &payload_len);
+            sentry_value_t logs = sentry__value_from_json(payload, payload_len);
+            sentry_value_t items = sentry_value_get_by_key(logs, "items");
+            TEST_CHECK_INT_EQUAL(sentry_value_get_length(items), 2);
+            TEST_CHECK_STRING_EQUAL(
+                sentry_value_as_string(sentry_value_get_by_key(
+                    sentry_value_get_by_index(items, 1), "body")),
+                "Warning \"quoted\"\n");
+            sentry_value_decref(logs);
+            sentry_envelope_free(envelope);
+        }
+        sentry__pathiter_free(it);
+    }
+    TEST_CHECK_INT_EQUAL(envelope_count, 1);
+
+    sentry_close();
+
+    // the logs went to disk instead of the transport
+    TEST_CHECK_INT_EQUAL(validation_data.called_count, 0);
+#endif
+}
+
 SENTRY_TEST(logs_custom_attributes_with_format_strings)
 {
     transport_validation_data_t validation_data = { 0, false };
@@ -379,3 +478,163 @@ SENTRY_TEST(logs_custom_attributes_with_format_strings)
     TEST_CHECK(!validation_data.has_validation_error);
     TEST_CHECK_INT_EQUAL(validation_data.called_count, 1);
 }
+
+static void
+validate_shared_attributes(sentry_envelope_t *envelope, void *data)
+{
+    transport_validation_data_t *validation_data = data;
+    const sentry_envelope_item_t *item = sentry__envelope_get_item(envelope, 0);
+    const char *type = sentry_value_as_string(
+        sentry__envelope_item_get_header(item, "type"));
+    if (item && strcmp(type, "log") == 0) {
+        validation_data->called_count += 1;
+
+        size_t payload_len = 0;
+        const char *payload
+            = sentry__envelope_item_get_payload(item, &payload_len);
+        sentry_value_t logs = sentry__value_from_json(payload, payload_len);
+        sentry_value_t items = sentry_value_get_by_key(logs, "items");
+        if (sentry_value_get_length(items) != 5) {
+            validation_data->has_validation_error = true;
+        }
+        for (size_t i = 0; i < sentry_value_get_length(items); i++) {
+            sentry_value_t attributes = sentry_value_get_by_key(
+                sentry_value_get_by_index(items, i), "attributes");
+            sentry_value_t release
+                = sentry_value_get_by_key(attributes, "sentry.release");
+            sentry_value_t sdk_name
+                = sentry_value_get_by_key(attributes, "sentry.sdk.name");
+            sentry_value_t environment
+                = sentry_value_get_by_key(attributes, "sentry.environment");
+            if (strcmp(sentry_value_as_string(
+                           sentry_value_get_by_key(environment, "value")),
+                    "custom")
+                    == 0
+                || strcmp(sentry_value_as_string(
+                           sentry_value_get_by_key(release, "value")),
+                    "test-release")
+                != 0
+                || strcmp(sentry_value_as_string(
+                              sentry_value_get_by_key(sdk_name, "value")),
+                       SENTRY_SDK_NAME)
+                    != 0) {
+                validation_data->has_validation_error = true;
+            }
+        }
+        sentry_value_decref(logs);
+    }
+
+    sentry_envelope_free(envelope);
+}
+
+SENTRY_TEST(logs_batch_shared_attributes)
+{
+    transport_validation_data_t validation_data = { 0, false };
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+    sentry_options_set_logs_with_attributes(options, true);
+    sentry_options_set_release(options, "test-release");
+
+    sentry_transport_t *transport
+        = sentry_transport_new(validate_shared_attributes);
+    sentry_transport_set_state(transport, &validation_data);
+    sentry_options_set_transport(options, transport);
+
+    sentry_init(options);
+    sentry__logs_wait_for_thread_startup();
+
+    for (int i = 0; i < 5; i++) {
+        sentry_value_t attributes = sentry_value_new_object();
+        if (i == 2) {
+            // the SDK's attributes can't be overridden by the log
+            sentry_value_set_by_key(attributes, "sentry.sdk.name",
+                sentry_value_new_attribute(
+                    sentry_value_new_string("custom"), NULL));
+            sentry_value_set_by_key(attributes, "sentry.environment",
+                sentry_value_new_attribute(
+                    sentry_value_new_string("custom"), NULL));
+        }
+        TEST_CHECK_INT_EQUAL(sentry_log_info("log %d", attributes, i), 0);
+    }
+    sentry_close();
+
+    TEST_CHECK(!validation_data.has_validation_error);
+    TEST_CHECK_INT_EQUAL(validation_data.called_count, 1);
+}
+
+SENTRY_TEST(logs_sampling_and_rate_limits)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+
+    TEST_CHECK(sentry_options_get_logs_sample_rate(options, SENTRY_LEVEL_DEBUG)
+        == 1.0);
+    sentry_options_set_logs_sample_rate(options, SENTRY_LEVEL_WARNING, 2.0);
+    TEST_CHECK(
+        sentry_options_get_logs_sample_rate(options, SENTRY_LEVEL_WARNING)
+        == 1.0);
+    sentry_options_set_logs_sample_rate(options, SENTRY_LEVEL_DEBUG, 0.25);
+    sentry_options_set_logs_template_rate_limit(options, 2);
+    TEST_CHECK_INT_EQUAL(
+        sentry_options_get_logs_template_rate_limit(options), 2);
+
+    sentry_init(options);
+    sentry__logs_wait_for_thread_startup();
+
+    // every fourth debug log is kept; unit tests only queue five logs, so stay
+    // below that to not depend on the batching thread
+    int kept = 0;
+    for (int i = 0; i < 4; i++) {
+        log_return_value_t rv = sentry_log_debug("debug %d", i);
+        TEST_CHECK(
+            rv == SENTRY_LOG_RETURN_SUCCESS || rv == SENTRY_LOG_RETURN_DISCARD);
+        kept += rv == SENTRY_LOG_RETURN_SUCCESS;
+    }
+    TEST_CHECK_INT_EQUAL(kept, 1);
+
+    // only two logs per second and template are kept
+    kept = 0;
+    for (int i = 0; i < 4; i++) {
+        kept += sentry_log_info("rate limited") == SENTRY_LOG_RETURN_SUCCESS;
+    }
+    TEST_CHECK_INT_EQUAL(kept, 2);
+    TEST_CHECK_INT_EQUAL(
+        sentry_log_info("another template"), SENTRY_LOG_RETURN_SUCCESS);
+
+    sentry_close();
+}
+
+SENTRY_TEST(logs_discard_releases_attributes)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_enable_logs(options, true);
+    sentry_options_set_logs_with_attributes(options, true);
+    sentry_options_set_logs_sample_rate(options, SENTRY_LEVEL_DEBUG, 0.0);
+    sentry_options_set_logs_template_rate_limit(options, 1);
+    sentry_init(options);
+    sentry__logs_wait_for_thread_startup();
+
+    // the log takes over the caller's reference, even when it is dropped
+    sentry_value_t attributes = sentry_value_new_object();
+    sentry_value_incref(attributes);
+    TEST_CHECK_INT_EQUAL(sentry_log_debug("sampled out", attributes),
+        SENTRY_LOG_RETURN_DISCARD);
+    TEST_CHECK_INT_EQUAL(sentry_value_refcount(attributes), 1);
+
+    sentry_value_incref(attributes);
+    TEST_CHECK_INT_EQUAL(sentry_log_info("rate limited", attributes),
+        SENTRY_LOG_RETURN_SUCCESS);
+    TEST_CHECK_INT_EQUAL(sentry_value_refcount(attributes), 1);
+    sentry_value_incref(attributes);
+    TEST_CHECK_INT_EQUAL(sentry_log_info("rate limited", attributes),
+        SENTRY_LOG_RETURN_DISCARD);
+    TEST_CHECK_INT_EQUAL(sentry_value_refcount(attributes), 1);
+
+    sentry_value_decref(attributes);
+
+    sentry_close();
+}
@@ -1,8 +1,12 @@
+#include "sentry_modulefinder.h"
 #include "sentry_path.h"
 #include "sentry_testsupport.h"
 
 #ifdef SENTRY_PLATFORM_LINUX
+#    include "modulefinder/sentry_buildid_cache.h"
 #    include "modulefinder/sentry_modulefinder_linux.h"
+#    include "sentry_sync.h"
+#    include <dlfcn.h>
 #endif
 
 SENTRY_TEST(module_finder)
@@ -40,6 +44,207 @@ SENTRY_TEST(module_finder)
     sentry_clear_modulecache();
 }
 
+#ifdef SENTRY_PLATFORM_LINUX
+static sentry_value_t
+find_module(sentry_value_t modules, const char *name)
+{
+    for (size_t i = 0; i < sentry_value_get_length(modules); i++) {
+        sentry_value_t mod = sentry_value_get_by_index(modules, i);
+        const char *code_file
+            = sentry_value_as_string(sentry_value_get_by_key(mod, "code_file"));
+        if (strstr(code_file, name)) {
+            return mod;
+        }
+    }
+    return sentry_value_new_null();
+}
+#endif
+
+SENTRY_TEST(module_finder_incremental)
+{
+#if !defined(SENTRY_PLATFORM_LINUX)
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+
+    // without a `dlopen` in between, the list is not read again
+    sentry_value_t modules = sentry_get_modules_list();
+    long generation = sentry__modules_generation();
+    sentry_value_t same_modules = sentry_get_modules_list();
+    TEST_CHECK(modules._bits == same_modules._bits);
+    TEST_CHECK_INT_EQUAL(sentry__modules_generation(), generation);
+    sentry_value_decref(same_modules);
+
+    // any library that is not loaded yet will do
+    const char *candidates[]
+        = { "libresolv.so.2", "libanl.so.1", "libutil.so.1", "libz.so.1" };
+    void *handle = NULL;
+    const char *loaded = NULL;
+    for (size_t i = 0; !handle && i < sizeof(candidates) / sizeof(char *);
+        i++) {
+        if (!sentry_value_is_null(find_module(modules, candidates[i]))) {
+            continue;
+        }
+        handle = dlopen(candidates[i], RTLD_NOW | RTLD_LOCAL);
+        loaded = candidates[i];
+    }
+    if (!handle) {
+        sentry_value_decref(modules);
+        sentry_clear_modulecache();
+        SKIP_TEST();
+    }
+
+    sentry_value_t new_modules = sentry_get_modules_list();
+    TEST_CHECK(new_modules._bits != modules._bits);
+    TEST_CHECK(sentry__modules_generation() != generation);
+    TEST_CHECK(!sentry_value_is_null(find_module(new_modules, loaded)));
+    TEST_CHECK(sentry_value_get_length(new_modules)
+        > sentry_value_get_length(modules));
+
+    // the modules that were loaded before are not parsed again
+    sentry_value_t test_module = find_module(modules, "sentry_test_unit");
+    TEST_CHECK(!sentry_value_is_null(test_module));
+    sentry_value_t same_test_module
+        = find_module(new_modules, "sentry_test_unit");
+    TEST_CHECK(same_test_module._bits == test_module._bits);
+
+    sentry_value_decref(new_modules);
+    sentry_value_decref(modules);
+    dlclose(handle);
+    generation = sentry__modules_generation();
+    sentry_clear_modulecache();
+    TEST_CHECK(sentry__modules_generation() != generation);
+#endif
+}
+
+SENTRY_TEST(module_finder_signal_handler)
+{
+#if !defined(SENTRY_PLATFORM_LINUX)
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+    sentry_value_t modules = sentry_get_modules_list();
+
+    // any library that is not loaded yet will do
+    const char *candidates[]
+        = { "libresolv.so.2", "libanl.so.1", "libutil.so.1", "libz.so.1" };
+    void *handle = NULL;
+    for (size_t i = 0; !handle && i < sizeof(candidates) / sizeof(char *);
+        i++) {
+        if (sentry_value_is_null(find_module(modules, candidates[i]))) {
+            handle = dlopen(candidates[i], RTLD_NOW | RTLD_LOCAL);
+        }
+    }
+    if (!handle) {
+        sentry_value_decref(modules);
+        sentry_clear_modulecache();
+        SKIP_TEST();
+    }
+
+    // the signal handler does not ask the dynamic loader, which might be
+    // locked by the crashed thread
+    long generation = sentry__modules_generation();
+    sentry__enter_signal_handler();
+    long handler_generation = sentry__modules_generation();
+    sentry_value_t handler_modules = sentry_get_modules_list();
+    sentry__leave_signal_handler();
+#    ifdef __GLIBC__
+    // but walks its objects to notice the new library
+    TEST_CHECK(handler_generation != generation);
+    TEST_CHECK_INT_EQUAL(sentry__modules_generation(), handler_generation);
+    TEST_CHECK(handler_modules._bits != modules._bits);
+    TEST_CHECK(sentry_value_get_length(handler_modules)
+        > sentry_value_get_length(modules));
+#    else
+    // and gets the cached modules
+    TEST_CHECK_INT_EQUAL(handler_generation, generation);
+    TEST_CHECK(handler_modules._bits == modules._bits);
+#    endif
+    sentry_value_decref(handler_modules);
+
+    // the change is picked up outside of it in any case
+    sentry_value_t new_modules = sentry_get_modules_list();
+    TEST_CHECK(new_modules._bits != modules._bits);
+    sentry_value_decref(new_modules);
+
+    sentry_value_decref(modules);
+    dlclose(handle);
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(module_finder_build_id_cache)
+{
+#if !defined(SENTRY_PLATFORM_LINUX)
+    SKIP_TEST();
+#else
+    sentry_path_t *db_path = sentry__path_from_str(".test-build-id-cache");
+    sentry__path_remove_all(db_path);
+    sentry__path_create_dir_all(db_path);
+    sentry_path_t *cache_path
+        = sentry__path_join_str(db_path, "build-id-cache");
+    sentry__buildid_cache_set_path(db_path);
+    sentry_clear_modulecache();
+
+    // the first read parses the modules and fills the cache
+    sentry_value_t modules = sentry_get_modules_list();
+    char *parsed = sentry_value_to_json(modules);
+    TEST_CHECK(sentry__path_get_size(cache_path) > 0);
+    sentry_value_t test_module = find_module(modules, "sentry_test_unit");
+    const char *code_file = sentry_value_as_string(
+        sentry_value_get_by_key(test_module, "code_file"));
+    sentry_path_t *exe_path = sentry__path_from_str(code_file);
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+
+    // the second read takes the same identifiers from the cache
+    modules = sentry_get_modules_list();
+    char *cached = sentry_value_to_json(modules);
+    TEST_CHECK_STRING_EQUAL(cached, parsed);
+    sentry_free(cached);
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+
+    // the modules are only parsed for entries that are not in the cache
+    struct stat st;
+    TEST_ASSERT(stat(exe_path->path, &st) == 0);
+    sentry_module_ids_t ids;
+    memset(&ids, 0, sizeof(ids));
+    ids.debug_id = sentry_uuid_from_string(
+        "00000000-1111-2222-3333-444444444444");
+    sentry_buildid_cache_t *cache = sentry__buildid_cache_open();
+    TEST_ASSERT(!!cache);
+    sentry__buildid_cache_put(cache, exe_path->path, &st, 0, &ids);
+    sentry__buildid_cache_close(cache);
+    modules = sentry_get_modules_list();
+    test_module = find_module(modules, "sentry_test_unit");
+    TEST_CHECK_STRING_EQUAL(sentry_value_as_string(sentry_value_get_by_key(
+                                test_module, "debug_id")),
+        "00000000-1111-2222-3333-444444444444");
+    TEST_CHECK(
+        sentry_value_is_null(sentry_value_get_by_key(test_module, "code_id")));
+    sentry_value_decref(modules);
+    sentry_clear_modulecache();
+
+    // an invalid cache file is ignored and replaced
+    sentry__path_write_buffer(cache_path, "garbage", 7);
+    modules = sentry_get_modules_list();
+    char *reparsed = sentry_value_to_json(modules);
+    TEST_CHECK_STRING_EQUAL(reparsed, parsed);
+    TEST_CHECK(sentry__path_get_size(cache_path) > 7);
+    sentry_free(reparsed);
+    sentry_value_decref(modules);
+
+    sentry_free(parsed);
+    sentry__buildid_cache_set_path(NULL);
+    sentry_clear_modulecache();
+    sentry__path_remove_all(db_path);
+    sentry__path_free(exe_path);
+    sentry__path_free(cache_path);
+    sentry__path_free(db_path);
+#endif
+}
+
 SENTRY_TEST(module_addr)
 {
 #if !defined(SENTRY_PLATFORM_LINUX)
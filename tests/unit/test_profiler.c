@@ -0,0 +1,213 @@
+#include "sentry_profiler.h"
+#include "sentry_testsupport.h"
+
+#include "sentry_envelope.h"
+#include "sentry_json.h"
+#include "sentry_utils.h"
+#include "sentry_value.h"
+#include <string.h>
+
+#ifdef SENTRY_PLATFORM_LINUX
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+typedef struct {
+    int chunks;
+    int transactions;
+    size_t samples;
+    size_t stacks;
+    size_t frames;
+    bool frames_unique;
+    bool has_current_thread;
+    char profiler_id[37];
+    char linked_profiler_id[37];
+} profiler_transport_data_t;
+
+static char g_current_tid[16];
+
+static void
+check_profile_chunk(profiler_transport_data_t *data, sentry_value_t chunk)
+{
+    data->chunks++;
+    const char *profiler_id = sentry_value_as_string(
+        sentry_value_get_by_key(chunk, "profiler_id"));
+    snprintf(data->profiler_id, sizeof(data->profiler_id), "%s", profiler_id);
+
+    sentry_value_t profile = sentry_value_get_by_key(chunk, "profile");
+    sentry_value_t frames = sentry_value_get_by_key(profile, "frames");
+    data->samples += sentry_value_get_length(
+        sentry_value_get_by_key(profile, "samples"));
+    data->stacks
+        += sentry_value_get_length(sentry_value_get_by_key(profile, "stacks"));
+    data->frames += sentry_value_get_length(frames);
+
+    for (size_t i = 0; i < sentry_value_get_length(frames); i++) {
+        const char *addr = sentry_value_as_string(sentry_value_get_by_key(
+            sentry_value_get_by_index(frames, i), "instruction_addr"));
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(addr,
+                    sentry_value_as_string(sentry_value_get_by_key(
+                        sentry_value_get_by_index(frames, j),
+                        "instruction_addr")))
+                == 0) {
+                data->frames_unique = false;
+            }
+        }
+    }
+
+    sentry_value_t thread_metadata
+        = sentry_value_get_by_key(profile, "thread_metadata");
+    if (!sentry_value_is_null(
+            sentry_value_get_by_key(thread_metadata, g_current_tid))) {
+        data->has_current_thread = true;
+    }
+}
+
+static void
+record_profile_envelope(sentry_envelope_t *envelope, void *_data)
+{
+    profiler_transport_data_t *data = _data;
+
+    for (size_t i = 0; i < sentry__envelope_get_item_count(envelope); i++) {
+        const sentry_envelope_item_t *item
+            = sentry__envelope_get_item(envelope, i);
+        const char *type = sentry_value_as_string(
+            sentry__envelope_item_get_header(item, "type"));
+        size_t len = 0;
+        const char *payload = sentry__envelope_item_get_payload(item, &len);
+        sentry_value_t value = sentry__value_from_json(payload, len);
+
+        if (strcmp(type, "profile_chunk") == 0) {
+            check_profile_chunk(data, value);
+        } else if (strcmp(type, "transaction") == 0) {
+            data->transactions++;
+            sentry_value_t profile = sentry_value_get_by_key(
+                sentry_value_get_by_key(value, "contexts"), "profile");
+            const char *profiler_id = sentry_value_as_string(
+                sentry_value_get_by_key(profile, "profiler_id"));
+            snprintf(data->linked_profiler_id,
+                sizeof(data->linked_profiler_id), "%s", profiler_id);
+        }
+        sentry_value_decref(value);
+    }
+    sentry_envelope_free(envelope);
+}
+
+static void
+burn_cpu(uint64_t msecs)
+{
+    volatile uint64_t counter = 0;
+    uint64_t start = sentry__monotonic_time();
+    while (sentry__monotonic_time() - start < msecs) {
+        for (int i = 0; i < 10000; i++) {
+            counter += (uint64_t)i;
+        }
+    }
+}
+
+SENTRY_TEST(profiler_sends_chunks)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    snprintf(g_current_tid, sizeof(g_current_tid), "%ld",
+        (long)syscall(SYS_gettid));
+
+    profiler_transport_data_t data;
+    memset(&data, 0, sizeof(data));
+    data.frames_unique = true;
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_traces_sample_rate(options, 1.0);
+    sentry_transport_t *transport
+        = sentry_transport_new(record_profile_envelope);
+    sentry_transport_set_state(transport, &data);
+    sentry_options_set_transport(options, transport);
+    sentry_init(options);
+
+    TEST_CHECK_INT_EQUAL(sentry_profiler_start(), 0);
+    // starting it again keeps the running profiler
+    TEST_CHECK_INT_EQUAL(sentry_profiler_start(), 0);
+
+    sentry_transaction_context_t *tx_ctx
+        = sentry_transaction_context_new("honk", "beep");
+    sentry_transaction_t *tx
+        = sentry_transaction_start(tx_ctx, sentry_value_new_null());
+    burn_cpu(300);
+    sentry_transaction_finish(tx);
+
+    sentry_profiler_stop();
+    sentry_close();
+
+    TEST_CHECK_INT_EQUAL(data.chunks, 1);
+    TEST_CHECK_INT_EQUAL(data.transactions, 1);
+    TEST_CHECK(data.samples > 0);
+    TEST_CHECK(data.stacks > 0);
+    TEST_CHECK(data.stacks <= data.samples);
+    TEST_CHECK(data.frames > 0);
+    TEST_CHECK(data.frames_unique);
+    TEST_CHECK(data.has_current_thread);
+    TEST_CHECK_STRING_EQUAL(data.linked_profiler_id, data.profiler_id);
+#endif
+}
+
+SENTRY_TEST(profiler_reinit_while_running)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    profiler_transport_data_t data;
+    memset(&data, 0, sizeof(data));
+    profiler_transport_data_t reinit_data;
+    memset(&reinit_data, 0, sizeof(reinit_data));
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_transport_t *transport
+        = sentry_transport_new(record_profile_envelope);
+    sentry_transport_set_state(transport, &data);
+    sentry_options_set_transport(options, transport);
+    sentry_init(options);
+
+    TEST_CHECK_INT_EQUAL(sentry_profiler_start(), 0);
+    burn_cpu(100);
+
+    // the re-init stops the profiler while holding the options lock, so the
+    // last chunk has to be sent without taking it
+    SENTRY_TEST_OPTIONS_NEW(reinit_options);
+    sentry_options_set_dsn(reinit_options, "https://foo@sentry.invalid/42");
+    sentry_options_set_auto_session_tracking(reinit_options, false);
+    transport = sentry_transport_new(record_profile_envelope);
+    sentry_transport_set_state(transport, &reinit_data);
+    sentry_options_set_transport(reinit_options, transport);
+    sentry_init(reinit_options);
+
+    // the last chunk went to the transport of the first init
+    TEST_CHECK_INT_EQUAL(data.chunks, 1);
+    TEST_CHECK(data.samples > 0);
+    sentry_profiler_stop();
+    sentry_close();
+    TEST_CHECK_INT_EQUAL(reinit_data.chunks, 0);
+#endif
+}
+
+SENTRY_TEST(profiler_not_running)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_init(options);
+
+    // stopping a profiler that was never started is fine
+    sentry_profiler_stop();
+
+    sentry_value_t tx = sentry_value_new_object();
+    sentry__profiler_apply_to_transaction(tx);
+    TEST_CHECK(sentry_value_is_null(sentry_value_get_by_key(tx, "contexts")));
+    sentry_value_decref(tx);
+
+    sentry_close();
+}
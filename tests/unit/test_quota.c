@@ -0,0 +1,171 @@
+#include "sentry_database.h"
+#include "sentry_options.h"
+#include "sentry_path.h"
+#include "sentry_quota.h"
+#include "sentry_testsupport.h"
+
+#include <string.h>
+
+static sentry_path_t *
+write_file(const sentry_path_t *dir, const char *filename, size_t size)
+{
+    char buf[1024];
+    memset(buf, 'x', sizeof(buf));
+    TEST_ASSERT(size <= sizeof(buf));
+    TEST_ASSERT(!sentry__path_create_dir_all(dir));
+    sentry_path_t *path = sentry__path_join_str(dir, filename);
+    TEST_ASSERT(!!path);
+    TEST_ASSERT(!sentry__path_write_buffer(path, buf, size));
+    return path;
+}
+
+static void
+check_usage(size_t expected_size, size_t expected_files)
+{
+    size_t size;
+    size_t files;
+    sentry__quota_get_usage(&size, &files);
+    TEST_CHECK_INT_EQUAL(size, expected_size);
+    TEST_CHECK_INT_EQUAL(files, expected_files);
+}
+
+SENTRY_TEST(database_quota_eviction_order)
+{
+    sentry_path_t *db
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-quota");
+    TEST_ASSERT(!!db);
+    sentry__path_remove_all(db);
+    sentry_path_t *old_run = sentry__path_join_str(
+        db, "0d0c6d40-5d1e-4a4b-8d55-93d1b7d3f2a1.run");
+    sentry_path_t *external = sentry__path_join_str(db, "external");
+
+    sentry_path_t *segment = write_file(old_run, "spool-00000000.seg", 100);
+    sentry_path_t *envelope = write_file(old_run, "a.envelope", 100);
+    sentry_path_t *report = write_file(external, "b.envelope", 100);
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_database_max_files(options, 2);
+    TEST_CHECK_INT_EQUAL(sentry_options_get_database_max_files(options), 2);
+    sentry__quota_start(options);
+
+    // spooled envelopes are evicted first
+    sentry__quota_scan(db);
+    check_usage(200, 2);
+    TEST_CHECK(!sentry__path_is_file(segment));
+    TEST_CHECK(sentry__path_is_file(envelope));
+    TEST_CHECK(sentry__path_is_file(report));
+
+    // then the oldest files of previous runs
+    sentry_path_t *newer = write_file(old_run, "c.envelope", 100);
+    sentry__quota_track(newer, 100);
+    check_usage(200, 2);
+    TEST_CHECK(!sentry__path_is_file(envelope));
+    TEST_CHECK(sentry__path_is_file(newer));
+    TEST_CHECK(sentry__path_is_file(report));
+
+    // removing the run is accounted for
+    sentry__quota_untrack_dir(old_run);
+    check_usage(100, 1);
+
+    sentry__quota_stop();
+    check_usage(0, 0);
+    sentry_options_free(options);
+
+    sentry__path_free(newer);
+    sentry__path_free(report);
+    sentry__path_free(envelope);
+    sentry__path_free(segment);
+    sentry__path_free(external);
+    sentry__path_free(old_run);
+    sentry__path_remove_all(db);
+    sentry__path_free(db);
+}
+
+SENTRY_TEST(database_quota_keeps_current_run)
+{
+    sentry_path_t *db
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-quota-run");
+    TEST_ASSERT(!!db);
+    sentry__path_remove_all(db);
+    sentry_path_t *old_run = sentry__path_join_str(
+        db, "0d0c6d40-5d1e-4a4b-8d55-93d1b7d3f2a1.run");
+    sentry_path_t *external = sentry__path_join_str(db, "external");
+    sentry_path_t *envelope = write_file(old_run, "a.envelope", 100);
+    sentry_path_t *report = write_file(external, "b.envelope", 100);
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_database_max_size(options, 250);
+    TEST_CHECK_INT_EQUAL(sentry_options_get_database_max_size(options), 250);
+    options->run = sentry__run_new(db);
+    TEST_ASSERT(!!options->run);
+    sentry__quota_start(options);
+    sentry__quota_scan(db);
+    check_usage(200, 2);
+
+    // crash reports of the external crash reporter are evicted last
+    sentry_path_t *current
+        = write_file(options->run->run_path, "c.envelope", 100);
+    sentry__quota_track(current, 100);
+    check_usage(200, 2);
+    TEST_CHECK(!sentry__path_is_file(envelope));
+    TEST_CHECK(sentry__path_is_file(report));
+
+    // and files of the current run are never evicted
+    sentry__quota_track(current, 400);
+    check_usage(400, 1);
+    TEST_CHECK(!sentry__path_is_file(report));
+    TEST_CHECK(sentry__path_is_file(current));
+
+    sentry__run_clean(options->run);
+    check_usage(0, 0);
+    sentry__quota_stop();
+    sentry_options_free(options);
+
+    sentry__path_free(current);
+    sentry__path_free(report);
+    sentry__path_free(envelope);
+    sentry__path_free(external);
+    sentry__path_free(old_run);
+    sentry__path_remove_all(db);
+    sentry__path_free(db);
+}
+
+SENTRY_TEST(database_quota_skips_locked_runs)
+{
+    sentry_path_t *db
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-quota-locked");
+    TEST_ASSERT(!!db);
+    sentry__path_remove_all(db);
+    sentry_path_t *old_run = sentry__path_join_str(
+        db, "0d0c6d40-5d1e-4a4b-8d55-93d1b7d3f2a1.run");
+    sentry_path_t *live_run = sentry__path_join_str(
+        db, "6a1b5e2c-7f3d-4c8e-9a0b-1d2e3f4a5b6c.run");
+    sentry_path_t *envelope = write_file(old_run, "a.envelope", 100);
+    sentry_path_t *live_envelope = write_file(live_run, "b.envelope", 100);
+
+    // the run of another process that is still running
+    sentry_filelock_t *lock
+        = sentry__filelock_new(sentry__path_append_str(live_run, ".lock"));
+    TEST_ASSERT(!!lock);
+    TEST_ASSERT(sentry__filelock_try_lock(lock));
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_database_max_size(options, 50);
+    sentry__quota_start(options);
+    sentry__quota_scan(db);
+    check_usage(0, 0);
+    TEST_CHECK(!sentry__path_is_file(envelope));
+    TEST_CHECK(sentry__path_is_file(live_envelope));
+
+    sentry__quota_stop();
+    sentry_options_free(options);
+    sentry__filelock_unlock(lock);
+    sentry__filelock_free(lock);
+
+    sentry__path_free(live_envelope);
+    sentry__path_free(envelope);
+    sentry__path_free(live_run);
+    sentry__path_free(old_run);
+    sentry__path_remove_all(db);
+    sentry__path_free(db);
+}
@@ -1,5 +1,7 @@
 #include "sentry_ringbuffer.h"
+#include "sentry_sync.h"
 #include "sentry_testsupport.h"
+#include "sentry_utils.h"
 #include "sentry_value.h"
 
 #define CHECK_KEY_IDX(List, Idx, Key, Val)                                     \
@@ -7,6 +9,9 @@
                              sentry_value_get_by_index(List, Idx), Key)),      \
         Val)
 
+#define CHECK_SLOT(Rb, Idx, Val)                                               \
+    TEST_CHECK_INT_EQUAL(sentry_value_as_int32((Rb)->slots[Idx].value), Val)
+
 #define CHECK_IDX(List, Idx, Val)                                              \
     TEST_CHECK_INT_EQUAL(                                                      \
         sentry_value_as_int32(sentry_value_get_by_index(List, Idx)), Val)
@@ -19,11 +24,11 @@ SENTRY_TEST(ringbuffer_append)
         sentry__ringbuffer_append(rb, sentry_value_new_int32(i));
     }
     sentry__ringbuffer_append(rb, sentry_value_new_int32(1010));
-    CHECK_IDX(rb->list, 0, 1010);
-    CHECK_IDX(rb->list, 1, 7);
-    CHECK_IDX(rb->list, 2, 8);
-    CHECK_IDX(rb->list, 3, 9);
-    CHECK_IDX(rb->list, 4, 10);
+    CHECK_SLOT(rb, 0, 1010);
+    CHECK_SLOT(rb, 1, 7);
+    CHECK_SLOT(rb, 2, 8);
+    CHECK_SLOT(rb, 3, 9);
+    CHECK_SLOT(rb, 4, 10);
     sentry__ringbuffer_free(rb);
 }
 
@@ -164,3 +169,108 @@ SENTRY_TEST(ringbuffer_max_size_nonempty_noop)
 
     sentry__ringbuffer_free(rb);
 }
+
+SENTRY_TEST(ringbuffer_snapshot_timestamps)
+{
+    sentry_ringbuffer_t *rb = sentry__ringbuffer_new(2);
+    TEST_CHECK_INT_EQUAL(sentry__ringbuffer_len(rb), 0);
+    sentry_ringbuffer_snapshot_t snapshot;
+    TEST_CHECK_INT_EQUAL(sentry__ringbuffer_snapshot(rb, &snapshot), 0);
+    TEST_CHECK_INT_EQUAL(snapshot.len, 0);
+
+    for (int32_t i = 1; i <= 3; i++) {
+        sentry_value_t crumb = sentry_value_new_object();
+        sentry_value_set_by_key(crumb, "timestamp",
+            sentry__value_new_string_owned(
+                sentry__usec_time_to_iso8601((uint64_t)i * 1000000)));
+        sentry_value_set_by_key(crumb, "key", sentry_value_new_int32(i));
+        sentry__ringbuffer_append(rb, crumb);
+    }
+    sentry__ringbuffer_append(rb, sentry_value_new_int32(4));
+
+    // items are returned oldest first, with their timestamps already parsed
+    TEST_CHECK_INT_EQUAL(sentry__ringbuffer_len(rb), 2);
+    size_t len = sentry__ringbuffer_snapshot(rb, &snapshot);
+    TEST_ASSERT(len == 2);
+    // small snapshots don't allocate
+    TEST_CHECK(snapshot.items == snapshot.inline_items);
+    const sentry_ringbuffer_item_t *items = snapshot.items;
+    TEST_CHECK_INT_EQUAL(items[0].timestamp, 3000000);
+    TEST_CHECK_INT_EQUAL(
+        sentry_value_as_int32(sentry_value_get_by_key(items[0].value, "key")),
+        3);
+    TEST_CHECK_INT_EQUAL(sentry_value_refcount(items[0].value), 2);
+    TEST_CHECK_INT_EQUAL(items[1].timestamp, 0);
+    TEST_CHECK_INT_EQUAL(sentry_value_as_int32(items[1].value), 4);
+    sentry__ringbuffer_snapshot_free(&snapshot);
+
+    sentry__ringbuffer_free(rb);
+}
+
+SENTRY_TEST(ringbuffer_snapshot_large)
+{
+    size_t capacity = SENTRY_RINGBUFFER_INLINE_ITEMS + 1;
+    sentry_ringbuffer_t *rb = sentry__ringbuffer_new(capacity);
+    for (int32_t i = 0; i < (int32_t)capacity; i++) {
+        sentry__ringbuffer_append(rb, sentry_value_new_int32(i));
+    }
+
+    // snapshots that don't fit inline are allocated, in the same order
+    sentry_ringbuffer_snapshot_t snapshot;
+    TEST_ASSERT(sentry__ringbuffer_snapshot(rb, &snapshot) == capacity);
+    TEST_CHECK(snapshot.items != snapshot.inline_items);
+    TEST_CHECK_INT_EQUAL(sentry_value_as_int32(snapshot.items[0].value), 0);
+    TEST_CHECK_INT_EQUAL(
+        sentry_value_as_int32(snapshot.items[capacity - 1].value),
+        (int32_t)capacity - 1);
+    sentry__ringbuffer_snapshot_free(&snapshot);
+
+    sentry__ringbuffer_free(rb);
+}
+
+#define APPEND_THREADS 4
+#define APPENDS_PER_THREAD 1000
+
+SENTRY_THREAD_FN
+append_thread(void *data)
+{
+    sentry_ringbuffer_t *rb = (sentry_ringbuffer_t *)data;
+    for (int32_t i = 0; i < APPENDS_PER_THREAD; i++) {
+        sentry__ringbuffer_append(rb, sentry_value_new_object());
+        if (i % 100 == 0) {
+            sentry_ringbuffer_snapshot_t snapshot;
+            sentry__ringbuffer_snapshot(rb, &snapshot);
+            sentry__ringbuffer_snapshot_free(&snapshot);
+        }
+    }
+    return 0;
+}
+
+SENTRY_TEST(ringbuffer_concurrent_append)
+{
+    sentry_ringbuffer_t *rb = sentry__ringbuffer_new(16);
+    sentry_threadid_t threads[APPEND_THREADS];
+    for (size_t i = 0; i < APPEND_THREADS; i++) {
+        sentry__thread_init(&threads[i]);
+        TEST_ASSERT(sentry__thread_spawn(&threads[i], append_thread, rb) == 0);
+    }
+    for (size_t i = 0; i < APPEND_THREADS; i++) {
+        sentry__thread_join(threads[i]);
+        sentry__thread_free(&threads[i]);
+    }
+
+    // every value is either in the ringbuffer or was freed, and only the
+    // ringbuffer and the snapshot hold a reference
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&rb->head),
+        APPEND_THREADS * APPENDS_PER_THREAD);
+    sentry_ringbuffer_snapshot_t snapshot;
+    size_t len = sentry__ringbuffer_snapshot(rb, &snapshot);
+    TEST_CHECK_INT_EQUAL(len, 16);
+    for (size_t i = 0; i < len; i++) {
+        TEST_CHECK_INT_EQUAL(
+            sentry_value_refcount(snapshot.items[i].value), 2);
+    }
+    sentry__ringbuffer_snapshot_free(&snapshot);
+
+    sentry__ringbuffer_free(rb);
+}
@@ -1,5 +1,9 @@
 #include "sentry.h"
+#include "sentry_alloc.h"
+#include "sentry_backend.h"
+#include "sentry_core.h"
 #include "sentry_scope.h"
+#include "sentry_sync.h"
 #include "sentry_testsupport.h"
 #include "sentry_utils.h"
 
@@ -835,3 +839,167 @@ SENTRY_TEST(scope_local_attributes)
 
     sentry_close();
 }
+
+static volatile long g_scope_flushes = 0;
+static volatile long g_flushed_counter = 0;
+
+static void
+record_scope_flush(
+    sentry_backend_t *UNUSED(backend), const sentry_options_t *UNUSED(options))
+{
+    sentry__atomic_fetch_and_add(&g_scope_flushes, 1);
+    SENTRY_WITH_SCOPE (scope) {
+        const char *counter = sentry_value_as_string(
+            sentry_value_get_by_key(scope->tags, "counter"));
+        sentry__atomic_store(&g_flushed_counter, atol(counter));
+    }
+}
+
+SENTRY_TEST(scope_flush_coalesced)
+{
+    g_scope_flushes = 0;
+    g_flushed_counter = 0;
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_backend_t *backend = SENTRY_MAKE(sentry_backend_t);
+    TEST_ASSERT(!!backend);
+    memset(backend, 0, sizeof(sentry_backend_t));
+    backend->flush_scope_func = record_scope_flush;
+    sentry_options_set_backend(options, backend);
+    sentry_init(options);
+
+    char counter[16];
+    for (int i = 1; i <= 1000; i++) {
+        snprintf(counter, sizeof(counter), "%d", i);
+        sentry_set_tag("counter", counter);
+    }
+    sentry_close();
+
+    // a burst of changes is coalesced, but the last change is always flushed
+    long flushes = sentry__atomic_fetch(&g_scope_flushes);
+    TEST_CHECK(flushes >= 1);
+    TEST_CHECK(flushes < 1000);
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&g_flushed_counter), 1000);
+}
+
+static volatile long g_flushed_breadcrumbs = 0;
+
+static void
+record_breadcrumb_flush(
+    sentry_backend_t *UNUSED(backend), const sentry_options_t *options)
+{
+    sentry__atomic_fetch_and_add(&g_scope_flushes, 1);
+    sentry_value_t event = sentry_value_new_object();
+    SENTRY_WITH_SCOPE (scope) {
+        sentry__scope_apply_to_event(
+            scope, options, event, SENTRY_SCOPE_BREADCRUMBS);
+    }
+    sentry__atomic_store(&g_flushed_breadcrumbs,
+        (long)sentry_value_get_length(
+            sentry_value_get_by_key(event, "breadcrumbs")));
+    sentry_value_decref(event);
+}
+
+static void
+request_breadcrumb_flush(sentry_backend_t *UNUSED(backend),
+    sentry_value_t UNUSED(breadcrumb), const sentry_options_t *UNUSED(options))
+{
+    sentry__scope_request_flush();
+}
+
+SENTRY_TEST(scope_flush_breadcrumbs_coalesced)
+{
+    g_scope_flushes = 0;
+    g_flushed_breadcrumbs = 0;
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_max_breadcrumbs(options, 10);
+    sentry_backend_t *backend = SENTRY_MAKE(sentry_backend_t);
+    TEST_ASSERT(!!backend);
+    memset(backend, 0, sizeof(sentry_backend_t));
+    backend->flush_scope_func = record_breadcrumb_flush;
+    backend->add_breadcrumb_func = request_breadcrumb_flush;
+    sentry_options_set_backend(options, backend);
+    sentry_init(options);
+
+    for (int i = 0; i < 1000; i++) {
+        sentry_add_breadcrumb(sentry_value_new_breadcrumb(NULL, "crumb"));
+    }
+    sentry_close();
+
+    // the backend is notified after the breadcrumb is in the scope, so the
+    // last flush sees all of them
+    long flushes = sentry__atomic_fetch(&g_scope_flushes);
+    TEST_CHECK(flushes >= 1);
+    TEST_CHECK(flushes < 1000);
+    TEST_CHECK_INT_EQUAL(sentry__atomic_fetch(&g_flushed_breadcrumbs), 10);
+}
+
+static sentry_value_t
+make_skeleton_test_event(void)
+{
+    sentry_value_t event = sentry_value_new_event();
+    sentry_value_set_by_key(event, "level", sentry_value_new_string("error"));
+    sentry_value_t tags = sentry_value_new_object();
+    sentry_value_set_by_key(tags, "all", sentry_value_new_string("event"));
+    sentry_value_set_by_key(event, "tags", tags);
+    return event;
+}
+
+SENTRY_TEST(scope_event_skeleton)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_release(options, "test-release");
+    sentry_options_set_environment(options, "test-env");
+    sentry_init(options);
+
+    sentry_set_tag("all", "global");
+    sentry_set_tag("global", "global");
+    sentry_set_extra("extra", sentry_value_new_int32(42));
+    sentry_set_context("ctx", sentry_value_new_string("global"));
+    sentry_set_fingerprint("{{ default }}", "skeleton", NULL);
+    sentry_value_t user = sentry_value_new_object();
+    sentry_value_set_by_key(user, "id", sentry_value_new_int32(1));
+    sentry_set_user(user);
+    sentry_add_breadcrumb(sentry_value_new_breadcrumb(NULL, "crumb"));
+
+    SENTRY_WITH_OPTIONS (o) {
+        SENTRY_WITH_SCOPE (scope) {
+            sentry_value_t skeleton
+                = sentry__scope_new_event_skeleton(scope, o);
+
+            sentry_value_t expected = make_skeleton_test_event();
+            sentry__scope_apply_to_event(
+                scope, o, expected, SENTRY_SCOPE_ALL);
+            sentry_value_t event = make_skeleton_test_event();
+            sentry__scope_apply_skeleton_to_event(
+                scope, o, event, skeleton, SENTRY_SCOPE_ALL);
+
+            const char *keys[] = { "platform", "level", "release",
+                "environment", "user", "fingerprint", "sdk", "tags", "extra",
+                "contexts", "breadcrumbs", "debug_meta" };
+            for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+                char *expected_json = sentry_value_to_json(
+                    sentry_value_get_by_key(expected, keys[i]));
+                char *event_json = sentry_value_to_json(
+                    sentry_value_get_by_key(event, keys[i]));
+                TEST_CHECK_STRING_EQUAL(event_json, expected_json);
+                TEST_MSG("key: %s", keys[i]);
+                sentry_free(expected_json);
+                sentry_free(event_json);
+            }
+
+            // the skeleton is shared between events and must stay untouched
+            sentry_value_t skeleton_tag = sentry_value_get_by_key(
+                sentry_value_get_by_key(skeleton, "tags"), "all");
+            TEST_CHECK_STRING_EQUAL(
+                sentry_value_as_string(skeleton_tag), "global");
+
+            sentry_value_decref(expected);
+            sentry_value_decref(event);
+            sentry_value_decref(skeleton);
+        }
+    }
+
+    sentry_close();
+}
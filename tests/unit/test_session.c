@@ -1,8 +1,20 @@
+#include "sentry_database.h"
 #include "sentry_envelope.h"
+#include "sentry_options.h"
+#include "sentry_path.h"
 #include "sentry_session.h"
+#include "sentry_session_aggregates.h"
 #include "sentry_testsupport.h"
 #include "sentry_value.h"
 
+#ifdef SENTRY_PLATFORM_WINDOWS
+#    include <windows.h>
+#    define sleep_ms(MILLISECONDS) Sleep(MILLISECONDS)
+#else
+#    include <unistd.h>
+#    define sleep_ms(MILLISECONDS) usleep(MILLISECONDS * 1000)
+#endif
+
 static void
 send_envelope(sentry_envelope_t *envelope, void *data)
 {
@@ -161,3 +173,203 @@ SENTRY_TEST(count_sampled_events)
 
     TEST_CHECK_INT_EQUAL(assertion.called, 1);
 }
+
+static void
+discard_envelope(sentry_envelope_t *envelope, void *UNUSED(data))
+{
+    sentry_envelope_free(envelope);
+}
+
+/**
+ * Waits for the persister to write a session with `errors` to the run.
+ */
+static bool
+wait_for_persisted_errors(const sentry_path_t *session_path, uint64_t errors)
+{
+    for (int i = 0; i < 100; i++) {
+        sentry_session_t *session = sentry__session_from_path(session_path);
+        bool matches = session && session->errors == errors;
+        sentry__session_free(session);
+        if (matches) {
+            return true;
+        }
+        sleep_ms(10);
+    }
+    return false;
+}
+
+SENTRY_TEST(session_persisted_in_background)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(
+        options, sentry_transport_new(discard_envelope));
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_database_path(
+        options, SENTRY_TEST_PATH_PREFIX ".test-session-persist");
+    sentry_init(options);
+
+    sentry_path_t *session_path = NULL;
+    SENTRY_WITH_OPTIONS (opts) {
+        session_path = sentry__path_clone(opts->run->session_path);
+    }
+    TEST_ASSERT(!!session_path);
+    TEST_CHECK(wait_for_persisted_errors(session_path, 0));
+
+    // recorded errors are written out by the persister, without any event
+    sentry__record_errors_on_current_session(3);
+    TEST_CHECK(wait_for_persisted_errors(session_path, 3));
+
+    // ending the session removes the file right away
+    sentry_end_session();
+    TEST_CHECK(!sentry__path_is_file(session_path));
+
+    sentry_close();
+    sentry__path_free(session_path);
+
+    sentry_path_t *database_path = sentry__path_from_str(
+        SENTRY_TEST_PATH_PREFIX ".test-session-persist");
+    sentry__path_remove_all(database_path);
+    sentry__path_free(database_path);
+}
+
+SENTRY_TEST(session_persister_started_lazily)
+{
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(
+        options, sentry_transport_new(discard_envelope));
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_options_set_database_path(
+        options, SENTRY_TEST_PATH_PREFIX ".test-session-lazy");
+    sentry_init(options);
+
+    // nothing is started as long as there is no session
+    TEST_CHECK(!sentry__session_persister_is_running());
+    sentry_end_session();
+    TEST_CHECK(!sentry__session_persister_is_running());
+
+    sentry_start_session();
+    TEST_CHECK(sentry__session_persister_is_running());
+
+    sentry_close();
+    TEST_CHECK(!sentry__session_persister_is_running());
+
+    sentry_path_t *database_path
+        = sentry__path_from_str(SENTRY_TEST_PATH_PREFIX ".test-session-lazy");
+    sentry__path_remove_all(database_path);
+    sentry__path_free(database_path);
+}
+
+typedef struct {
+    uint64_t envelopes;
+    int32_t counts[3];
+} aggregates_assertion_t;
+
+static void
+send_aggregates_envelope(sentry_envelope_t *envelope, void *data)
+{
+    aggregates_assertion_t *assertion = data;
+    assertion->envelopes += 1;
+
+    TEST_CHECK_INT_EQUAL(sentry__envelope_get_item_count(envelope), 1);
+    const sentry_envelope_item_t *item = sentry__envelope_get_item(envelope, 0);
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(sentry__envelope_item_get_header(item, "type")),
+        "sessions");
+
+    size_t buf_len;
+    const char *buf = sentry__envelope_item_get_payload(item, &buf_len);
+    sentry_value_t payload = sentry__value_from_json(buf, buf_len);
+    sentry_value_t attrs = sentry_value_get_by_key(payload, "attrs");
+    TEST_CHECK_STRING_EQUAL(
+        sentry_value_as_string(sentry_value_get_by_key(attrs, "release")),
+        "my_release");
+
+    // the outcomes may be spread over two minutes
+    sentry_value_t aggregates = sentry_value_get_by_key(payload, "aggregates");
+    TEST_CHECK(sentry_value_get_length(aggregates) >= 1);
+    for (size_t i = 0; i < sentry_value_get_length(aggregates); i++) {
+        sentry_value_t aggregate = sentry_value_get_by_index(aggregates, i);
+        sentry_value_t started = sentry_value_get_by_key(aggregate, "started");
+        TEST_CHECK_INT_EQUAL(
+            sentry_value_get_type(started), SENTRY_VALUE_TYPE_STRING);
+        assertion->counts[0] += sentry_value_as_int32(
+            sentry_value_get_by_key(aggregate, "exited"));
+        assertion->counts[1] += sentry_value_as_int32(
+            sentry_value_get_by_key(aggregate, "errored"));
+        assertion->counts[2] += sentry_value_as_int32(
+            sentry_value_get_by_key(aggregate, "crashed"));
+    }
+
+    sentry_value_decref(payload);
+    sentry_envelope_free(envelope);
+}
+
+SENTRY_TEST(session_aggregates)
+{
+    aggregates_assertion_t assertion = { 0, { 0, 0, 0 } };
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_transport_t *transport
+        = sentry_transport_new(send_aggregates_envelope);
+    sentry_transport_set_state(transport, &assertion);
+    sentry_options_set_transport(options, transport);
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_init(options);
+
+    for (int i = 0; i < 30; i++) {
+        sentry_record_request_outcome(SENTRY_REQUEST_OUTCOME_HEALTHY);
+    }
+    for (int i = 0; i < 20; i++) {
+        sentry_record_request_outcome(SENTRY_REQUEST_OUTCOME_ERRORED);
+    }
+    sentry_record_request_outcome(SENTRY_REQUEST_OUTCOME_CRASHED);
+
+    sentry_close();
+
+    // all outcomes are sent as one envelope, and none are recorded afterwards
+    sentry_record_request_outcome(SENTRY_REQUEST_OUTCOME_HEALTHY);
+    TEST_CHECK_INT_EQUAL(assertion.envelopes, 1);
+    TEST_CHECK_INT_EQUAL(assertion.counts[0], 30);
+    TEST_CHECK_INT_EQUAL(assertion.counts[1], 20);
+    TEST_CHECK_INT_EQUAL(assertion.counts[2], 1);
+}
+
+SENTRY_TEST(session_aggregates_started_lazily)
+{
+    aggregates_assertion_t assertion = { 0, { 0, 0, 0 } };
+
+    SENTRY_TEST_OPTIONS_NEW(options);
+    sentry_options_set_dsn(options, "https://foo@sentry.invalid/42");
+    sentry_transport_t *transport
+        = sentry_transport_new(send_aggregates_envelope);
+    sentry_transport_set_state(transport, &assertion);
+    sentry_options_set_transport(options, transport);
+    sentry_options_set_release(options, "my_release");
+    sentry_options_set_auto_session_tracking(options, false);
+    sentry_init(options);
+
+    // the flusher is only started by the first outcome
+    TEST_CHECK(!sentry__session_aggregates_is_running());
+    sentry_record_request_outcome(SENTRY_REQUEST_OUTCOME_HEALTHY);
+    TEST_CHECK(sentry__session_aggregates_is_running());
+
+    // initializing again flushes the outcomes without a deadlock
+    SENTRY_TEST_OPTIONS_NEW(options2);
+    sentry_options_set_dsn(options2, "https://foo@sentry.invalid/42");
+    sentry_options_set_transport(
+        options2, sentry_transport_new(discard_envelope));
+    sentry_options_set_release(options2, "my_release");
+    sentry_options_set_auto_session_tracking(options2, false);
+    sentry_init(options2);
+    TEST_CHECK(!sentry__session_aggregates_is_running());
+    TEST_CHECK_INT_EQUAL(assertion.envelopes, 1);
+    TEST_CHECK_INT_EQUAL(assertion.counts[0], 1);
+
+    sentry_close();
+    TEST_CHECK_INT_EQUAL(assertion.envelopes, 1);
+}
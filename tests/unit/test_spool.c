@@ -0,0 +1,172 @@
+#include "sentry_path.h"
+#include "sentry_spool.h"
+#include "sentry_testsupport.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static sentry_path_t *
+make_spool_dir(const char *name)
+{
+    sentry_path_t *path = sentry__path_from_str(name);
+    TEST_ASSERT(!!path);
+    sentry__path_remove_all(path);
+    TEST_ASSERT(!sentry__path_create_dir_all(path));
+    return path;
+}
+
+static void
+append_records(const sentry_path_t *path, size_t first, size_t count)
+{
+    sentry_spool_t *spool = sentry__spool_new(path);
+    TEST_ASSERT(!!spool);
+    for (size_t i = first; i < first + count; i++) {
+        char record[64];
+        snprintf(record, sizeof(record), "record %zu", i);
+        TEST_CHECK_INT_EQUAL(
+            sentry__spool_append(spool, record, strlen(record)), 0);
+    }
+    sentry__spool_free(spool);
+}
+
+static size_t
+read_records(sentry_spool_reader_t *reader, size_t expected_first,
+    size_t max_count)
+{
+    size_t count = 0;
+    size_t len;
+    char *record;
+    while (count < max_count
+        && (record = sentry__spool_reader_next(reader, &len)) != NULL) {
+        char expected[64];
+        snprintf(
+            expected, sizeof(expected), "record %zu", expected_first + count);
+        TEST_CHECK_INT_EQUAL(len, strlen(expected));
+        TEST_CHECK_STRING_EQUAL(record, expected);
+        sentry_free(record);
+        count++;
+    }
+    return count;
+}
+
+static size_t
+count_segments(const sentry_path_t *path)
+{
+    size_t count = 0;
+    sentry_pathiter_t *it = sentry__path_iter_directory(path);
+    const sentry_path_t *file;
+    while (it && (file = sentry__pathiter_next(it)) != NULL) {
+        if (sentry__path_ends_with(file, ".seg")) {
+            count++;
+        }
+    }
+    sentry__pathiter_free(it);
+    return count;
+}
+
+SENTRY_TEST(spool_append_and_read)
+{
+    sentry_path_t *path
+        = make_spool_dir(SENTRY_TEST_PATH_PREFIX ".test-spool-read");
+    TEST_CHECK(!sentry__spool_reader_new(path));
+
+    // enough records to rotate into a second segment
+    append_records(path, 0, 200);
+    TEST_CHECK_INT_EQUAL(count_segments(path), 2);
+    // a second writer continues in a new segment
+    append_records(path, 200, 10);
+    TEST_CHECK_INT_EQUAL(count_segments(path), 3);
+
+    sentry_spool_reader_t *reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 0, SIZE_MAX), 210);
+    sentry__spool_reader_free(reader);
+
+    sentry__path_remove_all(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(spool_truncated_tail)
+{
+    sentry_path_t *path
+        = make_spool_dir(SENTRY_TEST_PATH_PREFIX ".test-spool-torn");
+    append_records(path, 0, 3);
+
+    // cut the last record short, like a crash in the middle of a write
+    sentry_path_t *segment = sentry__path_join_str(path, "spool-00000000.seg");
+    size_t len;
+    char *buf = sentry__path_read_to_buffer(segment, &len);
+    TEST_ASSERT(!!buf);
+    TEST_CHECK(!sentry__path_write_buffer(segment, buf, len - 3));
+    sentry_free(buf);
+    sentry__path_free(segment);
+
+    sentry_spool_reader_t *reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 0, SIZE_MAX), 2);
+    sentry__spool_reader_free(reader);
+
+    // records written afterwards go into a new segment and are still read
+    append_records(path, 2, 2);
+    reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 0, 2), 2);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 2, SIZE_MAX), 2);
+    sentry__spool_reader_free(reader);
+
+    sentry__path_remove_all(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(spool_drops_oldest_segments)
+{
+    sentry_path_t *path
+        = make_spool_dir(SENTRY_TEST_PATH_PREFIX ".test-spool-full");
+    append_records(path, 0, 1000);
+    TEST_CHECK_INT_EQUAL(count_segments(path), 4);
+
+    // only the newest records are kept
+    sentry_spool_reader_t *reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    size_t len;
+    char *first = sentry__spool_reader_next(reader, &len);
+    TEST_ASSERT(!!first);
+    size_t first_index = (size_t)strtoul(first + strlen("record "), NULL, 10);
+    sentry_free(first);
+    TEST_CHECK(first_index > 0);
+    TEST_CHECK_INT_EQUAL(
+        read_records(reader, first_index + 1, SIZE_MAX), 999 - first_index);
+    sentry__spool_reader_free(reader);
+
+    sentry__path_remove_all(path);
+    sentry__path_free(path);
+}
+
+SENTRY_TEST(spool_reader_commit)
+{
+    sentry_path_t *path
+        = make_spool_dir(SENTRY_TEST_PATH_PREFIX ".test-spool-commit");
+    append_records(path, 0, 200);
+
+    sentry_spool_reader_t *reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 0, 150), 150);
+    sentry__spool_reader_commit(reader);
+    // records that were read but not committed are read again
+    TEST_CHECK_INT_EQUAL(read_records(reader, 150, 10), 10);
+    sentry__spool_reader_free(reader);
+
+    reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 150, SIZE_MAX), 50);
+    sentry__spool_reader_commit(reader);
+    sentry__spool_reader_free(reader);
+
+    reader = sentry__spool_reader_new(path);
+    TEST_ASSERT(!!reader);
+    TEST_CHECK_INT_EQUAL(read_records(reader, 200, SIZE_MAX), 0);
+    sentry__spool_reader_free(reader);
+
+    sentry__path_remove_all(path);
+    sentry__path_free(path);
+}
@@ -1,6 +1,12 @@
+#include "sentry_modulefinder.h"
 #include "sentry_symbolizer.h"
+#include "sentry_sync.h"
 #include "sentry_testsupport.h"
 
+#ifdef SENTRY_PLATFORM_LINUX
+#    include <dlfcn.h>
+#endif
+
 TEST_VISIBLE void
 test_function(void)
 {
@@ -43,3 +49,230 @@ SENTRY_TEST(symbolizer)
 #endif
     TEST_CHECK_INT_EQUAL(called, 1);
 }
+
+#ifdef SENTRY_PLATFORM_LINUX
+__attribute__((noinline)) static int
+static_test_function(int value)
+{
+    volatile int result = value + 1;
+    return result;
+}
+
+static void
+static_asserter(const sentry_frame_info_t *info, void *data)
+{
+    int *called = data;
+    TEST_CHECK(
+        info->symbol && strcmp(info->symbol, "static_test_function") == 0);
+    TEST_CHECK(info->object_name
+        && strstr(info->object_name, "sentry_test_unit") != 0);
+    TEST_CHECK(info->symbol_addr == (void *)&static_test_function);
+    *called += 1;
+}
+#endif
+
+SENTRY_TEST(symbolizer_static_function)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    // `dladdr` only knows about exported symbols, this needs the `.symtab`
+    TEST_CHECK_INT_EQUAL(static_test_function(1), 2);
+    int called = 0;
+    TEST_CHECK(sentry__symbolize(
+        ((char *)(void *)&static_test_function) + 1, static_asserter, &called));
+    TEST_CHECK_INT_EQUAL(called, 1);
+#endif
+}
+
+SENTRY_TEST(symbolizer_elf_clear)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    int called = 0;
+    void *addr = ((char *)(void *)&static_test_function) + 1;
+    TEST_CHECK(sentry__symbolize(addr, static_asserter, &called));
+    TEST_CHECK(sentry__symbolize_elf_mapped_count() > 0);
+
+    // clearing the module cache unmaps all files
+    sentry_clear_modulecache();
+    TEST_CHECK_INT_EQUAL(sentry__symbolize_elf_mapped_count(), 0);
+
+    // which are mapped again on demand
+    TEST_CHECK(sentry__symbolize(addr, static_asserter, &called));
+    TEST_CHECK_INT_EQUAL(called, 2);
+    TEST_CHECK(sentry__symbolize_elf_mapped_count() > 0);
+#endif
+}
+
+static void
+count_calls(const sentry_frame_info_t *info, void *data)
+{
+    int *called = data;
+    TEST_CHECK(!!info->symbol);
+    *called += 1;
+}
+
+SENTRY_TEST(symbolizer_batch)
+{
+#if defined(SENTRY_PLATFORM_NX) || defined(SENTRY_PLATFORM_XBOX)              \
+    || defined(SENTRY_PLATFORM_AIX)
+    SKIP_TEST();
+#else
+    int called[3] = { 0, 0, 0 };
+    void *addrs[3] = {
+        ((char *)(void *)&test_function) + 1,
+        NULL,
+        ((char *)(void *)&test_function) + 2,
+    };
+    void *data[3] = { &called[0], &called[1], &called[2] };
+
+    TEST_CHECK_INT_EQUAL(
+        sentry__symbolize_batch(addrs, 3, count_calls, data), 2);
+    TEST_CHECK_INT_EQUAL(called[0], 1);
+    TEST_CHECK_INT_EQUAL(called[1], 0);
+    TEST_CHECK_INT_EQUAL(called[2], 1);
+
+    // the results are the same as for every single address
+    called[0] = 0;
+    TEST_CHECK(sentry__symbolize(addrs[0], asserter, &called[0]));
+    TEST_CHECK_INT_EQUAL(called[0], 1);
+#endif
+}
+
+static void
+count_frames(const sentry_frame_info_t *UNUSED(info), void *data)
+{
+    int *called = data;
+    *called += 1;
+}
+
+SENTRY_TEST(symbolizer_cache)
+{
+#if defined(SENTRY_PLATFORM_NX) || defined(SENTRY_PLATFORM_XBOX)              \
+    || defined(SENTRY_PLATFORM_AIX)
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+    sentry_symbolizer_cache_stats_t before;
+    sentry__symbolizer_cache_get_stats(&before);
+    TEST_CHECK_INT_EQUAL(before.len, 0);
+
+    int called[2] = { 0, 0 };
+    void *addrs[2] = { ((char *)(void *)&test_function) + 1, NULL };
+    void *data[2] = { &called[0], &called[1] };
+    TEST_CHECK_INT_EQUAL(sentry__symbolize_cached(addrs, 2, asserter, data), 1);
+
+    // the second time, both the resolved and the unresolved address are hits
+    TEST_CHECK_INT_EQUAL(sentry__symbolize_cached(addrs, 2, asserter, data), 1);
+    TEST_CHECK_INT_EQUAL(called[0], 2);
+    TEST_CHECK_INT_EQUAL(called[1], 0);
+
+    sentry_symbolizer_cache_stats_t stats;
+    sentry__symbolizer_cache_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.misses - before.misses, 2);
+    TEST_CHECK_INT_EQUAL(stats.hits - before.hits, 2);
+    TEST_CHECK_INT_EQUAL(stats.len, 2);
+
+    // the cache is bounded, and evicts the least recently used addresses
+    void *many_addrs[32];
+    int many_called = 0;
+    void *many_data[32];
+    for (size_t i = 0; i < 32; i++) {
+        many_addrs[i] = ((char *)(void *)&test_function) + 2 + i;
+        many_data[i] = &many_called;
+    }
+    sentry__symbolize_cached(many_addrs, 32, count_frames, many_data);
+    sentry__symbolizer_cache_get_stats(&stats);
+    TEST_CHECK(stats.evictions > before.evictions);
+    TEST_CHECK(stats.len < 32);
+
+    sentry_clear_modulecache();
+    sentry__symbolizer_cache_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.len, 0);
+#endif
+}
+
+SENTRY_TEST(symbolizer_cache_modules_changed)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+    sentry_value_decref(sentry_get_modules_list());
+    long generation = sentry__modules_generation();
+
+    int called = 0;
+    void *addr = ((char *)(void *)&test_function) + 1;
+    void *data = &called;
+    TEST_CHECK_INT_EQUAL(
+        sentry__symbolize_cached(&addr, 1, asserter, &data), 1);
+    sentry_symbolizer_cache_stats_t before;
+    sentry__symbolizer_cache_get_stats(&before);
+    TEST_CHECK_INT_EQUAL(before.len, 1);
+
+    // any library that is not loaded yet will do
+    const char *candidates[]
+        = { "libresolv.so.2", "libanl.so.1", "libutil.so.1", "libz.so.1" };
+    void *handle = NULL;
+    for (size_t i = 0; !handle && i < sizeof(candidates) / sizeof(char *);
+        i++) {
+        void *loaded = dlopen(candidates[i], RTLD_NOW | RTLD_NOLOAD);
+        if (loaded) {
+            dlclose(loaded);
+            continue;
+        }
+        handle = dlopen(candidates[i], RTLD_NOW | RTLD_LOCAL);
+    }
+    if (!handle) {
+        sentry_clear_modulecache();
+        SKIP_TEST();
+    }
+
+    // the new module list drops all cached results, as the loaded library
+    // might occupy the addresses of one that was unloaded
+    sentry_value_decref(sentry_get_modules_list());
+    TEST_CHECK(sentry__modules_generation() != generation);
+    TEST_CHECK_INT_EQUAL(
+        sentry__symbolize_cached(&addr, 1, asserter, &data), 1);
+    TEST_CHECK_INT_EQUAL(called, 2);
+
+    sentry_symbolizer_cache_stats_t stats;
+    sentry__symbolizer_cache_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.misses - before.misses, 1);
+    TEST_CHECK_INT_EQUAL(stats.hits - before.hits, 0);
+    TEST_CHECK_INT_EQUAL(stats.len, 1);
+
+    dlclose(handle);
+    sentry_clear_modulecache();
+#endif
+}
+
+SENTRY_TEST(symbolizer_signal_handler)
+{
+#ifndef SENTRY_PLATFORM_LINUX
+    SKIP_TEST();
+#else
+    sentry_clear_modulecache();
+    sentry_symbolizer_cache_stats_t before;
+    sentry__symbolizer_cache_get_stats(&before);
+
+    // the exported function is still resolved, but without the symbol
+    // tables and without touching the cache
+    int called = 0;
+    void *addr = ((char *)(void *)&test_function) + 1;
+    void *data = &called;
+    sentry__enter_signal_handler();
+    size_t resolved = sentry__symbolize_cached(&addr, 1, asserter, &data);
+    sentry__leave_signal_handler();
+    TEST_CHECK_INT_EQUAL(resolved, 1);
+    TEST_CHECK_INT_EQUAL(called, 1);
+
+    sentry_symbolizer_cache_stats_t stats;
+    sentry__symbolizer_cache_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.misses, before.misses);
+    TEST_CHECK_INT_EQUAL(stats.hits, before.hits);
+    TEST_CHECK_INT_EQUAL(stats.len, 0);
+#endif
+}
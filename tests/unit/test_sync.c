@@ -1,6 +1,7 @@
 #include "sentry_core.h"
 #include "sentry_sync.h"
 #include "sentry_testsupport.h"
+#include "sentry_utils.h"
 
 #ifdef SENTRY_PLATFORM_WINDOWS
 #    include <windows.h>
@@ -167,3 +168,40 @@ SENTRY_TEST(bgworker_flush)
     TEST_CHECK_INT_EQUAL(shutdown, 0);
     sentry__bgworker_decref(bgw);
 }
+
+SENTRY_THREAD_FN
+raise_notify_thread(void *data)
+{
+    sentry_notify_t *notify = data;
+    sleep_s(1);
+    sentry__notify_raise(notify);
+    return 0;
+}
+
+SENTRY_TEST(notify_level_triggered)
+{
+    sentry_notify_t notify;
+    sentry__notify_init(&notify);
+
+    // nothing raised yet
+    TEST_CHECK(!sentry__notify_wait(&notify, 0));
+
+    // raising without a waiter is not lost, and raises don't accumulate
+    sentry__notify_raise(&notify);
+    sentry__notify_raise(&notify);
+    TEST_CHECK(sentry__notify_wait(&notify, 0));
+    TEST_CHECK(!sentry__notify_wait(&notify, 10));
+
+    // a raise from another thread wakes up a sleeping waiter
+    sentry_threadid_t thread;
+    sentry__thread_init(&thread);
+    TEST_ASSERT(
+        sentry__thread_spawn(&thread, raise_notify_thread, &notify) == 0);
+    uint64_t started = sentry__monotonic_time();
+    TEST_CHECK(sentry__notify_wait(&notify, 10000));
+    TEST_CHECK(sentry__monotonic_time() - started < 10000);
+    sentry__thread_join(thread);
+    sentry__thread_free(&thread);
+
+    sentry__notify_free(&notify);
+}
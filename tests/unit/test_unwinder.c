@@ -1,6 +1,12 @@
 #include "sentry_boot.h"
 #include "sentry_symbolizer.h"
 #include "sentry_testsupport.h"
+#include "sentry_unwinder.h"
+
+#if defined(SENTRY_PLATFORM_LINUX)                                             \
+    && (defined(__x86_64__) || defined(__aarch64__))
+#    include <ucontext.h>
+#endif
 
 #define MAX_FRAMES 128
 
@@ -79,3 +85,143 @@ SENTRY_TEST(unwinder)
         }
     }
 }
+
+TEST_VISIBLE size_t
+invoke_frame_pointer_unwinder(void **backtrace)
+{
+    size_t frame_count
+        = sentry_unwind_stack_frame_pointers(NULL, backtrace, MAX_FRAMES);
+    TEST_CHECK(frame_count < MAX_FRAMES);
+    return frame_count;
+}
+
+static void
+find_frame_pointer_invoker(const sentry_frame_info_t *info, void *data)
+{
+    int *found_frame = data;
+    void *invoker_address =
+#if defined(SENTRY_PLATFORM_AIX)
+        *(void **)&invoke_frame_pointer_unwinder;
+#else
+        &invoke_frame_pointer_unwinder;
+#endif
+    if (info->symbol_addr == invoker_address) {
+        *found_frame += 1;
+    }
+}
+
+SENTRY_TEST(unwinder_frame_pointers)
+{
+#if !(defined(SENTRY_PLATFORM_LINUX) || defined(SENTRY_PLATFORM_DARWIN))      \
+    || !(defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+    SKIP_TEST();
+#else
+    void *backtrace[MAX_FRAMES] = { 0 };
+    size_t frame_count = invoke_frame_pointer_unwinder(backtrace);
+    TEST_ASSERT(frame_count > 0);
+
+    // the unwinder sets up its own frame record, so the first frame is
+    // always its caller, regardless of how the caller was compiled
+    int found_frame = 0;
+    sentry__symbolize(backtrace[0], find_frame_pointer_invoker, &found_frame);
+    TEST_CHECK_INT_EQUAL(found_frame, 1);
+
+    // frame pointers outside of the stack of this thread are rejected
+    static void *not_a_frame[2] = { 0 };
+    TEST_CHECK_INT_EQUAL(sentry_unwind_stack_frame_pointers(
+                             &not_a_frame[0], backtrace, MAX_FRAMES),
+        0);
+#endif
+}
+
+SENTRY_TEST(unwinder_frame_pointers_from_ucontext)
+{
+#if !defined(SENTRY_PLATFORM_LINUX)                                            \
+    || !(defined(__x86_64__) || defined(__aarch64__))
+    SKIP_TEST();
+#else
+    ucontext_t context;
+    TEST_ASSERT(getcontext(&context) == 0);
+    sentry_ucontext_t uctx;
+    memset(&uctx, 0, sizeof(uctx));
+    uctx.user_context = &context;
+
+    // the walk starts at the instruction pointer of the context
+    void *backtrace[MAX_FRAMES] = { 0 };
+    size_t frame_count = sentry__unwind_stack_framepointer_from_ucontext(
+        &uctx, backtrace, MAX_FRAMES);
+    TEST_ASSERT(frame_count > 0);
+#    if defined(__x86_64__)
+    TEST_CHECK(backtrace[0] == (void *)context.uc_mcontext.gregs[REG_RIP]);
+#    else
+    TEST_CHECK(backtrace[0] == (void *)context.uc_mcontext.pc);
+#    endif
+
+    // and stops at a frame pointer into unmapped memory instead of faulting
+    uintptr_t unmapped = UINTPTR_MAX & ~(uintptr_t)0xfff;
+#    if defined(__x86_64__)
+    context.uc_mcontext.gregs[REG_RBP] = (greg_t)unmapped;
+#    else
+    context.uc_mcontext.regs[29] = unmapped;
+#    endif
+    TEST_CHECK_INT_EQUAL(sentry__unwind_stack_framepointer_from_ucontext(
+                             &uctx, backtrace, MAX_FRAMES),
+        1);
+#endif
+}
+
+#ifdef SENTRY_WITH_UNWINDER_FRAMEPOINTER
+TEST_VISIBLE size_t
+invoke_unwinder_nested(void **backtrace, int depth)
+{
+    size_t frame_count = depth > 0
+        ? invoke_unwinder_nested(backtrace, depth - 1)
+        : sentry_unwind_stack(NULL, backtrace, MAX_FRAMES);
+    // this keeps the recursion from turning into a loop
+    TEST_CHECK(frame_count > 0);
+    return frame_count;
+}
+
+static void
+count_nested_frames(const sentry_frame_info_t *info, void *data)
+{
+    int *found_frames = data;
+    void *nested_address =
+#    if defined(SENTRY_PLATFORM_AIX)
+        *(void **)&invoke_unwinder_nested;
+#    else
+        &invoke_unwinder_nested;
+#    endif
+    if (info->symbol_addr == nested_address) {
+        *found_frames += 1;
+    }
+}
+#endif
+
+SENTRY_TEST(unwinder_frame_pointer_depth)
+{
+#ifndef SENTRY_WITH_UNWINDER_FRAMEPOINTER
+    SKIP_TEST();
+#else
+    // with the frame pointer unwinder first in line, `sentry_unwind_stack`
+    // has to see through the SDK and all of our own frames
+    void *backtrace[MAX_FRAMES] = { 0 };
+    // keeps the compiler from specializing the recursion for each depth
+    volatile int depth = 4;
+    size_t frame_count = invoke_unwinder_nested(backtrace, depth);
+    TEST_CHECK(frame_count > 5);
+
+    int found_frames = 0;
+    size_t last_nested_frame = 0;
+    for (size_t i = 0; i < frame_count; i++) {
+        int found_before = found_frames;
+        sentry__symbolize(backtrace[i], count_nested_frames, &found_frames);
+        if (found_frames != found_before) {
+            last_nested_frame = i;
+        }
+    }
+    TEST_CHECK_INT_EQUAL(found_frames, 5);
+    // and beyond them, at least this test function and its caller
+    TEST_CHECK(frame_count >= last_nested_frame + 3);
+#endif
+}
@@ -288,15 +288,19 @@ SENTRY_TEST(page_allocator)
         p_after[i] = (i + 10) % 255;
     }
 
-    /* free is a noop after page allocator was enabled */
+    /* free is a noop for memory from before the page allocator was enabled */
     sentry_free(p_before);
-    sentry_free(p_after);
 
     for (size_t i = 0; i < size; i++) {
         TEST_CHECK_INT_EQUAL((unsigned char)p_before[i], i % 255);
         TEST_CHECK_INT_EQUAL((unsigned char)p_after[i], (i + 10) % 255);
     }
 
+    /* but its own blocks are reused */
+    sentry_free(p_after);
+    char *p_reused = sentry_malloc(size);
+    TEST_CHECK(p_reused == p_after);
+
     sentry__page_allocator_disable();
 
     /* now we can free p_before though */
@@ -304,6 +308,73 @@ SENTRY_TEST(page_allocator)
 #endif
 }
 
+SENTRY_TEST(page_allocator_reserve)
+{
+#if !defined(SENTRY_PLATFORM_UNIX) || defined(SENTRY_PLATFORM_PS)
+    SKIP_TEST();
+#else
+    sentry__page_allocator_reserve(16 * 1024);
+    sentry__page_allocator_enable();
+
+    /* small allocations are handed out back to back from the reserve */
+    char *a = sentry_malloc(100);
+    char *b = sentry_malloc(100);
+    TEST_ASSERT(!!a && !!b);
+    TEST_CHECK(b > a && b - a < 256);
+    memset(a, 'a', 100);
+    memset(b, 'b', 100);
+
+    /* once the reserve is exhausted, new pages are mapped */
+    const size_t size = 64 * 1024;
+    char *c = sentry_malloc(size);
+    TEST_ASSERT(!!c);
+    memset(c, 'c', size);
+    TEST_CHECK(a[99] == 'a');
+    TEST_CHECK(b[0] == 'b');
+
+    /* the reserve is kept while the allocator is enabled */
+    sentry__page_allocator_release_reserve();
+    TEST_CHECK(a[0] == 'a');
+
+    sentry__page_allocator_disable();
+    sentry__page_allocator_release_reserve();
+#endif
+}
+
+SENTRY_TEST(page_allocator_free_lists)
+{
+#if !defined(SENTRY_PLATFORM_UNIX) || defined(SENTRY_PLATFORM_PS)
+    SKIP_TEST();
+#else
+    sentry__page_allocator_enable();
+
+    /* blocks of the same size class are reused */
+    char *small = sentry_malloc(24);
+    TEST_ASSERT(!!small);
+    sentry_free(small);
+    TEST_CHECK(sentry_malloc(30) == small);
+    TEST_CHECK(sentry_malloc(24) != small);
+
+    /* and so are large blocks, as long as they are not much bigger */
+    char *large = sentry_malloc(10000);
+    TEST_ASSERT(!!large);
+    sentry_free(large);
+    TEST_CHECK(sentry_malloc(2000) != large);
+    TEST_CHECK(sentry_malloc(9000) == large);
+
+    sentry_page_allocator_stats_t stats;
+    sentry__page_allocator_get_stats(&stats);
+    TEST_CHECK_INT_EQUAL(stats.allocations, 6);
+    TEST_CHECK_INT_EQUAL(stats.frees, 2);
+    TEST_CHECK_INT_EQUAL(stats.reused, 2);
+    TEST_CHECK_INT_EQUAL(stats.bytes_in_use, 32 + 32 + 2048 + 10000);
+    TEST_CHECK_INT_EQUAL(stats.peak_bytes_in_use, stats.bytes_in_use);
+    TEST_CHECK(stats.bytes_mapped >= stats.bytes_in_use);
+
+    sentry__page_allocator_disable();
+#endif
+}
+
 SENTRY_TEST(os)
 {
     sentry_value_t os = sentry__get_os_context();
@@ -4,6 +4,7 @@
 #include <locale.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 SENTRY_TEST(value_null)
 {
@@ -637,6 +638,112 @@ SENTRY_TEST(value_freezing)
     sentry_value_decref(val);
 }
 
+SENTRY_TEST(value_json_memoized_frozen)
+{
+    sentry_value_t shared = sentry_value_new_object();
+    sentry_value_set_by_key(shared, "value", sentry_value_new_string("a\"b"));
+    sentry_value_set_by_key(shared, "type", sentry_value_new_string("string"));
+    sentry_value_freeze(shared);
+
+    sentry_value_t list = sentry_value_new_list();
+    for (int i = 0; i < 3; i++) {
+        sentry_value_t item = sentry_value_new_object();
+        sentry_value_set_by_key(item, "i", sentry_value_new_int32(i));
+        sentry_value_incref(shared);
+        sentry_value_set_by_key(item, "shared", shared);
+        sentry_value_append(list, item);
+    }
+    sentry_value_incref(shared);
+    sentry_value_append(list, shared);
+
+    sentry_jsonwriter_t *jw = sentry__jsonwriter_new_sb(NULL);
+    sentry__jsonwriter_enable_memo(jw, 4);
+    sentry__jsonwriter_write_value(jw, list);
+    char *memoized = sentry__jsonwriter_into_string(jw, NULL);
+    char *plain = sentry_value_to_json(list);
+
+    TEST_CHECK_STRING_EQUAL(memoized,
+        "[{\"i\":0,\"shared\":{\"value\":\"a\\\"b\",\"type\":\"string\"}},"
+        "{\"i\":1,\"shared\":{\"value\":\"a\\\"b\",\"type\":\"string\"}},"
+        "{\"i\":2,\"shared\":{\"value\":\"a\\\"b\",\"type\":\"string\"}},"
+        "{\"value\":\"a\\\"b\",\"type\":\"string\"}]");
+    TEST_CHECK_STRING_EQUAL(memoized, plain);
+
+    sentry_free(plain);
+    sentry_free(memoized);
+    sentry_value_decref(list);
+    sentry_value_decref(shared);
+}
+
+static sentry_value_t
+make_images(void)
+{
+    sentry_value_t images = sentry_value_new_list();
+    for (int i = 0; i < 3; i++) {
+        sentry_value_t image = sentry_value_new_object();
+        sentry_value_set_by_key(image, "type", sentry_value_new_string("elf"));
+        sentry_value_set_by_key(
+            image, "code_file", sentry_value_new_string("/usr/lib/\"a\".so"));
+        sentry_value_set_by_key(image, "index", sentry_value_new_int32(i));
+        sentry_value_append(images, image);
+    }
+    return images;
+}
+
+static sentry_value_t
+wrap_images(sentry_value_t images, int depth)
+{
+    sentry_value_t root = sentry_value_new_object();
+    sentry_value_t parent = root;
+    for (int i = 0; i < depth; i++) {
+        sentry_value_t child = sentry_value_new_object();
+        sentry_value_set_by_key(child, "before", sentry_value_new_bool(true));
+        sentry_value_set_by_key(parent, "child", child);
+        parent = child;
+    }
+    sentry_value_set_by_key(parent, "images", images);
+    sentry_value_set_by_key(parent, "after", sentry_value_new_null());
+    return root;
+}
+
+SENTRY_TEST(value_freeze_serialized)
+{
+    // the images are cut off by the maximum depth of the writer at 61
+    int depths[] = { 0, 1, 60, 61 };
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        sentry_value_t images = make_images();
+        sentry__value_freeze_serialized(images);
+        TEST_CHECK(sentry_value_is_frozen(images));
+        TEST_CHECK(
+            sentry_value_is_frozen(sentry_value_get_by_index(images, 0)));
+        TEST_CHECK_INT_EQUAL(sentry_value_get_length(images), 3);
+        TEST_CHECK_INT_EQUAL(
+            sentry_value_append(images, sentry_value_new_null()), 1);
+
+        sentry_value_t serialized = wrap_images(images, depths[i]);
+        sentry_value_t plain = wrap_images(make_images(), depths[i]);
+
+        char *serialized_json = sentry_value_to_json(serialized);
+        char *plain_json = sentry_value_to_json(plain);
+        TEST_CHECK_STRING_EQUAL(serialized_json, plain_json);
+        sentry_free(serialized_json);
+        sentry_free(plain_json);
+
+        size_t serialized_size = 0;
+        size_t plain_size = 0;
+        char *serialized_mpack
+            = sentry_value_to_msgpack(serialized, &serialized_size);
+        char *plain_mpack = sentry_value_to_msgpack(plain, &plain_size);
+        TEST_CHECK_INT_EQUAL(serialized_size, plain_size);
+        TEST_CHECK(memcmp(serialized_mpack, plain_mpack, plain_size) == 0);
+        sentry_free(serialized_mpack);
+        sentry_free(plain_mpack);
+
+        sentry_value_decref(serialized);
+        sentry_value_decref(plain);
+    }
+}
+
 SENTRY_TEST(value_stringify)
 {
 #define STRINGIFY_AND_CHECK(Val, Expected)                                     \